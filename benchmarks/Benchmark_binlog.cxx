@@ -0,0 +1,32 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "binlog.hpp"
+#include <catch2/catch.hpp>
+
+TEST_CASE("log a record on the hot path", "[binlog]") {
+  std::error_code ec;
+  ipc::binlog log(ipc::create_only, "bench", 1, 64 << 20, ec);
+  REQUIRE_FALSE(ec);
+  uint32_t id = log.define("order %u filled at %.2f by %s");
+  ipc::binlog_writer w(log);
+  auto discard = [](std::string_view) {};
+
+  BENCHMARK_ADVANCED("binlog write, 3 arguments")
+  (Catch::Benchmark::Chronometer meter) {
+    log.drain(discard);
+    meter.measure([&] { return w.write(id, 7u, 1.5, "alice"); });
+  };
+  BENCHMARK("snprintf, 3 arguments") {
+    char line[128];
+    return snprintf(line, sizeof(line), "order %u filled at %.2f by %s", 7u,
+                    1.5, "alice");
+  };
+  BENCHMARK_ADVANCED("drain and format, 1000 records")
+  (Catch::Benchmark::Chronometer meter) {
+    meter.measure([&] {
+      for (int i = 0; i < 1000; i++) {
+        w.write(id, 7u, 1.5, "alice");
+      }
+      return log.drain(discard);
+    });
+  };
+}
@@ -0,0 +1,33 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "bulkcpy.hpp"
+#include "shmhdl.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <string>
+#include <vector>
+
+TEST_CASE("copy payload into shmhdl buffer", "[bulkcpy]") {
+  const size_t sizes[] = {64 * 1024, 1024 * 1024, 4 * 1024 * 1024,
+                          16 * 1024 * 1024, 64 * 1024 * 1024};
+  for (size_t n : sizes) {
+    std::error_code ec;
+    ipc::shmhdl hdl("bench", n, ec);
+    REQUIRE_FALSE(ec);
+    void *dst = hdl.map();
+    std::vector<char> src(n, 'x');
+    // fault the destination pages in before measuring
+    std::memset(dst, 0, n);
+
+    std::string suffix = " " + std::to_string(n / 1024) + "KB";
+    BENCHMARK("memcpy" + suffix) { return std::memcpy(dst, src.data(), n); };
+    BENCHMARK("stream_copy" + suffix) {
+      return ipc::stream_copy(dst, src.data(), n);
+    };
+    BENCHMARK("parallel_copy" + suffix) {
+      return ipc::parallel_copy(dst, src.data(), n);
+    };
+    BENCHMARK("bulk_copy" + suffix) {
+      return ipc::bulk_copy(dst, src.data(), n);
+    };
+  }
+}
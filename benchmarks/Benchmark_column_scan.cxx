@@ -0,0 +1,39 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "column_scan.hpp"
+#include "shm_table.hpp"
+#include <catch2/catch.hpp>
+
+TEST_CASE("filter then sum a mapped column", "[scan]") {
+  constexpr size_t nrows = 16 << 20;
+  ipc::shm_table table(ipc::create_only, "bench",
+                       {{"price", ipc::column_type::FLOAT64},
+                        {"qty", ipc::column_type::INT32}},
+                       nrows);
+  double *price = table.column<double>(0);
+  int32_t *qty = table.column<int32_t>(1);
+  for (size_t i = 0; i < nrows; i++) {
+    price[i] = double(i % 1000);
+    qty[i] = int32_t(i % 100);
+  }
+  table.commit(nrows);
+  std::vector<uint64_t> sel(ipc::selection_words(nrows));
+
+  BENCHMARK("plain loop") {
+    double __sum = 0;
+    for (size_t i = 0; i < nrows; i++) {
+      if (qty[i] < 50) {
+        __sum += price[i];
+      }
+    }
+    return __sum;
+  };
+
+  BENCHMARK("column_filter + column_sum") {
+    ipc::column_filter(qty, nrows, ipc::cmp_op::LT, 50, sel.data());
+    return ipc::column_sum(price, nrows, sel.data());
+  };
+
+  BENCHMARK("column_sum, every row") {
+    return ipc::column_sum(price, nrows);
+  };
+}
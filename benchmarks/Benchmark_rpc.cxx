@@ -0,0 +1,55 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "rpc.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+constexpr uint32_t ECHO = 0;
+constexpr uint32_t STOP = 1;
+} // namespace
+
+TEST_CASE("rpc round trip between processes", "[rpc]") {
+  for (auto mode : {ipc::rpc_wait::futex, ipc::rpc_wait::poll}) {
+    std::error_code ec;
+    ipc::rpc_channel client(ipc::create_only, "bench", 16, 256, ec, mode);
+    REQUIRE_FALSE(ec);
+    pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      {
+        ipc::rpc_channel server(ipc::open_only, "bench", mode);
+        ipc::rpc_request req;
+        while (server.receive(req, ec)) {
+          std::memcpy(req.resp_, req.data_, req.size_);
+          server.reply(req, req.size_);
+          if (req.method_ == STOP) {
+            break;
+          }
+        }
+      }
+      _exit(0);
+    }
+
+    char req[64] = {};
+    char resp[64];
+    const char *name = mode == ipc::rpc_wait::poll ? "poll" : "futex";
+    BENCHMARK(std::string("call 64B ") + name) {
+      return client.call(ECHO, req, sizeof(req), resp, sizeof(resp));
+    };
+    BENCHMARK(std::string("8 pipelined calls 64B ") + name) {
+      ipc::rpc_ticket tickets[8];
+      for (auto &t : tickets) {
+        t = client.call_async(ECHO, req, sizeof(req));
+      }
+      size_t n = 0;
+      for (auto &t : tickets) {
+        n += client.wait(t, resp, sizeof(resp));
+      }
+      return n;
+    };
+    client.call(STOP, req, sizeof(req), resp, sizeof(resp));
+    waitpid(pid, nullptr, 0);
+  }
+}
@@ -0,0 +1,52 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "shm_barrier.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+/**
+ * @brief phase in which the helper processes stop, 0 while running
+ *
+ */
+struct stop_t {
+  std::atomic<uint32_t> phase;
+};
+} // namespace
+
+TEST_CASE("barrier phase latency versus process count", "[barrier]") {
+  for (uint32_t nprocs : {2u, 4u, 8u, 16u}) {
+    std::error_code ec;
+    ipc::shm_barrier barrier(ipc::create_only, "bench", nprocs, ec);
+    REQUIRE_FALSE(ec);
+    ipc::shm_object<stop_t> stop(ipc::create_only, "bench_stop", ec);
+    REQUIRE_FALSE(ec);
+
+    std::vector<pid_t> pids(nprocs - 1);
+    for (auto &pid : pids) {
+      pid = fork();
+      REQUIRE(pid != -1);
+      if (pid == 0) {
+        {
+          ipc::shm_barrier bar(ipc::open_only, "bench");
+          ipc::shm_object<stop_t> s(ipc::open_only, "bench_stop");
+          while (bar.arrive_and_wait() !=
+                 s->phase.load(std::memory_order_acquire)) {
+          }
+        }
+        _exit(0);
+      }
+    }
+
+    BENCHMARK(std::to_string(nprocs) + " processes") {
+      return barrier.arrive_and_wait();
+    };
+    // the next phase cannot complete before we arrive, every helper sees it
+    stop->phase.store(barrier.phase() + 1, std::memory_order_release);
+    barrier.arrive_and_wait();
+    for (pid_t pid : pids) {
+      waitpid(pid, nullptr, 0);
+    }
+  }
+}
@@ -0,0 +1,27 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "shm_pool.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+
+TEST_CASE("new segment, first write included", "[pool]") {
+  for (shmsz_t nbytes : {64 << 10, 1 << 20, 8 << 20}) {
+    std::string size = std::to_string(nbytes >> 10) + "KB";
+
+    BENCHMARK("shmhdl " + size) {
+      ipc::shmhdl hdl("bench", nbytes);
+      std::memset(hdl.map(), 1, nbytes);
+      return hdl.addr();
+    };
+
+    ipc::shm_pool pool("bench_pool", {nbytes}, 16);
+    pool.fill();
+    pool.start();
+    BENCHMARK("shm_pool " + size) {
+      ipc::shmhdl hdl = pool.acquire("bench", nbytes);
+      std::memset(hdl.map(), 1, nbytes);
+      pool.recycle(hdl);
+      return hdl.addr();
+    };
+    pool.stop();
+  }
+}
@@ -0,0 +1,61 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "shm_rwlock.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+struct stop_t {
+  std::atomic<uint32_t> stop;
+};
+} // namespace
+
+TEST_CASE("read lock latency versus concurrent readers", "[rwlock]") {
+  // one reader slot is the single contended counter the slots avoid
+  for (uint32_t nslots : {1u, ipc::shm_rwlock::MAX_SLOTS}) {
+    for (uint32_t nreaders : {1u, 4u, 16u, 64u}) {
+      std::error_code ec;
+      ipc::shm_rwlock lock(ipc::create_only, "bench", ec, nslots);
+      REQUIRE_FALSE(ec);
+      ipc::shm_object<stop_t> stop(ipc::create_only, "bench_stop", ec);
+      REQUIRE_FALSE(ec);
+
+      // the benchmarking process is one of the readers
+      std::vector<pid_t> pids(nreaders - 1);
+      for (auto &pid : pids) {
+        pid = fork();
+        REQUIRE(pid != -1);
+        if (pid == 0) {
+          {
+            ipc::shm_rwlock l(ipc::open_only, "bench", ec);
+            ipc::shm_object<stop_t> s(ipc::open_only, "bench_stop", ec);
+            if (ec) {
+              _exit(1);
+            }
+            while (!s->stop.load(std::memory_order_relaxed)) {
+              l.lock_shared();
+              l.unlock_shared();
+            }
+          }
+          _exit(0);
+        }
+      }
+
+      BENCHMARK(std::to_string(nreaders) + " readers, " +
+                std::to_string(nslots) + " slots") {
+        lock.lock_shared();
+        lock.unlock_shared();
+      };
+      BENCHMARK(std::to_string(nreaders) + " readers, " +
+                std::to_string(nslots) + " slots, write") {
+        lock.lock();
+        lock.unlock();
+      };
+      stop->stop.store(1, std::memory_order_relaxed);
+      for (pid_t pid : pids) {
+        waitpid(pid, nullptr, 0);
+      }
+    }
+  }
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "common.hpp"
+#include "cpuinfo.hpp"
+#include "ec.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+namespace detail {
+/**
+ * @brief how an argument is stored in a log record
+ *
+ */
+enum class log_arg : uint8_t {
+  I64 = 1,
+  U64,
+  F64,
+  /**
+   * @brief 16 bit length then the characters
+   *
+   */
+  STR,
+  PTR,
+};
+
+template <typename T> constexpr log_arg log_arg_of() noexcept {
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, const char *> || std::is_same_v<U, char *> ||
+                std::is_same_v<U, std::string> ||
+                std::is_same_v<U, std::string_view>) {
+    return log_arg::STR;
+  } else if constexpr (std::is_pointer_v<U>) {
+    return log_arg::PTR;
+  } else if constexpr (std::is_enum_v<U>) {
+    return log_arg_of<std::underlying_type_t<U>>();
+  } else if constexpr (std::is_floating_point_v<U>) {
+    return log_arg::F64;
+  } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+    return log_arg::I64;
+  } else {
+    static_assert(std::is_integral_v<U>,
+                  "log arguments are numbers, pointers or strings");
+    return log_arg::U64;
+  }
+}
+
+inline std::string_view log_str(std::string_view s) noexcept {
+  return s.substr(0, UINT16_MAX);
+}
+inline std::string_view log_str(const char *s) noexcept {
+  return log_str(std::string_view(s ? s : "(null)"));
+}
+
+template <typename T> size_t log_arg_size(const T &arg) noexcept {
+  if constexpr (log_arg_of<T>() == log_arg::STR) {
+    return sizeof(uint16_t) + log_str(arg).size();
+  } else {
+    return sizeof(uint64_t);
+  }
+}
+
+template <typename T> void log_encode(char *&p, const T &arg) noexcept {
+  constexpr log_arg __tag = log_arg_of<T>();
+  if constexpr (__tag == log_arg::STR) {
+    std::string_view __s = log_str(arg);
+    uint16_t __len = uint16_t(__s.size());
+    std::memcpy(p, &__len, sizeof(__len));
+    std::memcpy(p + sizeof(__len), __s.data(), __len);
+    p += sizeof(__len) + __len;
+  } else if constexpr (__tag == log_arg::PTR) {
+    uint64_t __v = reinterpret_cast<uintptr_t>(arg);
+    std::memcpy(p, &__v, sizeof(__v));
+  } else if constexpr (__tag == log_arg::F64) {
+    double __v = double(arg);
+    std::memcpy(p, &__v, sizeof(__v));
+  } else if constexpr (__tag == log_arg::I64) {
+    int64_t __v = int64_t(arg);
+    std::memcpy(p, &__v, sizeof(__v));
+  } else {
+    uint64_t __v = uint64_t(arg);
+    std::memcpy(p, &__v, sizeof(__v));
+  }
+  if constexpr (__tag != log_arg::STR) {
+    p += sizeof(uint64_t);
+  }
+}
+} // namespace detail
+
+class binlog_writer;
+
+/**
+ * @brief binary log living in shared memory, drained by another process
+ * @details the shared memory object holds a table of format strings and a
+ * number of byte rings. Each logging thread claims a ring of its own through
+ * a binlog_writer and appends records to it: the id of a format string, the
+ * time stamp counter and the raw arguments, so logging costs a couple of
+ * memcpy and no formatting. A sidecar process attaches to the same binlog and
+ * calls drain() now and then, which formats the records with their format
+ * string and hands the lines to a sink, typically a file.
+ *
+ * As the records live in shared memory, whatever a producer logged before
+ * crashing is still drained. A full ring never blocks its producer, the
+ * record is dropped and counted instead, and drain() reports the loss.
+ *
+ * Format strings use the printf syntax, the length modifiers are ignored as
+ * every integer is logged as 64 bits. `*` widths are not supported.
+ */
+class binlog {
+  friend class binlog_writer;
+
+public:
+  /**
+   * @brief capacity of the format table
+   *
+   */
+  static constexpr uint32_t MAX_FORMATS = 4096;
+  static constexpr uint32_t FORMAT_POOL = 256 * 1024;
+
+private:
+  struct log_meta_t;
+  struct ring_t;
+
+  shmhdl hdl_;
+  log_meta_t *meta_ = nullptr;
+  char *pool_ = nullptr;
+  char *rings_ = nullptr;
+
+  void create(std::string_view name, uint32_t nrings, uint32_t ring_bytes,
+              std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept;
+  ring_t *ring_at(uint32_t i) const noexcept;
+  size_t drain_ring(uint32_t i, double ns_per_tick,
+                    const std::function<void(std::string_view)> &sink);
+
+public:
+  binlog() noexcept = default;
+  /**
+   * @brief create a binlog with nrings rings of ring_bytes bytes
+   *
+   * @param name
+   * @param nrings the number of threads that can log at the same time
+   * @param ring_bytes rounded up to a power of 2
+   * @param ec
+   */
+  binlog(create_only_t, std::string_view name, uint32_t nrings,
+         uint32_t ring_bytes, std::error_code &ec) noexcept;
+  binlog(create_only_t, std::string_view name, uint32_t nrings,
+         uint32_t ring_bytes);
+  /**
+   * @brief attach to an existing binlog, as a producer or as the drain
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  binlog(open_only_t, std::string_view name, std::error_code &ec,
+         std::chrono::milliseconds timeout =
+             std::chrono::milliseconds(1000)) noexcept;
+  binlog(open_only_t, std::string_view name,
+         std::chrono::milliseconds timeout = std::chrono::milliseconds(1000));
+
+  binlog(binlog &&other) noexcept;
+  binlog &operator=(binlog &&other) noexcept;
+
+  /**
+   * @brief add a format string to the table, typically once per call site
+   * into a static
+   * @details fails with IPCErrc::LogFormatTableFull when the table is full.
+   *
+   * @param fmt
+   * @param ec
+   * @return uint32_t the id to log with
+   */
+  uint32_t define(std::string_view fmt, std::error_code &ec) noexcept;
+  uint32_t define(std::string_view fmt);
+
+  /**
+   * @brief drain: format every record logged so far and pass the lines to
+   * sink, oldest first within a ring
+   * @details a line is `<unix time in s.ns> <pid> <message>`, without the
+   * trailing newline. Only one process may drain a binlog.
+   *
+   * @param sink
+   * @return size_t the number of records drained
+   */
+  size_t drain(const std::function<void(std::string_view)> &sink);
+  /**
+   * @brief drain into a file, one line per record
+   *
+   * @param out
+   * @return size_t the number of records drained
+   */
+  size_t drain(std::FILE *out);
+
+  /**
+   * @brief the format string of id, empty if there is none
+   *
+   * @param id
+   * @return std::string_view
+   */
+  std::string_view format(uint32_t id) const noexcept;
+  uint32_t nrings() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+
+/**
+ * @brief the producer side of a binlog for one thread
+ * @details claims a free ring of the binlog, or one left behind by a dead
+ * process, and gives it back on destruction. Not thread safe: each logging
+ * thread owns its binlog_writer.
+ */
+class binlog_writer {
+private:
+  binlog::ring_t *ring_ = nullptr;
+  char *data_ = nullptr;
+  uint64_t mask_ = 0;
+  /**
+   * @brief private copies of the ring positions, the tail is only reloaded
+   * when the ring looks full
+   *
+   */
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+
+  void claim(binlog &log, std::error_code &ec) noexcept;
+  char *reserve(size_t nbytes) noexcept;
+  void commit(size_t nbytes) noexcept;
+
+public:
+  binlog_writer() noexcept = default;
+  /**
+   * @brief claim a ring of log
+   * @details fails with IPCErrc::LogNoFreeRing when every ring is taken.
+   *
+   * @param log
+   * @param ec
+   */
+  binlog_writer(binlog &log, std::error_code &ec) noexcept;
+  explicit binlog_writer(binlog &log);
+  ~binlog_writer();
+
+  binlog_writer(const binlog_writer &) = delete;
+  binlog_writer &operator=(const binlog_writer &) = delete;
+  binlog_writer(binlog_writer &&other) noexcept;
+  binlog_writer &operator=(binlog_writer &&other) noexcept;
+
+  /**
+   * @brief append a record
+   *
+   * @param fmt id returned by binlog::define()
+   * @param args numbers, pointers or strings; strings are copied
+   * @return false if the ring is full and the record was dropped
+   */
+  template <typename... Args>
+  bool write(uint32_t fmt, const Args &...args) noexcept {
+    constexpr size_t __nargs = sizeof...(Args);
+    static_assert(__nargs < 256, "too many log arguments");
+    uint64_t __tsc = read_tsc();
+    size_t __size = sizeof(uint32_t) * 2 + sizeof(uint64_t) + 1 + __nargs +
+                    (detail::log_arg_size(args) + ... + 0);
+    __size = (__size + 7) & ~size_t(7);
+    char *__p = this->reserve(__size);
+    if (!__p) {
+      return false;
+    }
+    uint32_t __head[2] = {uint32_t(__size), fmt};
+    std::memcpy(__p, __head, sizeof(__head));
+    std::memcpy(__p + sizeof(__head), &__tsc, sizeof(__tsc));
+    __p += sizeof(__head) + sizeof(__tsc);
+    *__p++ = char(__nargs);
+    ((*__p++ = char(detail::log_arg_of<Args>())), ...);
+    (detail::log_encode(__p, args), ...);
+    this->commit(__size);
+    return true;
+  }
+
+  /**
+   * @brief records this ring dropped because it was full, not yet reported
+   * by a drain
+   *
+   * @return uint64_t
+   */
+  uint64_t dropped() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
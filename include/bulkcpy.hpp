@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+
+namespace ipc {
+/**
+ * @brief below this size bulk_copy() falls back to memcpy
+ * @details a small copy is likely to be read back soon and fits in cache, so
+ * bypassing the cache does not pay off.
+ */
+constexpr size_t STREAM_COPY_THRESHOLD = 256 * 1024;
+/**
+ * @brief from this size on bulk_copy() splits the copy across threads
+ *
+ */
+constexpr size_t PARALLEL_COPY_THRESHOLD = 16 * 1024 * 1024;
+
+/**
+ * @brief copy nbytes from src to dst with non-temporal (streaming) stores
+ * @details the destination is written around the cache, so copying a large
+ * payload into a shared memory buffer does not evict the writer's working set.
+ * Uses AVX-512, AVX2 or SSE2 depending on what the cpu supports, plain memcpy
+ * on other platforms. The buffers must not overlap.
+ *
+ * @param dst
+ * @param src
+ * @param nbytes
+ * @return void* dst
+ */
+void *stream_copy(void *dst, const void *src, size_t nbytes) noexcept;
+
+/**
+ * @brief copy nbytes from src to dst, splitting the copy into page aligned
+ * chunks that are stream_copy()-ed by nthreads threads
+ * @details the calling thread copies the first chunk itself. nthreads == 0
+ * picks std::thread::hardware_concurrency(). If a thread can not be started
+ * its chunk is copied by the calling thread.
+ *
+ * @param dst
+ * @param src
+ * @param nbytes
+ * @param nthreads
+ * @return void* dst
+ */
+void *parallel_copy(void *dst, const void *src, size_t nbytes,
+                    unsigned nthreads = 0) noexcept;
+
+/**
+ * @brief copy nbytes from src to dst, choosing memcpy, stream_copy() or
+ * parallel_copy() by size
+ *
+ * @param dst
+ * @param src
+ * @param nbytes
+ * @return void* dst
+ */
+void *bulk_copy(void *dst, const void *src, size_t nbytes) noexcept;
+} // namespace ipc
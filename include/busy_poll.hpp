@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <system_error>
+
+namespace ipc {
+/**
+ * @brief instruction a busy_poll spins with between two polls
+ *
+ */
+enum class spin_hint {
+  /**
+   * @brief umwait where the cpu supports it, pause otherwise
+   *
+   */
+  automatic,
+  /**
+   * @brief `pause`, available on every x86 cpu
+   *
+   */
+  pause,
+  /**
+   * @brief `tpause`: pause in the C0.1 state for a short, fixed time
+   *
+   */
+  tpause,
+  /**
+   * @brief `umonitor/umwait`: sleep in the C0.1 state until the watched cache
+   * line is written, falls back to tpause when there is nothing to watch
+   *
+   */
+  umwait,
+};
+
+/**
+ * @brief counters of a busy_poll, to judge whether polling pays off
+ *
+ */
+struct poll_stats_t {
+  /**
+   * @brief waits that returned because the condition became true
+   *
+   */
+  uint64_t waits_ = 0;
+  /**
+   * @brief times the condition was checked
+   *
+   */
+  uint64_t polls_ = 0;
+  /**
+   * @brief time spent inside waits
+   *
+   */
+  std::chrono::nanoseconds wait_time_{0};
+
+  /**
+   * @brief fraction of the polls that found the condition true, close to 1
+   * means the consumer hardly ever spins
+   *
+   */
+  double efficiency() const noexcept {
+    return this->polls_ ? double(this->waits_) / double(this->polls_) : 0.0;
+  }
+};
+
+/**
+ * @brief pin the calling thread to cpu
+ *
+ * @param cpu
+ * @param ec
+ */
+void pin_current_thread(int cpu, std::error_code &ec) noexcept;
+void pin_current_thread(int cpu);
+
+/**
+ * @brief a wait strategy that never sleeps in the kernel
+ * @details meant for consumers owning a dedicated core: the consumer pins
+ * itself to that core with pin() and then waits with busy_poll instead of
+ * blocking in semhdl::wait() or on a futex, trading a busy core for wake up
+ * latency. Between two polls it executes the spin_hint instruction, which
+ * keeps the core's power draw and its pressure on the sibling hyperthread
+ * down. Each consumer thread uses its own busy_poll, which is not thread safe.
+ */
+class busy_poll {
+private:
+  int cpu_ = -1;
+  spin_hint hint_ = spin_hint::pause;
+  poll_stats_t stats_;
+
+  /**
+   * @brief spin once between two polls
+   *
+   */
+  void relax() noexcept;
+  /**
+   * @brief spin once, waking early when the cache line of word is written
+   *
+   */
+  void relax_on(const std::atomic<uint32_t> &word, uint32_t old) noexcept;
+
+  template <typename Pred>
+  bool poll(Pred &ready, bool forever,
+            std::chrono::steady_clock::time_point deadline) {
+    auto __start = std::chrono::steady_clock::now();
+    bool __ok = false;
+    uint32_t __spins = 0;
+    for (;;) {
+      this->stats_.polls_++;
+      if (ready()) {
+        __ok = true;
+        break;
+      }
+      // reading the clock costs more than a poll, only do it now and then
+      if (!forever && ++__spins % 64 == 0 &&
+          std::chrono::steady_clock::now() >= deadline) {
+        break;
+      }
+      this->relax();
+    }
+    this->stats_.waits_ += __ok;
+    this->stats_.wait_time_ += std::chrono::steady_clock::now() - __start;
+    return __ok;
+  }
+
+public:
+  /**
+   * @brief create a busy_poll spinning with hint
+   * @details a hint the cpu does not support falls back to pause, hint()
+   * tells which one is actually used.
+   *
+   * @param cpu cpu pin() pins to, -1 to leave the thread where it is
+   * @param hint
+   */
+  explicit busy_poll(int cpu = -1,
+                     spin_hint hint = spin_hint::automatic) noexcept;
+
+  /**
+   * @brief pin the calling thread to cpu()
+   *
+   * @param ec
+   */
+  void pin(std::error_code &ec) noexcept;
+  void pin();
+
+  /**
+   * @brief spin until ready() returns true
+   *
+   * @param ready
+   */
+  template <typename Pred> void wait(Pred &&ready) {
+    this->poll(ready, true, {});
+  }
+  /**
+   * @brief spin until ready() returns true, at most timeout
+   *
+   * @param ready
+   * @param timeout
+   * @return false if the wait timed out
+   */
+  template <typename Pred>
+  bool wait_for(Pred &&ready, std::chrono::nanoseconds timeout) {
+    return this->poll(ready, false,
+                      std::chrono::steady_clock::now() + timeout);
+  }
+  /**
+   * @brief spin until word no longer holds old
+   * @details with spin_hint::umwait the core sleeps until word's cache line
+   * is written instead of polling it.
+   *
+   * @param word
+   * @param old
+   * @return uint32_t the new value
+   */
+  uint32_t wait_change(const std::atomic<uint32_t> &word,
+                       uint32_t old) noexcept;
+
+  int cpu() const noexcept;
+  spin_hint hint() const noexcept;
+  const poll_stats_t &stats() const noexcept;
+  void reset_stats() noexcept;
+};
+} // namespace ipc
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "common.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+/**
+ * @brief one bit per page of a tracked segment, set by writers and cleared
+ * by the checkpointer
+ * @details the bitmap lives in its own shared memory object, so writers in
+ * any process can mark the pages they modify. Writers must call mark() after
+ * the write: a page marked before its write completes may be copied before
+ * the write lands and then never be copied again.
+ */
+class dirty_bitmap {
+private:
+  /**
+   * @brief memory layout might look like this:
+   *  | state | page_size | npages | words |
+   */
+  struct bitmap_meta_t {
+    /**
+     * @brief detail::READY once the creator filled in the meta
+     *
+     */
+    std::atomic<uint32_t> state_;
+    uint64_t page_size_;
+    uint64_t npages_;
+  };
+
+  shmhdl hdl_;
+  bitmap_meta_t *meta_ = nullptr;
+  std::atomic<uint64_t> *words_ = nullptr;
+
+  void create(std::string_view name, const shmsz_t nbytes,
+              std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept;
+
+public:
+  dirty_bitmap() noexcept = default;
+  /**
+   * @brief create a bitmap tracking a segment of nbytes
+   *
+   * @param name
+   * @param nbytes size of the tracked segment
+   * @param ec
+   */
+  dirty_bitmap(create_only_t, std::string_view name, const shmsz_t nbytes,
+               std::error_code &ec) noexcept;
+  dirty_bitmap(create_only_t, std::string_view name, const shmsz_t nbytes);
+  /**
+   * @brief attach to an existing bitmap
+   *
+   * @param name
+   * @param ec
+   * @param timeout how long to wait for the creator to initialize it
+   */
+  dirty_bitmap(open_only_t, std::string_view name, std::error_code &ec,
+               std::chrono::milliseconds timeout =
+                   std::chrono::milliseconds(1000)) noexcept;
+  dirty_bitmap(open_only_t, std::string_view name,
+               std::chrono::milliseconds timeout =
+                   std::chrono::milliseconds(1000));
+
+  dirty_bitmap(dirty_bitmap &&) noexcept = default;
+  dirty_bitmap &operator=(dirty_bitmap &&) noexcept = default;
+
+  /**
+   * @brief mark the pages overlapping [offset, offset + nbytes) as modified
+   *
+   * @param offset
+   * @param nbytes
+   */
+  void mark(shmsz_t offset, shmsz_t nbytes) noexcept;
+  /**
+   * @brief mark every page as modified
+   *
+   */
+  void mark_all() noexcept;
+  /**
+   * @brief whether page has been marked since it was last cleared
+   *
+   * @param page
+   */
+  bool test(size_t page) const noexcept;
+  /**
+   * @brief atomically fetch and clear the i-th word (pages i * 64 to
+   * i * 64 + 63)
+   *
+   * @param i
+   * @return uint64_t
+   */
+  uint64_t fetch_clear(size_t i) noexcept;
+
+  size_t page_size() const noexcept;
+  size_t npages() const noexcept;
+  size_t nwords() const noexcept;
+  bool valid() const noexcept;
+};
+
+/**
+ * @brief writes a live segment to a chain of snapshot files without stalling
+ * its writers
+ * @details every checkpoint streams the pages marked in the dirty_bitmap to
+ * a new file in dir with large page aligned writes (O_DIRECT where the
+ * filesystem supports it). The first checkpoint of a checkpointer, and every
+ * checkpoint(true), is a full snapshot; older files are removed once a full
+ * snapshot has been committed. A snapshot file is committed by writing its
+ * header last, so a crash during a checkpoint leaves the chain restorable.
+ *
+ * Pages are copied while writers keep going, so a snapshot is fuzzy: a page
+ * written during a checkpoint is captured either by this checkpoint or, as
+ * it is marked again, by the next one.
+ *
+ * The segment must stay mapped while the checkpointer is alive.
+ */
+class checkpointer {
+private:
+  char *base_ = nullptr;
+  shmsz_t nbytes_ = 0;
+  dirty_bitmap dirty_;
+  std::string dir_;
+  uint64_t seq_ = 0;
+  bool has_full_ = false;
+
+  /**
+   * @brief page aligned staging buffer for the writes
+   *
+   */
+  char *stage_ = nullptr;
+
+  /**
+   * @brief serializes checkpoints
+   *
+   */
+  std::mutex write_mtx_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::thread worker_;
+  bool running_ = false;
+  std::error_code last_ec_;
+  std::atomic<uint64_t> bytes_written_{0};
+
+  void init(shmhdl &hdl, std::string_view bitmap_name, std::string_view dir,
+            std::error_code &ec) noexcept;
+  void write_snapshot(bool full, std::error_code &ec) noexcept;
+
+public:
+  /**
+   * @brief track the (mapped) segment of hdl, creating a dirty_bitmap named
+   * bitmap_name, and write snapshots into directory dir
+   *
+   * @param hdl
+   * @param bitmap_name
+   * @param dir created if it does not exist
+   * @param ec
+   */
+  checkpointer(shmhdl &hdl, std::string_view bitmap_name, std::string_view dir,
+               std::error_code &ec) noexcept;
+  checkpointer(shmhdl &hdl, std::string_view bitmap_name,
+               std::string_view dir);
+  ~checkpointer();
+
+  checkpointer(const checkpointer &) = delete;
+  checkpointer &operator=(const checkpointer &) = delete;
+
+  /**
+   * @brief the dirty bitmap writers in this process should mark
+   *
+   * @return dirty_bitmap&
+   */
+  dirty_bitmap &dirty() noexcept;
+
+  /**
+   * @brief write a snapshot of the dirty pages (every page if full) now
+   *
+   * @param ec
+   * @param full
+   */
+  void checkpoint(std::error_code &ec, bool full = false) noexcept;
+  void checkpoint(bool full = false);
+
+  /**
+   * @brief checkpoint every interval on a background thread
+   *
+   * @param interval
+   */
+  void start(std::chrono::milliseconds interval);
+  /**
+   * @brief stop the background thread, waiting for a running checkpoint
+   *
+   */
+  void stop() noexcept;
+
+  /**
+   * @brief error of the last background checkpoint
+   *
+   * @return std::error_code
+   */
+  std::error_code last_error() noexcept;
+  /**
+   * @brief bytes of snapshot data written so far
+   *
+   * @return uint64_t
+   */
+  uint64_t bytes_written() const noexcept;
+  /**
+   * @brief sequence number the next snapshot will get
+   *
+   * @return uint64_t
+   */
+  uint64_t seq() const noexcept;
+
+  /**
+   * @brief restore the (mapped) segment of hdl from the latest full snapshot
+   * in dir and the incremental snapshots following it
+   *
+   * @param hdl
+   * @param dir
+   * @param ec
+   */
+  static void restore(shmhdl &hdl, std::string_view dir,
+                      std::error_code &ec) noexcept;
+  static void restore(shmhdl &hdl, std::string_view dir);
+};
+} // namespace ipc
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ipc {
+/**
+ * @brief comparison column_filter() applies to every value: value op operand
+ *
+ */
+enum class cmp_op : uint32_t { EQ, NE, LT, LE, GT, GE };
+
+/**
+ * @brief type column_sum() accumulates T in: int64_t for integers, double for
+ * floating point
+ *
+ */
+template <typename T> struct column_sum_type { using type = int64_t; };
+template <> struct column_sum_type<float> { using type = double; };
+template <> struct column_sum_type<double> { using type = double; };
+template <typename T>
+using column_sum_t = typename column_sum_type<T>::type;
+
+/**
+ * @brief 64 bit words of a selection bitmap for n rows
+ * @details bit i % 64 of word i / 64 is set when row i is selected.
+ */
+constexpr size_t selection_words(size_t n) noexcept { return (n + 63) / 64; }
+
+/**
+ * @brief select the rows of col whose value compares true with operand
+ * @details the kernels below are implemented for int32_t, int64_t, float and
+ * double columns. They use AVX2 when the cpu supports it and plain loops
+ * otherwise, read the column with unaligned loads and never write to it, so
+ * they run directly on columns mapped read only by any number of processes.
+ *
+ * @param col
+ * @param n number of rows
+ * @param op
+ * @param operand
+ * @param sel selection_words(n) words, overwritten; the bits past n are
+ * cleared
+ * @return size_t number of rows selected
+ */
+template <typename T>
+size_t column_filter(const T *col, size_t n, cmp_op op, T operand,
+                     uint64_t *sel) noexcept;
+
+/**
+ * @brief sum of the selected rows of col, of every row without sel
+ * @details floating point values are added in a different order than a
+ * sequential loop would, the last bits of the result may differ.
+ *
+ * @param col
+ * @param n
+ * @param sel
+ * @return column_sum_t<T>
+ */
+template <typename T>
+column_sum_t<T> column_sum(const T *col, size_t n,
+                           const uint64_t *sel = nullptr) noexcept;
+/**
+ * @brief smallest selected value, the largest value of T if none is selected
+ * @details NaNs are not skipped, the result is unspecified if col holds one.
+ *
+ * @param col
+ * @param n
+ * @param sel
+ * @return T
+ */
+template <typename T>
+T column_min(const T *col, size_t n, const uint64_t *sel = nullptr) noexcept;
+/**
+ * @brief largest selected value, the lowest value of T if none is selected
+ *
+ * @param col
+ * @param n
+ * @param sel
+ * @return T
+ */
+template <typename T>
+T column_max(const T *col, size_t n, const uint64_t *sel = nullptr) noexcept;
+
+/**
+ * @brief number of rows selected
+ *
+ * @param sel
+ * @param n
+ * @return size_t
+ */
+size_t selection_count(const uint64_t *sel, size_t n) noexcept;
+/**
+ * @brief keep in dst only the rows also selected in other
+ *
+ * @param dst
+ * @param other
+ * @param n
+ */
+void selection_and(uint64_t *dst, const uint64_t *other, size_t n) noexcept;
+/**
+ * @brief add to dst the rows selected in other
+ *
+ * @param dst
+ * @param other
+ * @param n
+ */
+void selection_or(uint64_t *dst, const uint64_t *other, size_t n) noexcept;
+} // namespace ipc
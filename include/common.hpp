@@ -20,6 +20,51 @@ using shmsz_t = unsigned long long;
 #endif
 
 namespace ipc {
+/**
+ * @brief maximum length of a shmhdl/semhdl name (terminating '\0' exclude)
+ * @details names are stored inline in the handle, so handles never allocate
+ * after construction.
+ */
+constexpr size_t MAX_NAME_LEN = 255;
+
+/**
+ * @brief copy name into a fixed size, '\0' terminated buffer
+ *
+ * @param dst
+ * @param name
+ * @return false if name is longer than MAX_NAME_LEN
+ */
+inline bool copy_name(char (&dst)[MAX_NAME_LEN + 1],
+                      std::string_view name) noexcept {
+  if (name.size() > MAX_NAME_LEN) {
+    return false;
+  }
+  name.copy(dst, name.size());
+  dst[name.size()] = '\0';
+  return true;
+}
+
+/**
+ * @brief tag selecting the constructor that creates a new shared object
+ *
+ */
+struct create_only_t {};
+constexpr create_only_t create_only{};
+/**
+ * @brief tag selecting the constructor that attaches to an existing shared
+ * object
+ *
+ */
+struct open_only_t {};
+constexpr open_only_t open_only{};
+/**
+ * @brief tag selecting the constructor that creates or reopens a shared
+ * memory object backed by a regular file
+ *
+ */
+struct persistent_t {};
+constexpr persistent_t persistent{};
+
 #ifdef __POSIX__
 enum class O_FLAGS {
   CREATE_ONLY = O_RDWR | O_CREAT | O_EXCL,
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace ipc {
+/**
+ * @brief instruction set extensions detected at runtime
+ * @details all false on non x86 platforms.
+ */
+struct cpu_features_t {
+  bool sse2 = false;
+  bool avx2 = false;
+  bool avx512f = false;
+  /**
+   * @brief umonitor/umwait/tpause
+   *
+   */
+  bool waitpkg = false;
+};
+
+/**
+ * @brief instruction set extensions of the current cpu, detected once
+ *
+ * @return const cpu_features_t&
+ */
+const cpu_features_t &cpu_features() noexcept;
+
+/**
+ * @brief hint to the cpu that the caller is spinning
+ * @details `pause` on x86, `yield` on arm, lets the sibling hyperthread run
+ * and avoids the memory order violation flush when the spin loop exits.
+ */
+inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+  _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+/**
+ * @brief a cheap, monotonic tick count
+ * @details the time stamp counter on x86, which is invariant and shared by
+ * all cores on any recent cpu, so ticks taken by different processes compare.
+ * Elsewhere nanoseconds of the steady clock.
+ */
+inline uint64_t read_tsc() noexcept {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+} // namespace ipc
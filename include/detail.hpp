@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+namespace ipc {
+namespace detail {
+/**
+ * @brief value of the state_ word heading the meta of a shared object once
+ * its creator has initialized it
+ * @details the creator stores it last, with release semantics; attachers
+ * wait for it with wait_ready() before reading anything else.
+ */
+constexpr uint32_t READY = 0x59444552; // "REDY"
+
+/**
+ * @brief fields written by different processes are kept this far apart, so
+ * that they do not share a cache line
+ *
+ */
+constexpr size_t CACHE_LINE = 64;
+
+constexpr size_t round_up(size_t n, size_t align) noexcept {
+  return (n + align - 1) / align * align;
+}
+
+constexpr uint32_t round_up_pow2(uint32_t n) noexcept {
+  uint32_t __p = 1;
+  while (__p < n) {
+    __p <<= 1;
+  }
+  return __p;
+}
+
+/**
+ * @brief wait at most timeout for the creator of a shared object to publish
+ * READY in state
+ *
+ * @param state
+ * @param timeout
+ * @return false if the object is still not initialized after timeout
+ */
+inline bool wait_ready(const std::atomic<uint32_t> &state,
+                       std::chrono::milliseconds timeout) noexcept {
+  auto __deadline = std::chrono::steady_clock::now() + timeout;
+  while (state.load(std::memory_order_acquire) != READY) {
+    if (std::chrono::steady_clock::now() >= __deadline) {
+      return false;
+    }
+    std::this_thread::yield();
+  }
+  return true;
+}
+
+/**
+ * @brief what the throwing overloads do with the error of their noexcept
+ * counterpart
+ *
+ * @param ec
+ */
+inline void throw_if(const std::error_code &ec) {
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+} // namespace detail
+} // namespace ipc
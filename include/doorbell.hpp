@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "cpuinfo.hpp"
+#include "futex.hpp"
+
+namespace ipc {
+/**
+ * @brief wake up notification for a shared channel that costs producers
+ * nothing while its consumers are awake
+ * @details lives in shared memory next to the channel it belongs to. A
+ * consumer with nothing to do spins for a while, then arms the bell and
+ * sleeps on it; ring() only issues a wake when the bell is armed, and
+ * disarms it in the same step, so a burst of rings while the consumer sleeps
+ * costs a single wake and a consumer busy draining a backlog costs none. A
+ * ring that finds the bell disarmed is a fence and a load.
+ *
+ * The word holds a sequence number, bumped by every ring that wakes, and the
+ * armed flag in its low bit.
+ */
+class doorbell {
+private:
+  static constexpr uint32_t ARMED = 1;
+  /**
+   * @brief attempts before a consumer arms the bell and sleeps
+   *
+   */
+  static constexpr uint32_t SPIN_LIMIT = 256;
+  static constexpr uint32_t SPIN_YIELD = 64;
+
+  std::atomic<uint32_t> word_{0};
+
+public:
+  doorbell() noexcept = default;
+  doorbell(const doorbell &) = delete;
+  doorbell &operator=(const doorbell &) = delete;
+
+  /**
+   * @brief producer: call after publishing, wakes the consumers if any is
+   * asleep
+   *
+   * @return true if this ring issued the wake
+   */
+  bool ring() noexcept {
+    // pairs with the arming in wait(): either the consumer sees what was
+    // published before the ring, or we see the bell armed
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t __word = this->word_.load(std::memory_order_relaxed);
+    while (__word & ARMED) {
+      // the ring that disarms the bell wakes everyone, the others skip it
+      if (this->word_.compare_exchange_weak(__word, (__word + 2) & ~ARMED,
+                                            std::memory_order_relaxed)) {
+        futex_wake_all(this->word_);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief consumer: wait until ready() holds, at most timeout
+   * @details ready() is the consumer's check of the channel, e.g. a try to
+   * pop from its queue; it is called again after every wake up and must not
+   * block.
+   *
+   * @tparam Ready
+   * @param ready
+   * @param timeout zero to check once, FOREVER to wait without a deadline
+   * @return false on timeout
+   */
+  template <typename Ready>
+  bool wait(Ready &&ready, std::chrono::nanoseconds timeout = FOREVER) {
+    if (ready()) {
+      return true;
+    }
+    if (timeout.count() == 0) {
+      return false;
+    }
+    for (uint32_t __spins = 1; __spins <= SPIN_LIMIT; __spins++) {
+      cpu_relax();
+      if (__spins % SPIN_YIELD == 0) {
+        std::this_thread::yield();
+      }
+      if (ready()) {
+        return true;
+      }
+    }
+    detail::deadline_t __deadline(timeout);
+    for (;;) {
+      uint32_t __word = this->word_.load(std::memory_order_relaxed);
+      if (!(__word & ARMED) &&
+          !this->word_.compare_exchange_weak(__word, __word | ARMED,
+                                             std::memory_order_relaxed)) {
+        continue;
+      }
+      __word |= ARMED;
+      // pairs with the fence in ring()
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (ready()) {
+        // left armed, which costs the next ring a wake for nobody
+        return true;
+      }
+      auto __left = __deadline.remaining();
+      if (__left.count() == 0) {
+        return false;
+      }
+      futex_wait(this->word_, __word, __left);
+      if (ready()) {
+        return true;
+      }
+    }
+  }
+
+  /**
+   * @brief whether a consumer is, or is about to be, asleep on the bell
+   *
+   */
+  bool armed() const noexcept {
+    return this->word_.load(std::memory_order_relaxed) & ARMED;
+  }
+};
+} // namespace ipc
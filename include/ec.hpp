@@ -8,6 +8,25 @@ enum class IPCErrc
   ShmNotMapped,
   ShmAddrNullptr,
   ShmDeleted,
+  ShmLayoutMismatch,
+  ShmNotInitialized,
+  SnapshotNotFound,
+  RpcNoFreeSlot,
+  TaskQueueFull,
+  LogFormatTableFull,
+  LogNoFreeRing,
+  McastNoFreeClient,
+  McastNoSuchClient,
+  McastQueueFull,
+  McastPoolExhausted,
+  EpochNoFreeSlot,
+  EpochLimboFull,
+  TableFull,
+  RecordOverflow,
+  RecordMismatch,
+  IdAllocatorFull,
+  ShmNoFreeSlot,
+  SnapshotCorrupted,
 };
 
 namespace std
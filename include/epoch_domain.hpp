@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string_view>
+
+#include "common.hpp"
+#include "ec.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+class epoch_guard;
+
+/**
+ * @brief epoch based reclamation for lock-free structures in shared memory
+ * @details a node unlinked from a shared structure may still be read by
+ * another process that found it before it was unlinked. Readers pin() the
+ * domain around every access to the structure; the writer that unlinks a node
+ * retire()s it instead of freeing it, and the node is handed to the reclaim
+ * callback once every participant has unpinned at least once since, i.e. two
+ * epochs later. Nodes are 64 bit tags, typically offsets into a shared arena,
+ * and the callback returns them to whatever allocator the arena uses.
+ *
+ * Every epoch_domain handle is a participant and holds a slot of the shared
+ * memory object, with the list of the nodes it retired that are not freed
+ * yet. A participant that dies while pinned would stop the epoch forever:
+ * when the epoch is stuck on a participant, its process is checked and its
+ * slot released if it is gone. The nodes a dead participant retired stay in
+ * its slot and are freed by the next participant joining it or by a
+ * collect() of another participant.
+ *
+ * A handle is not thread safe, each thread uses its own.
+ */
+class epoch_domain {
+private:
+  friend class epoch_guard;
+
+  struct domain_meta_t;
+  struct slot_t;
+  struct limbo_t;
+
+  shmhdl hdl_;
+  domain_meta_t *meta_ = nullptr;
+  slot_t *slots_ = nullptr;
+  limbo_t *limbo_ = nullptr;
+  uint32_t self_ = 0;
+  /**
+   * @brief pin() nesting depth
+   *
+   */
+  uint32_t nest_ = 0;
+  /**
+   * @brief collect() calls and failed advances, paces the checks of the
+   * other participants' processes
+   *
+   */
+  uint32_t collects_ = 0;
+  uint32_t stalls_ = 0;
+  std::function<void(uint64_t)> reclaim_;
+
+  void create(std::string_view name, uint32_t nslots, uint32_t limbo_cap,
+              std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept;
+  void join(std::error_code &ec) noexcept;
+  void leave() noexcept;
+  limbo_t *limbo_of(uint32_t slot) const noexcept;
+  size_t drain(uint32_t slot) noexcept;
+  void sweep() noexcept;
+
+public:
+  epoch_domain() noexcept = default;
+  /**
+   * @brief create a domain and join it as the first participant
+   *
+   * @param name
+   * @param nslots maximum number of participants
+   * @param limbo_cap nodes a participant can have retired and not yet freed,
+   * rounded up to a power of 2
+   * @param ec
+   */
+  epoch_domain(create_only_t, std::string_view name, uint32_t nslots,
+               uint32_t limbo_cap, std::error_code &ec) noexcept;
+  epoch_domain(create_only_t, std::string_view name, uint32_t nslots,
+               uint32_t limbo_cap);
+  /**
+   * @brief attach to an existing domain and join it
+   * @details fails with IPCErrc::EpochNoFreeSlot when every slot is taken by a
+   * live process.
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  epoch_domain(open_only_t, std::string_view name, std::error_code &ec,
+               std::chrono::milliseconds timeout =
+                   std::chrono::milliseconds(1000)) noexcept;
+  epoch_domain(open_only_t, std::string_view name,
+               std::chrono::milliseconds timeout =
+                   std::chrono::milliseconds(1000));
+  /**
+   * @brief free what can be freed and leave the slot, the nodes not freed yet
+   * are left to the other participants
+   *
+   */
+  ~epoch_domain();
+
+  epoch_domain(epoch_domain &&other) noexcept;
+  epoch_domain &operator=(epoch_domain &&other) noexcept;
+
+  /**
+   * @brief set the callback freeing the retired nodes, which collect() runs
+   * in the calling thread
+   * @details the callback may be handed nodes retired by other participants,
+   * left behind by a dead one.
+   *
+   * @param reclaim
+   */
+  void on_reclaim(std::function<void(uint64_t)> reclaim);
+
+  /**
+   * @brief enter a critical section: the nodes reachable from now on are not
+   * freed before the matching unpin(). Nests.
+   *
+   */
+  void pin() noexcept;
+  void unpin() noexcept;
+  /**
+   * @brief pin() until the guard is destroyed
+   *
+   * @return epoch_guard
+   */
+  epoch_guard guard() noexcept;
+  bool pinned() const noexcept;
+
+  /**
+   * @brief hand a node, already unlinked from the shared structure, over to
+   * the domain
+   * @details collects now and then, and when the list of retired nodes is
+   * full; fails with IPCErrc::EpochLimboFull if it stays full, i.e. when a
+   * live participant stays pinned for long.
+   *
+   * @param node
+   * @param ec
+   */
+  void retire(uint64_t node, std::error_code &ec) noexcept;
+  void retire(uint64_t node);
+  /**
+   * @brief advance the epoch if possible and pass the retired nodes nobody
+   * can read anymore to the reclaim callback
+   *
+   * @return size_t the number of nodes freed
+   */
+  size_t collect() noexcept;
+  /**
+   * @brief move the global epoch forward, which is possible once every pinned
+   * participant has seen the current one
+   *
+   * @return false if a participant is still pinned in an older epoch
+   */
+  bool try_advance() noexcept;
+
+  uint64_t epoch() const noexcept;
+  /**
+   * @brief nodes this participant retired that are not freed yet
+   *
+   * @return size_t
+   */
+  size_t pending() const noexcept;
+  /**
+   * @brief slot of this participant
+   *
+   * @return uint32_t
+   */
+  uint32_t id() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+
+/**
+ * @brief keeps an epoch_domain pinned while in scope
+ *
+ */
+class epoch_guard {
+private:
+  friend class epoch_domain;
+  epoch_domain *domain_ = nullptr;
+
+  explicit epoch_guard(epoch_domain *domain) noexcept;
+
+public:
+  epoch_guard() noexcept = default;
+  ~epoch_guard();
+  epoch_guard(const epoch_guard &) = delete;
+  epoch_guard &operator=(const epoch_guard &) = delete;
+  epoch_guard(epoch_guard &&other) noexcept;
+  epoch_guard &operator=(epoch_guard &&other) noexcept;
+
+  /**
+   * @brief unpin before the end of the scope
+   *
+   */
+  void reset() noexcept;
+};
+} // namespace ipc
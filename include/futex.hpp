@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+
+namespace ipc {
+/**
+ * @brief timeout value meaning "wait without a deadline"
+ *
+ */
+constexpr std::chrono::nanoseconds FOREVER{-1};
+
+namespace detail {
+/**
+ * @brief deadline of a wait, none for a negative timeout
+ *
+ */
+class deadline_t {
+private:
+  bool forever_;
+  std::chrono::steady_clock::time_point at_;
+
+public:
+  explicit deadline_t(std::chrono::nanoseconds timeout) noexcept
+      : forever_(timeout.count() < 0) {
+    if (!this->forever_) {
+      this->at_ = std::chrono::steady_clock::now() + timeout;
+    }
+  }
+  /**
+   * @brief time left, FOREVER for no deadline, zero once expired
+   *
+   */
+  std::chrono::nanoseconds remaining() const noexcept {
+    if (this->forever_) {
+      return FOREVER;
+    }
+    auto __left = this->at_ - std::chrono::steady_clock::now();
+    return __left.count() > 0 ? __left : std::chrono::nanoseconds(0);
+  }
+  bool expired() const noexcept {
+    return !this->forever_ && std::chrono::steady_clock::now() >= this->at_;
+  }
+};
+} // namespace detail
+
+/**
+ * @brief block while word holds expected, at most timeout
+ * @details the wait is process shared: word may live in shared memory and be
+ * woken by futex_wake() from any process mapping it. Spurious wake ups are
+ * possible, callers re-check their condition. Uses the futex syscall on
+ * Linux and falls back to short sleeps elsewhere.
+ *
+ * @param word
+ * @param expected
+ * @param timeout FOREVER (or any negative value) for no deadline
+ * @return false if the wait timed out
+ */
+bool futex_wait(std::atomic<uint32_t> &word, uint32_t expected,
+                std::chrono::nanoseconds timeout = FOREVER) noexcept;
+/**
+ * @brief wake at most count waiters blocked in futex_wait() on word
+ *
+ * @param word
+ * @param count
+ */
+void futex_wake(std::atomic<uint32_t> &word, int count = 1) noexcept;
+/**
+ * @brief wake every waiter blocked in futex_wait() on word
+ *
+ * @param word
+ */
+inline void futex_wake_all(std::atomic<uint32_t> &word) noexcept {
+  futex_wake(word, INT_MAX);
+}
+
+/**
+ * @brief most words futex_wait_any() waits on at once
+ *
+ */
+constexpr size_t FUTEX_WAIT_ANY_MAX = 128;
+
+/**
+ * @brief a word futex_wait_any() waits on, and the value it blocks on
+ *
+ */
+struct futex_waiter {
+  std::atomic<uint32_t> *word_;
+  uint32_t expected_;
+};
+
+/**
+ * @brief block while every word holds its expected value, at most timeout
+ * @details the futex_waitv syscall (Linux 5.16) sleeps on all the words at
+ * once, futex_wake() on any of them wakes the waiter. On older kernels and
+ * other platforms the words are polled with short sleeps. Spurious wake ups
+ * are possible, callers re-check their conditions.
+ *
+ * @param waiters
+ * @param n at most FUTEX_WAIT_ANY_MAX
+ * @param timeout FOREVER (or any negative value) for no deadline
+ * @return int the index of the word woken or found changed, -1 on timeout
+ * or if n is out of range
+ */
+int futex_wait_any(const futex_waiter *waiters, size_t n,
+                   std::chrono::nanoseconds timeout = FOREVER) noexcept;
+} // namespace ipc
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+#include "common.hpp"
+#include "ec.hpp"
+#include "proc_id.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+/**
+ * @brief lock-free allocator of small integer ids, e.g. session slots or
+ * subscriber indices, shared by the processes attached to a segment
+ * @details the ids in use are the bits of a bitmap in the shared memory
+ * object, one 64 bit word per 64 ids, claimed with a single fetch_or. Above
+ * the bitmap, summary levels have one bit per word of the level below, set
+ * when that word is full, so allocate() walks down from a single root word,
+ * taking the lowest clear bit of every level, and finds a free id in at most
+ * MAX_LEVELS words whatever the capacity. The summaries are hints kept in sync
+ * without locks, allocate() repairs the ones it finds stale and scans the
+ * bitmap before reporting that no id is left.
+ *
+ * The process holding every id is recorded next to the bitmap: reclaim()
+ * releases the ids of the processes that died without releasing them, and
+ * allocate() does it by itself when no id is left.
+ */
+class id_allocator {
+public:
+  static constexpr uint32_t MAX_LEVELS = 4;
+  static constexpr uint32_t MAX_CAPACITY = uint32_t(1) << 24;
+  static constexpr uint32_t npos = uint32_t(-1);
+
+private:
+  struct alloc_meta_t;
+
+  shmhdl hdl_;
+  alloc_meta_t *meta_ = nullptr;
+  /**
+   * @brief bitmap words of every level, the root first, the ids last
+   *
+   */
+  std::atomic<uint64_t> *levels_[MAX_LEVELS] = {};
+  uint32_t nwords_[MAX_LEVELS] = {};
+  uint32_t nlevels_ = 0;
+  std::atomic<proc_id> *owners_ = nullptr;
+
+  size_t layout(uint32_t capacity, size_t *offsets) noexcept;
+  void map_levels(char *buf, const size_t *offsets) noexcept;
+  void create(std::string_view name, uint32_t capacity,
+              std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept;
+  uint32_t try_allocate() noexcept;
+  void mark_full(uint32_t level, uint32_t word) noexcept;
+  void mark_free(uint32_t level, uint32_t word) noexcept;
+
+public:
+  id_allocator() noexcept = default;
+  /**
+   * @brief create an allocator of the ids 0 to capacity - 1
+   *
+   * @param name
+   * @param capacity at most MAX_CAPACITY
+   * @param ec
+   */
+  id_allocator(create_only_t, std::string_view name, uint32_t capacity,
+               std::error_code &ec) noexcept;
+  id_allocator(create_only_t, std::string_view name, uint32_t capacity);
+  /**
+   * @brief attach to an existing allocator
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  id_allocator(open_only_t, std::string_view name, std::error_code &ec,
+               std::chrono::milliseconds timeout =
+                   std::chrono::milliseconds(1000)) noexcept;
+  id_allocator(open_only_t, std::string_view name,
+               std::chrono::milliseconds timeout =
+                   std::chrono::milliseconds(1000));
+
+  id_allocator(id_allocator &&other) noexcept;
+  id_allocator &operator=(id_allocator &&other) noexcept;
+
+  /**
+   * @brief take a free id for the calling process, the lowest one unless
+   * other processes allocate or release meanwhile
+   * @details fails with IPCErrc::IdAllocatorFull if every id is taken, by live
+   * processes.
+   *
+   * @param ec
+   * @return uint32_t npos on failure
+   */
+  uint32_t allocate(std::error_code &ec) noexcept;
+  uint32_t allocate();
+  /**
+   * @brief give an id back, any process may release it
+   * @details fails with std::errc::invalid_argument if id is not allocated.
+   *
+   * @param id
+   * @param ec
+   */
+  void release(uint32_t id, std::error_code &ec) noexcept;
+  void release(uint32_t id);
+  /**
+   * @brief release the ids of the processes that are gone
+   *
+   * @return uint32_t ids released
+   */
+  uint32_t reclaim() noexcept;
+
+  bool allocated(uint32_t id) const noexcept;
+  /**
+   * @brief the process that allocated id
+   *
+   * @param id
+   * @return proc_id empty if id is free, or being allocated
+   */
+  proc_id owner(uint32_t id) const noexcept;
+  uint32_t capacity() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
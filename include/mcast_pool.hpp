@@ -0,0 +1,245 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+#include "common.hpp"
+#include "ec.hpp"
+#include "futex.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+class mcast_buffer;
+
+/**
+ * @brief fixed size buffers shared by reference between processes, for
+ * zero-copy multicast
+ * @details the shared memory object holds nbuffers buffers of buf_size
+ * bytes, and one receive queue per client. Every mcast_pool handle is a
+ * client and gets a client id when it is created or attached. A client
+ * allocates a buffer, fills it and publishes it to any number of clients:
+ * each publish only queues the index of the buffer, the data is never
+ * copied. Receivers may in turn publish what they received.
+ *
+ * A buffer keeps the set of clients holding a reference to it, as a bit mask
+ * in a single word: publishing to a client sets its bit, the client clears
+ * it on release, and the buffer is free again once the mask is empty. When a
+ * client dies, the next client to call reclaim() (or to be attached in its
+ * slot) clears its bit from every buffer, which drops in one go the
+ * references it held and the ones queued for it.
+ *
+ * A client handle is not thread safe. There are at most MAX_CLIENTS clients.
+ */
+class mcast_pool {
+public:
+  static constexpr uint32_t MAX_CLIENTS = 64;
+
+private:
+  friend class mcast_buffer;
+
+  struct pool_meta_t;
+  struct client_t;
+  struct desc_t;
+  struct cell_t;
+
+  shmhdl hdl_;
+  pool_meta_t *meta_ = nullptr;
+  client_t *clients_ = nullptr;
+  desc_t *descs_ = nullptr;
+  char *cells_ = nullptr;
+  char *data_ = nullptr;
+  uint32_t self_ = 0;
+
+  void create(std::string_view name, uint32_t nbuffers, uint32_t buf_size,
+              uint32_t nclients, uint32_t queue_cap,
+              std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept;
+  void join(std::error_code &ec) noexcept;
+  void leave() noexcept;
+  void scrub(uint32_t client) noexcept;
+  cell_t *queue_of(uint32_t client) const noexcept;
+  bool pop(uint32_t &index) noexcept;
+  mcast_buffer make_buffer(uint32_t index) noexcept;
+
+public:
+  mcast_pool() noexcept = default;
+  /**
+   * @brief create a pool and join it as the first client
+   *
+   * @param name
+   * @param nbuffers
+   * @param buf_size rounded up to a multiple of 64
+   * @param nclients at most MAX_CLIENTS
+   * @param queue_cap buffers each client can have queued, rounded up to a
+   * power of 2
+   * @param ec
+   */
+  mcast_pool(create_only_t, std::string_view name, uint32_t nbuffers,
+             uint32_t buf_size, uint32_t nclients, uint32_t queue_cap,
+             std::error_code &ec) noexcept;
+  mcast_pool(create_only_t, std::string_view name, uint32_t nbuffers,
+             uint32_t buf_size, uint32_t nclients, uint32_t queue_cap);
+  /**
+   * @brief attach to an existing pool and join it as a client
+   * @details fails with IPCErrc::McastNoFreeClient when every client slot is
+   * taken by a live process.
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  mcast_pool(open_only_t, std::string_view name, std::error_code &ec,
+             std::chrono::milliseconds timeout =
+                 std::chrono::milliseconds(1000)) noexcept;
+  mcast_pool(open_only_t, std::string_view name,
+             std::chrono::milliseconds timeout =
+                 std::chrono::milliseconds(1000));
+  /**
+   * @brief leave the pool, dropping the references still queued for this
+   * client
+   *
+   */
+  ~mcast_pool();
+
+  mcast_pool(mcast_pool &&other) noexcept;
+  mcast_pool &operator=(mcast_pool &&other) noexcept;
+
+  /**
+   * @brief get a free buffer, held by this client only
+   * @details when none is free, the clients of dead processes are reclaimed
+   * and the search retried once before failing with
+   * IPCErrc::McastPoolExhausted.
+   *
+   * @param ec
+   * @return mcast_buffer
+   */
+  mcast_buffer allocate(std::error_code &ec) noexcept;
+  mcast_buffer allocate();
+  /**
+   * @brief queue buf, which this client holds, for client
+   * @details fails with IPCErrc::McastNoSuchClient if client is not joined,
+   * IPCErrc::McastQueueFull if its queue is full, and EALREADY if client
+   * already holds the buffer.
+   *
+   * @param buf
+   * @param client
+   * @param ec
+   */
+  void publish(const mcast_buffer &buf, uint32_t client,
+               std::error_code &ec) noexcept;
+  void publish(const mcast_buffer &buf, uint32_t client);
+  /**
+   * @brief queue buf for every other joined client, skipping the ones whose
+   * queue is full
+   *
+   * @param buf
+   * @return uint32_t the number of clients it was queued for
+   */
+  uint32_t broadcast(const mcast_buffer &buf) noexcept;
+  /**
+   * @brief take the next buffer queued for this client, waiting at most
+   * timeout for one
+   *
+   * @param timeout zero to poll, FOREVER to wait without a deadline
+   * @return mcast_buffer empty on timeout
+   */
+  mcast_buffer receive(std::chrono::nanoseconds timeout =
+                           std::chrono::nanoseconds(0)) noexcept;
+
+  /**
+   * @brief free the client slots of dead processes, with the references
+   * they held
+   *
+   * @return uint32_t the number of clients reclaimed
+   */
+  uint32_t reclaim() noexcept;
+
+  /**
+   * @brief id of this client, what other clients publish to
+   *
+   * @return uint32_t
+   */
+  uint32_t id() const noexcept;
+  /**
+   * @brief buffers not held by any client
+   *
+   * @return uint32_t
+   */
+  uint32_t available() const noexcept;
+  uint32_t nbuffers() const noexcept;
+  uint32_t buf_size() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+
+/**
+ * @brief a reference to a buffer of a mcast_pool held by one client
+ * @details move only; the reference is dropped by release() or the
+ * destructor, and the buffer returns to the pool when the last client
+ * holding it drops its reference. Stays usable as long as the shared memory
+ * object is mapped, i.e. while the mcast_pool it came from (or one it was
+ * moved to) exists.
+ */
+class mcast_buffer {
+private:
+  friend class mcast_pool;
+
+  mcast_pool::desc_t *desc_ = nullptr;
+  char *data_ = nullptr;
+  uint32_t capacity_ = 0;
+  uint32_t index_ = 0;
+  /**
+   * @brief the client holding the reference
+   *
+   */
+  uint32_t client_ = 0;
+
+  mcast_buffer(mcast_pool::desc_t *desc, char *data, uint32_t capacity,
+               uint32_t index, uint32_t client) noexcept;
+
+public:
+  mcast_buffer() noexcept = default;
+  ~mcast_buffer();
+  mcast_buffer(const mcast_buffer &) = delete;
+  mcast_buffer &operator=(const mcast_buffer &) = delete;
+  mcast_buffer(mcast_buffer &&other) noexcept;
+  mcast_buffer &operator=(mcast_buffer &&other) noexcept;
+
+  /**
+   * @brief drop the reference, leaving the buffer empty
+   *
+   */
+  void release() noexcept;
+
+  void *data() const noexcept;
+  /**
+   * @brief bytes of the buffer in use, as set by the producer with resize()
+   *
+   * @return uint32_t
+   */
+  uint32_t size() const noexcept;
+  /**
+   * @brief producer: set the bytes in use, before the buffer is published
+   *
+   * @param nbytes at most capacity()
+   */
+  void resize(uint32_t nbytes) noexcept;
+  uint32_t capacity() const noexcept;
+  /**
+   * @brief index of the buffer in the pool
+   *
+   * @return uint32_t
+   */
+  uint32_t index() const noexcept;
+  /**
+   * @brief clients holding the buffer, the ones it is queued for included
+   *
+   * @return uint32_t
+   */
+  uint32_t use_count() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ipc {
+/**
+ * @brief identifies a process even after its pid is reused: the pid and the
+ * (truncated) time the process started
+ * @details fits in 64 bits, so it can be stored in a std::atomic in shared
+ * memory and claimed with a single compare exchange. The all zero value
+ * means "no process".
+ */
+struct proc_id {
+  uint32_t pid_ = 0;
+  /**
+   * @brief low bits of the start time in an OS specific unit, 0 when it is
+   * not known
+   *
+   */
+  uint32_t start_ = 0;
+
+  /**
+   * @brief the calling process, computed once
+   *
+   * @return proc_id
+   */
+  static proc_id self() noexcept;
+  /**
+   * @brief whether the process still runs, i.e. a process with this pid
+   * exists and started at the same time
+   *
+   */
+  bool alive() const noexcept;
+  bool empty() const noexcept { return this->pid_ == 0; }
+
+  friend bool operator==(const proc_id &a, const proc_id &b) noexcept {
+    return a.pid_ == b.pid_ && a.start_ == b.start_;
+  }
+  friend bool operator!=(const proc_id &a, const proc_id &b) noexcept {
+    return !(a == b);
+  }
+};
+
+/**
+ * @brief whether a process with this pid exists, whoever it is
+ *
+ * @param pid
+ */
+bool process_alive(uint32_t pid) noexcept;
+
+/**
+ * @brief identifies the pid namespace of the calling process, 0 where there
+ * are none or it is unknown
+ * @details a process of another pid namespace shows up under another pid, or
+ * not at all: the proc_id of such a process can not be checked with alive().
+ */
+uint64_t pid_namespace() noexcept;
+} // namespace ipc
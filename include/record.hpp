@@ -0,0 +1,328 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "ec.hpp"
+
+namespace ipc {
+/**
+ * @brief type of a record field, STRING and ARRAY are stored out of line;
+ * NONE is the type of a field that does not exist
+ *
+ */
+enum class field_type : uint32_t {
+  BOOL,
+  INT8,
+  UINT8,
+  INT16,
+  UINT16,
+  INT32,
+  UINT32,
+  INT64,
+  UINT64,
+  FLOAT32,
+  FLOAT64,
+  STRING,
+  ARRAY,
+  NONE,
+};
+
+template <typename T> struct field_type_of;
+template <> struct field_type_of<bool> {
+  static constexpr field_type value = field_type::BOOL;
+};
+template <> struct field_type_of<int8_t> {
+  static constexpr field_type value = field_type::INT8;
+};
+template <> struct field_type_of<uint8_t> {
+  static constexpr field_type value = field_type::UINT8;
+};
+template <> struct field_type_of<int16_t> {
+  static constexpr field_type value = field_type::INT16;
+};
+template <> struct field_type_of<uint16_t> {
+  static constexpr field_type value = field_type::UINT16;
+};
+template <> struct field_type_of<int32_t> {
+  static constexpr field_type value = field_type::INT32;
+};
+template <> struct field_type_of<uint32_t> {
+  static constexpr field_type value = field_type::UINT32;
+};
+template <> struct field_type_of<int64_t> {
+  static constexpr field_type value = field_type::INT64;
+};
+template <> struct field_type_of<uint64_t> {
+  static constexpr field_type value = field_type::UINT64;
+};
+template <> struct field_type_of<float> {
+  static constexpr field_type value = field_type::FLOAT32;
+};
+template <> struct field_type_of<double> {
+  static constexpr field_type value = field_type::FLOAT64;
+};
+
+/**
+ * @brief name and type of a field
+ *
+ */
+struct field_def {
+  std::string_view name_;
+  field_type type_;
+  /**
+   * @brief type of the elements of an ARRAY field, a scalar type, ignored for
+   * the other fields
+   *
+   */
+  field_type elem_ = field_type::UINT8;
+};
+
+/**
+ * @brief read-only view of the elements of an ARRAY field
+ *
+ * @tparam T
+ */
+template <typename T> class record_array {
+private:
+  const T *data_ = nullptr;
+  size_t size_ = 0;
+
+public:
+  record_array() noexcept = default;
+  record_array(const T *data, size_t size) noexcept
+      : data_(data), size_(size) {}
+
+  const T *data() const noexcept { return this->data_; }
+  size_t size() const noexcept { return this->size_; }
+  bool empty() const noexcept { return this->size_ == 0; }
+  const T &operator[](size_t i) const noexcept { return this->data_[i]; }
+  const T *begin() const noexcept { return this->data_; }
+  const T *end() const noexcept { return this->data_ + this->size_; }
+};
+
+/**
+ * @brief layout of a record, computed from the list of its fields
+ * @details a record is read in place by whoever builds the same schema, there
+ * is nothing to parse and nothing to allocate:
+ *  | record header | fixed fields | strings and arrays |
+ * The header holds the size of the record and a hash of the schema. Scalars
+ * are stored at their natural alignment in declaration order, a STRING or
+ * ARRAY field is an (offset, length) pair pointing past the fixed fields,
+ * where its bytes start on an 8 byte boundary. Offsets are relative to the
+ * begining of the record, so a record can be copied anywhere as is. Records
+ * start on an 8 byte boundary and their size is a multiple of 8.
+ */
+class record_schema {
+public:
+  static constexpr size_t MAX_FIELDS = 256;
+  static constexpr size_t npos = size_t(-1);
+  static constexpr size_t ALIGN = 8;
+
+private:
+  struct field_t {
+    std::string name_;
+    field_type type_;
+    field_type elem_;
+    /**
+     * @brief from the begining of the record
+     *
+     */
+    uint32_t offset_;
+  };
+
+  std::vector<field_t> fields_;
+  uint32_t inline_size_ = 0;
+  uint32_t hash_ = 0;
+
+  void build(const std::vector<field_def> &fields,
+             std::error_code &ec) noexcept;
+
+public:
+  record_schema() noexcept = default;
+  /**
+   * @brief lay out the fields
+   *
+   * @param fields at most MAX_FIELDS, with distinct names
+   * @param ec
+   */
+  record_schema(const std::vector<field_def> &fields,
+                std::error_code &ec) noexcept;
+  record_schema(const std::vector<field_def> &fields);
+
+  /**
+   * @brief index of the field called name
+   *
+   * @param name
+   * @return size_t npos if there is none
+   */
+  size_t find(std::string_view name) const noexcept;
+  std::string_view field_name(size_t field) const noexcept;
+  /**
+   * @brief type of field
+   *
+   * @param field
+   * @return field_type NONE if there is no such field
+   */
+  field_type type(size_t field) const noexcept;
+  /**
+   * @brief type of the elements of an ARRAY field
+   *
+   * @param field
+   * @return field_type NONE if there is no such field
+   */
+  field_type elem(size_t field) const noexcept;
+  /**
+   * @brief from the begining of the record, the fixed part of a STRING or
+   * ARRAY field for those
+   *
+   * @param field
+   * @return uint32_t 0 if there is no such field
+   */
+  uint32_t offset(size_t field) const noexcept;
+  size_t nfields() const noexcept;
+  /**
+   * @brief bytes of the header and the fixed fields, the smallest record
+   *
+   * @return uint32_t
+   */
+  uint32_t inline_size() const noexcept;
+  uint32_t hash() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+
+/**
+ * @brief writes a record straight into a buffer, e.g. an mcast_buffer or a
+ * region reserved in a segment
+ * @details the fixed fields are zeroed first, the setters fill them in any
+ * order and append strings and arrays behind them. A setter that fails (wrong
+ * field or type, no room left) does nothing but keeps the error for finish(),
+ * the setters after it do nothing either.
+ */
+class record_builder {
+private:
+  const record_schema *schema_ = nullptr;
+  char *buf_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  std::error_code ec_;
+
+  void *scalar(size_t field, field_type type) noexcept;
+  void *append(size_t field, field_type type, field_type elem, size_t n,
+               size_t width) noexcept;
+
+public:
+  record_builder() noexcept = default;
+  /**
+   * @brief start a record at buf
+   *
+   * @param schema must outlive the builder
+   * @param buf 8 byte aligned
+   * @param capacity bytes available at buf
+   */
+  record_builder(const record_schema &schema, void *buf,
+                 size_t capacity) noexcept;
+
+  template <typename T> void set(size_t field, T value) noexcept {
+    void *__p = this->scalar(field, field_type_of<T>::value);
+    if (__p) {
+      *static_cast<T *>(__p) = value;
+    }
+  }
+  void set_string(size_t field, std::string_view value) noexcept;
+  template <typename T>
+  void set_array(size_t field, const T *values, size_t n) noexcept {
+    T *__p = this->reserve_array<T>(field, n);
+    for (size_t i = 0; __p && i < n; i++) {
+      __p[i] = values[i];
+    }
+  }
+  /**
+   * @brief room for n elements of an ARRAY field, to be written in place
+   *
+   * @tparam T the element type of the field
+   * @param field
+   * @param n
+   * @return T* nullptr on failure
+   */
+  template <typename T> T *reserve_array(size_t field, size_t n) noexcept {
+    return static_cast<T *>(this->append(field, field_type::ARRAY,
+                                         field_type_of<T>::value, n,
+                                         sizeof(T)));
+  }
+
+  /**
+   * @brief complete the header
+   *
+   * @param ec the first error of the setters, or IPCErrc::RecordOverflow
+   * @return size_t bytes of the record
+   */
+  size_t finish(std::error_code &ec) noexcept;
+  size_t finish();
+  /**
+   * @brief bytes used so far
+   *
+   * @return size_t
+   */
+  size_t size() const noexcept;
+};
+
+/**
+ * @brief reads the fields of a record in place
+ * @details the constructor checks the header and that every string and array
+ * lies within the record, the accessors then return the values, or views of
+ * them, straight from the buffer. An accessor asked for a field of another
+ * type returns an empty value.
+ */
+class record_view {
+private:
+  const record_schema *schema_ = nullptr;
+  const char *base_ = nullptr;
+
+  const void *scalar(size_t field, field_type type) const noexcept;
+  const void *items(size_t field, field_type type, field_type elem,
+                    size_t &n) const noexcept;
+
+public:
+  record_view() noexcept = default;
+  /**
+   * @brief view the record at data
+   * @details fails with IPCErrc::RecordMismatch if the record was built with
+   * another schema or does not fit in size bytes.
+   *
+   * @param schema must outlive the view
+   * @param data 8 byte aligned
+   * @param size bytes available at data
+   * @param ec
+   */
+  record_view(const record_schema &schema, const void *data, size_t size,
+              std::error_code &ec) noexcept;
+  record_view(const record_schema &schema, const void *data, size_t size);
+
+  template <typename T> T get(size_t field) const noexcept {
+    const void *__p = this->scalar(field, field_type_of<T>::value);
+    return __p ? *static_cast<const T *>(__p) : T{};
+  }
+  std::string_view string(size_t field) const noexcept;
+  template <typename T> record_array<T> array(size_t field) const noexcept {
+    size_t __n = 0;
+    auto __p = static_cast<const T *>(
+        this->items(field, field_type::ARRAY, field_type_of<T>::value, __n));
+    return {__p, __n};
+  }
+
+  /**
+   * @brief bytes of the record
+   *
+   * @return size_t
+   */
+  size_t size() const noexcept;
+  const void *data() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+#include "common.hpp"
+#include "ec.hpp"
+#include "futex.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+/**
+ * @brief how an rpc_channel endpoint waits for the other side
+ *
+ */
+enum class rpc_wait {
+  /**
+   * @brief spin until the other side makes progress, never sleep
+   *
+   */
+  poll,
+  /**
+   * @brief spin briefly, then sleep on a futex until woken
+   *
+   */
+  futex,
+};
+
+/**
+ * @brief identifies an outstanding call, returned by call_async()
+ *
+ */
+struct rpc_ticket {
+  uint32_t slot_ = 0;
+  uint64_t id_ = 0;
+};
+
+/**
+ * @brief a request handed to the server by receive()
+ * @details data points into the request slot and resp into the response
+ * area of the same slot, both stay valid until reply() is called.
+ */
+struct rpc_request {
+  uint32_t slot_ = 0;
+  uint64_t id_ = 0;
+  uint32_t method_ = 0;
+  const void *data_ = nullptr;
+  size_t size_ = 0;
+  void *resp_ = nullptr;
+  size_t resp_cap_ = 0;
+};
+
+/**
+ * @brief request/response transport between processes over one shared memory
+ * object
+ * @details the object holds a fixed number of slots, each with room for one
+ * request and one response of at most max_payload bytes. A call claims a free
+ * slot, copies its request in and rings the server's doorbell; the server
+ * writes the response into the same slot and the caller copies it out,
+ * freeing the slot. Calls are matched to slots by a correlation id, so a
+ * client may keep up to nslots calls in flight and collect them in any order.
+ * Any number of client and server processes (or threads) may share one
+ * channel.
+ *
+ * With rpc_wait::futex a side that finds nothing to do spins briefly then
+ * sleeps, and the other side only makes a syscall to wake it when it actually
+ * sleeps. With rpc_wait::poll it never sleeps, which gives the lowest latency
+ * when both sides have a core of their own.
+ *
+ * A call whose caller dies keeps its slot busy until the channel is recreated.
+ */
+class rpc_channel {
+private:
+  struct channel_meta_t;
+  struct slot_t;
+
+  shmhdl hdl_;
+  channel_meta_t *meta_ = nullptr;
+  char *slots_ = nullptr;
+  rpc_wait mode_ = rpc_wait::futex;
+  /**
+   * @brief where this endpoint starts looking for a free (client) or pending
+   * (server) slot
+   *
+   */
+  uint32_t client_cursor_ = 0;
+  uint32_t server_cursor_ = 0;
+
+  void create(std::string_view name, uint32_t nslots, size_t max_payload,
+              std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept;
+  slot_t *slot_at(uint32_t i) const noexcept;
+  char *request_area(slot_t *slot) const noexcept;
+  char *response_area(slot_t *slot) const noexcept;
+  bool poll_request(rpc_request &req) noexcept;
+
+public:
+  rpc_channel() noexcept = default;
+  /**
+   * @brief create a new channel
+   *
+   * @param name
+   * @param nslots maximum number of calls in flight
+   * @param max_payload maximum size of a request or a response
+   * @param ec
+   * @param mode how this endpoint waits
+   */
+  rpc_channel(create_only_t, std::string_view name, uint32_t nslots,
+              size_t max_payload, std::error_code &ec,
+              rpc_wait mode = rpc_wait::futex) noexcept;
+  rpc_channel(create_only_t, std::string_view name, uint32_t nslots,
+              size_t max_payload, rpc_wait mode = rpc_wait::futex);
+  /**
+   * @brief attach to an existing channel, waiting at most timeout for its
+   * creator to finish initializing it
+   *
+   * @param name
+   * @param ec
+   * @param mode how this endpoint waits
+   * @param timeout
+   */
+  rpc_channel(open_only_t, std::string_view name, std::error_code &ec,
+              rpc_wait mode = rpc_wait::futex,
+              std::chrono::milliseconds timeout =
+                  std::chrono::milliseconds(1000)) noexcept;
+  rpc_channel(open_only_t, std::string_view name,
+              rpc_wait mode = rpc_wait::futex,
+              std::chrono::milliseconds timeout =
+                  std::chrono::milliseconds(1000));
+
+  rpc_channel(rpc_channel &&other) noexcept;
+  rpc_channel &operator=(rpc_channel &&other) noexcept;
+
+  /**
+   * @brief client: send a request without waiting for its response
+   * @details fails with IPCErrc::RpcNoFreeSlot when nslots calls are already
+   * in flight and with std::errc::message_size when size exceeds
+   * max_payload().
+   *
+   * @param method
+   * @param data
+   * @param size
+   * @param ec
+   * @return rpc_ticket to pass to wait()
+   */
+  rpc_ticket call_async(uint32_t method, const void *data, size_t size,
+                        std::error_code &ec) noexcept;
+  rpc_ticket call_async(uint32_t method, const void *data, size_t size);
+  /**
+   * @brief client: whether the response of ticket has arrived
+   *
+   * @param ticket
+   */
+  bool ready(const rpc_ticket &ticket) const noexcept;
+  /**
+   * @brief client: wait at most timeout for the response of ticket, copy at
+   * most cap bytes of it into resp and free its slot
+   * @details on timeout (std::errc::timed_out) the call stays in flight and
+   * may be waited for again. A ticket whose response was already collected
+   * fails with std::errc::invalid_argument, even once its slot serves another
+   * call.
+   *
+   * @param ticket
+   * @param resp
+   * @param cap
+   * @param ec
+   * @param timeout
+   * @return size_t size of the response, may exceed cap
+   */
+  size_t wait(const rpc_ticket &ticket, void *resp, size_t cap,
+              std::error_code &ec,
+              std::chrono::nanoseconds timeout = FOREVER) noexcept;
+  size_t wait(const rpc_ticket &ticket, void *resp, size_t cap,
+              std::chrono::nanoseconds timeout = FOREVER);
+  /**
+   * @brief client: call_async() then wait()
+   *
+   * @return size_t size of the response, may exceed cap
+   */
+  size_t call(uint32_t method, const void *data, size_t size, void *resp,
+              size_t cap, std::error_code &ec,
+              std::chrono::nanoseconds timeout = FOREVER) noexcept;
+  size_t call(uint32_t method, const void *data, size_t size, void *resp,
+              size_t cap, std::chrono::nanoseconds timeout = FOREVER);
+
+  /**
+   * @brief server: wait at most timeout for a request
+   *
+   * @param req
+   * @param ec std::errc::timed_out if no request arrived
+   * @param timeout
+   * @return true if req holds a request that must be answered with reply()
+   */
+  bool receive(rpc_request &req, std::error_code &ec,
+               std::chrono::nanoseconds timeout = FOREVER) noexcept;
+  /**
+   * @brief server: complete req with the size bytes written to req.resp_
+   *
+   * @param req
+   * @param size at most req.resp_cap_
+   */
+  void reply(const rpc_request &req, size_t size) noexcept;
+  /**
+   * @brief server: answer requests with handler until none arrives for
+   * timeout
+   * @details handler is called as
+   * `size_t handler(uint32_t method, const void *data, size_t size,
+   * void *resp, size_t cap)` and returns the size of the response.
+   *
+   * @param handler
+   * @param timeout
+   * @return size_t number of requests answered
+   */
+  template <typename Handler>
+  size_t serve(Handler &&handler, std::chrono::nanoseconds timeout) {
+    size_t __n = 0;
+    rpc_request __req;
+    std::error_code __ec;
+    while (this->receive(__req, __ec, timeout)) {
+      this->reply(__req, handler(__req.method_, __req.data_, __req.size_,
+                                 __req.resp_, __req.resp_cap_));
+      __n++;
+    }
+    return __n;
+  }
+
+  uint32_t nslots() const noexcept;
+  size_t max_payload() const noexcept;
+  rpc_wait mode() const noexcept;
+  void set_mode(rpc_wait mode) noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
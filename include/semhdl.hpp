@@ -11,19 +11,28 @@
 #endif
 
 namespace ipc {
+class busy_poll;
 
 class semhdl {
 private:
-  std::string name_;
+  char name_[MAX_NAME_LEN + 1] = {};
 #ifdef __POSIX__
-  sem_t *sema_;
+  sem_t *sema_ = nullptr;
 #endif
 
 #ifdef __WIN32__
-  HANDLE hSemaphore;
+  HANDLE hSemaphore = nullptr;
 #endif
 
+  void release() noexcept;
+
 public:
+  /**
+   * @brief create an empty semhdl object
+   * @details an empty handle owns nothing, it is also the state a handle is
+   * left in after being moved from.
+   */
+  semhdl() noexcept = default;
   /**
    * @brief create a new semahdl object
    *
@@ -49,6 +58,23 @@ public:
    */
   ~semhdl();
 
+  semhdl(const semhdl &) = delete;
+  semhdl &operator=(const semhdl &) = delete;
+  /**
+   * @brief take over other's semaphore, other is left empty
+   *
+   * @param other
+   */
+  semhdl(semhdl &&other) noexcept;
+  /**
+   * @brief release the current semaphore (as the destructor does) and take
+   * over other's, other is left empty
+   *
+   * @param other
+   * @return semhdl&
+   */
+  semhdl &operator=(semhdl &&other) noexcept;
+
   /**
    * @brief increase semaphore value
    *
@@ -65,6 +91,14 @@ public:
    */
   void wait(std::error_code &ec) noexcept;
   void wait();
+  /**
+   * @brief wait by polling with poller instead of blocking in the kernel
+   *
+   * @param poller
+   * @param ec
+   */
+  void wait(busy_poll &poller, std::error_code &ec) noexcept;
+  void wait(busy_poll &poller);
   /**
    * @brief non-block wiat
    *
@@ -86,5 +120,11 @@ public:
    * @return std::string_view
    */
   std::string_view name() const noexcept;
+  /**
+   * @brief whether the handle refers to a semaphore
+   *
+   */
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
 };
 } // namespace ipc
\ No newline at end of file
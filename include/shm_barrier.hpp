@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+#include "futex.hpp"
+#include "shm_object.hpp"
+
+namespace ipc {
+/**
+ * @brief barrier for a fixed number of processes, living in a shared memory
+ * object
+ * @details a central sense-reversing barrier: every party increments the
+ * arrival count and the last one to arrive resets it and advances the phase
+ * word, which releases the others. The sense is the phase number itself, so a
+ * party that is slow to leave phase n never mistakes phase n + 1 for it. A
+ * phase therefore costs one atomic increment per party and, when somebody is
+ * asleep, one futex wake for all of them, instead of a post per party.
+ *
+ * Waiting parties spin briefly on the phase word and then sleep on it with a
+ * futex. arrive() and wait() split a phase in two, so that a party can do
+ * useful work between announcing its arrival and waiting for the others.
+ */
+class shm_barrier {
+private:
+  struct state_t {
+    uint32_t nparties_;
+    alignas(64) std::atomic<uint32_t> count_{0};
+    /**
+     * @brief number of completed phases, parties sleep on it
+     *
+     */
+    alignas(64) std::atomic<uint32_t> phase_{0};
+    std::atomic<uint32_t> sleepers_{0};
+
+    explicit state_t(uint32_t nparties) noexcept : nparties_(nparties) {}
+  };
+
+  shm_object<state_t> obj_;
+
+public:
+  shm_barrier() noexcept = default;
+  /**
+   * @brief create a barrier for nparties processes
+   *
+   * @param name
+   * @param nparties
+   * @param ec
+   */
+  shm_barrier(create_only_t, std::string_view name, uint32_t nparties,
+              std::error_code &ec) noexcept;
+  shm_barrier(create_only_t, std::string_view name, uint32_t nparties);
+  /**
+   * @brief attach to an existing barrier
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  shm_barrier(open_only_t, std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout =
+                  std::chrono::milliseconds(1000)) noexcept;
+  shm_barrier(open_only_t, std::string_view name,
+              std::chrono::milliseconds timeout =
+                  std::chrono::milliseconds(1000));
+
+  shm_barrier(shm_barrier &&) noexcept = default;
+  shm_barrier &operator=(shm_barrier &&) noexcept = default;
+
+  /**
+   * @brief arrive at the barrier without waiting for the others
+   *
+   * @return uint32_t the token to pass to wait(), 0 if the barrier is not
+   * valid
+   */
+  uint32_t arrive() noexcept;
+  /**
+   * @brief wait until the phase arrive() returned token for is complete
+   *
+   * @param token
+   * @param timeout
+   * @return false on timeout, the arrival still counts and wait() can be
+   * called again; false as well if the barrier is not valid
+   */
+  bool wait(uint32_t token,
+            std::chrono::nanoseconds timeout = FOREVER) noexcept;
+  /**
+   * @brief arrive and wait for every other party
+   *
+   * @return uint32_t the number of completed phases, this one included; 0
+   * if the barrier is not valid
+   */
+  uint32_t arrive_and_wait() noexcept;
+
+  /**
+   * @brief number of completed phases
+   *
+   * @return uint32_t
+   */
+  uint32_t phase() const noexcept;
+  uint32_t nparties() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+#include "cpuinfo.hpp"
+#include "detail.hpp"
+#include "ec.hpp"
+#include "shm_object.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+/**
+ * @brief counters of one shm_cache handle
+ *
+ */
+struct cache_stats_t {
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  /**
+   * @brief entries this handle evicted to make room
+   *
+   */
+  uint64_t evictions_ = 0;
+
+  double hit_rate() const noexcept {
+    uint64_t __lookups = this->hits_ + this->misses_;
+    return __lookups ? double(this->hits_) / double(__lookups) : 0.0;
+  }
+};
+
+/**
+ * @brief fixed capacity key-value cache shared by several processes
+ * @details the shared memory object is split into sets of WAYS entries, each
+ * on its own cache lines. A key lives in one of the entries of the set its
+ * hash picks. Lookups take no lock: every entry carries a sequence number
+ * that is odd while the entry is written, a reader copies the entry and
+ * retries if the sequence number moved meanwhile. Writers of a set serialize
+ * on a spin lock of that set only, so the cache scales with the number of
+ * sets. A full set evicts with the CLOCK algorithm: a lookup hit marks the
+ * entry as referenced, the clock hand clears marks until it finds an entry
+ * that was not read since its last pass.
+ *
+ * K and V are copied with memcpy and must be trivially copyable and free of
+ * pointers. Hash must give the same value in every process, which std::hash
+ * does for integers; strings must be stored in fixed size arrays with a
+ * custom Hash. A process dying while it writes a set leaves that set locked.
+ *
+ * @tparam K
+ * @tparam V
+ * @tparam Hash
+ * @tparam KeyEqual
+ */
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>>
+class shm_cache {
+  static_assert(std::is_trivially_copyable_v<K> &&
+                    std::is_trivially_copyable_v<V>,
+                "shm_cache<K, V> requires trivially copyable K and V");
+  static_assert(is_shm_safe_v<K> && is_shm_safe_v<V>,
+                "shm_cache<K, V> requires K and V without raw pointers");
+
+public:
+  /**
+   * @brief entries of a set, i.e. the associativity of the cache
+   *
+   */
+  static constexpr uint32_t WAYS = 8;
+
+private:
+  /**
+   * @brief attempts of a reader on an entry that keeps changing before it
+   * reports a miss, in case its writer died half way
+   *
+   */
+  static constexpr uint32_t READ_RETRIES = 1024;
+
+  struct entry_t {
+    std::atomic<uint32_t> seq_;
+    uint32_t valid_;
+    uint64_t hash_;
+    K key_;
+    V value_;
+  };
+
+  struct alignas(detail::CACHE_LINE) set_t {
+    std::atomic<uint32_t> lock_;
+    uint32_t hand_;
+    /**
+     * @brief CLOCK reference marks, set by hits
+     *
+     */
+    std::atomic<uint8_t> ref_[WAYS];
+    entry_t entries_[WAYS];
+  };
+
+  /**
+   * @brief placed at the begining of the shared memory buffer
+   * memory layout might look like this:
+   *  | cache meta | set 0 | set 1 | ...
+   */
+  struct alignas(detail::CACHE_LINE) cache_meta_t {
+    std::atomic<uint32_t> state_;
+    uint32_t nsets_;
+    uint64_t layout_hash_;
+  };
+
+  static constexpr uint64_t layout_hash = detail::layout_hash<set_t>();
+
+  shmhdl hdl_;
+  cache_meta_t *meta_ = nullptr;
+  set_t *sets_ = nullptr;
+  cache_stats_t stats_;
+
+  static shmsz_t required_nbytes(uint32_t nsets) noexcept {
+    return sizeof(cache_meta_t) + shmsz_t(nsets) * sizeof(set_t);
+  }
+
+  static uint64_t hash_of(const K &key) noexcept {
+    // spread identity hashes of integers over the sets
+    uint64_t __x = uint64_t(Hash{}(key));
+    __x = (__x ^ (__x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    __x = (__x ^ (__x >> 27)) * 0x94d049bb133111ebull;
+    return __x ^ (__x >> 31);
+  }
+
+  set_t &set_of(uint64_t hash) const noexcept {
+    return this->sets_[hash % this->meta_->nsets_];
+  }
+
+  void create(std::string_view name, uint32_t capacity,
+              std::error_code &ec) noexcept {
+    if (capacity == 0) {
+      ec = std::make_error_code(std::errc::invalid_argument);
+      return;
+    }
+    uint32_t __nsets = (capacity + WAYS - 1) / WAYS;
+    this->hdl_ = shmhdl(name, required_nbytes(__nsets), ec);
+    if (ec) {
+      return;
+    }
+    void *__buf = this->hdl_.map(ec);
+    if (ec) {
+      this->hdl_ = shmhdl();
+      return;
+    }
+    this->meta_ = new (__buf) cache_meta_t;
+    this->meta_->nsets_ = __nsets;
+    this->meta_->layout_hash_ = layout_hash;
+    this->sets_ = reinterpret_cast<set_t *>(this->meta_ + 1);
+    for (uint32_t i = 0; i < __nsets; i++) {
+      set_t *__set = new (&this->sets_[i]) set_t;
+      __set->lock_.store(0, std::memory_order_relaxed);
+      __set->hand_ = 0;
+      for (uint32_t w = 0; w < WAYS; w++) {
+        __set->ref_[w].store(0, std::memory_order_relaxed);
+        __set->entries_[w].seq_.store(0, std::memory_order_relaxed);
+        __set->entries_[w].valid_ = 0;
+      }
+    }
+    this->meta_->state_.store(detail::READY, std::memory_order_release);
+  }
+
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept {
+    this->hdl_ = shmhdl(name, ec);
+    if (ec) {
+      return;
+    }
+    void *__buf = this->hdl_.map(ec);
+    if (ec) {
+      this->hdl_ = shmhdl();
+      return;
+    }
+    if (this->hdl_.nbytes() < shmsz_t(sizeof(cache_meta_t))) {
+      ec = IPCErrc::ShmLayoutMismatch;
+      this->hdl_ = shmhdl();
+      return;
+    }
+    auto __meta = static_cast<cache_meta_t *>(__buf);
+    // wait for the creator to finish initializing the sets
+    if (!detail::wait_ready(__meta->state_, timeout)) {
+      ec = IPCErrc::ShmNotInitialized;
+      this->hdl_ = shmhdl();
+      return;
+    }
+    if (__meta->layout_hash_ != layout_hash ||
+        this->hdl_.nbytes() != required_nbytes(__meta->nsets_)) {
+      ec = IPCErrc::ShmLayoutMismatch;
+      this->hdl_ = shmhdl();
+      return;
+    }
+    this->meta_ = __meta;
+    this->sets_ = reinterpret_cast<set_t *>(this->meta_ + 1);
+  }
+
+  static void lock(set_t &set) noexcept {
+    uint32_t __spins = 0;
+    for (;;) {
+      uint32_t __free = 0;
+      if (set.lock_.load(std::memory_order_relaxed) == 0 &&
+          set.lock_.compare_exchange_weak(__free, 1,
+                                          std::memory_order_acquire)) {
+        return;
+      }
+      cpu_relax();
+      // the holder may be descheduled on a shared core
+      if (++__spins % 64 == 0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  static void unlock(set_t &set) noexcept {
+    set.lock_.store(0, std::memory_order_release);
+  }
+
+  /**
+   * @brief write an entry under the set lock, readers see either the old or
+   * the new content
+   *
+   */
+  static void store(entry_t &entry, uint32_t valid, uint64_t hash,
+                    const K &key, const V &value) noexcept {
+    // an odd sequence left behind by a dead writer is simply overwritten
+    uint32_t __seq = entry.seq_.load(std::memory_order_relaxed) | 1;
+    entry.seq_.store(__seq, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.valid_ = valid;
+    entry.hash_ = hash;
+    std::memcpy(&entry.key_, &key, sizeof(K));
+    std::memcpy(&entry.value_, &value, sizeof(V));
+    entry.seq_.store(__seq + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief the way holding key, WAYS if there is none; under the set lock
+   *
+   */
+  static uint32_t find(set_t &set, uint64_t hash, const K &key) noexcept {
+    for (uint32_t w = 0; w < WAYS; w++) {
+      entry_t &__e = set.entries_[w];
+      if (__e.valid_ && __e.hash_ == hash && KeyEqual{}(__e.key_, key)) {
+        return w;
+      }
+    }
+    return WAYS;
+  }
+
+public:
+  shm_cache() noexcept = default;
+  /**
+   * @brief create an empty cache of at least capacity entries, rounded up to
+   * a multiple of WAYS
+   *
+   * @param name
+   * @param capacity
+   * @param ec
+   */
+  shm_cache(create_only_t, std::string_view name, uint32_t capacity,
+            std::error_code &ec) noexcept {
+    this->create(name, capacity, ec);
+  }
+  shm_cache(create_only_t, std::string_view name, uint32_t capacity) {
+    std::error_code ec;
+    this->create(name, capacity, ec);
+    detail::throw_if(ec);
+  }
+  /**
+   * @brief attach to an existing cache built with the same K and V
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  shm_cache(open_only_t, std::string_view name, std::error_code &ec,
+            std::chrono::milliseconds timeout =
+                std::chrono::milliseconds(1000)) noexcept {
+    this->attach(name, ec, timeout);
+  }
+  shm_cache(open_only_t, std::string_view name,
+            std::chrono::milliseconds timeout =
+                std::chrono::milliseconds(1000)) {
+    std::error_code ec;
+    this->attach(name, ec, timeout);
+    detail::throw_if(ec);
+  }
+
+  shm_cache(shm_cache &&other) noexcept
+      : hdl_(std::move(other.hdl_)),
+        meta_(std::exchange(other.meta_, nullptr)),
+        sets_(std::exchange(other.sets_, nullptr)), stats_(other.stats_) {}
+  shm_cache &operator=(shm_cache &&other) noexcept {
+    if (this != &other) {
+      this->hdl_ = std::move(other.hdl_);
+      this->meta_ = std::exchange(other.meta_, nullptr);
+      this->sets_ = std::exchange(other.sets_, nullptr);
+      this->stats_ = other.stats_;
+    }
+    return *this;
+  }
+
+  /**
+   * @brief look key up without locking
+   *
+   * @param key
+   * @param value set on a hit
+   * @return false on a miss
+   */
+  bool get(const K &key, V &value) noexcept {
+    uint64_t __hash = hash_of(key);
+    set_t &__set = this->set_of(__hash);
+    for (uint32_t w = 0; w < WAYS; w++) {
+      entry_t &__e = __set.entries_[w];
+      for (uint32_t __attempt = 0; __attempt < READ_RETRIES; __attempt++) {
+        uint32_t __seq = __e.seq_.load(std::memory_order_acquire);
+        if (__seq & 1) {
+          cpu_relax();
+          continue;
+        }
+        // copy first, compare the copy once it is known not to be torn
+        uint32_t __valid = __e.valid_;
+        uint64_t __h = __e.hash_;
+        alignas(K) unsigned char __k[sizeof(K)];
+        alignas(V) unsigned char __v[sizeof(V)];
+        std::memcpy(__k, &__e.key_, sizeof(K));
+        std::memcpy(__v, &__e.value_, sizeof(V));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (__e.seq_.load(std::memory_order_relaxed) != __seq) {
+          continue;
+        }
+        if (__valid && __h == __hash &&
+            KeyEqual{}(*reinterpret_cast<const K *>(__k), key)) {
+          std::memcpy(&value, __v, sizeof(V));
+          if (!__set.ref_[w].load(std::memory_order_relaxed)) {
+            __set.ref_[w].store(1, std::memory_order_relaxed);
+          }
+          this->stats_.hits_++;
+          return true;
+        }
+        break;
+      }
+    }
+    this->stats_.misses_++;
+    return false;
+  }
+
+  /**
+   * @brief insert key or update its value, evicting an entry of its set
+   * when the set is full
+   *
+   * @param key
+   * @param value
+   */
+  void put(const K &key, const V &value) noexcept {
+    uint64_t __hash = hash_of(key);
+    set_t &__set = this->set_of(__hash);
+    lock(__set);
+    uint32_t __way = find(__set, __hash, key);
+    if (__way == WAYS) {
+      for (uint32_t w = 0; w < WAYS; w++) {
+        if (!__set.entries_[w].valid_) {
+          __way = w;
+          break;
+        }
+      }
+    }
+    if (__way == WAYS) {
+      // CLOCK: give referenced entries a second chance
+      while (__set.ref_[__set.hand_].load(std::memory_order_relaxed)) {
+        __set.ref_[__set.hand_].store(0, std::memory_order_relaxed);
+        __set.hand_ = (__set.hand_ + 1) % WAYS;
+      }
+      __way = __set.hand_;
+      __set.hand_ = (__set.hand_ + 1) % WAYS;
+      this->stats_.evictions_++;
+    }
+    store(__set.entries_[__way], 1, __hash, key, value);
+    unlock(__set);
+  }
+
+  /**
+   * @brief remove key
+   *
+   * @param key
+   * @return false if key was not cached
+   */
+  bool erase(const K &key) noexcept {
+    uint64_t __hash = hash_of(key);
+    set_t &__set = this->set_of(__hash);
+    lock(__set);
+    uint32_t __way = find(__set, __hash, key);
+    if (__way != WAYS) {
+      entry_t &__e = __set.entries_[__way];
+      uint32_t __seq = __e.seq_.load(std::memory_order_relaxed) | 1;
+      __e.seq_.store(__seq, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      __e.valid_ = 0;
+      __e.seq_.store(__seq + 1, std::memory_order_release);
+      __set.ref_[__way].store(0, std::memory_order_relaxed);
+    }
+    unlock(__set);
+    return __way != WAYS;
+  }
+
+  /**
+   * @brief the cached value of key, or load(key) which is then cached
+   * @details concurrent misses on the same key may all call load.
+   *
+   * @param key
+   * @param load
+   * @return V
+   */
+  template <typename Load> V get_or_load(const K &key, Load &&load) {
+    V __value;
+    if (this->get(key, __value)) {
+      return __value;
+    }
+    __value = load(key);
+    this->put(key, __value);
+    return __value;
+  }
+
+  uint32_t capacity() const noexcept {
+    return this->meta_ ? this->meta_->nsets_ * WAYS : 0;
+  }
+  const cache_stats_t &stats() const noexcept { return this->stats_; }
+  void reset_stats() noexcept { this->stats_ = cache_stats_t{}; }
+  const shmhdl &handle() const noexcept { return this->hdl_; }
+  bool valid() const noexcept { return this->meta_ != nullptr; }
+  explicit operator bool() const noexcept { return this->valid(); }
+};
+} // namespace ipc
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "detail.hpp"
+#include "ec.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+namespace detail {
+/**
+ * @brief aggregates with more (array elements included) fields than this are
+ * not inspected field by field
+ *
+ */
+constexpr size_t MAX_PROBED_FIELDS = 64;
+
+template <typename T> struct is_std_atomic : std::false_type {};
+template <typename T> struct is_std_atomic<std::atomic<T>> : std::true_type {};
+
+template <typename T> constexpr bool check_shm_safe() noexcept;
+
+/**
+ * @brief converts to any type, used to count the fields of an aggregate
+ *
+ */
+struct any_field_t {
+  template <typename U> operator U() const noexcept;
+};
+
+/**
+ * @brief converts only to types that can live in shared memory. An aggregate
+ * that can be initialized field by field from it holds no raw pointer.
+ * @details the conversion to unsafe types is deleted rather than left out, so
+ * that an unsafe nested aggregate is not brace-elided into its fields.
+ */
+struct safe_field_t {
+  template <typename U, std::enable_if_t<check_shm_safe<U>(), int> = 0>
+  operator U() const noexcept;
+  template <typename U, std::enable_if_t<!check_shm_safe<U>(), int> = 0>
+  operator U() const noexcept = delete;
+};
+
+template <typename T, typename Probe, size_t... I>
+auto aggregate_init_test(std::index_sequence<I...>)
+    -> decltype(T{(void(I), Probe{})...}, std::true_type{});
+template <typename T, typename Probe>
+std::false_type aggregate_init_test(...);
+
+template <typename T, typename Probe, size_t N>
+constexpr bool is_aggregate_initializable_v = decltype(aggregate_init_test<
+    T, Probe>(std::make_index_sequence<N>{}))::value;
+
+/**
+ * @brief number of initializers T's aggregate initialization takes, elements
+ * of array fields are counted one by one
+ *
+ */
+template <typename T, size_t N = 0> constexpr size_t aggregate_field_count() {
+  if constexpr (N > MAX_PROBED_FIELDS) {
+    return N;
+  } else if constexpr (is_aggregate_initializable_v<T, any_field_t, N + 1>) {
+    return aggregate_field_count<T, N + 1>();
+  } else {
+    return N;
+  }
+}
+
+template <typename T> constexpr bool check_shm_safe() noexcept {
+  using U = std::remove_cv_t<T>;
+  if constexpr (std::is_pointer_v<U> || std::is_member_pointer_v<U> ||
+                std::is_reference_v<U>) {
+    return false;
+  } else if constexpr (std::is_array_v<U>) {
+    return check_shm_safe<std::remove_all_extents_t<U>>();
+  } else if constexpr (is_std_atomic<U>::value) {
+    return check_shm_safe<typename U::value_type>();
+  } else if constexpr (!std::is_class_v<U>) {
+    return !std::is_union_v<U> || std::is_standard_layout_v<U>;
+  } else if constexpr (!std::is_standard_layout_v<U>) {
+    return false;
+  } else if constexpr (std::is_aggregate_v<U>) {
+    // fields of non-aggregate classes can not be inspected
+    constexpr size_t __nfields = aggregate_field_count<U>();
+    if constexpr (__nfields > MAX_PROBED_FIELDS) {
+      return true;
+    } else {
+      return is_aggregate_initializable_v<U, safe_field_t, __nfields>;
+    }
+  } else {
+    return true;
+  }
+}
+
+template <typename T> constexpr std::string_view type_signature() noexcept {
+#if defined(_MSC_VER)
+  return __FUNCSIG__;
+#else
+  return __PRETTY_FUNCTION__;
+#endif
+}
+
+constexpr uint64_t fnv1a(std::string_view s,
+                         uint64_t h = 0xcbf29ce484222325ull) noexcept {
+  for (char c : s) {
+    h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+constexpr uint64_t fnv1a(uint64_t v, uint64_t h) noexcept {
+  for (int i = 0; i < 8; i++) {
+    h = (h ^ ((v >> (i * 8)) & 0xff)) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+/**
+ * @brief converts only to U, used to find out the type of a field
+ *
+ */
+template <typename U> struct exact_field_t {
+  template <typename V, std::enable_if_t<std::is_same_v<U, V>, int> = 0>
+  operator V() const noexcept;
+};
+
+template <typename T, size_t I, typename U, size_t... J>
+auto field_is_test(std::index_sequence<J...>)
+    -> decltype(T{std::conditional_t<J == I, exact_field_t<U>,
+                                     any_field_t>{}...},
+                std::true_type{});
+template <typename T, size_t I, typename U>
+std::false_type field_is_test(...);
+
+/**
+ * @brief the field types told apart by layout_hash()
+ *
+ */
+using field_types_t =
+    std::tuple<bool, char, signed char, unsigned char, wchar_t, char16_t,
+               char32_t, short, unsigned short, int, unsigned int, long,
+               unsigned long, long long, unsigned long long, float, double,
+               long double>;
+
+/**
+ * @brief 1 + the index in field_types_t of the type of T's I-th initializer,
+ * 0 for the other types (enums, atomics, nested classes)
+ *
+ */
+template <typename T, size_t N, size_t I, size_t K = 0>
+constexpr uint64_t field_type_code() noexcept {
+  if constexpr (K == std::tuple_size_v<field_types_t>) {
+    return 0;
+  } else if constexpr (decltype(field_is_test<
+                                T, I, std::tuple_element_t<K, field_types_t>>(
+                           std::make_index_sequence<N>{}))::value) {
+    return K + 1;
+  } else {
+    return field_type_code<T, N, I, K + 1>();
+  }
+}
+
+template <typename T, size_t N, size_t... I>
+constexpr uint64_t fields_hash(uint64_t h, std::index_sequence<I...>) noexcept {
+  ((h = fnv1a(field_type_code<T, N, I>(), h)), ...);
+  return h;
+}
+
+template <typename T> constexpr uint64_t layout_hash() noexcept {
+  uint64_t h = fnv1a(type_signature<T>());
+  h = fnv1a(sizeof(T), h);
+  h = fnv1a(alignof(T), h);
+  if constexpr (std::is_aggregate_v<T>) {
+    constexpr size_t __nfields = aggregate_field_count<T>();
+    h = fnv1a(__nfields, h);
+    // the type of every field in order: moving a field or changing its type
+    // for another of the same size changes the hash
+    if constexpr (__nfields <= MAX_PROBED_FIELDS) {
+      h = fields_hash<T, __nfields>(h, std::make_index_sequence<__nfields>{});
+    }
+  }
+  return h;
+}
+} // namespace detail
+
+/**
+ * @brief whether T can be placed in shared memory and accessed from several
+ * processes
+ * @details T must be standard-layout and hold no raw pointer, reference or
+ * member pointer. Fields of aggregates (nested aggregates and arrays included)
+ * are checked at compile time; the private fields of non-aggregate classes can
+ * not be inspected.
+ */
+template <typename T>
+constexpr bool is_shm_safe_v = detail::check_shm_safe<T>();
+
+/**
+ * @brief a T living in its own shared memory object
+ * @details the creator sizes the shared memory object from sizeof(T) and
+ * constructs T exactly once. Attachers wait until construction has finished,
+ * then check a compile-time hash of T's layout (type name, size, alignment,
+ * field count and the types of the arithmetic fields in order) so that
+ * binaries built with a different T are rejected instead of reading garbage.
+ * The hash includes the compiler's spelling of the type name, so both sides
+ * should be built with the same compiler. It does not see inside the fields
+ * of enum, atomic or nested class type, nor the fields of non-aggregate
+ * classes: changes there that keep sizeof(T) go unnoticed.
+ *
+ * T's destructor is never run, the object lives as long as the shared memory
+ * object does.
+ *
+ * @tparam T
+ */
+template <typename T> class shm_object {
+  static_assert(std::is_standard_layout_v<T>,
+                "shm_object<T> requires a standard-layout T");
+  static_assert(is_shm_safe_v<T>,
+                "shm_object<T> requires a T without raw pointers, references "
+                "or member pointers");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free,
+                "shm_object<T> requires lock free std::atomic<uint32_t>");
+
+private:
+  /**
+   * @brief placed at the begining of the shared memory buffer
+   * memory layout might look like this:
+   *  | state | layout_hash | padding | T |
+   */
+  struct object_meta_t {
+    std::atomic<uint32_t> state_;
+    uint64_t layout_hash_;
+  };
+
+  static constexpr shmsz_t required_nbytes =
+      sizeof(object_meta_t) + alignof(T) - 1 + sizeof(T);
+
+  shmhdl hdl_;
+  T *obj_ = nullptr;
+
+  static T *object_addr(void *buf) noexcept {
+    auto __addr = reinterpret_cast<uintptr_t>(buf) + sizeof(object_meta_t);
+    __addr = (__addr + alignof(T) - 1) & ~(uintptr_t(alignof(T)) - 1);
+    return reinterpret_cast<T *>(__addr);
+  }
+
+  template <typename... Args>
+  void create(std::string_view name, std::error_code &ec, Args &&...args) {
+    this->hdl_ = shmhdl(name, required_nbytes, ec);
+    if (ec) {
+      return;
+    }
+    void *__buf = this->hdl_.map(ec);
+    if (ec) {
+      this->hdl_ = shmhdl();
+      return;
+    }
+    auto __meta = new (__buf) object_meta_t;
+    this->obj_ = new (object_addr(__buf)) T(std::forward<Args>(args)...);
+    __meta->layout_hash_ = layout_hash;
+    __meta->state_.store(detail::READY, std::memory_order_release);
+  }
+
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept {
+    this->hdl_ = shmhdl(name, ec);
+    if (ec) {
+      return;
+    }
+    void *__buf = this->hdl_.map(ec);
+    if (ec) {
+      this->hdl_ = shmhdl();
+      return;
+    }
+    // the creator sizes the segment before anything else, a segment of
+    // another size is not one of ours
+    if (this->hdl_.nbytes() != required_nbytes) {
+      ec = IPCErrc::ShmLayoutMismatch;
+      this->hdl_ = shmhdl();
+      return;
+    }
+    auto __meta = reinterpret_cast<object_meta_t *>(__buf);
+    // wait for the creator to finish constructing T
+    if (!detail::wait_ready(__meta->state_, timeout)) {
+      ec = IPCErrc::ShmNotInitialized;
+      this->hdl_ = shmhdl();
+      return;
+    }
+    if (__meta->layout_hash_ != layout_hash) {
+      ec = IPCErrc::ShmLayoutMismatch;
+      this->hdl_ = shmhdl();
+      return;
+    }
+    this->obj_ = object_addr(__buf);
+  }
+
+public:
+  /**
+   * @brief compile-time hash of T's layout
+   *
+   */
+  static constexpr uint64_t layout_hash = detail::layout_hash<T>();
+
+  /**
+   * @brief create an empty shm_object
+   *
+   */
+  shm_object() noexcept = default;
+
+  /**
+   * @brief create a new shared memory object and construct T in it
+   *
+   * @param name
+   * @param ec
+   * @param args arguments forwarded to T's constructor
+   */
+  template <typename... Args>
+  shm_object(create_only_t, std::string_view name, std::error_code &ec,
+             Args &&...args) noexcept {
+    static_assert(std::is_nothrow_constructible_v<T, Args...>,
+                  "use the throwing constructor for a throwing T constructor");
+    this->create(name, ec, std::forward<Args>(args)...);
+  }
+  template <typename... Args>
+  shm_object(create_only_t, std::string_view name, Args &&...args) {
+    std::error_code ec;
+    this->create(name, ec, std::forward<Args>(args)...);
+    detail::throw_if(ec);
+  }
+
+  /**
+   * @brief attach to an existing shm_object, waiting at most timeout for its
+   * creator to finish constructing T
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  shm_object(open_only_t, std::string_view name, std::error_code &ec,
+             std::chrono::milliseconds timeout =
+                 std::chrono::milliseconds(1000)) noexcept {
+    this->attach(name, ec, timeout);
+  }
+  shm_object(open_only_t, std::string_view name,
+             std::chrono::milliseconds timeout =
+                 std::chrono::milliseconds(1000)) {
+    std::error_code ec;
+    this->attach(name, ec, timeout);
+    detail::throw_if(ec);
+  }
+
+  shm_object(shm_object &&other) noexcept
+      : hdl_(std::move(other.hdl_)),
+        obj_(std::exchange(other.obj_, nullptr)) {}
+  shm_object &operator=(shm_object &&other) noexcept {
+    if (this != &other) {
+      this->hdl_ = std::move(other.hdl_);
+      this->obj_ = std::exchange(other.obj_, nullptr);
+    }
+    return *this;
+  }
+
+  T *get() const noexcept { return this->obj_; }
+  T *operator->() const noexcept { return this->obj_; }
+  T &operator*() const noexcept { return *this->obj_; }
+
+  /**
+   * @brief the underlying shared memory handle
+   *
+   * @return const shmhdl&
+   */
+  const shmhdl &handle() const noexcept { return this->hdl_; }
+
+  bool valid() const noexcept { return this->obj_ != nullptr; }
+  explicit operator bool() const noexcept { return this->valid(); }
+};
+} // namespace ipc
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+/**
+ * @brief counters of a shm_pool
+ *
+ */
+struct pool_stats_t {
+  /**
+   * @brief acquire() served by a spare segment
+   *
+   */
+  uint64_t hits_;
+  /**
+   * @brief acquire() that had to create the segment itself
+   *
+   */
+  uint64_t misses_;
+  /**
+   * @brief segments taken back by recycle()
+   *
+   */
+  uint64_t recycled_;
+};
+
+/**
+ * @brief keeps spare shared memory objects of a few size classes ready, so
+ * that getting a new segment does not pay for shm_open(), ftruncate(), mmap()
+ * and the page faults zero filling it
+ * @details the spares are created, sized, mapped and prefaulted ahead of time
+ * by fill() or by the background thread started with start(). acquire()
+ * takes the spare of the smallest size class that fits and renames it, which
+ * is a link() in /dev/shm; processes attach to the new name with a plain
+ * shmhdl. Segments whose last user is done can be handed back to recycle(),
+ * they are zeroed in the background and reused instead of unlinked.
+ *
+ * The pool belongs to one process, the spares are unlinked when it is
+ * destroyed. It is thread safe. POSIX only; renaming needs the shm_open()
+ * names to be files of /dev/shm, i.e. Linux, elsewhere acquire() with a name
+ * creates the segment and recycle() refuses every segment.
+ */
+class shm_pool {
+private:
+  struct class_t {
+    shmsz_t nbytes_;
+    std::vector<shmhdl> spares_;
+    /**
+     * @brief spares being created right now
+     *
+     */
+    size_t pending_;
+  };
+
+  std::string prefix_;
+  size_t depth_ = 0;
+  std::vector<class_t> classes_;
+  /**
+   * @brief recycled segments waiting to be zeroed
+   *
+   */
+  std::vector<shmhdl> dirty_;
+  std::atomic<uint64_t> seq_{0};
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> recycled_{0};
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::thread worker_;
+  bool running_ = false;
+  std::error_code last_ec_;
+
+  void init(std::string_view prefix, std::vector<shmsz_t> classes,
+            size_t depth, std::error_code &ec) noexcept;
+  std::string next_name();
+  class_t *class_of(shmsz_t nbytes) noexcept;
+  bool idle() const noexcept;
+  shmhdl make_spare(shmsz_t nbytes, std::error_code &ec) noexcept;
+  void replenish(std::error_code &ec) noexcept;
+
+public:
+  /**
+   * @brief create a pool keeping depth spares of each size class
+   *
+   * @param prefix the spares are named "<prefix>.<pid>.<n>"
+   * @param classes buffer sizes of the spares
+   * @param depth
+   * @param ec
+   */
+  shm_pool(std::string_view prefix, std::vector<shmsz_t> classes,
+           size_t depth, std::error_code &ec) noexcept;
+  shm_pool(std::string_view prefix, std::vector<shmsz_t> classes,
+           size_t depth);
+  ~shm_pool();
+
+  shm_pool(const shm_pool &) = delete;
+  shm_pool &operator=(const shm_pool &) = delete;
+
+  /**
+   * @brief get a segment of at least nbytes named name
+   * @details the segment is a zeroed spare of the smallest size class that
+   * fits, already mapped in this process; its nbytes() is the one of the
+   * class. Without such a spare the segment is created as shmhdl(name,
+   * nbytes) would. Fails with EEXIST if name is taken.
+   *
+   * @param name
+   * @param nbytes
+   * @param ec
+   * @return shmhdl
+   */
+  shmhdl acquire(std::string_view name, shmsz_t nbytes,
+                 std::error_code &ec) noexcept;
+  shmhdl acquire(std::string_view name, shmsz_t nbytes);
+  /**
+   * @brief get a segment of at least nbytes under a name made up by the pool,
+   * for segments passed around by fd() or by name()
+   *
+   * @param nbytes
+   * @param ec
+   * @return shmhdl
+   */
+  shmhdl acquire(shmsz_t nbytes, std::error_code &ec) noexcept;
+  shmhdl acquire(shmsz_t nbytes);
+  /**
+   * @brief take back a segment nobody else is attached to
+   * @details the segment is renamed right away, so its name can be used
+   * again, and zeroed before it is handed out again. Segments of a size no
+   * class has, persistent or read only handles and segments other handles
+   * are still attached to are refused. Once the segment is taken no handle
+   * can attach to it anymore: a process that opened the old name just
+   * before fails with ShmDeleted instead of sharing a reused buffer.
+   *
+   * @param hdl left empty if the segment was taken
+   * @return true if the segment was taken
+   */
+  bool recycle(shmhdl &hdl) noexcept;
+
+  /**
+   * @brief zero the recycled segments and create the missing spares now,
+   * in the calling thread
+   *
+   * @param ec
+   */
+  void fill(std::error_code &ec) noexcept;
+  void fill();
+  /**
+   * @brief keep the pool filled from a background thread, woken whenever a
+   * spare is taken or a segment recycled
+   *
+   */
+  void start();
+  /**
+   * @brief stop the background thread
+   *
+   */
+  void stop() noexcept;
+  /**
+   * @brief error of the last background fill
+   *
+   * @return std::error_code
+   */
+  std::error_code last_error() noexcept;
+
+  /**
+   * @brief spares ready for a segment of nbytes
+   *
+   * @param nbytes
+   * @return size_t
+   */
+  size_t spares(shmsz_t nbytes) const noexcept;
+  pool_stats_t stats() const noexcept;
+};
+} // namespace ipc
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+#include "futex.hpp"
+#include "shm_object.hpp"
+
+namespace ipc {
+/**
+ * @brief who goes first when readers and a writer compete for a shm_rwlock
+ *
+ */
+enum class rw_prefer {
+  /**
+   * @brief a waiting writer keeps new readers out, readers can not starve it
+   *
+   */
+  writer,
+  /**
+   * @brief readers keep coming in until the writer actually holds the lock,
+   * a writer may starve under a steady stream of readers
+   *
+   */
+  reader,
+};
+
+/**
+ * @brief reader-writer lock living in a shared memory object
+ * @details readers do not share a counter: each one announces itself in one
+ * of up to MAX_SLOTS reader indicators, picked by hashing the calling thread
+ * and each on its own cache line, so readers on different cores do not
+ * bounce a cache line between them. A writer first takes the writer word,
+ * which serializes writers and tells readers to back off, and then waits for
+ * every indicator to drain. The price is a write lock that scans all the
+ * indicators, which suits read-mostly data.
+ *
+ * Both sides spin briefly and then sleep on a futex. The lock is not
+ * recursive, and it is not robust: a process dying while holding it leaves
+ * it held. On a rwlock that is not valid() the lock calls do nothing and the
+ * try_ ones fail.
+ */
+class shm_rwlock {
+public:
+  static constexpr uint32_t MAX_SLOTS = 64;
+
+private:
+  struct alignas(64) slot_t {
+    std::atomic<uint32_t> readers_{0};
+  };
+
+  struct state_t {
+    uint32_t nslots_;
+    rw_prefer prefer_;
+    /**
+     * @brief FREE, PENDING or HELD, readers and writers sleep on it
+     *
+     */
+    alignas(64) std::atomic<uint32_t> writer_{0};
+    std::atomic<uint32_t> sleepers_{0};
+    /**
+     * @brief bumped by readers leaving while a writer waits, the writer
+     * sleeps on it
+     *
+     */
+    alignas(64) std::atomic<uint32_t> drain_{0};
+    slot_t slots_[MAX_SLOTS];
+
+    state_t(uint32_t nslots, rw_prefer prefer) noexcept
+        : nslots_(nslots), prefer_(prefer) {}
+  };
+
+  shm_object<state_t> obj_;
+
+  std::atomic<uint32_t> &slot() const noexcept;
+  bool readers_gone() const noexcept;
+  bool enter_shared(std::atomic<uint32_t> &slot) noexcept;
+  void leave_shared(std::atomic<uint32_t> &slot) noexcept;
+  void wait_writer(bool any) noexcept;
+  void wait_drain() noexcept;
+  void release(uint32_t writer) noexcept;
+
+public:
+  shm_rwlock() noexcept = default;
+  /**
+   * @brief create an unlocked rwlock
+   *
+   * @param name
+   * @param ec
+   * @param nslots reader indicators, between 1 and MAX_SLOTS; about the
+   * number of cores the readers run on
+   * @param prefer
+   */
+  shm_rwlock(create_only_t, std::string_view name, std::error_code &ec,
+             uint32_t nslots = MAX_SLOTS,
+             rw_prefer prefer = rw_prefer::writer) noexcept;
+  shm_rwlock(create_only_t, std::string_view name, uint32_t nslots = MAX_SLOTS,
+             rw_prefer prefer = rw_prefer::writer);
+  /**
+   * @brief attach to an existing rwlock
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  shm_rwlock(open_only_t, std::string_view name, std::error_code &ec,
+             std::chrono::milliseconds timeout =
+                 std::chrono::milliseconds(1000)) noexcept;
+  shm_rwlock(open_only_t, std::string_view name,
+             std::chrono::milliseconds timeout =
+                 std::chrono::milliseconds(1000));
+
+  shm_rwlock(shm_rwlock &&) noexcept = default;
+  shm_rwlock &operator=(shm_rwlock &&) noexcept = default;
+
+  void lock() noexcept;
+  bool try_lock() noexcept;
+  void unlock() noexcept;
+
+  /**
+   * @brief the calling thread must unlock_shared() on this same thread
+   *
+   */
+  void lock_shared() noexcept;
+  bool try_lock_shared() noexcept;
+  void unlock_shared() noexcept;
+
+  uint32_t nslots() const noexcept;
+  rw_prefer prefer() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
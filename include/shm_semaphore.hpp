@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <initializer_list>
+#include <string_view>
+
+#include "futex.hpp"
+#include "shm_object.hpp"
+
+namespace ipc {
+/**
+ * @brief counting semaphore living in a shared memory object
+ * @details unlike semhdl, the count is a futex word the library owns, so a
+ * process can sleep on several semaphores at once with wait_any() instead of
+ * polling them in turn with try_wait(). post() and an uncontended wait stay
+ * in user space; waiters spin briefly before going to sleep.
+ */
+class shm_semaphore {
+private:
+  struct state_t {
+    alignas(64) std::atomic<uint32_t> count_;
+    /**
+     * @brief waiters asleep on count_, wait_any() ones included
+     *
+     */
+    std::atomic<uint32_t> sleepers_{0};
+
+    explicit state_t(uint32_t value) noexcept : count_(value) {}
+  };
+
+  shm_object<state_t> obj_;
+
+  bool take() noexcept;
+
+  friend int wait_any(shm_semaphore *const *sems, size_t n,
+                      std::chrono::nanoseconds timeout,
+                      std::error_code &ec) noexcept;
+
+public:
+  shm_semaphore() noexcept = default;
+  /**
+   * @brief create a semaphore with an initial count
+   *
+   * @param name
+   * @param value
+   * @param ec
+   */
+  shm_semaphore(create_only_t, std::string_view name, uint32_t value,
+                std::error_code &ec) noexcept;
+  shm_semaphore(create_only_t, std::string_view name, uint32_t value);
+  /**
+   * @brief attach to an existing semaphore
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  shm_semaphore(open_only_t, std::string_view name, std::error_code &ec,
+                std::chrono::milliseconds timeout =
+                    std::chrono::milliseconds(1000)) noexcept;
+  shm_semaphore(open_only_t, std::string_view name,
+                std::chrono::milliseconds timeout =
+                    std::chrono::milliseconds(1000));
+
+  shm_semaphore(shm_semaphore &&) noexcept = default;
+  shm_semaphore &operator=(shm_semaphore &&) noexcept = default;
+
+  /**
+   * @brief increase the count, waking a waiter if one is asleep; does
+   * nothing on an invalid semaphore
+   *
+   */
+  void post() noexcept;
+  /**
+   * @brief decrease the count, waiting at most timeout for it to be positive
+   *
+   * @param timeout
+   * @return false on timeout
+   */
+  bool wait(std::chrono::nanoseconds timeout = FOREVER) noexcept;
+  /**
+   * @brief decrease the count if it is positive
+   *
+   * @return false if it is not
+   */
+  bool try_wait() noexcept;
+
+  uint32_t value() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+
+/**
+ * @brief decrease the count of whichever of the semaphores gets positive
+ * first, waiting at most timeout
+ * @details the first of the semaphores that are ready is taken, or the one
+ * whose post() woke the caller if it is still ready. Fails with
+ * EINVAL if a semaphore is not valid or there are more than
+ * FUTEX_WAIT_ANY_MAX of them.
+ *
+ * @param sems
+ * @param n
+ * @param timeout
+ * @param ec
+ * @return int the index of the semaphore taken, -1 on timeout or error
+ */
+int wait_any(shm_semaphore *const *sems, size_t n,
+             std::chrono::nanoseconds timeout, std::error_code &ec) noexcept;
+int wait_any(shm_semaphore *const *sems, size_t n,
+             std::chrono::nanoseconds timeout = FOREVER);
+int wait_any(std::initializer_list<shm_semaphore *> sems,
+             std::chrono::nanoseconds timeout = FOREVER);
+} // namespace ipc
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+#include "ec.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+/**
+ * @brief type of the values of a shm_table column, NONE is the type of a
+ * column that does not exist
+ *
+ */
+enum class column_type : uint32_t { INT32, INT64, FLOAT32, FLOAT64, NONE };
+
+template <typename T> struct column_type_of;
+template <> struct column_type_of<int32_t> {
+  static constexpr column_type value = column_type::INT32;
+};
+template <> struct column_type_of<int64_t> {
+  static constexpr column_type value = column_type::INT64;
+};
+template <> struct column_type_of<float> {
+  static constexpr column_type value = column_type::FLOAT32;
+};
+template <> struct column_type_of<double> {
+  static constexpr column_type value = column_type::FLOAT64;
+};
+
+/**
+ * @brief name and type of a column, the name is at most
+ * shm_table::MAX_COLUMN_NAME bytes
+ *
+ */
+struct column_def {
+  std::string_view name_;
+  column_type type_;
+};
+
+/**
+ * @brief append-only table stored column by column in a shared memory object
+ * @details every column is a plain array of capacity values starting on a
+ * cache line, so readers scan it in place, e.g. with the kernels of
+ * column_scan.hpp, and any number of processes share one copy of the data.
+ *
+ * A single writer fills the rows past rows() through column(), then commit()s
+ * them: the row count is published with release semantics, the rows below
+ * rows() are complete and never change. Readers load rows() once and scan up
+ * to it while the writer goes on appending.
+ */
+class shm_table {
+public:
+  static constexpr size_t MAX_COLUMNS = 64;
+  static constexpr size_t MAX_COLUMN_NAME = 31;
+  static constexpr size_t npos = size_t(-1);
+
+private:
+  struct table_meta_t;
+  struct column_desc_t;
+
+  shmhdl hdl_;
+  table_meta_t *meta_ = nullptr;
+  column_desc_t *columns_ = nullptr;
+  char *base_ = nullptr;
+
+  void create(std::string_view name, const std::vector<column_def> &columns,
+              size_t capacity, std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept;
+  void *data(size_t col, column_type type) const noexcept;
+
+public:
+  shm_table() noexcept = default;
+  /**
+   * @brief create an empty table
+   *
+   * @param name
+   * @param columns at most MAX_COLUMNS, with distinct names
+   * @param capacity rows the table can hold
+   * @param ec
+   */
+  shm_table(create_only_t, std::string_view name,
+            const std::vector<column_def> &columns, size_t capacity,
+            std::error_code &ec) noexcept;
+  shm_table(create_only_t, std::string_view name,
+            const std::vector<column_def> &columns, size_t capacity);
+  /**
+   * @brief attach to an existing table
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  shm_table(open_only_t, std::string_view name, std::error_code &ec,
+            std::chrono::milliseconds timeout =
+                std::chrono::milliseconds(1000)) noexcept;
+  shm_table(open_only_t, std::string_view name,
+            std::chrono::milliseconds timeout =
+                std::chrono::milliseconds(1000));
+
+  shm_table(shm_table &&other) noexcept;
+  shm_table &operator=(shm_table &&other) noexcept;
+
+  /**
+   * @brief values of column col
+   *
+   * @tparam T the type of the column
+   * @param col
+   * @return T* nullptr if col is out of range or not of type T
+   */
+  template <typename T> T *column(size_t col) noexcept {
+    return static_cast<T *>(this->data(col, column_type_of<T>::value));
+  }
+  template <typename T> const T *column(size_t col) const noexcept {
+    return static_cast<const T *>(this->data(col, column_type_of<T>::value));
+  }
+  /**
+   * @brief index of the column called name
+   *
+   * @param name
+   * @return size_t npos if there is none
+   */
+  size_t find(std::string_view name) const noexcept;
+  std::string_view column_name(size_t col) const noexcept;
+  /**
+   * @brief type of the values of column col
+   *
+   * @param col
+   * @return column_type NONE if there is no such column
+   */
+  column_type type(size_t col) const noexcept;
+  size_t ncolumns() const noexcept;
+
+  /**
+   * @brief writer: publish the next nrows rows, whose values are written
+   * already
+   * @details fails with IPCErrc::TableFull past capacity().
+   *
+   * @param nrows
+   * @param ec
+   */
+  void commit(size_t nrows, std::error_code &ec) noexcept;
+  void commit(size_t nrows);
+  /**
+   * @brief rows published so far
+   *
+   * @return size_t
+   */
+  size_t rows() const noexcept;
+  size_t capacity() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
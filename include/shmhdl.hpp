@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.hpp"
+#include "proc_id.hpp"
 #include <atomic>
 #include <string_view>
 
@@ -24,9 +25,189 @@ enum class SHM_STATUS : size_t {
    *
    */
   DEL = 1,
+  /**
+   * @brief taken back by a shm_pool
+   * @details the object is renamed and about to be reused, attaching to it
+   * fails with ShmDeleted.
+   *
+   */
+  RETIRED = 2,
+};
+
+/**
+ * @brief expected access pattern of a range of a segment, see
+ * shmhdl::advise()
+ *
+ */
+enum class SHM_ADVICE {
+  /**
+   * @brief no particular pattern, undoes the other hints
+   *
+   */
+  NORMAL,
+  /**
+   * @brief the range will be accessed soon, fault it in ahead of time
+   *
+   */
+  WILLNEED,
+  /**
+   * @brief the range will be read front to back, read ahead aggressively and
+   * drop pages behind the reader
+   *
+   */
+  SEQUENTIAL,
+  /**
+   * @brief the range will be accessed randomly, do not read ahead
+   *
+   */
+  RANDOM,
+  /**
+   * @brief the range is not needed by this process anymore, unmap its pages
+   * here; other processes and the content are not affected
+   *
+   */
+  DONTNEED,
+  /**
+   * @brief free the memory (or disk blocks) backing the range, its content
+   * reads back as zeros everywhere
+   *
+   */
+  REMOVE,
+  /**
+   * @brief the range is cold, reclaim its pages first under memory pressure
+   *
+   */
+  COLD,
+  /**
+   * @brief reclaim the range's pages now (write them to swap or the backing
+   * file), the content is kept
+   *
+   */
+  PAGEOUT,
+};
+
+/**
+ * @brief how a handle maps the buffer of a shared memory object
+ *
+ */
+enum class SHM_ACCESS {
+  /**
+   * @brief shared, readable and writable mapping
+   *
+   */
+  READ_WRITE,
+  /**
+   * @brief shared, read only mapping: a stray write faults instead of
+   * corrupting the segment, and the kernel does not track dirty pages
+   *
+   */
+  READ_ONLY,
+  /**
+   * @brief private, writable mapping: pages are copied on the first write to
+   * them, the writes are never seen by other handles nor written back
+   *
+   */
+  COPY_ON_WRITE,
 };
 
+class shmhdl;
+
+/**
+ * @brief a window onto part of a shared memory object, made by
+ * shmhdl::map_range()
+ * @details only the pages overlapping the window are mapped, so a process
+ * working on a slice of a very large segment does not pay for mapping all of
+ * it. Copies of a view share its mapping, which is unmapped when the last
+ * copy is destroyed; a view stays usable after the handle that made it is
+ * released.
+ */
+class shmview {
+private:
+  /**
+   * @brief shared by the copies of a view
+   *
+   */
+  struct block_t {
+    std::atomic_size_t refs_;
+    void *base_;
+    size_t len_;
+  };
+
+  block_t *block_ = nullptr;
+  char *data_ = nullptr;
+  shmsz_t offset_ = 0;
+  shmsz_t nbytes_ = 0;
+
+  friend class shmhdl;
+  shmview(block_t *block, char *data, shmsz_t offset, shmsz_t nbytes) noexcept;
+
+public:
+  /**
+   * @brief create an empty view
+   *
+   */
+  shmview() noexcept = default;
+  ~shmview();
+  shmview(const shmview &other) noexcept;
+  shmview &operator=(const shmview &other) noexcept;
+  shmview(shmview &&other) noexcept;
+  shmview &operator=(shmview &&other) noexcept;
+
+  /**
+   * @brief drop this view's reference to the mapping, leaving it empty
+   *
+   */
+  void reset() noexcept;
+
+  /**
+   * @brief address of the first byte of the window
+   *
+   * @return void*
+   */
+  void *data() const noexcept;
+  /**
+   * @brief offset of the window in the buffer (meta exclude)
+   *
+   * @return shmsz_t
+   */
+  shmsz_t offset() const noexcept;
+  /**
+   * @brief size of the window
+   *
+   * @return shmsz_t
+   */
+  shmsz_t nbytes() const noexcept;
+  /**
+   * @brief hint the kernel how the window will be accessed, see
+   * shmhdl::advise()
+   *
+   * @param advice
+   * @param ec
+   */
+  void advise(SHM_ADVICE advice, std::error_code &ec) const noexcept;
+  void advise(SHM_ADVICE advice) const;
+  /**
+   * @brief number of views sharing this mapping, 0 if the view is empty
+   *
+   * @return size_t
+   */
+  size_t use_count() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+
+class shm_pool;
+
 class shmhdl {
+  friend class shm_pool;
+
+public:
+  /**
+   * @brief handles attached to a shared memory object at the same time, all
+   * processes together
+   *
+   */
+  static constexpr size_t MAX_ATTACHERS = 504;
 
 private:
   /**
@@ -34,48 +215,154 @@ private:
    * @details the meta info will be store at the begining of the shared memory
    * object.
    * memory layout might look like this:
-   *  | shm_status | ref_count | size | mutex| buffer |
+   *  | magic | shm_status | size | nattached | pidns | attachers | buffer |
+   * The meta is 4096 bytes long, the buffer starts on a page boundary.
    */
   struct shm_meta_t {
-    SHM_STATUS status_;
-    std::atomic_size_t ref_count_;
+    uint64_t magic_;
+    std::atomic<SHM_STATUS> status_;
     shmsz_t shmsz_;
+    /**
+     * @brief slots taken in attachers_, live or not, so that ref_count()
+     * does not scan them
+     *
+     */
+    std::atomic<uint32_t> nattached_;
+    /**
+     * @brief pid namespace of the attached processes, PIDNS_MIXED once
+     * processes of two namespaces attached
+     *
+     */
+    std::atomic<uint64_t> pidns_;
+    /**
+     * @brief one slot per attached handle, holding the process of the handle
+     * or nothing
+     * @details unlike a counter, a slot left behind by a process that crashed
+     * is recognized as such and released by the other handles.
+     */
+    alignas(64) std::atomic<proc_id> attachers_[MAX_ATTACHERS];
   };
+  static_assert(sizeof(shm_meta_t) == 4096, "shm_meta_t must fill a page");
+
+  /**
+   * @brief identifies an initialized shared memory object, checked when a
+   * persistent segment is reopened
+   *
+   */
+  static constexpr uint64_t SHM_MAGIC = 0x0003'4d48'5343'5049; // "IPCSHM" v3
+  static constexpr uint32_t NO_SLOT = uint32_t(-1);
+  static constexpr uint64_t PIDNS_MIXED = uint64_t(-1);
 
 #ifdef __POSIX__
   /**
    * @brief shared memory object file descriptor
    * @details this is only availible for POSIX supported platforms. User can use
-   * it with posix APIs;
+   * it with posix APIs; -1 if the handle is empty.
    */
-  int fd_;
+  int fd_ = -1;
 #endif
 
 #ifdef __WIN32__
-  HANDLE hMapFile_;
+  HANDLE hMapFile_ = nullptr;
 #endif
 
   /**
-   * @brief shm_handle's name
+   * @brief shm_handle's name, stored inline
+   *
+   */
+  char name_[MAX_NAME_LEN + 1] = {};
+
+  /**
+   * @brief size of the shared memory buffer (meta exclude)
+   * @details cached from shm_meta_t so that nbytes() never touches the
+   * shared memory object.
+   */
+  shmsz_t shmsz_ = 0;
+
+  /**
+   * @brief whether the segment is backed by a regular file
    *
    */
-  std::string name_;
+  bool persistent_ = false;
+
+  /**
+   * @brief how map() and map_range() map the buffer
+   *
+   */
+  SHM_ACCESS access_ = SHM_ACCESS::READ_WRITE;
 
   /**
    * @brief shared memory buffer ptr
    *
    */
-  void *addr_;
+  void *addr_ = nullptr;
 
   /**
    * @brief shared memory meta ptr
    *
    */
-  shm_meta_t *meta_;
+  shm_meta_t *meta_ = nullptr;
 
+  /**
+   * @brief the slot of the handle in shm_meta_t::attachers_
+   *
+   */
+  uint32_t slot_ = NO_SLOT;
+
+  void create(std::string_view name, const shmsz_t nbytes,
+              std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec) noexcept;
+  void open_persistent(std::string_view path, const shmsz_t nbytes,
+                       std::error_code &ec) noexcept;
+  void release() noexcept;
   void unmap_meta(std::error_code &ec) noexcept;
+  /**
+   * @brief take a slot of the attachers table for the calling process,
+   * reclaiming the slots of dead processes if none is free
+   *
+   */
+  bool join() noexcept;
+  /**
+   * @brief give the handle's slot back
+   *
+   * @return true if no live handle is left, the caller removes the object
+   */
+  bool leave() noexcept;
+#ifdef __POSIX__
+  int map_prot() const noexcept;
+  int map_flags() const noexcept;
+  /**
+   * @brief give the shared memory object another name, failing with EEXIST if
+   * the name is taken; attached handles keep working
+   *
+   */
+  void rename(std::string_view name, std::error_code &ec) noexcept;
+  /**
+   * @brief rename the object and mark it RETIRED, provided no other handle is
+   * attached
+   * @details the object is marked before the others are counted, and an
+   * attaching handle joins before it checks the mark: either this sees the
+   * other handle or the other handle fails. Once it returns true no handle
+   * can attach anymore, not even one that opened the old name earlier.
+   *
+   * @return false if another handle is attached or on error, the object
+   * is left as it was
+   */
+  bool retire(std::string_view name, std::error_code &ec) noexcept;
+  /**
+   * @brief let handles attach to a retired object again
+   *
+   */
+  void revive() noexcept;
+#endif
 
 public:
+  /**
+   * @brief create an empty handle
+   * @details an empty handle owns nothing, it is also the state a handle is
+   * left in after being moved from.
+   */
+  shmhdl() noexcept = default;
   /**
    * @brief create a new shared memory object with given size
    *
@@ -92,9 +379,54 @@ public:
    */
   shmhdl(std::string_view name, std::error_code &ec) noexcept;
   shmhdl(std::string_view name);
+  /**
+   * @brief attach to a existing shared memory object, map() and map_range()
+   * then map its buffer according to access
+   * @details the meta info stays writable, so the reference counting works
+   * the same for every access mode.
+   *
+   * @param name
+   * @param access
+   * @param ec
+   */
+  shmhdl(std::string_view name, SHM_ACCESS access,
+         std::error_code &ec) noexcept;
+  shmhdl(std::string_view name, SHM_ACCESS access);
+  /**
+   * @brief create or reopen a shared memory object backed by the regular file
+   * at path
+   * @details the file (on any filesystem, DAX-capable ones included) outlives
+   * all handles and reboots, so a restarted process maps its previous state
+   * instead of rebuilding it. A new file is sized to nbytes; an existing one
+   * keeps its content and grows to nbytes if it is smaller and nobody else
+   * has it open. The file is not removed when the last handle is released,
+   * only by unlink(). Use sync() to checkpoint the content to the disk.
+   *
+   * @param path
+   * @param nbytes
+   * @param ec
+   */
+  shmhdl(persistent_t, std::string_view path, const shmsz_t nbytes,
+         std::error_code &ec) noexcept;
+  shmhdl(persistent_t, std::string_view path, const shmsz_t nbytes);
   ~shmhdl();
 
   shmhdl(const shmhdl &) = delete;
+  shmhdl &operator=(const shmhdl &) = delete;
+  /**
+   * @brief take over other's shared memory object, other is left empty
+   *
+   * @param other
+   */
+  shmhdl(shmhdl &&other) noexcept;
+  /**
+   * @brief detach from the current shared memory object (as the destructor
+   * does) and take over other's, other is left empty
+   *
+   * @param other
+   * @return shmhdl&
+   */
+  shmhdl &operator=(shmhdl &&other) noexcept;
 
   /**
    * @brief map shared memory object into current process
@@ -105,6 +437,20 @@ public:
    */
   void *map(std::error_code &ec) noexcept;
   void *map();
+  /**
+   * @brief map only nbytes of the buffer from offset on
+   * @details the mapping is widened to whole pages (to the allocation
+   * granularity on Win32) and independent of map(), a handle may hand out any
+   * number of views.
+   *
+   * @param offset
+   * @param nbytes
+   * @param ec
+   * @return shmview
+   */
+  shmview map_range(shmsz_t offset, shmsz_t nbytes,
+                    std::error_code &ec) noexcept;
+  shmview map_range(shmsz_t offset, shmsz_t nbytes);
   /**
    * @brief unmap shared memory object from current process.
    *
@@ -119,6 +465,56 @@ public:
    */
   void unlink(std::error_code &ec) noexcept;
   void unlink();
+  /**
+   * @brief write the modified content of the mapped segment back to its
+   * backing file and wait for it to reach the disk (msync)
+   * @details this is the checkpoint of a persistent segment, for tmpfs backed
+   * segments it is a no-op.
+   *
+   * @param ec
+   */
+  void sync(std::error_code &ec) noexcept;
+  void sync();
+  /**
+   * @brief sync nbytes of the buffer from offset on, the range is widened to
+   * whole pages. The segment must be mapped.
+   *
+   * @param offset
+   * @param nbytes
+   * @param ec
+   */
+  void sync(shmsz_t offset, shmsz_t nbytes, std::error_code &ec) noexcept;
+  void sync(shmsz_t offset, shmsz_t nbytes);
+
+  /**
+   * @brief hint the kernel how nbytes of the buffer from offset on will be
+   * accessed (madvise)
+   * @details the segment must be mapped. Hints that drop content
+   * (SHM_ADVICE::DONTNEED, SHM_ADVICE::REMOVE) only apply to the pages lying
+   * entirely inside the range, the other hints to every page it overlaps.
+   * SHM_ADVICE::REMOVE is what returns an idle buffer's memory to the system,
+   * SHM_ADVICE::DONTNEED only unmaps it from this process.
+   *
+   * @param offset
+   * @param nbytes
+   * @param advice
+   * @param ec
+   */
+  void advise(shmsz_t offset, shmsz_t nbytes, SHM_ADVICE advice,
+              std::error_code &ec) noexcept;
+  void advise(shmsz_t offset, shmsz_t nbytes, SHM_ADVICE advice);
+  /**
+   * @brief start reading nbytes of the buffer from offset on into the page
+   * cache in the background, without waiting for it
+   * @details meant for persistent segments, prewarms a range before it is
+   * mapped or touched.
+   *
+   * @param offset
+   * @param nbytes
+   * @param ec
+   */
+  void readahead(shmsz_t offset, shmsz_t nbytes, std::error_code &ec) noexcept;
+  void readahead(shmsz_t offset, shmsz_t nbytes);
 
   /**
    * @brief size of shared memory object (meta exclude)
@@ -139,11 +535,42 @@ public:
    */
   void *addr() const noexcept;
   /**
-   * @brief Reference count of current shared memory object
+   * @brief Reference count of current shared memory object: the handles
+   * attached to it, 0 if the handle is empty
+   * @details a single load. The handles of processes that died without
+   * releasing them are counted until reclaim() drops them; attaching to a
+   * full object and releasing the last live handle reclaim too.
    *
-   * @return const size_t&
+   * @return size_t
    */
   size_t ref_count() const noexcept;
+  /**
+   * @brief drop the handles of processes that are gone
+   * @details checks every process holding a handle, i.e. reads /proc on
+   * Linux. The processes of another pid namespace can not be checked: once
+   * processes of two namespaces attached to the object, nothing is reclaimed
+   * anymore and the handles of crashed processes keep it alive.
+   *
+   * @return size_t the number of handles dropped
+   */
+  size_t reclaim() noexcept;
+  /**
+   * @brief whether the segment is backed by a regular file
+   *
+   */
+  bool persistent() const noexcept;
+  /**
+   * @brief how the buffer is mapped
+   *
+   * @return SHM_ACCESS
+   */
+  SHM_ACCESS access() const noexcept;
+  /**
+   * @brief whether the handle refers to a shared memory object
+   *
+   */
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
 
 #ifdef __WIN32__
   /**
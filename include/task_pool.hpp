@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+
+#include "common.hpp"
+#include "ec.hpp"
+#include "futex.hpp"
+#include "shmhdl.hpp"
+
+namespace ipc {
+/**
+ * @brief work-stealing scheduler for a pool of worker processes
+ * @details the shared memory object holds one Chase-Lev deque per worker and
+ * one injection queue. A task is a 64 bit word, typically an index into a job
+ * table kept in another shared memory object.
+ *
+ * A worker pushes the tasks it spawns onto the bottom of its own deque and
+ * takes them back from there (LIFO, cache friendly). Any process may submit()
+ * tasks to the injection queue. A worker out of work first drains the
+ * injection queue, then steals from the top of the other workers' deques
+ * (FIFO, i.e. the oldest, usually largest tasks), and when there is nothing to
+ * steal either it spins briefly then parks on a futex until a task is pushed.
+ *
+ * Worker i must be driven by a single thread; push(), take() and wait() with
+ * index i are only called by that thread.
+ */
+class task_pool {
+private:
+  struct pool_meta_t;
+  struct deque_t;
+  struct cell_t;
+
+  shmhdl hdl_;
+  pool_meta_t *meta_ = nullptr;
+  char *deques_ = nullptr;
+  cell_t *cells_ = nullptr;
+  /**
+   * @brief state of the victim picker of this process
+   *
+   */
+  uint64_t rng_ = 0x9e3779b97f4a7c15ull;
+
+  void create(std::string_view name, uint32_t nworkers, uint32_t capacity,
+              std::error_code &ec) noexcept;
+  void attach(std::string_view name, std::error_code &ec,
+              std::chrono::milliseconds timeout) noexcept;
+  deque_t *deque_at(uint32_t worker) const noexcept;
+  bool pop_injected(uint64_t &task) noexcept;
+  bool steal(uint32_t thief, uint64_t &task) noexcept;
+  bool has_work() const noexcept;
+  void notify() noexcept;
+
+public:
+  task_pool() noexcept = default;
+  /**
+   * @brief create a pool for nworkers workers
+   *
+   * @param name
+   * @param nworkers
+   * @param capacity tasks each deque, and the injection queue, can hold;
+   * rounded up to a power of 2
+   * @param ec
+   */
+  task_pool(create_only_t, std::string_view name, uint32_t nworkers,
+            uint32_t capacity, std::error_code &ec) noexcept;
+  task_pool(create_only_t, std::string_view name, uint32_t nworkers,
+            uint32_t capacity);
+  /**
+   * @brief attach to an existing pool, waiting at most timeout for its
+   * creator to finish initializing it
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  task_pool(open_only_t, std::string_view name, std::error_code &ec,
+            std::chrono::milliseconds timeout =
+                std::chrono::milliseconds(1000)) noexcept;
+  task_pool(open_only_t, std::string_view name,
+            std::chrono::milliseconds timeout =
+                std::chrono::milliseconds(1000));
+
+  task_pool(task_pool &&other) noexcept;
+  task_pool &operator=(task_pool &&other) noexcept;
+
+  /**
+   * @brief worker: push task onto the bottom of the worker's own deque
+   * @details fails with IPCErrc::TaskQueueFull when the deque is full.
+   *
+   * @param worker
+   * @param task
+   * @param ec
+   */
+  void push(uint32_t worker, uint64_t task, std::error_code &ec) noexcept;
+  void push(uint32_t worker, uint64_t task);
+  /**
+   * @brief any process: add task to the injection queue
+   * @details fails with IPCErrc::TaskQueueFull when the queue is full.
+   *
+   * @param task
+   * @param ec
+   */
+  void submit(uint64_t task, std::error_code &ec) noexcept;
+  void submit(uint64_t task);
+  /**
+   * @brief worker: get a task without waiting, from the worker's own deque,
+   * the injection queue or another worker's deque, in this order
+   *
+   * @param worker
+   * @param task
+   * @return false if no task was found
+   */
+  bool take(uint32_t worker, uint64_t &task) noexcept;
+  /**
+   * @brief worker: get a task, parking until one is pushed if there is none
+   *
+   * @param worker
+   * @param task
+   * @param timeout
+   * @return false on timeout, or once the pool is shut down and out of tasks
+   */
+  bool wait(uint32_t worker, uint64_t &task,
+            std::chrono::nanoseconds timeout = FOREVER) noexcept;
+  /**
+   * @brief make wait() return false in every worker once no task is left
+   *
+   */
+  void shutdown() noexcept;
+
+  /**
+   * @brief number of tasks taken from another worker's deque, over all workers
+   *
+   * @return uint64_t
+   */
+  uint64_t steals() const noexcept;
+  uint32_t nworkers() const noexcept;
+  uint32_t capacity() const noexcept;
+  bool valid() const noexcept;
+  explicit operator bool() const noexcept;
+};
+} // namespace ipc
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string_view>
+#include <type_traits>
+
+#include "shm_object.hpp"
+
+namespace ipc {
+/**
+ * @brief wait-free exchange of the latest T between one writer and one reader
+ * @details three slots live in a shared memory object: the writer owns the
+ * back slot, the reader owns the front slot and the middle one is shared.
+ * Publishing swaps the back slot with the middle one and reading the latest
+ * value swaps the middle slot with the front one, both with a single atomic
+ * exchange on one word holding the middle index and a "fresh" bit. Neither
+ * side ever blocks or retries, whatever the size of T, and the reader never
+ * sees a torn value. Values published while the reader is not looking are
+ * overwritten, only the newest one is kept.
+ *
+ * Each side keeps the index of its own slot in the shared memory object too,
+ * so a restarted writer or reader picks up where its predecessor left off.
+ *
+ * @tparam T
+ */
+template <typename T> class triple_buffer {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "triple_buffer<T> requires a trivially copyable T");
+
+private:
+  static constexpr uint32_t INDEX_MASK = 0x3;
+  static constexpr uint32_t FRESH = 0x4;
+
+  /**
+   * @brief one cache line aligned slot, so the writer filling its slot does
+   * not contend with the reader reading its own
+   */
+  struct alignas(64) slot_t {
+    T value_;
+  };
+
+  /**
+   * @brief memory layout might look like this:
+   *  | middle | back | front | slot 0 | slot 1 | slot 2 |
+   */
+  struct storage_t {
+    std::atomic<uint32_t> middle_{1};
+    uint32_t back_ = 0;
+    uint32_t front_ = 2;
+    slot_t slots_[3];
+  };
+
+  shm_object<storage_t> obj_;
+  uint32_t back_ = 0;
+  uint32_t front_ = 2;
+
+  void load_indices() noexcept {
+    if (this->obj_) {
+      this->back_ = this->obj_->back_;
+      this->front_ = this->obj_->front_;
+    }
+  }
+
+public:
+  triple_buffer() noexcept = default;
+  /**
+   * @brief create a triple buffer, all three slots hold a value-initialized T
+   *
+   * @param name
+   * @param ec
+   */
+  triple_buffer(create_only_t, std::string_view name,
+                std::error_code &ec) noexcept
+      : obj_(create_only, name, ec) {
+    this->load_indices();
+  }
+  triple_buffer(create_only_t, std::string_view name)
+      : obj_(create_only, name) {
+    this->load_indices();
+  }
+  /**
+   * @brief attach to an existing triple buffer
+   *
+   * @param name
+   * @param ec
+   * @param timeout
+   */
+  triple_buffer(open_only_t, std::string_view name, std::error_code &ec,
+                std::chrono::milliseconds timeout =
+                    std::chrono::milliseconds(1000)) noexcept
+      : obj_(open_only, name, ec, timeout) {
+    this->load_indices();
+  }
+  triple_buffer(open_only_t, std::string_view name,
+                std::chrono::milliseconds timeout =
+                    std::chrono::milliseconds(1000))
+      : obj_(open_only, name, timeout) {
+    this->load_indices();
+  }
+
+  triple_buffer(triple_buffer &&) noexcept = default;
+  triple_buffer &operator=(triple_buffer &&) noexcept = default;
+
+  /**
+   * @brief writer: the slot the next value is built in, in place
+   *
+   * @return T&
+   */
+  T &back() noexcept { return this->obj_->slots_[this->back_].value_; }
+  /**
+   * @brief writer: publish the value built in back(), back() then refers to
+   * a different slot with unspecified content
+   *
+   */
+  void publish() noexcept {
+    uint32_t __old = this->obj_->middle_.exchange(this->back_ | FRESH,
+                                                  std::memory_order_acq_rel);
+    this->back_ = __old & INDEX_MASK;
+    this->obj_->back_ = this->back_;
+  }
+  /**
+   * @brief writer: copy value into the back slot and publish it
+   *
+   * @param value
+   */
+  void write(const T &value) noexcept {
+    this->back() = value;
+    this->publish();
+  }
+
+  /**
+   * @brief reader: whether a value newer than front() has been published
+   *
+   */
+  bool fresh() const noexcept {
+    return this->obj_->middle_.load(std::memory_order_relaxed) & FRESH;
+  }
+  /**
+   * @brief reader: make front() refer to the latest published value
+   *
+   * @return false if nothing has been published since the last update()
+   */
+  bool update() noexcept {
+    if (!this->fresh()) {
+      return false;
+    }
+    uint32_t __old = this->obj_->middle_.exchange(this->front_,
+                                                  std::memory_order_acq_rel);
+    this->front_ = __old & INDEX_MASK;
+    this->obj_->front_ = this->front_;
+    return true;
+  }
+  /**
+   * @brief reader: the latest value as of the last update(), it stays intact
+   * until the next update()
+   *
+   * @return const T&
+   */
+  const T &front() const noexcept {
+    return this->obj_->slots_[this->front_].value_;
+  }
+  /**
+   * @brief reader: update() and copy front() into value
+   *
+   * @param value
+   * @return true if value is newer than the one read before
+   */
+  bool read(T &value) noexcept {
+    bool __fresh = this->update();
+    value = this->front();
+    return __fresh;
+  }
+
+  const shmhdl &handle() const noexcept { return this->obj_.handle(); }
+  bool valid() const noexcept { return this->obj_.valid(); }
+  explicit operator bool() const noexcept { return this->valid(); }
+};
+} // namespace ipc
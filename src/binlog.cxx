@@ -0,0 +1,662 @@
+#include "binlog.hpp"
+#include "detail.hpp"
+#include "proc_id.hpp"
+
+#include <cctype>
+#include <new>
+#include <utility>
+
+namespace ipc {
+namespace {
+using detail::CACHE_LINE;
+using detail::READY;
+using detail::round_up;
+using detail::round_up_pow2;
+using detail::throw_if;
+using detail::wait_ready;
+
+/**
+ * @brief format ids of the records that are not log lines: the filler at the
+ * end of a ring, and the pid of a new owner of the ring
+ *
+ */
+constexpr uint32_t FMT_PAD = UINT32_MAX;
+constexpr uint32_t FMT_CLAIM = UINT32_MAX - 1;
+
+/**
+ * @brief size, format id and time stamp
+ *
+ */
+constexpr size_t RECORD_HEADER = sizeof(uint32_t) * 2 + sizeof(uint64_t);
+
+int64_t wall_clock_ns() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+template <typename... Args>
+void append_printf(std::string &out, const char *spec, Args... args) {
+  int __n = snprintf(nullptr, 0, spec, args...);
+  if (__n <= 0) {
+    return;
+  }
+  size_t __at = out.size();
+  out.resize(__at + size_t(__n) + 1);
+  snprintf(&out[__at], size_t(__n) + 1, spec, args...);
+  out.resize(__at + size_t(__n));
+}
+
+/**
+ * @brief one decoded record argument
+ *
+ */
+struct log_value_t {
+  detail::log_arg tag_;
+  uint64_t bits_ = 0;
+  std::string_view str_;
+
+  int64_t i64() const noexcept {
+    if (this->tag_ == detail::log_arg::F64) {
+      double __d;
+      std::memcpy(&__d, &this->bits_, sizeof(__d));
+      return int64_t(__d);
+    }
+    return int64_t(this->bits_);
+  }
+  double f64() const noexcept {
+    switch (this->tag_) {
+    case detail::log_arg::F64: {
+      double __d;
+      std::memcpy(&__d, &this->bits_, sizeof(__d));
+      return __d;
+    }
+    case detail::log_arg::I64:
+      return double(int64_t(this->bits_));
+    default:
+      return double(this->bits_);
+    }
+  }
+};
+
+/**
+ * @brief decode the argument at p, false if it overruns end
+ *
+ */
+bool decode_value(uint8_t tag, const char *&p, const char *end,
+                  log_value_t &value) noexcept {
+  value.tag_ = detail::log_arg(tag);
+  switch (value.tag_) {
+  case detail::log_arg::STR: {
+    uint16_t __len;
+    if (end - p < ptrdiff_t(sizeof(__len))) {
+      return false;
+    }
+    std::memcpy(&__len, p, sizeof(__len));
+    p += sizeof(__len);
+    if (end - p < ptrdiff_t(__len)) {
+      return false;
+    }
+    value.str_ = std::string_view(p, __len);
+    p += __len;
+    return true;
+  }
+  case detail::log_arg::I64:
+  case detail::log_arg::U64:
+  case detail::log_arg::F64:
+  case detail::log_arg::PTR:
+    if (end - p < ptrdiff_t(sizeof(uint64_t))) {
+      return false;
+    }
+    std::memcpy(&value.bits_, p, sizeof(uint64_t));
+    p += sizeof(uint64_t);
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * @brief print value for the conversion conv of a printf spec, whatever
+ * type it was logged with
+ *
+ */
+void append_value(std::string &out, std::string spec, char conv,
+                  const log_value_t &value) {
+  bool __is_str = value.tag_ == detail::log_arg::STR;
+  switch (conv) {
+  case 'd':
+  case 'i':
+    if (!__is_str) {
+      append_printf(out, (spec + "lld").data(), (long long)value.i64());
+      return;
+    }
+    break;
+  case 'o':
+  case 'u':
+  case 'x':
+  case 'X':
+    if (!__is_str) {
+      append_printf(out, (spec + "ll" + conv).data(),
+                    (unsigned long long)value.i64());
+      return;
+    }
+    break;
+  case 'c':
+    if (!__is_str) {
+      append_printf(out, (spec + 'c').data(), int(value.i64()));
+      return;
+    }
+    break;
+  case 'f':
+  case 'F':
+  case 'e':
+  case 'E':
+  case 'g':
+  case 'G':
+  case 'a':
+  case 'A':
+    if (!__is_str) {
+      append_printf(out, (spec + conv).data(), value.f64());
+      return;
+    }
+    break;
+  case 'p':
+    if (!__is_str) {
+      append_printf(out, (spec + 'p').data(),
+                    reinterpret_cast<void *>(uintptr_t(value.bits_)));
+      return;
+    }
+    break;
+  default:
+    break;
+  }
+  // %s, or a conversion that does not fit what was logged
+  if (__is_str) {
+    append_printf(out, (spec + 's').data(), std::string(value.str_).data());
+  } else if (value.tag_ == detail::log_arg::F64) {
+    append_printf(out, "%g", value.f64());
+  } else if (value.tag_ == detail::log_arg::I64) {
+    append_printf(out, "%lld", (long long)value.i64());
+  } else {
+    append_printf(out, "%llu", (unsigned long long)value.bits_);
+  }
+}
+
+/**
+ * @brief printf fmt with the logged arguments
+ *
+ */
+void format_message(std::string &out, std::string_view fmt, uint8_t nargs,
+                    const uint8_t *tags, const char *p, const char *end) {
+  uint8_t __arg = 0;
+  for (size_t i = 0; i < fmt.size(); i++) {
+    if (fmt[i] != '%') {
+      out += fmt[i];
+      continue;
+    }
+    if (i + 1 < fmt.size() && fmt[i + 1] == '%') {
+      out += '%';
+      i++;
+      continue;
+    }
+    std::string __spec = "%";
+    size_t j = i + 1;
+    while (j < fmt.size() && fmt[j] && std::strchr("-+ #0", fmt[j])) {
+      __spec += fmt[j++];
+    }
+    while (j < fmt.size() && std::isdigit((unsigned char)fmt[j])) {
+      __spec += fmt[j++];
+    }
+    if (j < fmt.size() && fmt[j] == '.') {
+      __spec += fmt[j++];
+      while (j < fmt.size() && std::isdigit((unsigned char)fmt[j])) {
+        __spec += fmt[j++];
+      }
+    }
+    // every integer was logged as 64 bits
+    while (j < fmt.size() && fmt[j] && std::strchr("hljztLq", fmt[j])) {
+      j++;
+    }
+    if (j >= fmt.size()) {
+      out.append(fmt.substr(i));
+      return;
+    }
+    i = j;
+    log_value_t __value;
+    if (__arg >= nargs || !decode_value(tags[__arg], p, end, __value)) {
+      out += "<?>";
+      continue;
+    }
+    __arg++;
+    append_value(out, __spec, fmt[j], __value);
+  }
+}
+} // namespace
+
+/**
+ * @brief placed at the begining of the shared memory buffer
+ * memory layout might look like this:
+ *  | log meta | format pool | ring 0 | data 0 | ring 1 | data 1 | ...
+ */
+struct binlog::log_meta_t {
+  struct format_t {
+    std::atomic<uint32_t> ready_;
+    uint32_t offset_;
+    uint32_t len_;
+  };
+
+  std::atomic<uint32_t> state_;
+  uint32_t nrings_;
+  uint64_t ring_bytes_;
+  uint64_t ring_stride_;
+  /**
+   * @brief time stamp counter and wall clock at creation, the drain converts
+   * time stamps with them
+   *
+   */
+  uint64_t tsc0_;
+  int64_t wall0_;
+  alignas(CACHE_LINE) std::atomic<uint32_t> nformats_;
+  std::atomic<uint32_t> pool_used_;
+  format_t formats_[MAX_FORMATS];
+};
+
+/**
+ * @brief single producer, single consumer byte ring. Followed by ring_bytes
+ * of records, each one 8 byte aligned.
+ */
+struct binlog::ring_t {
+  /**
+   * @brief the owning process, empty if the ring is free
+   *
+   */
+  alignas(CACHE_LINE) std::atomic<proc_id> owner_;
+  std::atomic<uint64_t> dropped_;
+  alignas(CACHE_LINE) std::atomic<uint64_t> head_;
+  alignas(CACHE_LINE) std::atomic<uint64_t> tail_;
+  /**
+   * @brief pid of the last claim record drained, the one the records up to
+   * tail_ belong to; only touched by the drainer
+   */
+  uint32_t drained_pid_;
+
+  char *data() noexcept { return reinterpret_cast<char *>(this + 1); }
+};
+
+void binlog::create(std::string_view name, uint32_t nrings,
+                    uint32_t ring_bytes, std::error_code &ec) noexcept {
+  if (nrings == 0 || ring_bytes < CACHE_LINE || ring_bytes > (1u << 30)) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  ring_bytes = round_up_pow2(ring_bytes);
+  size_t __meta_size = round_up(sizeof(log_meta_t), CACHE_LINE);
+  size_t __stride = round_up(sizeof(ring_t) + ring_bytes, CACHE_LINE);
+  this->hdl_ = shmhdl(name, __meta_size + FORMAT_POOL + __stride * nrings, ec);
+  if (ec) {
+    return;
+  }
+  void *__buf = this->hdl_.map(ec);
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = new (__buf) log_meta_t;
+  this->meta_->nrings_ = nrings;
+  this->meta_->ring_bytes_ = ring_bytes;
+  this->meta_->ring_stride_ = __stride;
+  this->meta_->tsc0_ = read_tsc();
+  this->meta_->wall0_ = wall_clock_ns();
+  this->meta_->nformats_.store(0, std::memory_order_relaxed);
+  this->meta_->pool_used_.store(0, std::memory_order_relaxed);
+  for (auto &__f : this->meta_->formats_) {
+    __f.ready_.store(0, std::memory_order_relaxed);
+  }
+  this->pool_ = static_cast<char *>(__buf) + __meta_size;
+  this->rings_ = this->pool_ + FORMAT_POOL;
+  for (uint32_t i = 0; i < nrings; i++) {
+    auto __ring = new (this->ring_at(i)) ring_t;
+    __ring->owner_.store(proc_id{}, std::memory_order_relaxed);
+    __ring->drained_pid_ = 0;
+    __ring->dropped_.store(0, std::memory_order_relaxed);
+    __ring->head_.store(0, std::memory_order_relaxed);
+    __ring->tail_.store(0, std::memory_order_relaxed);
+  }
+  this->meta_->state_.store(READY, std::memory_order_release);
+}
+
+void binlog::attach(std::string_view name, std::error_code &ec,
+                    std::chrono::milliseconds timeout) noexcept {
+  this->hdl_ = shmhdl(name, ec);
+  if (ec) {
+    return;
+  }
+  void *__buf = this->hdl_.map(ec);
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __meta_size = round_up(sizeof(log_meta_t), CACHE_LINE);
+  if (size_t(this->hdl_.nbytes()) < __meta_size + FORMAT_POOL) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = static_cast<log_meta_t *>(__buf);
+  // wait for the creator to finish initializing the rings
+  if (!wait_ready(__meta->state_, timeout)) {
+    ec = IPCErrc::ShmNotInitialized;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  if (size_t(this->hdl_.nbytes()) !=
+      __meta_size + FORMAT_POOL + __meta->ring_stride_ * __meta->nrings_) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = __meta;
+  this->pool_ = static_cast<char *>(__buf) + __meta_size;
+  this->rings_ = this->pool_ + FORMAT_POOL;
+}
+
+binlog::ring_t *binlog::ring_at(uint32_t i) const noexcept {
+  return reinterpret_cast<ring_t *>(this->rings_ +
+                                    i * this->meta_->ring_stride_);
+}
+
+binlog::binlog(create_only_t, std::string_view name, uint32_t nrings,
+               uint32_t ring_bytes, std::error_code &ec) noexcept {
+  this->create(name, nrings, ring_bytes, ec);
+}
+
+binlog::binlog(create_only_t, std::string_view name, uint32_t nrings,
+               uint32_t ring_bytes) {
+  std::error_code ec;
+  this->create(name, nrings, ring_bytes, ec);
+  throw_if(ec);
+}
+
+binlog::binlog(open_only_t, std::string_view name, std::error_code &ec,
+               std::chrono::milliseconds timeout) noexcept {
+  this->attach(name, ec, timeout);
+}
+
+binlog::binlog(open_only_t, std::string_view name,
+               std::chrono::milliseconds timeout) {
+  std::error_code ec;
+  this->attach(name, ec, timeout);
+  throw_if(ec);
+}
+
+binlog::binlog(binlog &&other) noexcept
+    : hdl_(std::move(other.hdl_)), meta_(std::exchange(other.meta_, nullptr)),
+      pool_(std::exchange(other.pool_, nullptr)),
+      rings_(std::exchange(other.rings_, nullptr)) {}
+
+binlog &binlog::operator=(binlog &&other) noexcept {
+  if (this != &other) {
+    this->hdl_ = std::move(other.hdl_);
+    this->meta_ = std::exchange(other.meta_, nullptr);
+    this->pool_ = std::exchange(other.pool_, nullptr);
+    this->rings_ = std::exchange(other.rings_, nullptr);
+  }
+  return *this;
+}
+
+uint32_t binlog::define(std::string_view fmt, std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return 0;
+  }
+  uint32_t __id = this->meta_->nformats_.fetch_add(1, std::memory_order_relaxed);
+  if (__id >= MAX_FORMATS) {
+    ec = IPCErrc::LogFormatTableFull;
+    return 0;
+  }
+  uint32_t __len = uint32_t(fmt.size());
+  uint32_t __offset =
+      this->meta_->pool_used_.fetch_add(__len + 1, std::memory_order_relaxed);
+  if (__offset + __len + 1 > FORMAT_POOL) {
+    // the id stays unused, it is never ready
+    ec = IPCErrc::LogFormatTableFull;
+    return 0;
+  }
+  std::memcpy(this->pool_ + __offset, fmt.data(), __len);
+  this->pool_[__offset + __len] = '\0';
+  auto &__f = this->meta_->formats_[__id];
+  __f.offset_ = __offset;
+  __f.len_ = __len;
+  __f.ready_.store(1, std::memory_order_release);
+  return __id;
+}
+
+uint32_t binlog::define(std::string_view fmt) {
+  std::error_code ec;
+  uint32_t __id = this->define(fmt, ec);
+  throw_if(ec);
+  return __id;
+}
+
+std::string_view binlog::format(uint32_t id) const noexcept {
+  if (!this->meta_ || id >= MAX_FORMATS) {
+    return {};
+  }
+  auto &__f = this->meta_->formats_[id];
+  if (!__f.ready_.load(std::memory_order_acquire)) {
+    return {};
+  }
+  return std::string_view(this->pool_ + __f.offset_, __f.len_);
+}
+
+size_t binlog::drain_ring(uint32_t i, double ns_per_tick,
+                          const std::function<void(std::string_view)> &sink) {
+  ring_t *__ring = this->ring_at(i);
+  const uint64_t __mask = this->meta_->ring_bytes_ - 1;
+  uint64_t __tail = __ring->tail_.load(std::memory_order_relaxed);
+  uint64_t __head = __ring->head_.load(std::memory_order_acquire);
+  // the records left from a previous drain belong to the last claim it saw,
+  // not to whoever owns the ring now
+  uint32_t __pid = __ring->drained_pid_;
+  size_t __count = 0;
+  std::string __line;
+  auto __prefix = [&](uint64_t tsc) {
+    int64_t __ns =
+        this->meta_->wall0_ +
+        int64_t(double(int64_t(tsc - this->meta_->tsc0_)) * ns_per_tick);
+    __line.clear();
+    append_printf(__line, "%lld.%09lld %u ", (long long)(__ns / 1000000000),
+                  (long long)(__ns % 1000000000), __pid);
+  };
+
+  while (__tail < __head) {
+    const char *__rec = __ring->data() + (__tail & __mask);
+    uint32_t __hdr[2];
+    std::memcpy(__hdr, __rec, sizeof(__hdr));
+    if (__hdr[0] == 0 || __hdr[0] % 8 != 0 || __hdr[0] > __head - __tail) {
+      // a corrupted ring, skip what is left rather than looping on it
+      __tail = __head;
+      break;
+    }
+    if (__hdr[1] != FMT_PAD) {
+      uint64_t __tsc;
+      std::memcpy(&__tsc, __rec + sizeof(__hdr), sizeof(__tsc));
+      const char *__end = __rec + __hdr[0];
+      const char *__p = __rec + RECORD_HEADER;
+      uint8_t __nargs = uint8_t(*__p++);
+      auto __tags = reinterpret_cast<const uint8_t *>(__p);
+      __p += __nargs;
+      if (__hdr[1] == FMT_CLAIM) {
+        log_value_t __owner;
+        if (__nargs == 1 && decode_value(__tags[0], __p, __end, __owner)) {
+          __pid = uint32_t(__owner.bits_);
+        }
+      } else {
+        __prefix(__tsc);
+        if (__hdr[1] < MAX_FORMATS &&
+            this->meta_->formats_[__hdr[1]].ready_.load(
+                std::memory_order_acquire)) {
+          format_message(__line, this->format(__hdr[1]), __nargs, __tags, __p,
+                         __end);
+        } else {
+          append_printf(__line, "<unknown format %u>", __hdr[1]);
+        }
+        sink(__line);
+        __count++;
+      }
+    }
+    __tail += __hdr[0];
+  }
+  __ring->drained_pid_ = __pid;
+  __ring->tail_.store(__tail, std::memory_order_release);
+
+  uint64_t __dropped = __ring->dropped_.exchange(0, std::memory_order_relaxed);
+  if (__dropped) {
+    __prefix(read_tsc());
+    append_printf(__line, "%llu records dropped, ring %u was full",
+                  (unsigned long long)__dropped, i);
+    sink(__line);
+  }
+  return __count;
+}
+
+size_t binlog::drain(const std::function<void(std::string_view)> &sink) {
+  if (!this->meta_) {
+    return 0;
+  }
+  // the longer the log runs, the better the tick rate estimate
+  uint64_t __ticks = read_tsc() - this->meta_->tsc0_;
+  int64_t __ns = wall_clock_ns() - this->meta_->wall0_;
+  double __ns_per_tick =
+      __ticks > 0 && __ns > 0 ? double(__ns) / double(__ticks) : 1.0;
+  size_t __count = 0;
+  for (uint32_t i = 0; i < this->meta_->nrings_; i++) {
+    __count += this->drain_ring(i, __ns_per_tick, sink);
+  }
+  return __count;
+}
+
+size_t binlog::drain(std::FILE *out) {
+  size_t __count = this->drain([out](std::string_view line) {
+    std::fwrite(line.data(), 1, line.size(), out);
+    std::fputc('\n', out);
+  });
+  std::fflush(out);
+  return __count;
+}
+
+uint32_t binlog::nrings() const noexcept {
+  return this->meta_ ? this->meta_->nrings_ : 0;
+}
+
+bool binlog::valid() const noexcept { return this->meta_ != nullptr; }
+
+binlog::operator bool() const noexcept { return this->valid(); }
+
+void binlog_writer::claim(binlog &log, std::error_code &ec) noexcept {
+  ec.clear();
+  if (!log.meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  const proc_id __self = proc_id::self();
+  for (uint32_t i = 0; i < log.meta_->nrings_; i++) {
+    binlog::ring_t *__ring = log.ring_at(i);
+    proc_id __owner = __ring->owner_.load(std::memory_order_acquire);
+    // a ring of another thread of this process is never up for grabs; the
+    // start time tells a dead owner from a process that reused its pid
+    if (!__owner.empty() && (__owner == __self || __owner.alive())) {
+      continue;
+    }
+    if (!__ring->owner_.compare_exchange_strong(__owner, __self,
+                                                std::memory_order_acq_rel)) {
+      continue;
+    }
+    this->ring_ = __ring;
+    this->data_ = __ring->data();
+    this->mask_ = log.meta_->ring_bytes_ - 1;
+    // a record its dead owner did not commit is simply overwritten
+    this->head_ = __ring->head_.load(std::memory_order_relaxed);
+    this->tail_ = __ring->tail_.load(std::memory_order_acquire);
+    this->write(FMT_CLAIM, uint64_t(__self.pid_));
+    return;
+  }
+  ec = IPCErrc::LogNoFreeRing;
+}
+
+binlog_writer::binlog_writer(binlog &log, std::error_code &ec) noexcept {
+  this->claim(log, ec);
+}
+
+binlog_writer::binlog_writer(binlog &log) {
+  std::error_code ec;
+  this->claim(log, ec);
+  throw_if(ec);
+}
+
+binlog_writer::~binlog_writer() {
+  if (this->ring_) {
+    this->ring_->owner_.store(proc_id{}, std::memory_order_release);
+  }
+}
+
+binlog_writer::binlog_writer(binlog_writer &&other) noexcept
+    : ring_(std::exchange(other.ring_, nullptr)),
+      data_(std::exchange(other.data_, nullptr)), mask_(other.mask_),
+      head_(other.head_), tail_(other.tail_) {}
+
+binlog_writer &binlog_writer::operator=(binlog_writer &&other) noexcept {
+  if (this != &other) {
+    if (this->ring_) {
+      this->ring_->owner_.store(proc_id{}, std::memory_order_release);
+    }
+    this->ring_ = std::exchange(other.ring_, nullptr);
+    this->data_ = std::exchange(other.data_, nullptr);
+    this->mask_ = other.mask_;
+    this->head_ = other.head_;
+    this->tail_ = other.tail_;
+  }
+  return *this;
+}
+
+char *binlog_writer::reserve(size_t nbytes) noexcept {
+  if (!this->ring_) {
+    return nullptr;
+  }
+  const uint64_t __cap = this->mask_ + 1;
+  uint64_t __pos = this->head_ & this->mask_;
+  uint64_t __contiguous = __cap - __pos;
+  // a record never wraps, the end of the ring is padded instead
+  uint64_t __need = nbytes <= __contiguous ? nbytes : nbytes + __contiguous;
+  if (nbytes > __cap / 2 || this->head_ + __need - this->tail_ > __cap) {
+    this->tail_ = this->ring_->tail_.load(std::memory_order_acquire);
+    if (nbytes > __cap / 2 || this->head_ + __need - this->tail_ > __cap) {
+      this->ring_->dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+  }
+  if (nbytes > __contiguous) {
+    uint32_t __pad[2] = {uint32_t(__contiguous), FMT_PAD};
+    std::memcpy(this->data_ + __pos, __pad, sizeof(__pad));
+    this->head_ += __contiguous;
+    __pos = 0;
+  }
+  return this->data_ + __pos;
+}
+
+void binlog_writer::commit(size_t nbytes) noexcept {
+  this->head_ += nbytes;
+  this->ring_->head_.store(this->head_, std::memory_order_release);
+}
+
+uint64_t binlog_writer::dropped() const noexcept {
+  return this->ring_ ? this->ring_->dropped_.load(std::memory_order_relaxed)
+                     : 0;
+}
+
+bool binlog_writer::valid() const noexcept { return this->ring_ != nullptr; }
+
+binlog_writer::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
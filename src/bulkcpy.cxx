@@ -0,0 +1,186 @@
+#include "bulkcpy.hpp"
+#include "cpuinfo.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+#include <immintrin.h>
+#define IPC_X86 1
+#endif
+
+#if defined(__GNUC__)
+#define IPC_TARGET(isa) __attribute__((target(isa)))
+#else
+#define IPC_TARGET(isa)
+#endif
+
+namespace ipc {
+namespace {
+using copy_fn = void (*)(char *, const char *, size_t) noexcept;
+
+/**
+ * @brief chunks handed to a copy thread are at least this large
+ *
+ */
+constexpr size_t MIN_PARALLEL_CHUNK = 4 * 1024 * 1024;
+constexpr size_t PAGE_SIZE = 4096;
+
+/**
+ * @brief copy the bytes in front of the first width-aligned destination
+ * address, returns the number of bytes copied
+ */
+inline size_t copy_head(char *dst, const char *src, size_t n,
+                        size_t width) noexcept {
+  size_t __head = (width - reinterpret_cast<uintptr_t>(dst) % width) % width;
+  __head = std::min(__head, n);
+  std::memcpy(dst, src, __head);
+  return __head;
+}
+
+void copy_memcpy(char *dst, const char *src, size_t n) noexcept {
+  std::memcpy(dst, src, n);
+}
+
+#ifdef IPC_X86
+IPC_TARGET("sse2")
+void copy_sse2(char *dst, const char *src, size_t n) noexcept {
+  size_t i = copy_head(dst, src, n, 16);
+  for (; i + 64 <= n; i += 64) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 16));
+    __m128i c =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 32));
+    __m128i d =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 48));
+    _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i), a);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 16), b);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 32), c);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(dst + i + 48), d);
+  }
+  _mm_sfence();
+  std::memcpy(dst + i, src + i, n - i);
+}
+
+IPC_TARGET("avx2")
+void copy_avx2(char *dst, const char *src, size_t n) noexcept {
+  size_t i = copy_head(dst, src, n, 32);
+  for (; i + 128 <= n; i += 128) {
+    __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 32));
+    __m256i c =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 64));
+    __m256i d =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 96));
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + i), a);
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + i + 32), b);
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + i + 64), c);
+    _mm256_stream_si256(reinterpret_cast<__m256i *>(dst + i + 96), d);
+  }
+  _mm_sfence();
+  std::memcpy(dst + i, src + i, n - i);
+}
+
+IPC_TARGET("avx512f")
+void copy_avx512(char *dst, const char *src, size_t n) noexcept {
+  size_t i = copy_head(dst, src, n, 64);
+  for (; i + 256 <= n; i += 256) {
+    __m512i a = _mm512_loadu_si512(src + i);
+    __m512i b = _mm512_loadu_si512(src + i + 64);
+    __m512i c = _mm512_loadu_si512(src + i + 128);
+    __m512i d = _mm512_loadu_si512(src + i + 192);
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + i), a);
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + i + 64), b);
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + i + 128), c);
+    _mm512_stream_si512(reinterpret_cast<__m512i *>(dst + i + 192), d);
+  }
+  _mm_sfence();
+  std::memcpy(dst + i, src + i, n - i);
+}
+#endif
+
+copy_fn select_stream_copy() noexcept {
+#ifdef IPC_X86
+  const cpu_features_t &__f = cpu_features();
+  if (__f.avx512f) {
+    return copy_avx512;
+  }
+  if (__f.avx2) {
+    return copy_avx2;
+  }
+  if (__f.sse2) {
+    return copy_sse2;
+  }
+#endif
+  return copy_memcpy;
+}
+} // namespace
+
+void *stream_copy(void *dst, const void *src, size_t nbytes) noexcept {
+  static const copy_fn __copy = select_stream_copy();
+  __copy(static_cast<char *>(dst), static_cast<const char *>(src), nbytes);
+  return dst;
+}
+
+void *parallel_copy(void *dst, const void *src, size_t nbytes,
+                    unsigned nthreads) noexcept {
+  if (nthreads == 0) {
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  size_t __nchunks =
+      std::min<size_t>(nthreads, std::max<size_t>(1, nbytes / MIN_PARALLEL_CHUNK));
+  if (__nchunks <= 1) {
+    return stream_copy(dst, src, nbytes);
+  }
+  auto __dst = static_cast<char *>(dst);
+  auto __src = static_cast<const char *>(src);
+  // chunks end on page boundaries of the destination, so that no two threads
+  // write the same page; each one is at least nbytes / __nchunks long
+  size_t __chunk = nbytes / __nchunks;
+  uintptr_t __base = reinterpret_cast<uintptr_t>(__dst);
+  auto __cut = [&](size_t off) {
+    size_t __end = ((__base + off + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1)) - __base;
+    return std::min(__end, nbytes);
+  };
+
+  std::vector<std::thread> __workers;
+  try {
+    __workers.reserve(__nchunks - 1);
+  } catch (...) {
+    return stream_copy(dst, src, nbytes);
+  }
+  size_t __first = __cut(__chunk);
+  for (size_t __off = __first; __off < nbytes;) {
+    size_t __len = __cut(__off + __chunk) - __off;
+    try {
+      __workers.emplace_back(stream_copy, __dst + __off, __src + __off, __len);
+    } catch (const std::system_error &) {
+      stream_copy(__dst + __off, __src + __off, __len);
+    }
+    __off += __len;
+  }
+  stream_copy(__dst, __src, __first);
+  for (auto &__t : __workers) {
+    __t.join();
+  }
+  return dst;
+}
+
+void *bulk_copy(void *dst, const void *src, size_t nbytes) noexcept {
+  if (nbytes < STREAM_COPY_THRESHOLD) {
+    return std::memcpy(dst, src, nbytes);
+  }
+  if (nbytes < PARALLEL_COPY_THRESHOLD) {
+    return stream_copy(dst, src, nbytes);
+  }
+  return parallel_copy(dst, src, nbytes);
+}
+} // namespace ipc
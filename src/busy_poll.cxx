@@ -0,0 +1,140 @@
+#include "busy_poll.hpp"
+#include "cpuinfo.hpp"
+
+#include <cstdio>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+#include <immintrin.h>
+#define IPC_X86 1
+#endif
+
+#if defined(__GNUC__)
+#define IPC_TARGET(isa) __attribute__((target(isa)))
+#else
+#define IPC_TARGET(isa)
+#endif
+
+namespace ipc {
+namespace {
+/**
+ * @brief upper bound of a single tpause/umwait, in TSC ticks
+ * @details short enough to notice a condition that is not tied to the
+ * watched cache line (and a deadline) within a couple of microseconds.
+ */
+constexpr uint64_t WAIT_TICKS = 4096;
+/**
+ * @brief ask for the C0.1 state, which wakes faster than C0.2
+ *
+ */
+constexpr uint32_t C01 = 1;
+
+#if defined(IPC_X86) && (defined(__GNUC__) || defined(_MSC_VER))
+#define IPC_WAITPKG 1
+IPC_TARGET("waitpkg")
+void tpause_once() noexcept { _tpause(C01, __rdtsc() + WAIT_TICKS); }
+
+IPC_TARGET("waitpkg")
+void umwait_once(const std::atomic<uint32_t> &word, uint32_t old) noexcept {
+  _umonitor(const_cast<std::atomic<uint32_t> *>(&word));
+  // a write between the caller's poll and arming the monitor is not seen by
+  // umwait, check once more
+  if (word.load(std::memory_order_relaxed) == old) {
+    _umwait(C01, __rdtsc() + WAIT_TICKS);
+  }
+}
+#endif
+
+spin_hint resolve_hint(spin_hint hint) noexcept {
+  bool __waitpkg = cpu_features().waitpkg;
+  switch (hint) {
+  case spin_hint::automatic:
+    return __waitpkg ? spin_hint::umwait : spin_hint::pause;
+  case spin_hint::tpause:
+  case spin_hint::umwait:
+    return __waitpkg ? hint : spin_hint::pause;
+  default:
+    return spin_hint::pause;
+  }
+}
+} // namespace
+
+busy_poll::busy_poll(int cpu, spin_hint hint) noexcept
+    : cpu_(cpu), hint_(resolve_hint(hint)) {}
+
+void busy_poll::pin(std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->cpu_ >= 0) {
+    pin_current_thread(this->cpu_, ec);
+  }
+}
+
+void busy_poll::pin() {
+  std::error_code ec;
+  this->pin(ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+void busy_poll::relax() noexcept {
+#ifdef IPC_WAITPKG
+  if (this->hint_ != spin_hint::pause) {
+    tpause_once();
+    return;
+  }
+#endif
+  cpu_relax();
+}
+
+void busy_poll::relax_on(const std::atomic<uint32_t> &word,
+                         uint32_t old) noexcept {
+#ifdef IPC_WAITPKG
+  if (this->hint_ == spin_hint::umwait) {
+    umwait_once(word, old);
+    return;
+  }
+#endif
+  (void)word;
+  (void)old;
+  this->relax();
+}
+
+uint32_t busy_poll::wait_change(const std::atomic<uint32_t> &word,
+                                uint32_t old) noexcept {
+  auto __start = std::chrono::steady_clock::now();
+  uint32_t __value;
+  for (;;) {
+    this->stats_.polls_++;
+    __value = word.load(std::memory_order_acquire);
+    if (__value != old) {
+      break;
+    }
+    this->relax_on(word, old);
+  }
+  this->stats_.waits_++;
+  this->stats_.wait_time_ += std::chrono::steady_clock::now() - __start;
+  return __value;
+}
+
+int busy_poll::cpu() const noexcept { return this->cpu_; }
+
+spin_hint busy_poll::hint() const noexcept { return this->hint_; }
+
+const poll_stats_t &busy_poll::stats() const noexcept { return this->stats_; }
+
+void busy_poll::reset_stats() noexcept { this->stats_ = poll_stats_t(); }
+
+void pin_current_thread(int cpu) {
+  std::error_code ec;
+  pin_current_thread(cpu, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+} // namespace ipc
@@ -0,0 +1,526 @@
+#include "column_scan.hpp"
+#include "cpuinfo.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+#include <immintrin.h>
+#define IPC_X86 1
+#endif
+
+#if defined(__GNUC__)
+#define IPC_TARGET(isa) __attribute__((target(isa)))
+#else
+#define IPC_TARGET(isa)
+#endif
+
+namespace ipc {
+namespace {
+/**
+ * @brief rows per selection word, the kernels work a word at a time
+ *
+ */
+constexpr size_t BLOCK = 64;
+constexpr uint64_t ALL_ROWS = ~uint64_t(0);
+
+inline size_t popcount(uint64_t word) noexcept {
+#if defined(__GNUC__)
+  return size_t(__builtin_popcountll(word));
+#else
+  size_t __n = 0;
+  for (; word; word &= word - 1) {
+    __n++;
+  }
+  return __n;
+#endif
+}
+
+template <typename T>
+inline bool compare(T value, cmp_op op, T operand) noexcept {
+  switch (op) {
+  case cmp_op::EQ:
+    return value == operand;
+  case cmp_op::NE:
+    return value != operand;
+  case cmp_op::LT:
+    return value < operand;
+  case cmp_op::LE:
+    return value <= operand;
+  case cmp_op::GT:
+    return value > operand;
+  case cmp_op::GE:
+    return value >= operand;
+  }
+  return false;
+}
+
+/**
+ * @brief filters the rows from begin, a multiple of BLOCK, to n
+ */
+template <typename T>
+size_t filter_scalar(const T *col, size_t begin, size_t n, cmp_op op,
+                     T operand, uint64_t *sel) noexcept {
+  size_t __selected = 0;
+  for (size_t b = begin; b < n; b += BLOCK) {
+    size_t __end = std::min(n, b + BLOCK);
+    uint64_t __word = 0;
+    for (size_t i = b; i < __end; i++) {
+      __word |= uint64_t(compare(col[i], op, operand)) << (i - b);
+    }
+    sel[b / BLOCK] = __word;
+    __selected += popcount(__word);
+  }
+  return __selected;
+}
+
+/**
+ * @brief calls fold with the selected values of the rows from begin to n
+ */
+template <typename T, typename Fold>
+inline void fold_scalar(const T *col, size_t begin, size_t n,
+                        const uint64_t *sel, Fold &&fold) noexcept {
+  for (size_t i = begin; i < n; i++) {
+    if (!sel || (sel[i / BLOCK] >> (i % BLOCK)) & 1) {
+      fold(col[i]);
+    }
+  }
+}
+
+template <typename T>
+size_t filter_plain(const T *col, size_t n, cmp_op op, T operand,
+                    uint64_t *sel) noexcept {
+  return filter_scalar(col, 0, n, op, operand, sel);
+}
+
+template <typename T>
+column_sum_t<T> sum_plain(const T *col, size_t n,
+                          const uint64_t *sel) noexcept {
+  column_sum_t<T> __sum = 0;
+  fold_scalar(col, 0, n, sel, [&](T x) { __sum += x; });
+  return __sum;
+}
+
+template <typename T, bool MAX>
+T extreme_plain(const T *col, size_t n, const uint64_t *sel) noexcept {
+  T __best = MAX ? std::numeric_limits<T>::lowest()
+                 : std::numeric_limits<T>::max();
+  fold_scalar(col, 0, n, sel, [&](T x) {
+    __best = MAX ? std::max(__best, x) : std::min(__best, x);
+  });
+  return __best;
+}
+
+#ifdef IPC_X86
+/**
+ * @brief AVX2 operations on W values of T, S is the vector column_sum()
+ * accumulates in
+ */
+template <typename T> struct avx2_ops;
+
+/**
+ * @brief comparison mask of two integer vectors from their eq and gt
+ */
+template <typename Ops, cmp_op OP>
+IPC_TARGET("avx2")
+inline uint32_t int_compare(typename Ops::V a, typename Ops::V b) noexcept {
+  constexpr uint32_t __all = (1u << Ops::W) - 1;
+  switch (OP) {
+  case cmp_op::EQ:
+    return Ops::mask(Ops::eq(a, b));
+  case cmp_op::NE:
+    return ~Ops::mask(Ops::eq(a, b)) & __all;
+  case cmp_op::LT:
+    return Ops::mask(Ops::gt(b, a));
+  case cmp_op::LE:
+    return ~Ops::mask(Ops::gt(a, b)) & __all;
+  case cmp_op::GT:
+    return Ops::mask(Ops::gt(a, b));
+  case cmp_op::GE:
+    return ~Ops::mask(Ops::gt(b, a)) & __all;
+  }
+  return 0;
+}
+
+/**
+ * @brief predicate of _mm256_cmp_ps/pd matching the scalar comparison, NaNs
+ * compare false but for NE
+ */
+template <cmp_op OP> constexpr int float_predicate() noexcept {
+  switch (OP) {
+  case cmp_op::EQ:
+    return _CMP_EQ_OQ;
+  case cmp_op::NE:
+    return _CMP_NEQ_UQ;
+  case cmp_op::LT:
+    return _CMP_LT_OQ;
+  case cmp_op::LE:
+    return _CMP_LE_OQ;
+  case cmp_op::GT:
+    return _CMP_GT_OQ;
+  case cmp_op::GE:
+    return _CMP_GE_OQ;
+  }
+  return _CMP_FALSE_OQ;
+}
+
+template <> struct avx2_ops<int32_t> {
+  using V = __m256i;
+  using S = __m256i;
+  static constexpr size_t W = 8;
+
+  IPC_TARGET("avx2") static V load(const int32_t *p) noexcept {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  IPC_TARGET("avx2") static void store(int32_t *p, V v) noexcept {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+  IPC_TARGET("avx2") static V set1(int32_t x) noexcept {
+    return _mm256_set1_epi32(x);
+  }
+  IPC_TARGET("avx2") static V eq(V a, V b) noexcept {
+    return _mm256_cmpeq_epi32(a, b);
+  }
+  IPC_TARGET("avx2") static V gt(V a, V b) noexcept {
+    return _mm256_cmpgt_epi32(a, b);
+  }
+  IPC_TARGET("avx2") static uint32_t mask(V m) noexcept {
+    return uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+  }
+  template <cmp_op OP>
+  IPC_TARGET("avx2") static uint32_t compare(V a, V b) noexcept {
+    return int_compare<avx2_ops, OP>(a, b);
+  }
+  IPC_TARGET("avx2") static V min(V a, V b) noexcept {
+    return _mm256_min_epi32(a, b);
+  }
+  IPC_TARGET("avx2") static V max(V a, V b) noexcept {
+    return _mm256_max_epi32(a, b);
+  }
+  IPC_TARGET("avx2") static S sum_zero() noexcept {
+    return _mm256_setzero_si256();
+  }
+  // widened to 64 bits, a sum of int32_t overflows quickly
+  IPC_TARGET("avx2") static S sum_add(S acc, V v) noexcept {
+    __m256i __lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v));
+    __m256i __hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1));
+    return _mm256_add_epi64(acc, _mm256_add_epi64(__lo, __hi));
+  }
+  IPC_TARGET("avx2") static int64_t sum_reduce(S acc) noexcept {
+    alignas(32) int64_t __lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(__lanes), acc);
+    return __lanes[0] + __lanes[1] + __lanes[2] + __lanes[3];
+  }
+};
+
+template <> struct avx2_ops<int64_t> {
+  using V = __m256i;
+  using S = __m256i;
+  static constexpr size_t W = 4;
+
+  IPC_TARGET("avx2") static V load(const int64_t *p) noexcept {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  IPC_TARGET("avx2") static void store(int64_t *p, V v) noexcept {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+  IPC_TARGET("avx2") static V set1(int64_t x) noexcept {
+    return _mm256_set1_epi64x(x);
+  }
+  IPC_TARGET("avx2") static V eq(V a, V b) noexcept {
+    return _mm256_cmpeq_epi64(a, b);
+  }
+  IPC_TARGET("avx2") static V gt(V a, V b) noexcept {
+    return _mm256_cmpgt_epi64(a, b);
+  }
+  IPC_TARGET("avx2") static uint32_t mask(V m) noexcept {
+    return uint32_t(_mm256_movemask_pd(_mm256_castsi256_pd(m)));
+  }
+  template <cmp_op OP>
+  IPC_TARGET("avx2") static uint32_t compare(V a, V b) noexcept {
+    return int_compare<avx2_ops, OP>(a, b);
+  }
+  // no 64 bit min/max before AVX-512
+  IPC_TARGET("avx2") static V min(V a, V b) noexcept {
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+  }
+  IPC_TARGET("avx2") static V max(V a, V b) noexcept {
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(b, a));
+  }
+  IPC_TARGET("avx2") static S sum_zero() noexcept {
+    return _mm256_setzero_si256();
+  }
+  IPC_TARGET("avx2") static S sum_add(S acc, V v) noexcept {
+    return _mm256_add_epi64(acc, v);
+  }
+  IPC_TARGET("avx2") static int64_t sum_reduce(S acc) noexcept {
+    alignas(32) int64_t __lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(__lanes), acc);
+    return __lanes[0] + __lanes[1] + __lanes[2] + __lanes[3];
+  }
+};
+
+template <> struct avx2_ops<float> {
+  using V = __m256;
+  using S = __m256d;
+  static constexpr size_t W = 8;
+
+  IPC_TARGET("avx2") static V load(const float *p) noexcept {
+    return _mm256_loadu_ps(p);
+  }
+  IPC_TARGET("avx2") static void store(float *p, V v) noexcept {
+    _mm256_storeu_ps(p, v);
+  }
+  IPC_TARGET("avx2") static V set1(float x) noexcept {
+    return _mm256_set1_ps(x);
+  }
+  template <cmp_op OP>
+  IPC_TARGET("avx2") static uint32_t compare(V a, V b) noexcept {
+    constexpr int __predicate = float_predicate<OP>();
+    return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a, b, __predicate)));
+  }
+  IPC_TARGET("avx2") static V min(V a, V b) noexcept {
+    return _mm256_min_ps(a, b);
+  }
+  IPC_TARGET("avx2") static V max(V a, V b) noexcept {
+    return _mm256_max_ps(a, b);
+  }
+  IPC_TARGET("avx2") static S sum_zero() noexcept {
+    return _mm256_setzero_pd();
+  }
+  // accumulated in double, as the scalar loop does
+  IPC_TARGET("avx2") static S sum_add(S acc, V v) noexcept {
+    __m256d __lo = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+    __m256d __hi = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+    return _mm256_add_pd(acc, _mm256_add_pd(__lo, __hi));
+  }
+  IPC_TARGET("avx2") static double sum_reduce(S acc) noexcept {
+    alignas(32) double __lanes[4];
+    _mm256_store_pd(__lanes, acc);
+    return (__lanes[0] + __lanes[1]) + (__lanes[2] + __lanes[3]);
+  }
+};
+
+template <> struct avx2_ops<double> {
+  using V = __m256d;
+  using S = __m256d;
+  static constexpr size_t W = 4;
+
+  IPC_TARGET("avx2") static V load(const double *p) noexcept {
+    return _mm256_loadu_pd(p);
+  }
+  IPC_TARGET("avx2") static void store(double *p, V v) noexcept {
+    _mm256_storeu_pd(p, v);
+  }
+  IPC_TARGET("avx2") static V set1(double x) noexcept {
+    return _mm256_set1_pd(x);
+  }
+  template <cmp_op OP>
+  IPC_TARGET("avx2") static uint32_t compare(V a, V b) noexcept {
+    constexpr int __predicate = float_predicate<OP>();
+    return uint32_t(_mm256_movemask_pd(_mm256_cmp_pd(a, b, __predicate)));
+  }
+  IPC_TARGET("avx2") static V min(V a, V b) noexcept {
+    return _mm256_min_pd(a, b);
+  }
+  IPC_TARGET("avx2") static V max(V a, V b) noexcept {
+    return _mm256_max_pd(a, b);
+  }
+  IPC_TARGET("avx2") static S sum_zero() noexcept {
+    return _mm256_setzero_pd();
+  }
+  IPC_TARGET("avx2") static S sum_add(S acc, V v) noexcept {
+    return _mm256_add_pd(acc, v);
+  }
+  IPC_TARGET("avx2") static double sum_reduce(S acc) noexcept {
+    alignas(32) double __lanes[4];
+    _mm256_store_pd(__lanes, acc);
+    return (__lanes[0] + __lanes[1]) + (__lanes[2] + __lanes[3]);
+  }
+};
+
+template <typename T, cmp_op OP>
+IPC_TARGET("avx2")
+size_t filter_avx2_op(const T *col, size_t n, T operand,
+                      uint64_t *sel) noexcept {
+  using ops = avx2_ops<T>;
+  const typename ops::V __operand = ops::set1(operand);
+  size_t __selected = 0;
+  size_t b = 0;
+  for (; b + BLOCK <= n; b += BLOCK) {
+    uint64_t __word = 0;
+    for (size_t k = 0; k < BLOCK; k += ops::W) {
+      __word |= uint64_t(ops::template compare<OP>(ops::load(col + b + k),
+                                                   __operand))
+                << k;
+    }
+    sel[b / BLOCK] = __word;
+    __selected += popcount(__word);
+  }
+  return __selected + filter_scalar(col, b, n, OP, operand, sel);
+}
+
+template <typename T>
+size_t filter_avx2(const T *col, size_t n, cmp_op op, T operand,
+                   uint64_t *sel) noexcept {
+  switch (op) {
+  case cmp_op::EQ:
+    return filter_avx2_op<T, cmp_op::EQ>(col, n, operand, sel);
+  case cmp_op::NE:
+    return filter_avx2_op<T, cmp_op::NE>(col, n, operand, sel);
+  case cmp_op::LT:
+    return filter_avx2_op<T, cmp_op::LT>(col, n, operand, sel);
+  case cmp_op::LE:
+    return filter_avx2_op<T, cmp_op::LE>(col, n, operand, sel);
+  case cmp_op::GT:
+    return filter_avx2_op<T, cmp_op::GT>(col, n, operand, sel);
+  case cmp_op::GE:
+    return filter_avx2_op<T, cmp_op::GE>(col, n, operand, sel);
+  }
+  return filter_scalar(col, 0, n, op, operand, sel);
+}
+
+// fully selected blocks go through the vector unit, the others are added a
+// row at a time
+template <typename T>
+IPC_TARGET("avx2")
+column_sum_t<T> sum_avx2(const T *col, size_t n,
+                         const uint64_t *sel) noexcept {
+  using ops = avx2_ops<T>;
+  typename ops::S __acc = ops::sum_zero();
+  column_sum_t<T> __rest = 0;
+  size_t b = 0;
+  for (; b + BLOCK <= n; b += BLOCK) {
+    uint64_t __word = sel ? sel[b / BLOCK] : ALL_ROWS;
+    if (__word == ALL_ROWS) {
+      for (size_t k = 0; k < BLOCK; k += ops::W) {
+        __acc = ops::sum_add(__acc, ops::load(col + b + k));
+      }
+      continue;
+    }
+    for (size_t k = 0; __word; k++, __word >>= 1) {
+      if (__word & 1) {
+        __rest += col[b + k];
+      }
+    }
+  }
+  fold_scalar(col, b, n, sel, [&](T x) { __rest += x; });
+  return ops::sum_reduce(__acc) + __rest;
+}
+
+template <typename T, bool MAX>
+IPC_TARGET("avx2")
+T extreme_avx2(const T *col, size_t n, const uint64_t *sel) noexcept {
+  using ops = avx2_ops<T>;
+  T __best = MAX ? std::numeric_limits<T>::lowest()
+                 : std::numeric_limits<T>::max();
+  typename ops::V __acc = ops::set1(__best);
+  auto __fold = [&](T x) {
+    __best = MAX ? std::max(__best, x) : std::min(__best, x);
+  };
+  size_t b = 0;
+  for (; b + BLOCK <= n; b += BLOCK) {
+    uint64_t __word = sel ? sel[b / BLOCK] : ALL_ROWS;
+    if (__word == ALL_ROWS) {
+      for (size_t k = 0; k < BLOCK; k += ops::W) {
+        typename ops::V __v = ops::load(col + b + k);
+        __acc = MAX ? ops::max(__acc, __v) : ops::min(__acc, __v);
+      }
+      continue;
+    }
+    for (size_t k = 0; __word; k++, __word >>= 1) {
+      if (__word & 1) {
+        __fold(col[b + k]);
+      }
+    }
+  }
+  fold_scalar(col, b, n, sel, __fold);
+  alignas(32) T __lanes[ops::W];
+  ops::store(__lanes, __acc);
+  for (T __lane : __lanes) {
+    __fold(__lane);
+  }
+  return __best;
+}
+#endif
+
+template <typename T> struct kernels_t {
+  size_t (*filter_)(const T *, size_t, cmp_op, T, uint64_t *) noexcept;
+  column_sum_t<T> (*sum_)(const T *, size_t, const uint64_t *) noexcept;
+  T (*min_)(const T *, size_t, const uint64_t *) noexcept;
+  T (*max_)(const T *, size_t, const uint64_t *) noexcept;
+};
+
+template <typename T> kernels_t<T> select_kernels() noexcept {
+#ifdef IPC_X86
+  if (cpu_features().avx2) {
+    return {filter_avx2<T>, sum_avx2<T>, extreme_avx2<T, false>,
+            extreme_avx2<T, true>};
+  }
+#endif
+  return {filter_plain<T>, sum_plain<T>, extreme_plain<T, false>,
+          extreme_plain<T, true>};
+}
+
+template <typename T> const kernels_t<T> &kernels() noexcept {
+  static const kernels_t<T> __kernels = select_kernels<T>();
+  return __kernels;
+}
+} // namespace
+
+template <typename T>
+size_t column_filter(const T *col, size_t n, cmp_op op, T operand,
+                     uint64_t *sel) noexcept {
+  return kernels<T>().filter_(col, n, op, operand, sel);
+}
+
+template <typename T>
+column_sum_t<T> column_sum(const T *col, size_t n,
+                           const uint64_t *sel) noexcept {
+  return kernels<T>().sum_(col, n, sel);
+}
+
+template <typename T>
+T column_min(const T *col, size_t n, const uint64_t *sel) noexcept {
+  return kernels<T>().min_(col, n, sel);
+}
+
+template <typename T>
+T column_max(const T *col, size_t n, const uint64_t *sel) noexcept {
+  return kernels<T>().max_(col, n, sel);
+}
+
+#define IPC_COLUMN_KERNELS(T)                                                  \
+  template size_t column_filter<T>(const T *, size_t, cmp_op, T,               \
+                                   uint64_t *) noexcept;                       \
+  template column_sum_t<T> column_sum<T>(const T *, size_t,                    \
+                                         const uint64_t *) noexcept;           \
+  template T column_min<T>(const T *, size_t, const uint64_t *) noexcept;      \
+  template T column_max<T>(const T *, size_t, const uint64_t *) noexcept;
+
+IPC_COLUMN_KERNELS(int32_t)
+IPC_COLUMN_KERNELS(int64_t)
+IPC_COLUMN_KERNELS(float)
+IPC_COLUMN_KERNELS(double)
+
+size_t selection_count(const uint64_t *sel, size_t n) noexcept {
+  size_t __count = 0;
+  for (size_t i = 0; i < selection_words(n); i++) {
+    __count += popcount(sel[i]);
+  }
+  return __count;
+}
+
+void selection_and(uint64_t *dst, const uint64_t *other, size_t n) noexcept {
+  for (size_t i = 0; i < selection_words(n); i++) {
+    dst[i] &= other[i];
+  }
+}
+
+void selection_or(uint64_t *dst, const uint64_t *other, size_t n) noexcept {
+  for (size_t i = 0; i < selection_words(n); i++) {
+    dst[i] |= other[i];
+  }
+}
+} // namespace ipc
@@ -0,0 +1,40 @@
+#include "cpuinfo.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+namespace ipc {
+static cpu_features_t detect_cpu_features() noexcept {
+  cpu_features_t __f;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  __f.sse2 = __builtin_cpu_supports("sse2");
+  __f.avx2 = __builtin_cpu_supports("avx2");
+  __f.avx512f = __builtin_cpu_supports("avx512f");
+  unsigned __eax, __ebx, __ecx, __edx;
+  if (__get_cpuid_count(7, 0, &__eax, &__ebx, &__ecx, &__edx)) {
+    __f.waitpkg = (__ecx >> 5) & 1;
+  }
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  int __regs[4];
+  __cpuid(__regs, 1);
+  __f.sse2 = (__regs[3] >> 26) & 1;
+  bool __osxsave = (__regs[2] >> 27) & 1;
+  unsigned long long __xcr0 = __osxsave ? _xgetbv(0) : 0;
+  __cpuidex(__regs, 7, 0);
+  __f.avx2 = ((__xcr0 & 0x6) == 0x6) && ((__regs[1] >> 5) & 1);
+  __f.avx512f = ((__xcr0 & 0xe6) == 0xe6) && ((__regs[1] >> 16) & 1);
+  __f.waitpkg = (__regs[2] >> 5) & 1;
+#endif
+  return __f;
+}
+
+const cpu_features_t &cpu_features() noexcept {
+  static const cpu_features_t __features = detect_cpu_features();
+  return __features;
+}
+} // namespace ipc
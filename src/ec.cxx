@@ -20,6 +20,44 @@ std::string IPCErrorCategory::message(int ev) const {
     return "shm address is nullptr!";
   case IPCErrc::ShmDeleted:
       return "shm is marked as deleted!";
+  case IPCErrc::ShmLayoutMismatch:
+    return "shm object layout does not match!";
+  case IPCErrc::ShmNotInitialized:
+    return "shm object is not initialized!";
+  case IPCErrc::SnapshotNotFound:
+    return "no valid snapshot found!";
+  case IPCErrc::RpcNoFreeSlot:
+    return "no free rpc slot!";
+  case IPCErrc::TaskQueueFull:
+    return "task queue is full!";
+  case IPCErrc::LogFormatTableFull:
+    return "log format table is full!";
+  case IPCErrc::LogNoFreeRing:
+    return "no free log ring!";
+  case IPCErrc::McastNoFreeClient:
+    return "no free multicast client slot!";
+  case IPCErrc::McastNoSuchClient:
+    return "no such multicast client!";
+  case IPCErrc::McastQueueFull:
+    return "multicast queue is full!";
+  case IPCErrc::McastPoolExhausted:
+    return "no free buffer in the multicast pool!";
+  case IPCErrc::EpochNoFreeSlot:
+    return "no free participant slot in the epoch domain!";
+  case IPCErrc::EpochLimboFull:
+    return "too many retired nodes waiting for the epoch to advance!";
+  case IPCErrc::TableFull:
+    return "shared table is full!";
+  case IPCErrc::RecordOverflow:
+    return "record does not fit in its buffer!";
+  case IPCErrc::RecordMismatch:
+    return "record does not match its schema!";
+  case IPCErrc::IdAllocatorFull:
+    return "no free id left in the allocator!";
+  case IPCErrc::ShmNoFreeSlot:
+    return "too many handles attached to the shared memory object!";
+  case IPCErrc::SnapshotCorrupted:
+    return "snapshot is corrupted!";
   default:
     return "unknown error";
   }
@@ -0,0 +1,454 @@
+#include "epoch_domain.hpp"
+#include "detail.hpp"
+#include "proc_id.hpp"
+
+#include <new>
+#include <utility>
+
+namespace ipc {
+namespace {
+using detail::CACHE_LINE;
+using detail::READY;
+using detail::round_up;
+using detail::round_up_pow2;
+using detail::throw_if;
+using detail::wait_ready;
+
+/**
+ * @brief low bit of a participant's local epoch, set while it is pinned
+ *
+ */
+constexpr uint64_t PINNED = 1;
+
+/**
+ * @brief failed advances before the process of the participant holding the
+ * epoch back is checked, reading /proc is not free
+ *
+ */
+constexpr uint32_t STALL_CHECK = 64;
+/**
+ * @brief retire() collects every COLLECT_EVERY nodes, collect() looks at the
+ * slots left behind by other participants every SWEEP_EVERY calls
+ *
+ */
+constexpr uint64_t COLLECT_EVERY = 64;
+constexpr uint32_t SWEEP_EVERY = 64;
+
+static_assert(std::atomic<proc_id>::is_always_lock_free,
+              "participant slots are claimed with a compare exchange");
+} // namespace
+
+/**
+ * @brief placed at the begining of the shared memory buffer
+ * memory layout might look like this:
+ *  | domain meta | slots | limbo 0 | limbo 1 | ... |
+ */
+struct epoch_domain::domain_meta_t {
+  std::atomic<uint32_t> state_;
+  uint32_t nslots_;
+  uint32_t limbo_cap_;
+  alignas(CACHE_LINE) std::atomic<uint64_t> epoch_;
+};
+
+struct epoch_domain::slot_t {
+  /**
+   * @brief process of the participant, or of a participant freeing the nodes
+   * left in the slot
+   *
+   */
+  alignas(CACHE_LINE) std::atomic<proc_id> owner_;
+  /**
+   * @brief epoch seen by the participant << 1 | PINNED while pinned, 0
+   * otherwise
+   *
+   */
+  std::atomic<uint64_t> local_;
+  /**
+   * @brief positions in the limbo ring of the slot, only moved by the owner
+   *
+   */
+  std::atomic<uint64_t> head_;
+  std::atomic<uint64_t> tail_;
+};
+
+/**
+ * @brief a retired node and the epoch it was retired in, it can be freed once
+ * the global epoch is two ahead
+ */
+struct epoch_domain::limbo_t {
+  uint64_t epoch_;
+  uint64_t node_;
+};
+
+void epoch_domain::create(std::string_view name, uint32_t nslots,
+                          uint32_t limbo_cap, std::error_code &ec) noexcept {
+  if (nslots == 0 || limbo_cap == 0 || limbo_cap > (1u << 30)) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  limbo_cap = round_up_pow2(limbo_cap);
+  size_t __meta_size = round_up(sizeof(domain_meta_t), CACHE_LINE);
+  this->hdl_ = shmhdl(name,
+                      __meta_size + sizeof(slot_t) * nslots +
+                          sizeof(limbo_t) * limbo_cap * nslots,
+                      ec);
+  if (ec) {
+    return;
+  }
+  char *__buf = static_cast<char *>(this->hdl_.map(ec));
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = new (__buf) domain_meta_t;
+  this->meta_->nslots_ = nslots;
+  this->meta_->limbo_cap_ = limbo_cap;
+  this->meta_->epoch_.store(0, std::memory_order_relaxed);
+  this->slots_ = reinterpret_cast<slot_t *>(__buf + __meta_size);
+  for (uint32_t i = 0; i < nslots; i++) {
+    auto __s = new (&this->slots_[i]) slot_t;
+    __s->owner_.store(proc_id{}, std::memory_order_relaxed);
+    __s->local_.store(0, std::memory_order_relaxed);
+    __s->head_.store(0, std::memory_order_relaxed);
+    __s->tail_.store(0, std::memory_order_relaxed);
+  }
+  this->limbo_ = reinterpret_cast<limbo_t *>(this->slots_ + nslots);
+  this->meta_->state_.store(READY, std::memory_order_release);
+  this->join(ec);
+}
+
+void epoch_domain::attach(std::string_view name, std::error_code &ec,
+                          std::chrono::milliseconds timeout) noexcept {
+  this->hdl_ = shmhdl(name, ec);
+  if (ec) {
+    return;
+  }
+  char *__buf = static_cast<char *>(this->hdl_.map(ec));
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __meta_size = round_up(sizeof(domain_meta_t), CACHE_LINE);
+  if (size_t(this->hdl_.nbytes()) < __meta_size) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = reinterpret_cast<domain_meta_t *>(__buf);
+  // wait for the creator to finish initializing the domain
+  if (!wait_ready(__meta->state_, timeout)) {
+    ec = IPCErrc::ShmNotInitialized;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  if (size_t(this->hdl_.nbytes()) !=
+      __meta_size + sizeof(slot_t) * __meta->nslots_ +
+          sizeof(limbo_t) * __meta->limbo_cap_ * __meta->nslots_) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = __meta;
+  this->slots_ = reinterpret_cast<slot_t *>(__buf + __meta_size);
+  this->limbo_ = reinterpret_cast<limbo_t *>(this->slots_ + __meta->nslots_);
+  this->join(ec);
+}
+
+epoch_domain::limbo_t *epoch_domain::limbo_of(uint32_t slot) const noexcept {
+  return this->limbo_ + size_t(slot) * this->meta_->limbo_cap_;
+}
+
+void epoch_domain::join(std::error_code &ec) noexcept {
+  const proc_id __self = proc_id::self();
+  for (uint32_t i = 0; i < this->meta_->nslots_; i++) {
+    slot_t &__s = this->slots_[i];
+    proc_id __owner = __s.owner_.load(std::memory_order_acquire);
+    if (!__owner.empty() && __owner.alive()) {
+      continue;
+    }
+    if (!__s.owner_.compare_exchange_strong(__owner, __self,
+                                            std::memory_order_acq_rel)) {
+      continue;
+    }
+    // a dead owner may have been pinned; the nodes it retired are kept and
+    // freed by this participant
+    __s.local_.store(0, std::memory_order_release);
+    this->self_ = i;
+    return;
+  }
+  ec = IPCErrc::EpochNoFreeSlot;
+  this->meta_ = nullptr;
+  this->hdl_ = shmhdl();
+}
+
+void epoch_domain::leave() noexcept {
+  if (!this->meta_) {
+    return;
+  }
+  slot_t &__s = this->slots_[this->self_];
+  this->nest_ = 0;
+  __s.local_.store(0, std::memory_order_release);
+  this->collect();
+  __s.owner_.store(proc_id{}, std::memory_order_release);
+  this->meta_ = nullptr;
+}
+
+epoch_domain::epoch_domain(create_only_t, std::string_view name,
+                           uint32_t nslots, uint32_t limbo_cap,
+                           std::error_code &ec) noexcept {
+  this->create(name, nslots, limbo_cap, ec);
+}
+
+epoch_domain::epoch_domain(create_only_t, std::string_view name,
+                           uint32_t nslots, uint32_t limbo_cap) {
+  std::error_code ec;
+  this->create(name, nslots, limbo_cap, ec);
+  throw_if(ec);
+}
+
+epoch_domain::epoch_domain(open_only_t, std::string_view name,
+                           std::error_code &ec,
+                           std::chrono::milliseconds timeout) noexcept {
+  this->attach(name, ec, timeout);
+}
+
+epoch_domain::epoch_domain(open_only_t, std::string_view name,
+                           std::chrono::milliseconds timeout) {
+  std::error_code ec;
+  this->attach(name, ec, timeout);
+  throw_if(ec);
+}
+
+epoch_domain::~epoch_domain() { this->leave(); }
+
+epoch_domain::epoch_domain(epoch_domain &&other) noexcept
+    : hdl_(std::move(other.hdl_)), meta_(std::exchange(other.meta_, nullptr)),
+      slots_(std::exchange(other.slots_, nullptr)),
+      limbo_(std::exchange(other.limbo_, nullptr)), self_(other.self_),
+      nest_(std::exchange(other.nest_, 0)), collects_(other.collects_),
+      stalls_(other.stalls_), reclaim_(std::move(other.reclaim_)) {}
+
+epoch_domain &epoch_domain::operator=(epoch_domain &&other) noexcept {
+  if (this != &other) {
+    this->leave();
+    this->hdl_ = std::move(other.hdl_);
+    this->meta_ = std::exchange(other.meta_, nullptr);
+    this->slots_ = std::exchange(other.slots_, nullptr);
+    this->limbo_ = std::exchange(other.limbo_, nullptr);
+    this->self_ = other.self_;
+    this->nest_ = std::exchange(other.nest_, 0);
+    this->collects_ = other.collects_;
+    this->stalls_ = other.stalls_;
+    this->reclaim_ = std::move(other.reclaim_);
+  }
+  return *this;
+}
+
+void epoch_domain::on_reclaim(std::function<void(uint64_t)> reclaim) {
+  this->reclaim_ = std::move(reclaim);
+}
+
+void epoch_domain::pin() noexcept {
+  if (!this->meta_ || this->nest_++ > 0) {
+    return;
+  }
+  slot_t &__s = this->slots_[this->self_];
+  uint64_t __epoch = this->meta_->epoch_.load(std::memory_order_relaxed);
+  for (;;) {
+    __s.local_.store(__epoch << 1 | PINNED, std::memory_order_relaxed);
+    // pairs with the fence in try_advance(): either the advancer sees this
+    // participant pinned, or the reads that follow see what was unlinked
+    // before the advance
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t __now = this->meta_->epoch_.load(std::memory_order_relaxed);
+    if (__now == __epoch) {
+      return;
+    }
+    // a stale epoch is safe but would hold the next advance back
+    __epoch = __now;
+  }
+}
+
+void epoch_domain::unpin() noexcept {
+  if (!this->meta_ || this->nest_ == 0 || --this->nest_ > 0) {
+    return;
+  }
+  // the reads of the critical section happen before the nodes are freed
+  this->slots_[this->self_].local_.store(0, std::memory_order_release);
+}
+
+epoch_guard epoch_domain::guard() noexcept {
+  if (!this->meta_) {
+    return {};
+  }
+  this->pin();
+  return epoch_guard(this);
+}
+
+bool epoch_domain::pinned() const noexcept { return this->nest_ > 0; }
+
+bool epoch_domain::try_advance() noexcept {
+  if (!this->meta_) {
+    return false;
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t __epoch = this->meta_->epoch_.load(std::memory_order_relaxed);
+  const proc_id __self = proc_id::self();
+  for (uint32_t i = 0; i < this->meta_->nslots_; i++) {
+    slot_t &__s = this->slots_[i];
+    uint64_t __local = __s.local_.load(std::memory_order_acquire);
+    if (!(__local & PINNED) || __local >> 1 == __epoch) {
+      continue;
+    }
+    if (++this->stalls_ % STALL_CHECK != 0) {
+      return false;
+    }
+    // pinned in an older epoch for a while, maybe by a dead process
+    proc_id __owner = __s.owner_.load(std::memory_order_acquire);
+    if (__owner.empty() || __owner.alive() ||
+        !__s.owner_.compare_exchange_strong(__owner, __self,
+                                            std::memory_order_acq_rel)) {
+      return false;
+    }
+    // the limbo ring is left to the next owner or to a sweep
+    __s.local_.store(0, std::memory_order_release);
+    __s.owner_.store(proc_id{}, std::memory_order_release);
+  }
+  // a failed exchange means another participant advanced it
+  this->meta_->epoch_.compare_exchange_strong(__epoch, __epoch + 1,
+                                              std::memory_order_acq_rel);
+  return true;
+}
+
+size_t epoch_domain::drain(uint32_t slot) noexcept {
+  slot_t &__s = this->slots_[slot];
+  limbo_t *__limbo = this->limbo_of(slot);
+  const uint64_t __mask = this->meta_->limbo_cap_ - 1;
+  const uint64_t __epoch = this->meta_->epoch_.load(std::memory_order_acquire);
+  uint64_t __head = __s.head_.load(std::memory_order_relaxed);
+  const uint64_t __tail = __s.tail_.load(std::memory_order_relaxed);
+  size_t __freed = 0;
+  // retired in epoch order, the oldest first
+  for (; __head != __tail; __head++, __freed++) {
+    const limbo_t &__l = __limbo[__head & __mask];
+    if (__l.epoch_ + 2 > __epoch) {
+      break;
+    }
+    this->reclaim_(__l.node_);
+  }
+  __s.head_.store(__head, std::memory_order_relaxed);
+  return __freed;
+}
+
+void epoch_domain::sweep() noexcept {
+  const proc_id __self = proc_id::self();
+  for (uint32_t i = 0; i < this->meta_->nslots_; i++) {
+    slot_t &__s = this->slots_[i];
+    if (i == this->self_ || __s.head_.load(std::memory_order_relaxed) ==
+                                __s.tail_.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    proc_id __owner = __s.owner_.load(std::memory_order_acquire);
+    if (!__owner.empty() && __owner.alive()) {
+      continue;
+    }
+    // owning the slot for the time of the drain keeps joiners away
+    if (!__s.owner_.compare_exchange_strong(__owner, __self,
+                                            std::memory_order_acq_rel)) {
+      continue;
+    }
+    __s.local_.store(0, std::memory_order_release);
+    this->drain(i);
+    __s.owner_.store(proc_id{}, std::memory_order_release);
+  }
+}
+
+size_t epoch_domain::collect() noexcept {
+  if (!this->meta_ || !this->reclaim_) {
+    return 0;
+  }
+  this->try_advance();
+  size_t __freed = this->drain(this->self_);
+  if (++this->collects_ % SWEEP_EVERY == 0) {
+    this->sweep();
+  }
+  return __freed;
+}
+
+void epoch_domain::retire(uint64_t node, std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  slot_t &__s = this->slots_[this->self_];
+  const uint64_t __cap = this->meta_->limbo_cap_;
+  uint64_t __tail = __s.tail_.load(std::memory_order_relaxed);
+  // a node waits for two advances, which may take a few collects
+  for (int __attempt = 0;
+       __attempt < 3 &&
+       __tail - __s.head_.load(std::memory_order_relaxed) >= __cap;
+       __attempt++) {
+    this->collect();
+  }
+  if (__tail - __s.head_.load(std::memory_order_relaxed) >= __cap) {
+    ec = IPCErrc::EpochLimboFull;
+    return;
+  }
+  // the node is unlinked already, readers pinned from now on cannot reach it
+  limbo_t &__l = this->limbo_of(this->self_)[__tail & (__cap - 1)];
+  __l.epoch_ = this->meta_->epoch_.load(std::memory_order_seq_cst);
+  __l.node_ = node;
+  __s.tail_.store(__tail + 1, std::memory_order_relaxed);
+  if ((__tail + 1) % COLLECT_EVERY == 0) {
+    this->collect();
+  }
+}
+
+void epoch_domain::retire(uint64_t node) {
+  std::error_code ec;
+  this->retire(node, ec);
+  throw_if(ec);
+}
+
+uint64_t epoch_domain::epoch() const noexcept {
+  return this->meta_ ? this->meta_->epoch_.load(std::memory_order_acquire) : 0;
+}
+
+size_t epoch_domain::pending() const noexcept {
+  if (!this->meta_) {
+    return 0;
+  }
+  const slot_t &__s = this->slots_[this->self_];
+  return size_t(__s.tail_.load(std::memory_order_relaxed) -
+                __s.head_.load(std::memory_order_relaxed));
+}
+
+uint32_t epoch_domain::id() const noexcept { return this->self_; }
+
+bool epoch_domain::valid() const noexcept { return this->meta_ != nullptr; }
+
+epoch_domain::operator bool() const noexcept { return this->valid(); }
+
+epoch_guard::epoch_guard(epoch_domain *domain) noexcept : domain_(domain) {}
+
+epoch_guard::~epoch_guard() { this->reset(); }
+
+epoch_guard::epoch_guard(epoch_guard &&other) noexcept
+    : domain_(std::exchange(other.domain_, nullptr)) {}
+
+epoch_guard &epoch_guard::operator=(epoch_guard &&other) noexcept {
+  if (this != &other) {
+    this->reset();
+    this->domain_ = std::exchange(other.domain_, nullptr);
+  }
+  return *this;
+}
+
+void epoch_guard::reset() noexcept {
+  if (this->domain_) {
+    this->domain_->unpin();
+  }
+  this->domain_ = nullptr;
+}
+} // namespace ipc
@@ -0,0 +1,416 @@
+#include "id_allocator.hpp"
+#include "detail.hpp"
+
+#include <new>
+#include <utility>
+
+namespace ipc {
+namespace {
+using detail::CACHE_LINE;
+using detail::READY;
+using detail::round_up;
+using detail::throw_if;
+using detail::wait_ready;
+
+constexpr uint64_t FULL = ~uint64_t(0);
+
+/**
+ * @brief index of the lowest set bit, word is not 0
+ *
+ */
+inline uint32_t lowest_set(uint64_t word) noexcept {
+#if defined(__GNUC__)
+  return uint32_t(__builtin_ctzll(word));
+#else
+  uint32_t __n = 0;
+  for (; !(word & 1); word >>= 1) {
+    __n++;
+  }
+  return __n;
+#endif
+}
+} // namespace
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the bitmap words must be lock free to be shared");
+static_assert(std::atomic<proc_id>::is_always_lock_free,
+              "proc_id must be lock free to be claimed in shared memory");
+
+/**
+ * @brief placed at the begining of the shared memory buffer
+ * memory layout might look like this:
+ *  | alloc meta | root word | level 1 | ... | id bits | owners |
+ */
+struct id_allocator::alloc_meta_t {
+  std::atomic<uint32_t> state_;
+  uint32_t nlevels_;
+  uint32_t capacity_;
+  uint32_t reserved_;
+};
+
+size_t id_allocator::layout(uint32_t capacity, size_t *offsets) noexcept {
+  // words of every level from the ids up to a single root word
+  uint32_t __n[MAX_LEVELS];
+  uint32_t __words = (capacity + 63) / 64;
+  uint32_t __l = 0;
+  __n[__l++] = __words;
+  while (__words > 1) {
+    __words = (__words + 63) / 64;
+    __n[__l++] = __words;
+  }
+  this->nlevels_ = __l;
+  size_t __offset = round_up(sizeof(alloc_meta_t), CACHE_LINE);
+  for (uint32_t i = 0; i < __l; i++) {
+    this->nwords_[i] = __n[__l - 1 - i];
+    offsets[i] = __offset;
+    __offset += round_up(sizeof(uint64_t) * this->nwords_[i], CACHE_LINE);
+  }
+  offsets[__l] = __offset;
+  return __offset + round_up(sizeof(proc_id) * capacity, CACHE_LINE);
+}
+
+void id_allocator::map_levels(char *buf, const size_t *offsets) noexcept {
+  for (uint32_t i = 0; i < this->nlevels_; i++) {
+    this->levels_[i] =
+        reinterpret_cast<std::atomic<uint64_t> *>(buf + offsets[i]);
+  }
+  this->owners_ =
+      reinterpret_cast<std::atomic<proc_id> *>(buf + offsets[this->nlevels_]);
+}
+
+void id_allocator::create(std::string_view name, uint32_t capacity,
+                          std::error_code &ec) noexcept {
+  if (capacity == 0 || capacity > MAX_CAPACITY) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  size_t __offsets[MAX_LEVELS + 1];
+  size_t __size = this->layout(capacity, __offsets);
+  this->hdl_ = shmhdl(name, __size, ec);
+  if (ec) {
+    return;
+  }
+  char *__buf = static_cast<char *>(this->hdl_.map(ec));
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = new (__buf) alloc_meta_t;
+  __meta->nlevels_ = this->nlevels_;
+  __meta->capacity_ = capacity;
+  __meta->reserved_ = 0;
+  this->map_levels(__buf, __offsets);
+  // the object is new hence zero filled: every id is free and has no owner,
+  // the pages of a large allocator are not touched before they are used.
+  // Only the bits past the last id, or the last word of the level below, are
+  // set, so that they are never handed out.
+  for (uint32_t l = 0; l < this->nlevels_; l++) {
+    uint32_t __count =
+        l + 1 == this->nlevels_ ? capacity : this->nwords_[l + 1];
+    if (__count % 64) {
+      this->levels_[l][this->nwords_[l] - 1].store(FULL << (__count % 64),
+                                                   std::memory_order_relaxed);
+    }
+  }
+  this->meta_ = __meta;
+  this->meta_->state_.store(READY, std::memory_order_release);
+}
+
+void id_allocator::attach(std::string_view name, std::error_code &ec,
+                          std::chrono::milliseconds timeout) noexcept {
+  this->hdl_ = shmhdl(name, ec);
+  if (ec) {
+    return;
+  }
+  char *__buf = static_cast<char *>(this->hdl_.map(ec));
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  if (size_t(this->hdl_.nbytes()) < round_up(sizeof(alloc_meta_t), CACHE_LINE)) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = reinterpret_cast<alloc_meta_t *>(__buf);
+  // wait for the creator to finish initializing the bitmap
+  if (!wait_ready(__meta->state_, timeout)) {
+    ec = IPCErrc::ShmNotInitialized;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __offsets[MAX_LEVELS + 1];
+  if (__meta->capacity_ == 0 || __meta->capacity_ > MAX_CAPACITY ||
+      this->layout(__meta->capacity_, __offsets) !=
+          size_t(this->hdl_.nbytes()) ||
+      this->nlevels_ != __meta->nlevels_) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->nlevels_ = 0;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->map_levels(__buf, __offsets);
+  this->meta_ = __meta;
+}
+
+id_allocator::id_allocator(create_only_t, std::string_view name,
+                           uint32_t capacity, std::error_code &ec) noexcept {
+  this->create(name, capacity, ec);
+}
+
+id_allocator::id_allocator(create_only_t, std::string_view name,
+                           uint32_t capacity) {
+  std::error_code ec;
+  this->create(name, capacity, ec);
+  throw_if(ec);
+}
+
+id_allocator::id_allocator(open_only_t, std::string_view name,
+                           std::error_code &ec,
+                           std::chrono::milliseconds timeout) noexcept {
+  this->attach(name, ec, timeout);
+}
+
+id_allocator::id_allocator(open_only_t, std::string_view name,
+                           std::chrono::milliseconds timeout) {
+  std::error_code ec;
+  this->attach(name, ec, timeout);
+  throw_if(ec);
+}
+
+id_allocator::id_allocator(id_allocator &&other) noexcept {
+  *this = std::move(other);
+}
+
+id_allocator &id_allocator::operator=(id_allocator &&other) noexcept {
+  if (this != &other) {
+    this->hdl_ = std::move(other.hdl_);
+    this->meta_ = std::exchange(other.meta_, nullptr);
+    for (uint32_t i = 0; i < MAX_LEVELS; i++) {
+      this->levels_[i] = std::exchange(other.levels_[i], nullptr);
+      this->nwords_[i] = std::exchange(other.nwords_[i], 0);
+    }
+    this->nlevels_ = std::exchange(other.nlevels_, 0);
+    this->owners_ = std::exchange(other.owners_, nullptr);
+  }
+  return *this;
+}
+
+void id_allocator::mark_full(uint32_t level, uint32_t word) noexcept {
+  for (uint32_t l = level; l > 0; l--, word /= 64) {
+    std::atomic<uint64_t> &__parent = this->levels_[l - 1][word / 64];
+    uint64_t __bit = uint64_t(1) << (word % 64);
+    uint64_t __prev = __parent.fetch_or(__bit, std::memory_order_acq_rel);
+    // a release between the word filling up and the summary bit being set
+    // saw no summary to clear, the bit must not hide its free id
+    if (this->levels_[l][word].load(std::memory_order_acquire) != FULL) {
+      __parent.fetch_and(~__bit, std::memory_order_acq_rel);
+      return;
+    }
+    if ((__prev | __bit) != FULL) {
+      return;
+    }
+  }
+}
+
+void id_allocator::mark_free(uint32_t level, uint32_t word) noexcept {
+  for (uint32_t l = level; l > 0; l--, word /= 64) {
+    uint64_t __bit = uint64_t(1) << (word % 64);
+    uint64_t __prev = this->levels_[l - 1][word / 64].fetch_and(
+        ~__bit, std::memory_order_acq_rel);
+    if (__prev != FULL) {
+      return;
+    }
+  }
+}
+
+uint32_t id_allocator::try_allocate() noexcept {
+  const uint32_t __leaf = this->nlevels_ - 1;
+  for (;;) {
+    // walk down the lowest words that are not full
+    uint32_t __w = 0;
+    uint32_t l = 0;
+    for (; l < __leaf; l++) {
+      uint64_t __word = this->levels_[l][__w].load(std::memory_order_acquire);
+      if (__word == FULL) {
+        break;
+      }
+      __w = __w * 64 + lowest_set(~__word);
+    }
+    if (l == __leaf) {
+      std::atomic<uint64_t> &__ids = this->levels_[__leaf][__w];
+      uint64_t __word = __ids.load(std::memory_order_relaxed);
+      while (__word != FULL) {
+        uint32_t __b = lowest_set(~__word);
+        uint64_t __bit = uint64_t(1) << __b;
+        uint64_t __prev = __ids.fetch_or(__bit, std::memory_order_acq_rel);
+        if (!(__prev & __bit)) {
+          if ((__prev | __bit) == FULL) {
+            this->mark_full(__leaf, __w);
+          }
+          return __w * 64 + __b;
+        }
+        __word = __prev;
+      }
+    }
+    if (l == 0) {
+      break;
+    }
+    // the summary above missed a full word, fix it and walk again
+    this->mark_full(l, __w);
+  }
+
+  // the root says every id is taken, yet summaries may be stale, e.g. set by
+  // a process that died before a release cleared them: scan the ids
+  const uint32_t __nwords = this->nwords_[__leaf];
+  for (uint32_t w = 0; w < __nwords; w++) {
+    std::atomic<uint64_t> &__ids = this->levels_[__leaf][w];
+    uint64_t __word = __ids.load(std::memory_order_relaxed);
+    while (__word != FULL) {
+      uint32_t __b = lowest_set(~__word);
+      uint64_t __bit = uint64_t(1) << __b;
+      uint64_t __prev = __ids.fetch_or(__bit, std::memory_order_acq_rel);
+      if (!(__prev & __bit)) {
+        if ((__prev | __bit) == FULL) {
+          this->mark_full(__leaf, w);
+        } else {
+          // clear the summaries above, whatever they say
+          for (uint32_t k = __leaf, __i = w; k > 0; k--, __i /= 64) {
+            this->levels_[k - 1][__i / 64].fetch_and(
+                ~(uint64_t(1) << (__i % 64)), std::memory_order_acq_rel);
+          }
+        }
+        return w * 64 + __b;
+      }
+      __word = __prev;
+    }
+  }
+  return npos;
+}
+
+uint32_t id_allocator::allocate(std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return npos;
+  }
+  uint32_t __id = this->try_allocate();
+  if (__id == npos && this->reclaim() > 0) {
+    __id = this->try_allocate();
+  }
+  if (__id == npos) {
+    ec = IPCErrc::IdAllocatorFull;
+    return npos;
+  }
+  this->owners_[__id].store(proc_id::self(), std::memory_order_release);
+  return __id;
+}
+
+uint32_t id_allocator::allocate() {
+  std::error_code ec;
+  uint32_t __id = this->allocate(ec);
+  throw_if(ec);
+  return __id;
+}
+
+void id_allocator::release(uint32_t id, std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  const uint32_t __leaf = this->nlevels_ - 1;
+  uint64_t __bit = uint64_t(1) << (id % 64);
+  if (id >= this->meta_->capacity_ ||
+      !(this->levels_[__leaf][id / 64].load(std::memory_order_relaxed) &
+        __bit)) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  // the next process to take the id sets its owner after the bit
+  this->owners_[id].store(proc_id{}, std::memory_order_relaxed);
+  uint64_t __prev = this->levels_[__leaf][id / 64].fetch_and(
+      ~__bit, std::memory_order_acq_rel);
+  if (!(__prev & __bit)) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  if (__prev == FULL) {
+    this->mark_free(__leaf, id / 64);
+  }
+}
+
+void id_allocator::release(uint32_t id) {
+  std::error_code ec;
+  this->release(id, ec);
+  throw_if(ec);
+}
+
+uint32_t id_allocator::reclaim() noexcept {
+  if (!this->meta_) {
+    return 0;
+  }
+  const uint32_t __leaf = this->nlevels_ - 1;
+  uint32_t __released = 0;
+  // a process usually holds many ids, remember the last verdicts
+  proc_id __alive, __dead;
+  for (uint32_t w = 0; w < this->nwords_[__leaf]; w++) {
+    uint64_t __word = this->levels_[__leaf][w].load(std::memory_order_acquire);
+    for (; __word; __word &= __word - 1) {
+      uint32_t __id = w * 64 + lowest_set(__word);
+      if (__id >= this->meta_->capacity_) {
+        break;
+      }
+      proc_id __owner = this->owners_[__id].load(std::memory_order_acquire);
+      // free, or being allocated
+      if (__owner.empty() || __owner == __alive) {
+        continue;
+      }
+      if (__owner != __dead) {
+        if (__owner.alive()) {
+          __alive = __owner;
+          continue;
+        }
+        __dead = __owner;
+      }
+      if (!this->owners_[__id].compare_exchange_strong(
+              __owner, proc_id{}, std::memory_order_acq_rel)) {
+        continue;
+      }
+      uint64_t __bit = uint64_t(1) << (__id % 64);
+      uint64_t __prev = this->levels_[__leaf][w].fetch_and(
+          ~__bit, std::memory_order_acq_rel);
+      if (__prev == FULL) {
+        this->mark_free(__leaf, w);
+      }
+      __released++;
+    }
+  }
+  return __released;
+}
+
+bool id_allocator::allocated(uint32_t id) const noexcept {
+  if (!this->meta_ || id >= this->meta_->capacity_) {
+    return false;
+  }
+  return (this->levels_[this->nlevels_ - 1][id / 64].load(
+              std::memory_order_acquire) >>
+          (id % 64)) &
+         1;
+}
+
+proc_id id_allocator::owner(uint32_t id) const noexcept {
+  if (!this->meta_ || id >= this->meta_->capacity_) {
+    return {};
+  }
+  return this->owners_[id].load(std::memory_order_acquire);
+}
+
+uint32_t id_allocator::capacity() const noexcept {
+  return this->meta_ ? this->meta_->capacity_ : 0;
+}
+
+bool id_allocator::valid() const noexcept { return this->meta_ != nullptr; }
+
+id_allocator::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
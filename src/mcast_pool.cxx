@@ -0,0 +1,621 @@
+#include "mcast_pool.hpp"
+#include "detail.hpp"
+#include "doorbell.hpp"
+#include "proc_id.hpp"
+
+#include <algorithm>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace ipc {
+namespace {
+using detail::CACHE_LINE;
+using detail::READY;
+using detail::round_up;
+using detail::round_up_pow2;
+using detail::throw_if;
+using detail::wait_ready;
+
+/**
+ * @brief rounds a reclaimer waits for the publishers of a client before it
+ * checks whether the ones left are gone
+ *
+ */
+constexpr uint32_t PUBLISH_SPINS = 64;
+
+/**
+ * @brief client slot states
+ *
+ */
+constexpr uint32_t FREE = 0;
+constexpr uint32_t ACTIVE = 1;
+constexpr uint32_t RECLAIMING = 2;
+
+static_assert(std::atomic<proc_id>::is_always_lock_free,
+              "client owners are claimed with a compare exchange");
+} // namespace
+
+/**
+ * @brief placed at the begining of the shared memory buffer
+ * memory layout might look like this:
+ *  | pool meta | clients | descriptors | queue 0 | queue 1 | ... | buffers |
+ */
+struct mcast_pool::pool_meta_t {
+  std::atomic<uint32_t> state_;
+  uint32_t nbuffers_;
+  uint32_t buf_size_;
+  uint32_t nclients_;
+  uint32_t queue_cap_;
+  /**
+   * @brief where the next allocation starts looking, spreads the
+   * allocators over the descriptors
+   *
+   */
+  std::atomic<uint32_t> alloc_hint_;
+};
+
+struct mcast_pool::client_t {
+  /**
+   * @brief process of the handle using the slot, or reclaiming it
+   *
+   */
+  alignas(CACHE_LINE) std::atomic<proc_id> owner_;
+  std::atomic<uint32_t> state_;
+  /**
+   * @brief bit i is set while client i publishes to this client, a
+   * reclaimer waits for the live ones
+   *
+   */
+  std::atomic<uint64_t> publishers_;
+  /**
+   * @brief the client sleeps on it while its queue is empty
+   *
+   */
+  doorbell bell_;
+  /**
+   * @brief positions of the bounded MPSC receive queue
+   *
+   */
+  alignas(CACHE_LINE) std::atomic<uint64_t> enqueue_pos_;
+  alignas(CACHE_LINE) std::atomic<uint64_t> dequeue_pos_;
+};
+
+/**
+ * @brief one per buffer; bit i of holders_ is set while client i holds a
+ * reference, the buffer is free when no bit is set
+ */
+struct mcast_pool::desc_t {
+  std::atomic<uint64_t> holders_;
+  std::atomic<uint32_t> size_;
+  uint32_t reserved_;
+};
+
+/**
+ * @brief receive queue cell, seq_ tells whether it is free or holds a buffer
+ * index for a given lap
+ */
+struct mcast_pool::cell_t {
+  std::atomic<uint64_t> seq_;
+  uint32_t index_;
+};
+
+void mcast_pool::create(std::string_view name, uint32_t nbuffers,
+                        uint32_t buf_size, uint32_t nclients,
+                        uint32_t queue_cap, std::error_code &ec) noexcept {
+  if (nbuffers == 0 || buf_size == 0 || nclients == 0 ||
+      nclients > MAX_CLIENTS || queue_cap == 0 || queue_cap > (1u << 30)) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  buf_size = uint32_t(round_up(buf_size, CACHE_LINE));
+  queue_cap = round_up_pow2(queue_cap);
+  size_t __meta_size = round_up(sizeof(pool_meta_t), CACHE_LINE);
+  size_t __descs_size = round_up(sizeof(desc_t) * nbuffers, CACHE_LINE);
+  size_t __cells_size =
+      round_up(sizeof(cell_t) * queue_cap * nclients, CACHE_LINE);
+  this->hdl_ = shmhdl(name,
+                      __meta_size + sizeof(client_t) * nclients +
+                          __descs_size + __cells_size +
+                          size_t(buf_size) * nbuffers,
+                      ec);
+  if (ec) {
+    return;
+  }
+  char *__buf = static_cast<char *>(this->hdl_.map(ec));
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = new (__buf) pool_meta_t;
+  this->meta_->nbuffers_ = nbuffers;
+  this->meta_->buf_size_ = buf_size;
+  this->meta_->nclients_ = nclients;
+  this->meta_->queue_cap_ = queue_cap;
+  this->meta_->alloc_hint_.store(0, std::memory_order_relaxed);
+  this->clients_ = reinterpret_cast<client_t *>(__buf + __meta_size);
+  for (uint32_t i = 0; i < nclients; i++) {
+    auto __c = new (&this->clients_[i]) client_t;
+    __c->owner_.store(proc_id{}, std::memory_order_relaxed);
+    __c->state_.store(FREE, std::memory_order_relaxed);
+    __c->publishers_.store(0, std::memory_order_relaxed);
+    __c->enqueue_pos_.store(0, std::memory_order_relaxed);
+    __c->dequeue_pos_.store(0, std::memory_order_relaxed);
+  }
+  this->descs_ = reinterpret_cast<desc_t *>(this->clients_ + nclients);
+  for (uint32_t i = 0; i < nbuffers; i++) {
+    auto __d = new (&this->descs_[i]) desc_t;
+    __d->holders_.store(0, std::memory_order_relaxed);
+    __d->size_.store(0, std::memory_order_relaxed);
+  }
+  this->cells_ = reinterpret_cast<char *>(this->descs_) + __descs_size;
+  for (uint32_t c = 0; c < nclients; c++) {
+    cell_t *__queue = this->queue_of(c);
+    for (uint32_t i = 0; i < queue_cap; i++) {
+      new (&__queue[i]) cell_t;
+      __queue[i].seq_.store(i, std::memory_order_relaxed);
+    }
+  }
+  this->data_ = this->cells_ + __cells_size;
+  this->meta_->state_.store(READY, std::memory_order_release);
+  this->join(ec);
+}
+
+void mcast_pool::attach(std::string_view name, std::error_code &ec,
+                        std::chrono::milliseconds timeout) noexcept {
+  this->hdl_ = shmhdl(name, ec);
+  if (ec) {
+    return;
+  }
+  char *__buf = static_cast<char *>(this->hdl_.map(ec));
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __meta_size = round_up(sizeof(pool_meta_t), CACHE_LINE);
+  if (size_t(this->hdl_.nbytes()) < __meta_size) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = reinterpret_cast<pool_meta_t *>(__buf);
+  // wait for the creator to finish initializing the pool
+  if (!wait_ready(__meta->state_, timeout)) {
+    ec = IPCErrc::ShmNotInitialized;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __descs_size = round_up(sizeof(desc_t) * __meta->nbuffers_, CACHE_LINE);
+  size_t __cells_size = round_up(
+      sizeof(cell_t) * __meta->queue_cap_ * __meta->nclients_, CACHE_LINE);
+  if (size_t(this->hdl_.nbytes()) !=
+      __meta_size + sizeof(client_t) * __meta->nclients_ + __descs_size +
+          __cells_size + size_t(__meta->buf_size_) * __meta->nbuffers_) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = __meta;
+  this->clients_ = reinterpret_cast<client_t *>(__buf + __meta_size);
+  this->descs_ = reinterpret_cast<desc_t *>(this->clients_ + __meta->nclients_);
+  this->cells_ = reinterpret_cast<char *>(this->descs_) + __descs_size;
+  this->data_ = this->cells_ + __cells_size;
+  this->join(ec);
+}
+
+mcast_pool::cell_t *mcast_pool::queue_of(uint32_t client) const noexcept {
+  return reinterpret_cast<cell_t *>(this->cells_) +
+         size_t(client) * this->meta_->queue_cap_;
+}
+
+void mcast_pool::scrub(uint32_t client) noexcept {
+  client_t &__c = this->clients_[client];
+  const uint64_t __bit = uint64_t(1) << client;
+  // the slot is RECLAIMING: publishers that did not see it yet are finishing,
+  // pairs with the bit set then check in publish(). A client publishes only
+  // while it is ACTIVE, so a publisher which is not, or whose process is
+  // gone, died half way and is not waited for.
+  for (uint32_t __round = 1;; __round++) {
+    uint64_t __pubs = __c.publishers_.load(std::memory_order_seq_cst);
+    if (__pubs == 0) {
+      break;
+    }
+    if (__round % PUBLISH_SPINS == 0) {
+      for (uint32_t p = 0; p < this->meta_->nclients_; p++) {
+        const uint64_t __pbit = uint64_t(1) << p;
+        client_t &__p = this->clients_[p];
+        if ((__pubs & __pbit) &&
+            (__p.state_.load(std::memory_order_acquire) != ACTIVE ||
+             !__p.owner_.load(std::memory_order_acquire).alive())) {
+          __c.publishers_.fetch_and(~__pbit, std::memory_order_relaxed);
+        }
+      }
+    }
+    std::this_thread::yield();
+  }
+  // the client is not publishing anymore: a stale bit left by a dead one
+  // must not hold up the reclaimers of the clients it published to
+  for (uint32_t i = 0; i < this->meta_->nclients_; i++) {
+    if (this->clients_[i].publishers_.load(std::memory_order_relaxed) &
+        __bit) {
+      this->clients_[i].publishers_.fetch_and(~__bit,
+                                              std::memory_order_relaxed);
+    }
+  }
+  // drops the references the client held and the ones queued for it
+  for (uint32_t i = 0; i < this->meta_->nbuffers_; i++) {
+    desc_t &__d = this->descs_[i];
+    if (__d.holders_.load(std::memory_order_relaxed) & __bit) {
+      __d.holders_.fetch_and(~__bit, std::memory_order_acq_rel);
+    }
+  }
+  cell_t *__queue = this->queue_of(client);
+  for (uint32_t i = 0; i < this->meta_->queue_cap_; i++) {
+    __queue[i].seq_.store(i, std::memory_order_relaxed);
+  }
+  __c.enqueue_pos_.store(0, std::memory_order_relaxed);
+  __c.dequeue_pos_.store(0, std::memory_order_relaxed);
+}
+
+void mcast_pool::join(std::error_code &ec) noexcept {
+  const proc_id __self = proc_id::self();
+  for (uint32_t i = 0; i < this->meta_->nclients_; i++) {
+    client_t &__c = this->clients_[i];
+    proc_id __owner = __c.owner_.load(std::memory_order_acquire);
+    if (!__owner.empty() && __owner.alive()) {
+      continue;
+    }
+    if (!__c.owner_.compare_exchange_strong(__owner, __self,
+                                            std::memory_order_acq_rel)) {
+      continue;
+    }
+    // whatever a dead owner left behind is dropped before the slot is used
+    __c.state_.store(RECLAIMING, std::memory_order_seq_cst);
+    this->scrub(i);
+    __c.state_.store(ACTIVE, std::memory_order_release);
+    this->self_ = i;
+    return;
+  }
+  ec = IPCErrc::McastNoFreeClient;
+  this->meta_ = nullptr;
+  this->hdl_ = shmhdl();
+}
+
+void mcast_pool::leave() noexcept {
+  if (!this->meta_) {
+    return;
+  }
+  client_t &__c = this->clients_[this->self_];
+  __c.state_.store(RECLAIMING, std::memory_order_seq_cst);
+  this->scrub(this->self_);
+  __c.state_.store(FREE, std::memory_order_relaxed);
+  __c.owner_.store(proc_id{}, std::memory_order_release);
+  this->meta_ = nullptr;
+}
+
+mcast_pool::mcast_pool(create_only_t, std::string_view name,
+                       uint32_t nbuffers, uint32_t buf_size, uint32_t nclients,
+                       uint32_t queue_cap, std::error_code &ec) noexcept {
+  this->create(name, nbuffers, buf_size, nclients, queue_cap, ec);
+}
+
+mcast_pool::mcast_pool(create_only_t, std::string_view name,
+                       uint32_t nbuffers, uint32_t buf_size, uint32_t nclients,
+                       uint32_t queue_cap) {
+  std::error_code ec;
+  this->create(name, nbuffers, buf_size, nclients, queue_cap, ec);
+  throw_if(ec);
+}
+
+mcast_pool::mcast_pool(open_only_t, std::string_view name,
+                       std::error_code &ec,
+                       std::chrono::milliseconds timeout) noexcept {
+  this->attach(name, ec, timeout);
+}
+
+mcast_pool::mcast_pool(open_only_t, std::string_view name,
+                       std::chrono::milliseconds timeout) {
+  std::error_code ec;
+  this->attach(name, ec, timeout);
+  throw_if(ec);
+}
+
+mcast_pool::~mcast_pool() { this->leave(); }
+
+mcast_pool::mcast_pool(mcast_pool &&other) noexcept
+    : hdl_(std::move(other.hdl_)),
+      meta_(std::exchange(other.meta_, nullptr)),
+      clients_(std::exchange(other.clients_, nullptr)),
+      descs_(std::exchange(other.descs_, nullptr)),
+      cells_(std::exchange(other.cells_, nullptr)),
+      data_(std::exchange(other.data_, nullptr)), self_(other.self_) {}
+
+mcast_pool &mcast_pool::operator=(mcast_pool &&other) noexcept {
+  if (this != &other) {
+    this->leave();
+    this->hdl_ = std::move(other.hdl_);
+    this->meta_ = std::exchange(other.meta_, nullptr);
+    this->clients_ = std::exchange(other.clients_, nullptr);
+    this->descs_ = std::exchange(other.descs_, nullptr);
+    this->cells_ = std::exchange(other.cells_, nullptr);
+    this->data_ = std::exchange(other.data_, nullptr);
+    this->self_ = other.self_;
+  }
+  return *this;
+}
+
+mcast_buffer mcast_pool::make_buffer(uint32_t index) noexcept {
+  return mcast_buffer(&this->descs_[index],
+                      this->data_ + size_t(index) * this->meta_->buf_size_,
+                      this->meta_->buf_size_, index, this->self_);
+}
+
+mcast_buffer mcast_pool::allocate(std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return {};
+  }
+  const uint32_t __n = this->meta_->nbuffers_;
+  const uint64_t __bit = uint64_t(1) << this->self_;
+  for (int __round = 0; __round < 2; __round++) {
+    uint32_t __start =
+        this->meta_->alloc_hint_.fetch_add(1, std::memory_order_relaxed) % __n;
+    for (uint32_t k = 0; k < __n; k++) {
+      uint32_t __i = (__start + k) % __n;
+      desc_t &__d = this->descs_[__i];
+      uint64_t __free = 0;
+      if (__d.holders_.load(std::memory_order_relaxed) == 0 &&
+          __d.holders_.compare_exchange_strong(__free, __bit,
+                                               std::memory_order_acquire)) {
+        __d.size_.store(this->meta_->buf_size_, std::memory_order_relaxed);
+        return this->make_buffer(__i);
+      }
+    }
+    if (__round == 0 && this->reclaim() == 0) {
+      break;
+    }
+  }
+  ec = IPCErrc::McastPoolExhausted;
+  return {};
+}
+
+mcast_buffer mcast_pool::allocate() {
+  std::error_code ec;
+  mcast_buffer __buf = this->allocate(ec);
+  throw_if(ec);
+  return __buf;
+}
+
+void mcast_pool::publish(const mcast_buffer &buf, uint32_t client,
+                         std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_ || !buf || buf.client_ != this->self_ ||
+      client == this->self_) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  if (client >= this->meta_->nclients_) {
+    ec = IPCErrc::McastNoSuchClient;
+    return;
+  }
+  client_t &__c = this->clients_[client];
+  const uint64_t __self_bit = uint64_t(1) << this->self_;
+  // pairs with the state change then wait in scrub(): either the reclaimer
+  // waits for this publish, or this publish sees the client is gone
+  __c.publishers_.fetch_or(__self_bit, std::memory_order_seq_cst);
+  if (__c.state_.load(std::memory_order_seq_cst) != ACTIVE) {
+    __c.publishers_.fetch_and(~__self_bit, std::memory_order_release);
+    ec = IPCErrc::McastNoSuchClient;
+    return;
+  }
+  const uint64_t __bit = uint64_t(1) << client;
+  if (buf.desc_->holders_.fetch_or(__bit, std::memory_order_relaxed) &
+      __bit) {
+    __c.publishers_.fetch_and(~__self_bit, std::memory_order_release);
+    ec = std::make_error_code(std::errc::connection_already_in_progress);
+    return;
+  }
+  const uint64_t __mask = this->meta_->queue_cap_ - 1;
+  cell_t *__queue = this->queue_of(client);
+  uint64_t __pos = __c.enqueue_pos_.load(std::memory_order_relaxed);
+  cell_t *__cell;
+  for (;;) {
+    __cell = &__queue[__pos & __mask];
+    uint64_t __seq = __cell->seq_.load(std::memory_order_acquire);
+    int64_t __diff = int64_t(__seq) - int64_t(__pos);
+    if (__diff == 0) {
+      if (__c.enqueue_pos_.compare_exchange_weak(__pos, __pos + 1,
+                                                 std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (__diff < 0) {
+      // we still hold the buffer, this cannot free it
+      buf.desc_->holders_.fetch_and(~__bit, std::memory_order_relaxed);
+      __c.publishers_.fetch_and(~__self_bit, std::memory_order_release);
+      ec = IPCErrc::McastQueueFull;
+      return;
+    } else {
+      __pos = __c.enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  __cell->index_ = buf.index_;
+  __cell->seq_.store(__pos + 1, std::memory_order_release);
+  __c.publishers_.fetch_and(~__self_bit, std::memory_order_release);
+  __c.bell_.ring();
+}
+
+void mcast_pool::publish(const mcast_buffer &buf, uint32_t client) {
+  std::error_code ec;
+  this->publish(buf, client, ec);
+  throw_if(ec);
+}
+
+uint32_t mcast_pool::broadcast(const mcast_buffer &buf) noexcept {
+  if (!this->meta_) {
+    return 0;
+  }
+  uint32_t __sent = 0;
+  for (uint32_t i = 0; i < this->meta_->nclients_; i++) {
+    if (i == this->self_ ||
+        this->clients_[i].state_.load(std::memory_order_relaxed) != ACTIVE) {
+      continue;
+    }
+    std::error_code __ec;
+    this->publish(buf, i, __ec);
+    __sent += !__ec;
+  }
+  return __sent;
+}
+
+bool mcast_pool::pop(uint32_t &index) noexcept {
+  client_t &__c = this->clients_[this->self_];
+  // single consumer, the position is only moved by this client
+  uint64_t __pos = __c.dequeue_pos_.load(std::memory_order_relaxed);
+  cell_t *__cell = &this->queue_of(this->self_)[__pos & (this->meta_->queue_cap_ - 1)];
+  if (__cell->seq_.load(std::memory_order_acquire) != __pos + 1) {
+    return false;
+  }
+  index = __cell->index_;
+  __cell->seq_.store(__pos + this->meta_->queue_cap_, std::memory_order_release);
+  __c.dequeue_pos_.store(__pos + 1, std::memory_order_relaxed);
+  return true;
+}
+
+mcast_buffer mcast_pool::receive(std::chrono::nanoseconds timeout) noexcept {
+  if (!this->meta_) {
+    return {};
+  }
+  uint32_t __index;
+  if (!this->clients_[this->self_].bell_.wait(
+          [&] { return this->pop(__index); }, timeout)) {
+    return {};
+  }
+  return this->make_buffer(__index);
+}
+
+uint32_t mcast_pool::reclaim() noexcept {
+  if (!this->meta_) {
+    return 0;
+  }
+  const proc_id __self = proc_id::self();
+  uint32_t __reclaimed = 0;
+  for (uint32_t i = 0; i < this->meta_->nclients_; i++) {
+    client_t &__c = this->clients_[i];
+    proc_id __owner = __c.owner_.load(std::memory_order_acquire);
+    if (__owner.empty() || __owner.alive()) {
+      continue;
+    }
+    // the owner swap elects a single reclaimer, a reclaimer dying half way
+    // leaves the slot to the next one
+    if (!__c.owner_.compare_exchange_strong(__owner, __self,
+                                            std::memory_order_acq_rel)) {
+      continue;
+    }
+    __c.state_.store(RECLAIMING, std::memory_order_seq_cst);
+    this->scrub(i);
+    __c.state_.store(FREE, std::memory_order_relaxed);
+    __c.owner_.store(proc_id{}, std::memory_order_release);
+    __reclaimed++;
+  }
+  return __reclaimed;
+}
+
+uint32_t mcast_pool::id() const noexcept { return this->self_; }
+
+uint32_t mcast_pool::available() const noexcept {
+  if (!this->meta_) {
+    return 0;
+  }
+  uint32_t __n = 0;
+  for (uint32_t i = 0; i < this->meta_->nbuffers_; i++) {
+    __n += this->descs_[i].holders_.load(std::memory_order_relaxed) == 0;
+  }
+  return __n;
+}
+
+uint32_t mcast_pool::nbuffers() const noexcept {
+  return this->meta_ ? this->meta_->nbuffers_ : 0;
+}
+
+uint32_t mcast_pool::buf_size() const noexcept {
+  return this->meta_ ? this->meta_->buf_size_ : 0;
+}
+
+bool mcast_pool::valid() const noexcept { return this->meta_ != nullptr; }
+
+mcast_pool::operator bool() const noexcept { return this->valid(); }
+
+mcast_buffer::mcast_buffer(mcast_pool::desc_t *desc, char *data,
+                           uint32_t capacity, uint32_t index,
+                           uint32_t client) noexcept
+    : desc_(desc), data_(data), capacity_(capacity), index_(index),
+      client_(client) {}
+
+mcast_buffer::~mcast_buffer() { this->release(); }
+
+mcast_buffer::mcast_buffer(mcast_buffer &&other) noexcept
+    : desc_(std::exchange(other.desc_, nullptr)),
+      data_(std::exchange(other.data_, nullptr)),
+      capacity_(std::exchange(other.capacity_, 0)),
+      index_(std::exchange(other.index_, 0)),
+      client_(std::exchange(other.client_, 0)) {}
+
+mcast_buffer &mcast_buffer::operator=(mcast_buffer &&other) noexcept {
+  if (this != &other) {
+    this->release();
+    this->desc_ = std::exchange(other.desc_, nullptr);
+    this->data_ = std::exchange(other.data_, nullptr);
+    this->capacity_ = std::exchange(other.capacity_, 0);
+    this->index_ = std::exchange(other.index_, 0);
+    this->client_ = std::exchange(other.client_, 0);
+  }
+  return *this;
+}
+
+void mcast_buffer::release() noexcept {
+  if (this->desc_) {
+    // the reads and writes of the buffer happen before its next allocation
+    this->desc_->holders_.fetch_and(~(uint64_t(1) << this->client_),
+                                    std::memory_order_release);
+  }
+  this->desc_ = nullptr;
+  this->data_ = nullptr;
+  this->capacity_ = 0;
+  this->index_ = 0;
+  this->client_ = 0;
+}
+
+void *mcast_buffer::data() const noexcept { return this->data_; }
+
+uint32_t mcast_buffer::size() const noexcept {
+  return this->desc_ ? this->desc_->size_.load(std::memory_order_relaxed) : 0;
+}
+
+void mcast_buffer::resize(uint32_t nbytes) noexcept {
+  if (this->desc_) {
+    this->desc_->size_.store(std::min(nbytes, this->capacity_),
+                             std::memory_order_relaxed);
+  }
+}
+
+uint32_t mcast_buffer::capacity() const noexcept { return this->capacity_; }
+
+uint32_t mcast_buffer::index() const noexcept { return this->index_; }
+
+uint32_t mcast_buffer::use_count() const noexcept {
+  if (!this->desc_) {
+    return 0;
+  }
+  uint64_t __holders = this->desc_->holders_.load(std::memory_order_relaxed);
+  uint32_t __n = 0;
+  for (; __holders; __holders &= __holders - 1) {
+    __n++;
+  }
+  return __n;
+}
+
+bool mcast_buffer::valid() const noexcept { return this->desc_ != nullptr; }
+
+mcast_buffer::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
@@ -0,0 +1,27 @@
+#include "busy_poll.hpp"
+
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+
+namespace ipc {
+void pin_current_thread(int cpu, std::error_code &ec) noexcept {
+  ec.clear();
+#ifdef __linux__
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
+  cpu_set_t __set;
+  CPU_ZERO(&__set);
+  CPU_SET(cpu, &__set);
+  int __rc = pthread_setaffinity_np(pthread_self(), sizeof(__set), &__set);
+  if (__rc != 0) {
+    ec.assign(__rc, std::system_category());
+  }
+#else
+  (void)cpu;
+  ec.assign(ENOTSUP, std::system_category());
+#endif
+}
+} // namespace ipc
@@ -0,0 +1,628 @@
+#include "checkpoint.hpp"
+#include "detail.hpp"
+#include "ec.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace ipc {
+namespace {
+using detail::READY;
+using detail::wait_ready;
+
+/**
+ * @brief size of the page aligned staging buffer, i.e. of a single write
+ *
+ */
+constexpr size_t STAGE_SIZE = 4 * 1024 * 1024;
+constexpr uint64_t SNAPSHOT_MAGIC = 0x0001'5041'4e53'4349; // "ICSNAP" v1
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+/**
+ * @brief first page of a snapshot file, written last
+ * memory layout of a snapshot file might look like this:
+ *  | header page | page data ... | run table |
+ */
+struct snapshot_header_t {
+  uint64_t magic_;
+  uint32_t version_;
+  uint32_t full_;
+  uint64_t seq_;
+  uint64_t nbytes_;
+  uint64_t page_size_;
+  uint64_t nruns_;
+  uint64_t table_offset_;
+};
+
+/**
+ * @brief npages_ consecutive pages starting at first_page_, stored back to
+ * back in the page data
+ */
+struct snapshot_run_t {
+  uint64_t first_page_;
+  uint64_t npages_;
+};
+
+size_t system_page_size() noexcept {
+  static const size_t __pgsz = sysconf(_SC_PAGESIZE);
+  return __pgsz;
+}
+
+bool write_all(int fd, const char *buf, size_t n, off_t off,
+               std::error_code &ec) noexcept {
+  while (n > 0) {
+    ssize_t __rv = pwrite(fd, buf, n, off);
+    if (__rv == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ec.assign(errno, std::system_category());
+      return false;
+    }
+    buf += __rv;
+    off += __rv;
+    n -= __rv;
+  }
+  return true;
+}
+
+bool read_all(int fd, char *buf, size_t n, off_t off,
+              std::error_code &ec) noexcept {
+  while (n > 0) {
+    ssize_t __rv = pread(fd, buf, n, off);
+    if (__rv == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ec.assign(errno, std::system_category());
+      return false;
+    }
+    if (__rv == 0) {
+      ec = IPCErrc::SnapshotNotFound;
+      return false;
+    }
+    buf += __rv;
+    off += __rv;
+    n -= __rv;
+  }
+  return true;
+}
+
+void snapshot_path(char (&path)[PATH_MAX], const std::string &dir,
+                   uint64_t seq) noexcept {
+  snprintf(path, PATH_MAX, "%s/%016llx.snap", dir.c_str(),
+           static_cast<unsigned long long>(seq));
+}
+
+/**
+ * @brief sequence numbers of the snapshot files in dir, sorted
+ *
+ */
+std::vector<uint64_t> list_snapshots(const std::string &dir) {
+  std::vector<uint64_t> __seqs;
+  DIR *__dir = opendir(dir.c_str());
+  if (__dir == nullptr) {
+    return __seqs;
+  }
+  while (dirent *__e = readdir(__dir)) {
+    unsigned long long __seq;
+    char __suffix[8];
+    if (strlen(__e->d_name) == 21 &&
+        sscanf(__e->d_name, "%16llx.%5s", &__seq, __suffix) == 2 &&
+        strcmp(__suffix, "snap") == 0) {
+      __seqs.push_back(__seq);
+    }
+  }
+  closedir(__dir);
+  std::sort(__seqs.begin(), __seqs.end());
+  return __seqs;
+}
+
+bool read_header(const std::string &dir, uint64_t seq, snapshot_header_t &hdr,
+                 int &fd) noexcept {
+  char __path[PATH_MAX];
+  snapshot_path(__path, dir, seq);
+  fd = open(__path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  std::error_code __ec;
+  if (!read_all(fd, reinterpret_cast<char *>(&hdr), sizeof(hdr), 0, __ec) ||
+      hdr.magic_ != SNAPSHOT_MAGIC || hdr.version_ != SNAPSHOT_VERSION ||
+      hdr.seq_ != seq) {
+    close(fd);
+    fd = -1;
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+void dirty_bitmap::create(std::string_view name, const shmsz_t nbytes,
+                          std::error_code &ec) noexcept {
+  size_t __pgsz = system_page_size();
+  size_t __npages = (nbytes + __pgsz - 1) / __pgsz;
+  size_t __nwords = (__npages + 63) / 64;
+  this->hdl_ = shmhdl(name, sizeof(bitmap_meta_t) + __nwords * 8, ec);
+  if (ec) {
+    return;
+  }
+  void *__buf = this->hdl_.map(ec);
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = new (__buf) bitmap_meta_t;
+  __meta->page_size_ = __pgsz;
+  __meta->npages_ = __npages;
+  // attachers may read the meta from now on
+  __meta->state_.store(READY, std::memory_order_release);
+  this->meta_ = __meta;
+  this->words_ = reinterpret_cast<std::atomic<uint64_t> *>(this->meta_ + 1);
+}
+
+void dirty_bitmap::attach(std::string_view name, std::error_code &ec,
+                          std::chrono::milliseconds timeout) noexcept {
+  this->hdl_ = shmhdl(name, ec);
+  if (ec) {
+    return;
+  }
+  void *__buf = this->hdl_.map(ec);
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  if (size_t(this->hdl_.nbytes()) < sizeof(bitmap_meta_t)) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = reinterpret_cast<bitmap_meta_t *>(__buf);
+  // wait for the creator to fill in the meta
+  if (!wait_ready(__meta->state_, timeout)) {
+    ec = IPCErrc::ShmNotInitialized;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  if (__meta->page_size_ == 0 ||
+      size_t(this->hdl_.nbytes()) !=
+          sizeof(bitmap_meta_t) + (__meta->npages_ + 63) / 64 * 8) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = __meta;
+  this->words_ = reinterpret_cast<std::atomic<uint64_t> *>(this->meta_ + 1);
+}
+
+dirty_bitmap::dirty_bitmap(create_only_t, std::string_view name,
+                           const shmsz_t nbytes, std::error_code &ec) noexcept {
+  this->create(name, nbytes, ec);
+}
+
+dirty_bitmap::dirty_bitmap(create_only_t, std::string_view name,
+                           const shmsz_t nbytes) {
+  std::error_code ec;
+  this->create(name, nbytes, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+dirty_bitmap::dirty_bitmap(open_only_t, std::string_view name,
+                           std::error_code &ec,
+                           std::chrono::milliseconds timeout) noexcept {
+  this->attach(name, ec, timeout);
+}
+
+dirty_bitmap::dirty_bitmap(open_only_t, std::string_view name,
+                           std::chrono::milliseconds timeout) {
+  std::error_code ec;
+  this->attach(name, ec, timeout);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+void dirty_bitmap::mark(shmsz_t offset, shmsz_t nbytes) noexcept {
+  if (nbytes <= 0 || offset < 0 || this->meta_ == nullptr) {
+    return;
+  }
+  size_t __first = offset / this->meta_->page_size_;
+  size_t __last = (offset + nbytes - 1) / this->meta_->page_size_;
+  __last = std::min<size_t>(__last, this->meta_->npages_ - 1);
+  // the caller's writes must be visible before the bits are tested, else a
+  // checkpoint clearing a bit seen as set here could miss them
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (size_t __w = __first / 64; __w <= __last / 64; __w++) {
+    size_t __lo = __w == __first / 64 ? __first % 64 : 0;
+    size_t __hi = __w == __last / 64 ? __last % 64 : 63;
+    uint64_t __mask = (~0ull >> (63 - __hi)) & (~0ull << __lo);
+    // already dirty pages do not need the cache line exclusively
+    if ((this->words_[__w].load(std::memory_order_relaxed) & __mask) !=
+        __mask) {
+      this->words_[__w].fetch_or(__mask);
+    }
+  }
+}
+
+void dirty_bitmap::mark_all() noexcept {
+  if (this->meta_ == nullptr) {
+    return;
+  }
+  this->mark(0, this->meta_->npages_ * this->meta_->page_size_);
+}
+
+bool dirty_bitmap::test(size_t page) const noexcept {
+  return (this->words_[page / 64].load() >> (page % 64)) & 1;
+}
+
+uint64_t dirty_bitmap::fetch_clear(size_t i) noexcept {
+  return this->words_[i].exchange(0);
+}
+
+size_t dirty_bitmap::page_size() const noexcept {
+  return this->meta_ ? this->meta_->page_size_ : 0;
+}
+
+size_t dirty_bitmap::npages() const noexcept {
+  return this->meta_ ? this->meta_->npages_ : 0;
+}
+
+size_t dirty_bitmap::nwords() const noexcept {
+  return (this->npages() + 63) / 64;
+}
+
+bool dirty_bitmap::valid() const noexcept { return this->meta_ != nullptr; }
+
+void checkpointer::init(shmhdl &hdl, std::string_view bitmap_name,
+                        std::string_view dir, std::error_code &ec) noexcept {
+  ec.clear();
+  this->base_ = static_cast<char *>(hdl.map(ec));
+  if (ec) {
+    return;
+  }
+  this->nbytes_ = hdl.nbytes();
+  this->dirty_ = dirty_bitmap(create_only, bitmap_name, this->nbytes_, ec);
+  if (ec) {
+    return;
+  }
+  try {
+    this->dir_.assign(dir.begin(), dir.end());
+    if (mkdir(this->dir_.c_str(), 0755) == -1 && errno != EEXIST) {
+      ec.assign(errno, std::system_category());
+      return;
+    }
+    // continue the existing chain
+    auto __seqs = list_snapshots(this->dir_);
+    this->seq_ = __seqs.empty() ? 0 : __seqs.back() + 1;
+  } catch (const std::bad_alloc &) {
+    ec = std::make_error_code(std::errc::not_enough_memory);
+    return;
+  }
+  void *__stage = nullptr;
+  int __rv = posix_memalign(&__stage, system_page_size(), STAGE_SIZE);
+  if (__rv != 0) {
+    ec.assign(__rv, std::system_category());
+    return;
+  }
+  this->stage_ = static_cast<char *>(__stage);
+}
+
+checkpointer::checkpointer(shmhdl &hdl, std::string_view bitmap_name,
+                           std::string_view dir, std::error_code &ec) noexcept {
+  this->init(hdl, bitmap_name, dir, ec);
+}
+
+checkpointer::checkpointer(shmhdl &hdl, std::string_view bitmap_name,
+                           std::string_view dir) {
+  std::error_code ec;
+  this->init(hdl, bitmap_name, dir, ec);
+  if (ec) {
+    free(this->stage_);
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+checkpointer::~checkpointer() {
+  this->stop();
+  free(this->stage_);
+}
+
+dirty_bitmap &checkpointer::dirty() noexcept { return this->dirty_; }
+
+void checkpointer::write_snapshot(bool full, std::error_code &ec) noexcept {
+  const size_t __pgsz = this->dirty_.page_size();
+  const size_t __npages = this->dirty_.npages();
+  char __path[PATH_MAX];
+  snapshot_path(__path, this->dir_, this->seq_);
+
+  // large aligned writes may go around the page cache
+  int __fd = open(__path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT,
+                  0644);
+  if (__fd == -1 && errno == EINVAL) {
+    __fd = open(__path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  }
+  if (__fd == -1) {
+    ec.assign(errno, std::system_category());
+    return;
+  }
+
+  std::vector<snapshot_run_t> __runs;
+  off_t __off = __pgsz; // the header page is written last
+  size_t __fill = 0;
+  bool __ok = true;
+  try {
+    for (size_t __w = 0; __ok && __w < this->dirty_.nwords(); __w++) {
+      uint64_t __bits = this->dirty_.fetch_clear(__w);
+      if (full) {
+        size_t __left = __npages - __w * 64;
+        __bits = __left >= 64 ? ~0ull : (1ull << __left) - 1;
+      }
+      while (__bits) {
+        size_t __page = __w * 64 + __builtin_ctzll(__bits);
+        __bits &= __bits - 1;
+        if (!__runs.empty() &&
+            __runs.back().first_page_ + __runs.back().npages_ == __page) {
+          __runs.back().npages_++;
+        } else {
+          __runs.push_back({__page, 1});
+        }
+        size_t __len = std::min<size_t>(__pgsz, this->nbytes_ - __page * __pgsz);
+        std::memcpy(this->stage_ + __fill, this->base_ + __page * __pgsz,
+                    __len);
+        std::memset(this->stage_ + __fill + __len, 0, __pgsz - __len);
+        __fill += __pgsz;
+        if (__fill == STAGE_SIZE) {
+          __ok = write_all(__fd, this->stage_, __fill, __off, ec);
+          __off += __fill;
+          __fill = 0;
+        }
+      }
+    }
+  } catch (const std::bad_alloc &) {
+    ec = std::make_error_code(std::errc::not_enough_memory);
+    __ok = false;
+  }
+  if (__ok && __fill > 0) {
+    __ok = write_all(__fd, this->stage_, __fill, __off, ec);
+    __off += __fill;
+    __fill = 0;
+  }
+
+  // run table, padded to whole pages
+  const off_t __table_offset = __off;
+  const char *__table = reinterpret_cast<const char *>(__runs.data());
+  size_t __table_bytes = __runs.size() * sizeof(snapshot_run_t);
+  while (__ok && __table_bytes > 0) {
+    size_t __len = std::min(__table_bytes, STAGE_SIZE);
+    size_t __padded = (__len + __pgsz - 1) & ~(__pgsz - 1);
+    std::memcpy(this->stage_, __table, __len);
+    std::memset(this->stage_ + __len, 0, __padded - __len);
+    __ok = write_all(__fd, this->stage_, __padded, __off, ec);
+    __off += __padded;
+    __table += __len;
+    __table_bytes -= __len;
+  }
+  if (__ok && fdatasync(__fd) == -1) {
+    ec.assign(errno, std::system_category());
+    __ok = false;
+  }
+
+  // commit
+  if (__ok) {
+    std::memset(this->stage_, 0, __pgsz);
+    auto __hdr = reinterpret_cast<snapshot_header_t *>(this->stage_);
+    __hdr->magic_ = SNAPSHOT_MAGIC;
+    __hdr->version_ = SNAPSHOT_VERSION;
+    __hdr->full_ = full;
+    __hdr->seq_ = this->seq_;
+    __hdr->nbytes_ = this->nbytes_;
+    __hdr->page_size_ = __pgsz;
+    __hdr->nruns_ = __runs.size();
+    __hdr->table_offset_ = __table_offset;
+    __ok = write_all(__fd, this->stage_, __pgsz, 0, ec);
+  }
+  if (__ok && fdatasync(__fd) == -1) {
+    ec.assign(errno, std::system_category());
+    __ok = false;
+  }
+  close(__fd);
+
+  if (!__ok) {
+    // the pages of this snapshot are lost, the next one has to be full
+    unlink(__path);
+    this->has_full_ = false;
+    return;
+  }
+  this->bytes_written_ += __off;
+  if (full) {
+    // the older snapshots are no longer needed to restore
+    try {
+      for (uint64_t __seq : list_snapshots(this->dir_)) {
+        if (__seq < this->seq_) {
+          snapshot_path(__path, this->dir_, __seq);
+          unlink(__path);
+        }
+      }
+    } catch (const std::bad_alloc &) {
+    }
+    this->has_full_ = true;
+  }
+  this->seq_++;
+}
+
+void checkpointer::checkpoint(std::error_code &ec, bool full) noexcept {
+  ec.clear();
+  if (this->stage_ == nullptr) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  std::lock_guard<std::mutex> __lk(this->write_mtx_);
+  this->write_snapshot(full || !this->has_full_, ec);
+}
+
+void checkpointer::checkpoint(bool full) {
+  std::error_code ec;
+  this->checkpoint(ec, full);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+void checkpointer::start(std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> __lk(this->mtx_);
+  if (this->running_) {
+    return;
+  }
+  this->running_ = true;
+  this->worker_ = std::thread([this, interval]() {
+    std::unique_lock<std::mutex> __lk(this->mtx_);
+    while (!this->cv_.wait_for(__lk, interval,
+                               [this]() { return !this->running_; })) {
+      __lk.unlock();
+      std::error_code __ec;
+      this->checkpoint(__ec);
+      __lk.lock();
+      this->last_ec_ = __ec;
+    }
+  });
+}
+
+void checkpointer::stop() noexcept {
+  {
+    std::lock_guard<std::mutex> __lk(this->mtx_);
+    this->running_ = false;
+  }
+  this->cv_.notify_all();
+  if (this->worker_.joinable()) {
+    this->worker_.join();
+  }
+}
+
+std::error_code checkpointer::last_error() noexcept {
+  std::lock_guard<std::mutex> __lk(this->mtx_);
+  return this->last_ec_;
+}
+
+uint64_t checkpointer::bytes_written() const noexcept {
+  return this->bytes_written_;
+}
+
+uint64_t checkpointer::seq() const noexcept { return this->seq_; }
+
+void checkpointer::restore(shmhdl &hdl, std::string_view dir,
+                           std::error_code &ec) noexcept {
+  ec.clear();
+  auto __base = static_cast<char *>(hdl.map(ec));
+  if (ec) {
+    return;
+  }
+  try {
+    std::string __dir(dir.begin(), dir.end());
+    auto __seqs = list_snapshots(__dir);
+
+    // the chain starts at the latest committed full snapshot
+    size_t __begin = __seqs.size();
+    for (size_t i = __seqs.size(); i-- > 0;) {
+      snapshot_header_t __hdr;
+      int __fd;
+      if (read_header(__dir, __seqs[i], __hdr, __fd)) {
+        close(__fd);
+        if (__hdr.full_) {
+          __begin = i;
+          break;
+        }
+      }
+    }
+    if (__begin == __seqs.size()) {
+      ec = IPCErrc::SnapshotNotFound;
+      return;
+    }
+
+    std::vector<snapshot_run_t> __runs;
+    for (size_t i = __begin; i < __seqs.size(); i++) {
+      snapshot_header_t __hdr;
+      int __fd;
+      // an uncommitted or missing snapshot ends the chain
+      if ((i > __begin && __seqs[i] != __seqs[i - 1] + 1) ||
+          !read_header(__dir, __seqs[i], __hdr, __fd)) {
+        break;
+      }
+      if (static_cast<shmsz_t>(__hdr.nbytes_) != hdl.nbytes()) {
+        close(__fd);
+        ec = IPCErrc::ShmLayoutMismatch;
+        return;
+      }
+      // a truncated or corrupt snapshot must not write past the segment
+      uint64_t __pgsz = __hdr.page_size_;
+      if (__pgsz == 0 || (__pgsz & (__pgsz - 1)) != 0) {
+        close(__fd);
+        ec = IPCErrc::SnapshotCorrupted;
+        return;
+      }
+      uint64_t __npages = (__hdr.nbytes_ + __pgsz - 1) / __pgsz;
+      if (__hdr.nruns_ > __npages) {
+        close(__fd);
+        ec = IPCErrc::SnapshotCorrupted;
+        return;
+      }
+      __runs.resize(__hdr.nruns_);
+      bool __ok = read_all(__fd, reinterpret_cast<char *>(__runs.data()),
+                           __runs.size() * sizeof(snapshot_run_t),
+                           __hdr.table_offset_, ec);
+      for (size_t r = 0; __ok && r < __runs.size(); r++) {
+        if (__runs[r].first_page_ >= __npages || __runs[r].npages_ == 0 ||
+            __runs[r].npages_ > __npages - __runs[r].first_page_) {
+          close(__fd);
+          ec = IPCErrc::SnapshotCorrupted;
+          return;
+        }
+      }
+      off_t __off = __hdr.page_size_;
+      for (size_t r = 0; __ok && r < __runs.size(); r++) {
+        size_t __start = __runs[r].first_page_ * __hdr.page_size_;
+        size_t __len = std::min<size_t>(__runs[r].npages_ * __hdr.page_size_,
+                                        __hdr.nbytes_ - __start);
+        __ok = read_all(__fd, __base + __start, __len, __off, ec);
+        __off += __runs[r].npages_ * __hdr.page_size_;
+      }
+      close(__fd);
+      if (!__ok) {
+        return;
+      }
+    }
+  } catch (const std::bad_alloc &) {
+    ec = std::make_error_code(std::errc::not_enough_memory);
+  }
+}
+
+void checkpointer::restore(shmhdl &hdl, std::string_view dir) {
+  std::error_code ec;
+  restore(hdl, dir, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+} // namespace ipc
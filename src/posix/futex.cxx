@@ -0,0 +1,157 @@
+#include "futex.hpp"
+
+#include <cerrno>
+#include <ctime>
+
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// kernel headers older than 5.16 lack futex_waitv, the kernel may have it
+#ifndef SYS_futex_waitv
+#define SYS_futex_waitv 449
+#endif
+#ifndef FUTEX_WAITV_MAX
+#define FUTEX_32 2
+struct futex_waitv {
+  uint64_t val;
+  uint64_t uaddr;
+  uint32_t flags;
+  uint32_t __reserved;
+};
+#endif
+#endif
+
+namespace ipc {
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex words must be plain 32 bit integers");
+
+namespace {
+int changed(const futex_waiter *waiters, size_t n) noexcept {
+  for (size_t i = 0; i < n; i++) {
+    if (waiters[i].word_->load(std::memory_order_acquire) !=
+        waiters[i].expected_) {
+      return int(i);
+    }
+  }
+  return -1;
+}
+
+int poll_any(const futex_waiter *waiters, size_t n,
+             std::chrono::nanoseconds timeout) noexcept {
+  auto __start = std::chrono::steady_clock::now();
+  int __index;
+  while ((__index = changed(waiters, n)) < 0) {
+    if (timeout.count() >= 0 &&
+        std::chrono::steady_clock::now() - __start >= timeout) {
+      return -1;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  return __index;
+}
+} // namespace
+
+#ifdef __linux__
+bool futex_wait(std::atomic<uint32_t> &word, uint32_t expected,
+                std::chrono::nanoseconds timeout) noexcept {
+  timespec __ts;
+  timespec *__pts = nullptr;
+  if (timeout.count() >= 0) {
+    __ts.tv_sec = timeout.count() / 1'000'000'000;
+    __ts.tv_nsec = timeout.count() % 1'000'000'000;
+    __pts = &__ts;
+  }
+  // no FUTEX_PRIVATE_FLAG, the word is shared between processes
+  long __rc = syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word),
+                      FUTEX_WAIT, expected, __pts, nullptr, 0);
+  return __rc == 0 || errno != ETIMEDOUT;
+}
+
+void futex_wake(std::atomic<uint32_t> &word, int count) noexcept {
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, count,
+          nullptr, nullptr, 0);
+}
+
+int futex_wait_any(const futex_waiter *waiters, size_t n,
+                   std::chrono::nanoseconds timeout) noexcept {
+  if (n == 0 || n > FUTEX_WAIT_ANY_MAX) {
+    return -1;
+  }
+  // cleared on the first ENOSYS, the kernel predates futex_waitv
+  static std::atomic<bool> __has_waitv{true};
+  if (!__has_waitv.load(std::memory_order_relaxed)) {
+    return poll_any(waiters, n, timeout);
+  }
+  struct futex_waitv __v[FUTEX_WAIT_ANY_MAX] = {};
+  for (size_t i = 0; i < n; i++) {
+    __v[i].uaddr = reinterpret_cast<uintptr_t>(waiters[i].word_);
+    __v[i].val = waiters[i].expected_;
+    // no FUTEX_PRIVATE_FLAG, the words are shared between processes
+    __v[i].flags = FUTEX_32;
+  }
+  // futex_waitv takes an absolute CLOCK_MONOTONIC deadline
+  timespec __ts;
+  timespec *__pts = nullptr;
+  if (timeout.count() >= 0) {
+    clock_gettime(CLOCK_MONOTONIC, &__ts);
+    int64_t __ns = int64_t(__ts.tv_nsec) + timeout.count();
+    __ts.tv_sec += __ns / 1'000'000'000;
+    __ts.tv_nsec = __ns % 1'000'000'000;
+    __pts = &__ts;
+  }
+  for (;;) {
+    long __rc = syscall(SYS_futex_waitv, __v, unsigned(n), 0, __pts,
+                        CLOCK_MONOTONIC);
+    if (__rc >= 0) {
+      return int(__rc);
+    }
+    switch (errno) {
+    case ETIMEDOUT:
+      return -1;
+    case ENOSYS:
+      __has_waitv.store(false, std::memory_order_relaxed);
+      return poll_any(waiters, n, timeout);
+    case EAGAIN: {
+      // some word did not hold its expected value
+      int __index = changed(waiters, n);
+      if (__index >= 0) {
+        return __index;
+      }
+      break;
+    }
+    case EINTR:
+      break;
+    default:
+      return poll_any(waiters, n, timeout);
+    }
+  }
+}
+#else
+bool futex_wait(std::atomic<uint32_t> &word, uint32_t expected,
+                std::chrono::nanoseconds timeout) noexcept {
+  auto __start = std::chrono::steady_clock::now();
+  while (word.load(std::memory_order_acquire) == expected) {
+    if (timeout.count() >= 0 &&
+        std::chrono::steady_clock::now() - __start >= timeout) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  return true;
+}
+
+void futex_wake(std::atomic<uint32_t> &, int) noexcept {}
+
+int futex_wait_any(const futex_waiter *waiters, size_t n,
+                   std::chrono::nanoseconds timeout) noexcept {
+  if (n == 0 || n > FUTEX_WAIT_ANY_MAX) {
+    return -1;
+  }
+  return poll_any(waiters, n, timeout);
+}
+#endif
+} // namespace ipc
@@ -1,4 +1,5 @@
 #include "semhdl.hpp"
+#include "busy_poll.hpp"
 
 #include <chrono>
 #include <cstdio>
@@ -7,79 +8,124 @@
 #include <semaphore.h>
 #include <stdexcept>
 #include <system_error>
+#include <utility>
 
 namespace ipc {
 semhdl::semhdl(std::string_view name, const uint32_t value,
                std::error_code &ec) noexcept {
   ec.clear();
-  auto __sema = sem_open(name.data(), static_cast<int>(O_FLAGS::CREATE_ONLY),
+  if (!copy_name(this->name_, name)) {
+    ec.assign(ENAMETOOLONG, std::system_category());
+    return;
+  }
+  auto __sema = sem_open(this->name_, static_cast<int>(O_FLAGS::CREATE_ONLY),
                          0644, value);
   // fail
-  if (__sema == nullptr) {
+  if (__sema == SEM_FAILED) {
     ec.assign(errno, std::system_category());
-    sem_unlink(name.data());
+    sem_unlink(this->name_);
+    this->name_[0] = '\0';
     return;
   }
   // success
   this->sema_ = __sema;
-  this->name_ = {name.begin(), name.end()};
 }
 semhdl::semhdl(std::string_view name, const uint32_t value) {
   std::error_code ec;
-  auto __sema = sem_open(name.data(), static_cast<int>(O_FLAGS::CREATE_ONLY),
+  if (!copy_name(this->name_, name)) {
+    ec.assign(ENAMETOOLONG, std::system_category());
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+  auto __sema = sem_open(this->name_, static_cast<int>(O_FLAGS::CREATE_ONLY),
                          0644, value);
   // fail
-  if (__sema == nullptr) {
+  if (__sema == SEM_FAILED) {
     ec.assign(errno, std::system_category());
-    sem_unlink(name.data());
+    sem_unlink(this->name_);
     char errmsg[256];
     snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
     throw std::runtime_error(errmsg);
   }
   // success
   this->sema_ = __sema;
-  this->name_ = {name.begin(), name.end()};
 }
 
 semhdl::semhdl(std::string_view name, std::error_code &ec) noexcept {
   ec.clear();
-  auto __sem = sem_open(name.data(), static_cast<int>(O_FLAGS::OPEN_ONLY));
+  if (!copy_name(this->name_, name)) {
+    ec.assign(ENAMETOOLONG, std::system_category());
+    return;
+  }
+  auto __sem = sem_open(this->name_, static_cast<int>(O_FLAGS::OPEN_ONLY));
 
-  if (__sem == nullptr) {
+  if (__sem == SEM_FAILED) {
     ec.assign(errno, std::system_category());
+    this->name_[0] = '\0';
     return;
   }
   // success
   this->sema_ = __sem;
-  this->name_ = {name.begin(), name.end()};
 }
 
 semhdl::semhdl(std::string_view name) {
   std::error_code ec;
-  auto __sem = sem_open(name.data(), static_cast<int>(O_FLAGS::OPEN_ONLY));
+  if (!copy_name(this->name_, name)) {
+    ec.assign(ENAMETOOLONG, std::system_category());
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+  auto __sem = sem_open(this->name_, static_cast<int>(O_FLAGS::OPEN_ONLY));
 
-  if (__sem == nullptr) {
+  if (__sem == SEM_FAILED) {
     ec.assign(errno, std::system_category());
     char errmsg[256];
     snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
     throw std::runtime_error(errmsg);
-    return;
   }
   // success
   this->sema_ = __sem;
-  this->name_ = {name.begin(), name.end()};
 }
 
-semhdl::~semhdl() {
+semhdl::semhdl(semhdl &&other) noexcept
+    : sema_(std::exchange(other.sema_, nullptr)) {
+  copy_name(this->name_, other.name_);
+  other.name_[0] = '\0';
+}
+
+semhdl &semhdl::operator=(semhdl &&other) noexcept {
+  if (this != &other) {
+    this->release();
+    this->sema_ = std::exchange(other.sema_, nullptr);
+    copy_name(this->name_, other.name_);
+    other.name_[0] = '\0';
+  }
+  return *this;
+}
+
+void semhdl::release() noexcept {
+  if (this->sema_ == nullptr) {
+    return;
+  }
   sem_close(this->sema_);
-  if (sem_unlink(this->name_.data()) == -1) {
+  this->sema_ = nullptr;
+  if (sem_unlink(this->name_) == -1) {
     std::error_code ec(errno, std::system_category());
     std::cerr << ec.message() << std::endl;
   }
+  this->name_[0] = '\0';
 }
 
+semhdl::~semhdl() { this->release(); }
+
 void semhdl::wait(std::error_code &ec) noexcept {
   ec.clear();
+  if (this->sema_ == nullptr) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
   if (sem_wait(this->sema_) == -1) {
     ec.assign(errno, std::system_category());
   }
@@ -95,8 +141,43 @@ void semhdl::wait() {
   }
 }
 
+void semhdl::wait(busy_poll &poller, std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->sema_ == nullptr) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
+  // sem_trywait() stays in user space while the semaphore is uncontended
+  int __err = 0;
+  poller.wait([&] {
+    if (sem_trywait(this->sema_) == 0) {
+      __err = 0;
+      return true;
+    }
+    __err = errno;
+    return __err != EAGAIN;
+  });
+  if (__err != 0) {
+    ec.assign(__err, std::system_category());
+  }
+}
+
+void semhdl::wait(busy_poll &poller) {
+  std::error_code ec;
+  this->wait(poller, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
 void semhdl::post(std::error_code &ec) noexcept {
   ec.clear();
+  if (this->sema_ == nullptr) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
   if (sem_post(this->sema_) == -1) {
     ec.assign(errno, std::system_category());
   }
@@ -114,6 +195,10 @@ void semhdl::post() {
 
 void semhdl::try_wait(std::error_code &ec) noexcept {
   ec.clear();
+  if (this->sema_ == nullptr) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
   if (sem_trywait(this->sema_) == -1) {
     ec.assign(errno, std::system_category());
   }
@@ -121,7 +206,11 @@ void semhdl::try_wait(std::error_code &ec) noexcept {
 
 int semhdl::value(std::error_code &ec) const noexcept {
   ec.clear();
-  int val;
+  int val = 0;
+  if (this->sema_ == nullptr) {
+    ec.assign(EINVAL, std::system_category());
+    return val;
+  }
   if (sem_getvalue(this->sema_, &val) == -1) {
     ec.assign(errno, std::system_category());
   }
@@ -140,4 +229,8 @@ int semhdl::value() const {
 }
 
 std::string_view semhdl::name() const noexcept { return this->name_; }
+
+bool semhdl::valid() const noexcept { return this->sema_ != nullptr; }
+
+semhdl::operator bool() const noexcept { return this->valid(); }
 } // namespace ipc
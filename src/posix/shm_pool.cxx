@@ -0,0 +1,317 @@
+#include "shm_pool.hpp"
+#include "detail.hpp"
+#include "ec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ipc {
+namespace {
+using detail::throw_if;
+
+/**
+ * @brief fault in every page of a mapped buffer for writing, so that its
+ * first user does not take the faults
+ *
+ */
+void prefault(void *addr, shmsz_t nbytes) noexcept {
+  static const uintptr_t __pgsz = sysconf(_SC_PAGESIZE);
+#ifdef MADV_POPULATE_WRITE
+  uintptr_t __begin = reinterpret_cast<uintptr_t>(addr) & ~(__pgsz - 1);
+  uintptr_t __end = reinterpret_cast<uintptr_t>(addr) + nbytes;
+  if (madvise(reinterpret_cast<void *>(__begin), __end - __begin,
+              MADV_POPULATE_WRITE) == 0) {
+    return;
+  }
+#endif
+  // older kernels: write to every page, the buffer is still all zeros
+  for (shmsz_t __off = 0; __off < nbytes; __off += __pgsz) {
+    static_cast<volatile char *>(addr)[__off] = 0;
+  }
+  static_cast<volatile char *>(addr)[nbytes - 1] = 0;
+}
+} // namespace
+
+void shm_pool::init(std::string_view prefix, std::vector<shmsz_t> classes,
+                    size_t depth, std::error_code &ec) noexcept {
+  ec.clear();
+  std::sort(classes.begin(), classes.end());
+  classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+  if (classes.empty() || classes.front() <= 0) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
+  this->prefix_ = prefix;
+  this->depth_ = depth;
+  for (shmsz_t __nbytes : classes) {
+    this->classes_.push_back(class_t{__nbytes, {}, 0});
+  }
+}
+
+shm_pool::shm_pool(std::string_view prefix, std::vector<shmsz_t> classes,
+                   size_t depth, std::error_code &ec) noexcept {
+  this->init(prefix, std::move(classes), depth, ec);
+}
+
+shm_pool::shm_pool(std::string_view prefix, std::vector<shmsz_t> classes,
+                   size_t depth) {
+  std::error_code ec;
+  this->init(prefix, std::move(classes), depth, ec);
+  throw_if(ec);
+}
+
+shm_pool::~shm_pool() { this->stop(); }
+
+std::string shm_pool::next_name() {
+  return this->prefix_ + "." + std::to_string(getpid()) + "." +
+         std::to_string(this->seq_.fetch_add(1, std::memory_order_relaxed));
+}
+
+shm_pool::class_t *shm_pool::class_of(shmsz_t nbytes) noexcept {
+  for (auto &__cls : this->classes_) {
+    if (__cls.nbytes_ >= nbytes) {
+      return &__cls;
+    }
+  }
+  return nullptr;
+}
+
+bool shm_pool::idle() const noexcept {
+  if (!this->dirty_.empty()) {
+    return false;
+  }
+  for (auto &__cls : this->classes_) {
+    if (__cls.spares_.size() + __cls.pending_ < this->depth_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+shmhdl shm_pool::make_spare(shmsz_t nbytes, std::error_code &ec) noexcept {
+  shmhdl __hdl;
+  // skip the names left behind by a crashed process with the same pid
+  for (int __retry = 0; __retry < 16; __retry++) {
+    __hdl = shmhdl(this->next_name(), nbytes, ec);
+    if (ec != std::errc::file_exists) {
+      break;
+    }
+  }
+  if (ec) {
+    return {};
+  }
+  void *__addr = __hdl.map(ec);
+  if (ec) {
+    return {};
+  }
+  prefault(__addr, nbytes);
+  return __hdl;
+}
+
+void shm_pool::replenish(std::error_code &ec) noexcept {
+  ec.clear();
+  std::vector<shmhdl> __dirty;
+  {
+    std::lock_guard<std::mutex> __lk(this->mtx_);
+    __dirty.swap(this->dirty_);
+  }
+  // surplus segments are dropped, i.e. unlinked, outside of the lock
+  std::vector<shmhdl> __surplus;
+  for (auto &__hdl : __dirty) {
+    void *__addr = __hdl.map(ec);
+    if (ec) {
+      return;
+    }
+    std::memset(__addr, 0, __hdl.nbytes());
+    __hdl.revive();
+    std::lock_guard<std::mutex> __lk(this->mtx_);
+    class_t *__cls = this->class_of(__hdl.nbytes());
+    if (__cls->spares_.size() < this->depth_) {
+      __cls->spares_.push_back(std::move(__hdl));
+    } else {
+      __surplus.push_back(std::move(__hdl));
+    }
+  }
+
+  for (auto &__cls : this->classes_) {
+    size_t __need;
+    {
+      std::lock_guard<std::mutex> __lk(this->mtx_);
+      size_t __have = __cls.spares_.size() + __cls.pending_;
+      __need = __have < this->depth_ ? this->depth_ - __have : 0;
+      __cls.pending_ += __need;
+    }
+    for (; __need > 0; __need--) {
+      shmhdl __hdl = this->make_spare(__cls.nbytes_, ec);
+      std::lock_guard<std::mutex> __lk(this->mtx_);
+      if (ec) {
+        __cls.pending_ -= __need;
+        return;
+      }
+      __cls.spares_.push_back(std::move(__hdl));
+      __cls.pending_ -= 1;
+    }
+  }
+}
+
+shmhdl shm_pool::acquire(std::string_view name, shmsz_t nbytes,
+                         std::error_code &ec) noexcept {
+  ec.clear();
+  shmhdl __hdl;
+  {
+    std::lock_guard<std::mutex> __lk(this->mtx_);
+    class_t *__cls = this->class_of(nbytes);
+    if (__cls && !__cls->spares_.empty()) {
+      __hdl = std::move(__cls->spares_.back());
+      __cls->spares_.pop_back();
+    }
+  }
+  this->cv_.notify_all();
+  if (!__hdl) {
+    this->misses_.fetch_add(1, std::memory_order_relaxed);
+    return shmhdl(name, nbytes, ec);
+  }
+  __hdl.rename(name, ec);
+  if (ec) {
+    {
+      std::lock_guard<std::mutex> __lk(this->mtx_);
+      this->class_of(nbytes)->spares_.push_back(std::move(__hdl));
+    }
+    if (ec != std::errc::not_supported) {
+      return {};
+    }
+    // no way to rename a spare here, create the segment instead
+    this->misses_.fetch_add(1, std::memory_order_relaxed);
+    return shmhdl(name, nbytes, ec);
+  }
+  this->hits_.fetch_add(1, std::memory_order_relaxed);
+  return __hdl;
+}
+
+shmhdl shm_pool::acquire(std::string_view name, shmsz_t nbytes) {
+  std::error_code ec;
+  shmhdl __hdl = this->acquire(name, nbytes, ec);
+  throw_if(ec);
+  return __hdl;
+}
+
+shmhdl shm_pool::acquire(shmsz_t nbytes, std::error_code &ec) noexcept {
+  ec.clear();
+  shmhdl __hdl;
+  {
+    std::lock_guard<std::mutex> __lk(this->mtx_);
+    class_t *__cls = this->class_of(nbytes);
+    if (__cls && !__cls->spares_.empty()) {
+      __hdl = std::move(__cls->spares_.back());
+      __cls->spares_.pop_back();
+    }
+  }
+  this->cv_.notify_all();
+  if (__hdl) {
+    this->hits_.fetch_add(1, std::memory_order_relaxed);
+    return __hdl;
+  }
+  this->misses_.fetch_add(1, std::memory_order_relaxed);
+  return this->make_spare(nbytes, ec);
+}
+
+shmhdl shm_pool::acquire(shmsz_t nbytes) {
+  std::error_code ec;
+  shmhdl __hdl = this->acquire(nbytes, ec);
+  throw_if(ec);
+  return __hdl;
+}
+
+bool shm_pool::recycle(shmhdl &hdl) noexcept {
+  if (!hdl || hdl.persistent() || hdl.access() != SHM_ACCESS::READ_WRITE) {
+    return false;
+  }
+  auto __match = [&](const class_t &cls) {
+    return cls.nbytes_ == hdl.nbytes();
+  };
+  if (std::none_of(this->classes_.begin(), this->classes_.end(), __match)) {
+    return false;
+  }
+  // free the name for its next user, and keep late attachers out
+  std::error_code __ec;
+  if (!hdl.retire(this->next_name(), __ec)) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> __lk(this->mtx_);
+    this->dirty_.push_back(std::move(hdl));
+  }
+  this->recycled_.fetch_add(1, std::memory_order_relaxed);
+  this->cv_.notify_all();
+  return true;
+}
+
+void shm_pool::fill(std::error_code &ec) noexcept { this->replenish(ec); }
+
+void shm_pool::fill() {
+  std::error_code ec;
+  this->replenish(ec);
+  throw_if(ec);
+}
+
+void shm_pool::start() {
+  std::lock_guard<std::mutex> __lk(this->mtx_);
+  if (this->running_) {
+    return;
+  }
+  this->running_ = true;
+  this->worker_ = std::thread([this]() {
+    std::unique_lock<std::mutex> __lk(this->mtx_);
+    while (this->running_) {
+      this->cv_.wait(__lk, [this]() { return !this->running_ || !this->idle(); });
+      if (!this->running_) {
+        break;
+      }
+      __lk.unlock();
+      std::error_code __ec;
+      this->replenish(__ec);
+      __lk.lock();
+      this->last_ec_ = __ec;
+      if (__ec) {
+        // do not spin on a persistent failure, e.g. /dev/shm being full
+        this->cv_.wait_for(__lk, std::chrono::milliseconds(100),
+                           [this]() { return !this->running_; });
+      }
+    }
+  });
+}
+
+void shm_pool::stop() noexcept {
+  {
+    std::lock_guard<std::mutex> __lk(this->mtx_);
+    this->running_ = false;
+  }
+  this->cv_.notify_all();
+  if (this->worker_.joinable()) {
+    this->worker_.join();
+  }
+}
+
+std::error_code shm_pool::last_error() noexcept {
+  std::lock_guard<std::mutex> __lk(this->mtx_);
+  return this->last_ec_;
+}
+
+size_t shm_pool::spares(shmsz_t nbytes) const noexcept {
+  std::lock_guard<std::mutex> __lk(this->mtx_);
+  for (auto &__cls : this->classes_) {
+    if (__cls.nbytes_ >= nbytes) {
+      return __cls.spares_.size();
+    }
+  }
+  return 0;
+}
+
+pool_stats_t shm_pool::stats() const noexcept {
+  return {this->hits_.load(std::memory_order_relaxed),
+          this->misses_.load(std::memory_order_relaxed),
+          this->recycled_.load(std::memory_order_relaxed)};
+}
+} // namespace ipc
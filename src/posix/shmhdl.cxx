@@ -1,194 +1,603 @@
 #include "shmhdl.hpp"
+#include "ec.hpp"
 
 #include <cstdio>
+#include <new>
+#include <string>
 #include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
+#include <utility>
 
 namespace ipc {
+namespace {
+/**
+ * @brief lock the whole file shared or exclusive
+ * @details open file description locks are used where available: converting
+ * between shared and exclusive is then atomic, and handles in the same
+ * process do not share their locks.
+ */
+int lock_file(int fd, bool exclusive, bool wait) noexcept {
+#ifdef F_OFD_SETLK
+  struct flock __fl = {};
+  __fl.l_type = exclusive ? F_WRLCK : F_RDLCK;
+  __fl.l_whence = SEEK_SET;
+  return fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &__fl);
+#else
+  return flock(fd, (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB));
+#endif
+}
+
+int unlock_file(int fd) noexcept {
+#ifdef F_OFD_SETLK
+  struct flock __fl = {};
+  __fl.l_type = F_UNLCK;
+  __fl.l_whence = SEEK_SET;
+  return fcntl(fd, F_OFD_SETLK, &__fl);
+#else
+  return flock(fd, LOCK_UN);
+#endif
+}
+
+/**
+ * @brief madvise() the pages of [begin, end), shrunk to whole pages for the
+ * hints dropping content and widened to whole pages for the others
+ */
+void advise_range(char *begin, char *end, SHM_ADVICE advice,
+                  std::error_code &ec) noexcept {
+  ec.clear();
+  int __advice;
+  bool __destructive = false;
+  switch (advice) {
+  case SHM_ADVICE::NORMAL:
+    __advice = MADV_NORMAL;
+    break;
+  case SHM_ADVICE::WILLNEED:
+    __advice = MADV_WILLNEED;
+    break;
+  case SHM_ADVICE::SEQUENTIAL:
+    __advice = MADV_SEQUENTIAL;
+    break;
+  case SHM_ADVICE::RANDOM:
+    __advice = MADV_RANDOM;
+    break;
+  case SHM_ADVICE::DONTNEED:
+    __advice = MADV_DONTNEED;
+    __destructive = true;
+    break;
+#ifdef MADV_REMOVE
+  case SHM_ADVICE::REMOVE:
+    __advice = MADV_REMOVE;
+    __destructive = true;
+    break;
+#endif
+#ifdef MADV_COLD
+  case SHM_ADVICE::COLD:
+    __advice = MADV_COLD;
+    break;
+#endif
+#ifdef MADV_PAGEOUT
+  case SHM_ADVICE::PAGEOUT:
+    __advice = MADV_PAGEOUT;
+    break;
+#endif
+  default:
+    ec.assign(ENOTSUP, std::system_category());
+    return;
+  }
+  static const uintptr_t __pgsz = sysconf(_SC_PAGESIZE);
+  uintptr_t __begin = reinterpret_cast<uintptr_t>(begin);
+  uintptr_t __end = reinterpret_cast<uintptr_t>(end);
+  if (__destructive) {
+    __begin = (__begin + __pgsz - 1) & ~(__pgsz - 1);
+    __end &= ~(__pgsz - 1);
+  } else {
+    __begin &= ~(__pgsz - 1);
+    __end = (__end + __pgsz - 1) & ~(__pgsz - 1);
+  }
+  if (__begin >= __end) {
+    return;
+  }
+  if (madvise(reinterpret_cast<void *>(__begin), __end - __begin, __advice) ==
+      -1) {
+    ec.assign(errno, std::system_category());
+  }
+}
+} // namespace
+
+shmview::shmview(block_t *block, char *data, shmsz_t offset,
+                 shmsz_t nbytes) noexcept
+    : block_(block), data_(data), offset_(offset), nbytes_(nbytes) {}
+
+shmview::~shmview() { this->reset(); }
+
+shmview::shmview(const shmview &other) noexcept
+    : block_(other.block_), data_(other.data_), offset_(other.offset_),
+      nbytes_(other.nbytes_) {
+  if (this->block_) {
+    this->block_->refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+shmview &shmview::operator=(const shmview &other) noexcept {
+  if (this != &other) {
+    if (other.block_) {
+      other.block_->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    this->reset();
+    this->block_ = other.block_;
+    this->data_ = other.data_;
+    this->offset_ = other.offset_;
+    this->nbytes_ = other.nbytes_;
+  }
+  return *this;
+}
+
+shmview::shmview(shmview &&other) noexcept
+    : block_(std::exchange(other.block_, nullptr)),
+      data_(std::exchange(other.data_, nullptr)),
+      offset_(std::exchange(other.offset_, 0)),
+      nbytes_(std::exchange(other.nbytes_, 0)) {}
+
+shmview &shmview::operator=(shmview &&other) noexcept {
+  if (this != &other) {
+    this->reset();
+    this->block_ = std::exchange(other.block_, nullptr);
+    this->data_ = std::exchange(other.data_, nullptr);
+    this->offset_ = std::exchange(other.offset_, 0);
+    this->nbytes_ = std::exchange(other.nbytes_, 0);
+  }
+  return *this;
+}
+
+void shmview::reset() noexcept {
+  if (this->block_ &&
+      this->block_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    munmap(this->block_->base_, this->block_->len_);
+    delete this->block_;
+  }
+  this->block_ = nullptr;
+  this->data_ = nullptr;
+  this->offset_ = 0;
+  this->nbytes_ = 0;
+}
+
+void *shmview::data() const noexcept { return this->data_; }
+
+shmsz_t shmview::offset() const noexcept { return this->offset_; }
+
+shmsz_t shmview::nbytes() const noexcept { return this->nbytes_; }
+
+void shmview::advise(SHM_ADVICE advice, std::error_code &ec) const noexcept {
+  if (this->block_ == nullptr) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  advise_range(this->data_, this->data_ + this->nbytes_, advice, ec);
+}
+
+void shmview::advise(SHM_ADVICE advice) const {
+  std::error_code ec;
+  this->advise(advice, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+size_t shmview::use_count() const noexcept {
+  return this->block_ ? this->block_->refs_.load(std::memory_order_relaxed)
+                      : 0;
+}
+
+bool shmview::valid() const noexcept { return this->block_ != nullptr; }
+
+shmview::operator bool() const noexcept { return this->valid(); }
 
 void shmhdl::unmap_meta(std::error_code &ec) noexcept {
   ec.clear();
-  munmap(this->meta_, sizeof(shm_meta_t));
+  if (this->meta_ == nullptr) {
+    ec = IPCErrc::ShmAddrNullptr;
+    return;
+  }
+  if (munmap(this->meta_, sizeof(shm_meta_t)) == -1) {
+    ec.assign(errno, std::system_category());
+    return;
+  }
+  this->meta_ = nullptr;
 }
 
-shmhdl::shmhdl(std::string_view name, const shmsz_t nbytes,
-               std::error_code &ec) noexcept{
-                 
+void shmhdl::create(std::string_view name, const shmsz_t nbytes,
+                    std::error_code &ec) noexcept {
   ec.clear();
+  if (!copy_name(this->name_, name)) {
+    ec.assign(ENAMETOOLONG, std::system_category());
+    return;
+  }
   // create a shared memory object
-  int __fd = shm_open(name.data(), (int)O_FLAGS::CREATE_ONLY, (int)PERM::ALL);
+  int __fd =
+      shm_open(this->name_, (int)O_FLAGS::CREATE_ONLY, (int)PERM::ALL);
   if (__fd == -1) {
     ec.assign(errno, std::system_category());
+    this->name_[0] = '\0';
     return;
   }
   // setup shared memory object size
   if (ftruncate(__fd, nbytes + sizeof(shm_meta_t)) == -1) {
     ec.assign(errno, std::system_category());
-    shm_unlink(name.data());
+    close(__fd);
+    shm_unlink(this->name_);
+    this->name_[0] = '\0';
     return;
   }
   // map
   char *pMetaBuf = static_cast<char *>(mmap(nullptr, sizeof(shm_meta_t),
-                                            PROT_EXEC | PROT_READ | PROT_WRITE,
+                                            PROT_READ | PROT_WRITE,
                                             MAP_SHARED, __fd, 0));
 
   // fail to map
   if (pMetaBuf == (void *)-1) {
     ec.assign(errno, std::system_category());
     close(__fd);
-    shm_unlink(name.data());
+    shm_unlink(this->name_);
+    this->name_[0] = '\0';
     return;
   }
 
   // success
   this->meta_ = new (pMetaBuf) shm_meta_t;
-  this->meta_->ref_count_ = 1;
+  // the object is new, its attachers table is zero filled hence empty
+  this->meta_->pidns_.store(pid_namespace(), std::memory_order_relaxed);
+  this->join();
   this->meta_->shmsz_ = nbytes;
   this->meta_->status_ = SHM_STATUS::OK;
+  // attachers check the magic, publish it last
+  std::atomic_thread_fence(std::memory_order_release);
+  this->meta_->magic_ = SHM_MAGIC;
 
   this->fd_ = __fd;
-  this->name_ = {name.begin(), name.end()};
+  this->shmsz_ = nbytes;
+  this->persistent_ = false;
   this->addr_ = nullptr;
 }
 
-shmhdl::shmhdl(std::string_view name, const shmsz_t nbytes) {
-  std::error_code ec;
-
-  int __fd = shm_open(name.data(), (int)O_FLAGS::CREATE_ONLY, (int)PERM::ALL);
+void shmhdl::attach(std::string_view name, std::error_code &ec) noexcept {
+  ec.clear();
+  if (!copy_name(this->name_, name)) {
+    ec.assign(ENAMETOOLONG, std::system_category());
+    return;
+  }
+  int __fd = shm_open(this->name_, static_cast<int>(O_FLAGS::OPEN_ONLY),
+                      static_cast<int>(PERM::ALL));
+  // fail to open
   if (__fd == -1) {
     ec.assign(errno, std::system_category());
-    char errmsg[256];
-    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
-    throw std::runtime_error(errmsg);
+    this->name_[0] = '\0';
+    return;
   }
-  // setup shared memory object size
-  if (ftruncate(__fd, nbytes + sizeof(shm_meta_t)) == -1) {
+  // the creator may not have sized the shared memory object yet
+  struct stat __st;
+  if (fstat(__fd, &__st) == -1) {
     ec.assign(errno, std::system_category());
-    shm_unlink(name.data());
-    char errmsg[256];
-    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
-    throw std::runtime_error(errmsg);
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
   }
-  // map
-  char *pMetaBuf = static_cast<char *>(mmap(nullptr, sizeof(shm_meta_t),
-                                            PROT_EXEC | PROT_READ | PROT_WRITE,
-                                            MAP_SHARED, __fd, 0));
+  if (static_cast<size_t>(__st.st_size) < sizeof(shm_meta_t)) {
+    ec = IPCErrc::ShmNotInitialized;
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
+  }
+  void *pMetaBuf = mmap(nullptr, sizeof(shm_meta_t), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, __fd, 0);
 
-  // fail to map
+  // fail to map, the object belongs to its creator and other handles: leave
+  // it alone
   if (pMetaBuf == (void *)-1) {
     ec.assign(errno, std::system_category());
     close(__fd);
-    shm_unlink(name.data());
-    char errmsg[256];
-    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
-    throw std::runtime_error(errmsg);
+    this->name_[0] = '\0';
+    return;
+  }
+  // the creator has not finished initializing the meta yet
+  auto __meta = reinterpret_cast<shm_meta_t *>(pMetaBuf);
+  if (__meta->magic_ != SHM_MAGIC) {
+    ec = IPCErrc::ShmNotInitialized;
+    munmap(pMetaBuf, sizeof(shm_meta_t));
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  this->meta_ = __meta;
+  if (!this->join()) {
+    ec = IPCErrc::ShmNoFreeSlot;
+    this->meta_ = nullptr;
+    munmap(pMetaBuf, sizeof(shm_meta_t));
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
+  }
+  // pairs with the fence in retire(): either it sees our slot or we see the
+  // object retired
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (__meta->status_.load(std::memory_order_relaxed) != SHM_STATUS::OK) {
+    // unlinked or recycled between shm_open() and join(), it is not ours to
+    // remove
+    ec = IPCErrc::ShmDeleted;
+    this->leave();
+    this->meta_ = nullptr;
+    munmap(pMetaBuf, sizeof(shm_meta_t));
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
   }
-
-  // success
-  this->meta_ = new (pMetaBuf) shm_meta_t;
-  this->meta_->ref_count_ = 1;
-  this->meta_->shmsz_ = nbytes;
-  this->meta_->status_ = SHM_STATUS::OK;
 
   this->fd_ = __fd;
-  this->name_ = {name.begin(), name.end()};
+  this->shmsz_ = __st.st_size - sizeof(shm_meta_t);
+  this->persistent_ = false;
   this->addr_ = nullptr;
 }
 
-shmhdl::shmhdl(std::string_view name, std::error_code &ec) noexcept {
+void shmhdl::open_persistent(std::string_view path, const shmsz_t nbytes,
+                             std::error_code &ec) noexcept {
   ec.clear();
-  int __fd = shm_open(name.data(), static_cast<int>(O_FLAGS::OPEN_ONLY),
-                      static_cast<int>(PERM::ALL));
-  // fail to open
+  if (!copy_name(this->name_, path)) {
+    ec.assign(ENAMETOOLONG, std::system_category());
+    return;
+  }
+  int __fd = open(this->name_, O_RDWR | O_CREAT | O_CLOEXEC,
+                  static_cast<int>(PERM::READ) | static_cast<int>(PERM::WRITE));
   if (__fd == -1) {
     ec.assign(errno, std::system_category());
+    this->name_[0] = '\0';
     return;
   }
-  void *pMetaBuf =
-      mmap(nullptr, sizeof(shm_meta_t), PROT_EXEC | PROT_READ | PROT_WRITE,
-           MAP_SHARED, __fd, 0);
-
-  // fail to map
+  // a shared lock is held as long as the handle is attached. The segment is
+  // only initialized or resized by a handle that can upgrade it to an
+  // exclusive lock, i.e. when nobody else has the file open.
+  bool __alone = false;
+  struct stat __st;
+  for (int __retry = 0;; __retry++) {
+    if (lock_file(__fd, false, true) == -1 || fstat(__fd, &__st) == -1) {
+      ec.assign(errno, std::system_category());
+      close(__fd);
+      this->name_[0] = '\0';
+      return;
+    }
+    __alone = lock_file(__fd, true, false) == 0;
+    if (__alone || __st.st_size != 0 || __retry == 100) {
+      break;
+    }
+    // another handle is creating the file right now, let it win
+    unlock_file(__fd);
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  shmsz_t __fsize = __st.st_size;
+  bool __fresh = __fsize == 0;
+  if (__fresh && !__alone) {
+    ec = IPCErrc::ShmNotInitialized;
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
+  }
+  if (!__fresh && __fsize < static_cast<shmsz_t>(sizeof(shm_meta_t))) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
+  }
+  if (__fresh) {
+    __fsize = nbytes + sizeof(shm_meta_t);
+    if (ftruncate(__fd, __fsize) == -1) {
+      ec.assign(errno, std::system_category());
+      close(__fd);
+      ::unlink(this->name_);
+      this->name_[0] = '\0';
+      return;
+    }
+  }
+  void *pMetaBuf = mmap(nullptr, sizeof(shm_meta_t), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, __fd, 0);
   if (pMetaBuf == (void *)-1) {
     ec.assign(errno, std::system_category());
     close(__fd);
-    shm_unlink(name.data());
+    this->name_[0] = '\0';
     return;
   }
-  // success
-  this->meta_ = reinterpret_cast<shm_meta_t *>(pMetaBuf);
-  this->meta_->ref_count_ += 1;
 
+  auto __meta = reinterpret_cast<shm_meta_t *>(pMetaBuf);
+  if (__fresh) {
+    __meta = new (pMetaBuf) shm_meta_t;
+    __meta->magic_ = SHM_MAGIC;
+  }
+  // refuse to touch a file which is not a segment
+  if (__meta->magic_ != SHM_MAGIC) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    munmap(pMetaBuf, sizeof(shm_meta_t));
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
+  }
+  if (__alone) {
+    if (__fsize < nbytes + static_cast<shmsz_t>(sizeof(shm_meta_t))) {
+      if (ftruncate(__fd, nbytes + sizeof(shm_meta_t)) == 0) {
+        __fsize = nbytes + sizeof(shm_meta_t);
+      }
+    }
+    // nobody else has the file open, the handles left in the table are the
+    // ones of processes that crashed
+    for (std::atomic<proc_id> &__a : __meta->attachers_) {
+      __a.store(proc_id{}, std::memory_order_relaxed);
+    }
+    __meta->nattached_.store(0, std::memory_order_relaxed);
+    __meta->pidns_.store(pid_namespace(), std::memory_order_relaxed);
+    __meta->status_ = SHM_STATUS::OK;
+    __meta->shmsz_ = __fsize - sizeof(shm_meta_t);
+    lock_file(__fd, false, true);
+  }
+
+  this->meta_ = __meta;
+  if (!this->join()) {
+    ec = IPCErrc::ShmNoFreeSlot;
+    this->meta_ = nullptr;
+    munmap(pMetaBuf, sizeof(shm_meta_t));
+    close(__fd);
+    this->name_[0] = '\0';
+    return;
+  }
   this->fd_ = __fd;
-  this->name_ = {name.begin(), name.end()};
+  this->shmsz_ = __fsize - sizeof(shm_meta_t);
+  this->persistent_ = true;
   this->addr_ = nullptr;
 }
 
-shmhdl::shmhdl(std::string_view name) {
+shmhdl::shmhdl(std::string_view name, const shmsz_t nbytes,
+               std::error_code &ec) noexcept {
+  this->create(name, nbytes, ec);
+}
+
+shmhdl::shmhdl(std::string_view name, const shmsz_t nbytes) {
   std::error_code ec;
+  this->create(name, nbytes, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
 
-  int __fd = shm_open(name.data(), static_cast<int>(O_FLAGS::OPEN_ONLY),
-                      static_cast<int>(PERM::ALL));
-  // fail to open
-  if (__fd == -1) {
-    ec.assign(errno, std::system_category());
+shmhdl::shmhdl(std::string_view name, std::error_code &ec) noexcept {
+  this->attach(name, ec);
+}
+
+shmhdl::shmhdl(std::string_view name) {
+  std::error_code ec;
+  this->attach(name, ec);
+  if (ec) {
     char errmsg[256];
     snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
     throw std::runtime_error(errmsg);
   }
-  void *pMetaBuf =
-      mmap(nullptr, sizeof(shm_meta_t), PROT_EXEC | PROT_READ | PROT_WRITE,
-           MAP_SHARED, __fd, 0);
+}
 
-  // fail to map
-  if (pMetaBuf == (void *)-1) {
-    ec.assign(errno, std::system_category());
-    close(__fd);
-    shm_unlink(name.data());
+shmhdl::shmhdl(std::string_view name, SHM_ACCESS access,
+               std::error_code &ec) noexcept
+    : shmhdl(name, ec) {
+  if (!ec) {
+    this->access_ = access;
+  }
+}
+
+shmhdl::shmhdl(std::string_view name, SHM_ACCESS access) : shmhdl(name) {
+  this->access_ = access;
+}
+
+shmhdl::shmhdl(persistent_t, std::string_view path, const shmsz_t nbytes,
+               std::error_code &ec) noexcept {
+  this->open_persistent(path, nbytes, ec);
+}
+
+shmhdl::shmhdl(persistent_t, std::string_view path, const shmsz_t nbytes) {
+  std::error_code ec;
+  this->open_persistent(path, nbytes, ec);
+  if (ec) {
     char errmsg[256];
     snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
     throw std::runtime_error(errmsg);
   }
-  // success
-  this->meta_ = reinterpret_cast<shm_meta_t *>(pMetaBuf);
-  this->meta_->ref_count_ += 1;
+}
 
-  this->fd_ = __fd;
-  this->name_ = {name.begin(), name.end()};
-  this->addr_ = nullptr;
+shmhdl::shmhdl(shmhdl &&other) noexcept
+    : fd_(std::exchange(other.fd_, -1)), shmsz_(std::exchange(other.shmsz_, 0)),
+      persistent_(std::exchange(other.persistent_, false)),
+      access_(std::exchange(other.access_, SHM_ACCESS::READ_WRITE)),
+      addr_(std::exchange(other.addr_, nullptr)),
+      meta_(std::exchange(other.meta_, nullptr)),
+      slot_(std::exchange(other.slot_, NO_SLOT)) {
+  copy_name(this->name_, other.name_);
+  other.name_[0] = '\0';
 }
 
-shmhdl::~shmhdl() {
+shmhdl &shmhdl::operator=(shmhdl &&other) noexcept {
+  if (this != &other) {
+    this->release();
+    this->fd_ = std::exchange(other.fd_, -1);
+    this->shmsz_ = std::exchange(other.shmsz_, 0);
+    this->persistent_ = std::exchange(other.persistent_, false);
+    this->access_ = std::exchange(other.access_, SHM_ACCESS::READ_WRITE);
+    this->addr_ = std::exchange(other.addr_, nullptr);
+    this->meta_ = std::exchange(other.meta_, nullptr);
+    this->slot_ = std::exchange(other.slot_, NO_SLOT);
+    copy_name(this->name_, other.name_);
+    other.name_[0] = '\0';
+  }
+  return *this;
+}
+
+void shmhdl::release() noexcept {
   std::error_code ec;
-  if (this->fd() > 0) {
-    this->meta_->ref_count_ -= 1;
-    if (this->meta_->ref_count_ == 0) {
-      this->meta_->status_ = SHM_STATUS::DEL;
-      this->unmap(ec);
-      this->unmap_meta(ec);
+  if (this->meta_ != nullptr) {
+    // the last live handle removes the object, even if others were left
+    // behind by processes that crashed. Unlinked handles only give their slot
+    // back.
+    bool __last = this->leave();
+    if (this->fd_ != -1) {
+      // persistent segments outlive their handles. Two handles may both see
+      // themselves last, only the one marking the object DEL removes it: the
+      // other could remove a new object created under the same name
+      if (__last && !this->persistent_ &&
+          this->meta_->status_.exchange(SHM_STATUS::DEL,
+                                        std::memory_order_acq_rel) !=
+              SHM_STATUS::DEL) {
+        shm_unlink(this->name_);
+      }
       close(fd_);
       fd_ = -1;
-      shm_unlink(name_.c_str());
-      return;
     }
     this->unmap(ec);
     this->unmap_meta(ec);
-    close(fd_);
-    fd_ = -1;
   }
+  this->name_[0] = '\0';
+  this->shmsz_ = 0;
+  this->persistent_ = false;
+  this->access_ = SHM_ACCESS::READ_WRITE;
 }
 
+shmhdl::~shmhdl() { this->release(); }
+
 void *shmhdl::map(std::error_code &ec) noexcept {
+  ec.clear();
   // if already map, return address
   if (this->addr_) {
     return this->addr_;
   }
+  if (this->fd_ == -1) {
+    ec = IPCErrc::ShmDeleted;
+    return nullptr;
+  }
 
   // if haven't map
-  void *__tptr = mmap(nullptr, this->meta_->shmsz_,
-                      PROT_EXEC | PROT_WRITE | PROT_READ, MAP_SHARED, fd_, 0);
+  void *__tptr = (void *)-1;
+#ifdef MAP_SYNC
+  // on a DAX filesystem, stores reach persistent memory without page cache
+  if (this->persistent_ && this->access_ == SHM_ACCESS::READ_WRITE) {
+    __tptr = mmap(nullptr, this->shmsz_ + sizeof(shm_meta_t),
+                  PROT_WRITE | PROT_READ, MAP_SHARED_VALIDATE | MAP_SYNC, fd_,
+                  0);
+  }
+#endif
+  if (__tptr == (void *)-1) {
+    __tptr = mmap(nullptr, this->shmsz_ + sizeof(shm_meta_t),
+                  this->map_prot(), this->map_flags(), fd_, 0);
+  }
   if (__tptr == (void *)-1) {
     ec.assign(errno, std::system_category());
     return nullptr;
@@ -208,12 +617,58 @@ void *shmhdl::map() {
   return __addr;
 }
 
+shmview shmhdl::map_range(shmsz_t offset, shmsz_t nbytes,
+                          std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->fd_ == -1) {
+    ec = IPCErrc::ShmDeleted;
+    return {};
+  }
+  if (offset < 0 || nbytes <= 0 || offset + nbytes > this->shmsz_) {
+    ec.assign(EINVAL, std::system_category());
+    return {};
+  }
+  static const shmsz_t __pgsz = sysconf(_SC_PAGESIZE);
+  // the buffer starts right after the meta, in the middle of the first page
+  shmsz_t __begin = offset + sizeof(shm_meta_t);
+  shmsz_t __map_off = __begin & ~(__pgsz - 1);
+  size_t __map_len = __begin + nbytes - __map_off;
+  auto __block = new (std::nothrow) shmview::block_t;
+  if (__block == nullptr) {
+    ec.assign(ENOMEM, std::system_category());
+    return {};
+  }
+  void *__base = mmap(nullptr, __map_len, this->map_prot(), this->map_flags(),
+                      this->fd_, __map_off);
+  if (__base == (void *)-1) {
+    ec.assign(errno, std::system_category());
+    delete __block;
+    return {};
+  }
+  __block->refs_ = 1;
+  __block->base_ = __base;
+  __block->len_ = __map_len;
+  return shmview(__block, static_cast<char *>(__base) + (__begin - __map_off),
+                 offset, nbytes);
+}
+
+shmview shmhdl::map_range(shmsz_t offset, shmsz_t nbytes) {
+  std::error_code ec;
+  shmview __view = this->map_range(offset, nbytes, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+  return __view;
+}
+
 void shmhdl::unmap(std::error_code &ec) noexcept {
   ec.clear();
   // if addr is not nullptr
   if (this->addr_) {
     int rv = munmap(static_cast<char *>(addr_) - sizeof(shm_meta_t),
-                    this->meta_->shmsz_ + sizeof(shm_meta_t));
+                    this->shmsz_ + sizeof(shm_meta_t));
     if (rv == -1) {
       ec.assign(errno, std::system_category());
       return;
@@ -235,7 +690,9 @@ void shmhdl::unmap() {
 void shmhdl::unlink(std::error_code &ec) noexcept {
   ec.clear();
   if (this->fd_ != -1) {
-    int rv = shm_unlink(name_.c_str());
+    int rv = this->persistent_ ? ::unlink(this->name_)
+                               : shm_unlink(this->name_);
+    close(this->fd_);
     this->fd_ = -1;
     if (rv == -1) {
       ec.assign(errno, std::system_category());
@@ -254,7 +711,127 @@ void shmhdl::unlink() {
   }
 }
 
-shmsz_t shmhdl::nbytes() const noexcept { return this->meta_->shmsz_; }
+void shmhdl::sync(std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->addr_ == nullptr && this->fd_ == -1) {
+    ec = IPCErrc::ShmDeleted;
+    return;
+  }
+  // tmpfs backed segments have no disk to write back to
+  if (!this->persistent_) {
+    return;
+  }
+  if (this->addr_) {
+    if (msync(static_cast<char *>(this->addr_) - sizeof(shm_meta_t),
+              this->shmsz_ + sizeof(shm_meta_t), MS_SYNC) == -1) {
+      ec.assign(errno, std::system_category());
+    }
+    return;
+  }
+  // other handles' mappings share the page cache with the file descriptor
+  if (fdatasync(this->fd_) == -1) {
+    ec.assign(errno, std::system_category());
+  }
+}
+
+void shmhdl::sync() {
+  std::error_code ec;
+  this->sync(ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+void shmhdl::sync(shmsz_t offset, shmsz_t nbytes,
+                  std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->addr_ == nullptr) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  if (offset < 0 || nbytes < 0 || offset + nbytes > this->shmsz_) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
+  if (!this->persistent_) {
+    return;
+  }
+  static const shmsz_t __pgsz = sysconf(_SC_PAGESIZE);
+  char *__base = static_cast<char *>(this->addr_) - sizeof(shm_meta_t);
+  shmsz_t __begin = (offset + sizeof(shm_meta_t)) & ~(__pgsz - 1);
+  shmsz_t __end = offset + nbytes + sizeof(shm_meta_t);
+  if (msync(__base + __begin, __end - __begin, MS_SYNC) == -1) {
+    ec.assign(errno, std::system_category());
+  }
+}
+
+void shmhdl::sync(shmsz_t offset, shmsz_t nbytes) {
+  std::error_code ec;
+  this->sync(offset, nbytes, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+void shmhdl::advise(shmsz_t offset, shmsz_t nbytes, SHM_ADVICE advice,
+                    std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->addr_ == nullptr) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  if (offset < 0 || nbytes < 0 || offset + nbytes > this->shmsz_) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
+  char *__begin = static_cast<char *>(this->addr_) + offset;
+  advise_range(__begin, __begin + nbytes, advice, ec);
+}
+
+void shmhdl::advise(shmsz_t offset, shmsz_t nbytes, SHM_ADVICE advice) {
+  std::error_code ec;
+  this->advise(offset, nbytes, advice, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+void shmhdl::readahead(shmsz_t offset, shmsz_t nbytes,
+                       std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->fd_ == -1) {
+    ec = IPCErrc::ShmDeleted;
+    return;
+  }
+  if (offset < 0 || nbytes < 0 || offset + nbytes > this->shmsz_) {
+    ec.assign(EINVAL, std::system_category());
+    return;
+  }
+  // returns once the reads are queued, they complete in the background
+  int __rc = posix_fadvise(this->fd_, offset + sizeof(shm_meta_t), nbytes,
+                           POSIX_FADV_WILLNEED);
+  if (__rc != 0) {
+    ec.assign(__rc, std::system_category());
+  }
+}
+
+void shmhdl::readahead(shmsz_t offset, shmsz_t nbytes) {
+  std::error_code ec;
+  this->readahead(offset, nbytes, ec);
+  if (ec) {
+    char errmsg[256];
+    snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+    throw std::runtime_error(errmsg);
+  }
+}
+
+shmsz_t shmhdl::nbytes() const noexcept { return this->shmsz_; }
 
 int shmhdl::fd() const noexcept { return this->fd_; }
 
@@ -262,6 +839,81 @@ std::string_view shmhdl::name() const noexcept { return this->name_; }
 
 void *shmhdl::addr() const noexcept { return this->addr_; }
 
-size_t shmhdl::ref_count() const noexcept { return this->meta_->ref_count_; }
+bool shmhdl::persistent() const noexcept { return this->persistent_; }
+
+SHM_ACCESS shmhdl::access() const noexcept { return this->access_; }
+
+int shmhdl::map_prot() const noexcept {
+  return this->access_ == SHM_ACCESS::READ_ONLY ? PROT_READ
+                                                : PROT_READ | PROT_WRITE;
+}
+
+int shmhdl::map_flags() const noexcept {
+  return this->access_ == SHM_ACCESS::COPY_ON_WRITE ? MAP_PRIVATE
+                                                    : MAP_SHARED;
+}
+
+void shmhdl::rename(std::string_view name, std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->fd_ == -1 || this->persistent_) {
+    ec = IPCErrc::ShmDeleted;
+    return;
+  }
+  char __name[MAX_NAME_LEN + 1];
+  if (!copy_name(__name, name)) {
+    ec.assign(ENAMETOOLONG, std::system_category());
+    return;
+  }
+#ifdef __linux__
+  // shm_open() names are files of /dev/shm, link() fails instead of
+  // replacing an existing name
+  auto __path = [](const char *n) {
+    std::string __p = "/dev/shm/";
+    return __p.append(n[0] == '/' ? n + 1 : n);
+  };
+  std::string __from = __path(this->name_);
+  if (link(__from.c_str(), __path(__name).c_str()) == -1) {
+    ec.assign(errno, std::system_category());
+    return;
+  }
+  ::unlink(__from.c_str());
+  copy_name(this->name_, __name);
+#else
+  // elsewhere shm_open() names need not be files one can link()
+  ec.assign(ENOTSUP, std::system_category());
+#endif
+}
+
+bool shmhdl::retire(std::string_view name, std::error_code &ec) noexcept {
+  ec.clear();
+  if (this->meta_ == nullptr || this->ref_count() != 1) {
+    return false;
+  }
+  SHM_STATUS __ok = SHM_STATUS::OK;
+  if (!this->meta_->status_.compare_exchange_strong(__ok, SHM_STATUS::RETIRED,
+                                                    std::memory_order_relaxed)) {
+    return false;
+  }
+  // pairs with the fence in attach()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (this->ref_count() == 1) {
+    this->rename(name, ec);
+    if (!ec) {
+      return true;
+    }
+  }
+  this->revive();
+  return false;
+}
+
+void shmhdl::revive() noexcept {
+  SHM_STATUS __retired = SHM_STATUS::RETIRED;
+  this->meta_->status_.compare_exchange_strong(__retired, SHM_STATUS::OK,
+                                               std::memory_order_relaxed);
+}
+
+bool shmhdl::valid() const noexcept { return this->fd_ != -1; }
+
+shmhdl::operator bool() const noexcept { return this->valid(); }
 
 } // namespace ipc
@@ -0,0 +1,120 @@
+#include "proc_id.hpp"
+
+#ifdef __POSIX__
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <Windows.h>
+#endif
+
+namespace ipc {
+namespace {
+/**
+ * @brief start time of pid, 0 if unknown
+ * @details jiffies since boot from /proc/<pid>/stat on Linux, the creation
+ * FILETIME on Win32. Other platforms only know pids.
+ */
+uint64_t start_time(uint32_t pid, bool &found) noexcept {
+  found = true;
+#ifdef __POSIX__
+  char __path[64];
+  snprintf(__path, sizeof(__path), "/proc/%u/stat", pid);
+  std::FILE *__f = std::fopen(__path, "r");
+  if (!__f) {
+    found = errno != ENOENT;
+    return 0;
+  }
+  char __buf[1024];
+  size_t __n = std::fread(__buf, 1, sizeof(__buf) - 1, __f);
+  std::fclose(__f);
+  __buf[__n] = '\0';
+  // the command name may hold spaces and parentheses, skip past its end
+  const char *__p = std::strrchr(__buf, ')');
+  if (!__p) {
+    return 0;
+  }
+  // starttime is the 22nd field, the 20th after the command name
+  for (int __field = 0; __field < 20 && __p; __field++) {
+    __p = std::strchr(__p + 1, ' ');
+  }
+  return __p ? std::strtoull(__p + 1, nullptr, 10) : 0;
+#else
+  HANDLE __proc = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+  if (!__proc) {
+    found = GetLastError() == ERROR_ACCESS_DENIED;
+    return 0;
+  }
+  FILETIME __created, __exited, __kernel, __user;
+  uint64_t __start = 0;
+  if (GetProcessTimes(__proc, &__created, &__exited, &__kernel, &__user)) {
+    __start = (uint64_t(__created.dwHighDateTime) << 32) |
+              __created.dwLowDateTime;
+  }
+  CloseHandle(__proc);
+  return __start;
+#endif
+}
+} // namespace
+
+proc_id proc_id::self() noexcept {
+#ifdef __POSIX__
+  uint32_t __pid = uint32_t(getpid());
+#else
+  uint32_t __pid = uint32_t(GetCurrentProcessId());
+#endif
+  // a forked child has a pid and a start time of its own
+  static thread_local proc_id __self;
+  if (__self.pid_ != __pid) {
+    bool __found;
+    __self.pid_ = __pid;
+    __self.start_ = uint32_t(start_time(__pid, __found));
+  }
+  return __self;
+}
+
+bool proc_id::alive() const noexcept {
+  if (this->pid_ == 0) {
+    return false;
+  }
+  if (this->start_ == 0) {
+    return process_alive(this->pid_);
+  }
+  bool __found;
+  uint64_t __start = start_time(this->pid_, __found);
+  if (!__found) {
+    return false;
+  }
+  // unreadable, assume it is the same process
+  return __start == 0 || uint32_t(__start) == this->start_;
+}
+
+bool process_alive(uint32_t pid) noexcept {
+#ifdef __POSIX__
+  return kill(pid_t(pid), 0) == 0 || errno == EPERM;
+#else
+  HANDLE __proc = OpenProcess(SYNCHRONIZE, FALSE, pid);
+  if (!__proc) {
+    return GetLastError() == ERROR_ACCESS_DENIED;
+  }
+  bool __alive = WaitForSingleObject(__proc, 0) == WAIT_TIMEOUT;
+  CloseHandle(__proc);
+  return __alive;
+#endif
+}
+
+uint64_t pid_namespace() noexcept {
+#ifdef __linux__
+  // the inode of the namespace file tells namespaces apart. Not cached: a
+  // child forked after unshare(CLONE_NEWPID) is in a namespace of its own
+  struct stat __st;
+  return stat("/proc/self/ns/pid", &__st) == 0 ? uint64_t(__st.st_ino) : 0;
+#else
+  return 0;
+#endif
+}
+} // namespace ipc
@@ -0,0 +1,380 @@
+#include "record.hpp"
+#include "detail.hpp"
+
+#include <cstring>
+
+namespace ipc {
+namespace {
+using detail::round_up;
+using detail::throw_if;
+
+/**
+ * @brief placed at the begining of every record
+ *
+ */
+struct record_header_t {
+  /**
+   * @brief bytes of the record, a multiple of record_schema::ALIGN
+   *
+   */
+  uint32_t size_;
+  uint32_t schema_;
+};
+
+/**
+ * @brief fixed part of a STRING or ARRAY field
+ *
+ */
+struct span_t {
+  /**
+   * @brief from the begining of the record, 0 for a field never set
+   *
+   */
+  uint32_t offset_;
+  /**
+   * @brief elements, or bytes of a string without its terminating '\0'
+   *
+   */
+  uint32_t length_;
+};
+
+constexpr bool is_scalar(field_type type) noexcept {
+  return uint32_t(type) < uint32_t(field_type::STRING);
+}
+
+constexpr size_t width_of(field_type type) noexcept {
+  switch (type) {
+  case field_type::BOOL:
+  case field_type::INT8:
+  case field_type::UINT8:
+    return 1;
+  case field_type::INT16:
+  case field_type::UINT16:
+    return 2;
+  case field_type::INT32:
+  case field_type::UINT32:
+  case field_type::FLOAT32:
+    return 4;
+  case field_type::INT64:
+  case field_type::UINT64:
+  case field_type::FLOAT64:
+    return 8;
+  case field_type::STRING:
+  case field_type::ARRAY:
+    return sizeof(span_t);
+  case field_type::NONE:
+    break;
+  }
+  return 0;
+}
+
+constexpr size_t align_of(field_type type) noexcept {
+  return is_scalar(type) ? width_of(type) : alignof(span_t);
+}
+
+/**
+ * @brief FNV-1a
+ *
+ */
+uint32_t fnv1a(uint32_t hash, const void *data, size_t n) noexcept {
+  auto __p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < n; i++) {
+    hash = (hash ^ __p[i]) * 16777619u;
+  }
+  return hash;
+}
+} // namespace
+
+void record_schema::build(const std::vector<field_def> &fields,
+                          std::error_code &ec) noexcept {
+  ec.clear();
+  if (fields.empty() || fields.size() > MAX_FIELDS) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (fields[i].name_.empty() ||
+        uint32_t(fields[i].type_) > uint32_t(field_type::ARRAY) ||
+        (fields[i].type_ == field_type::ARRAY &&
+         !is_scalar(fields[i].elem_))) {
+      ec = std::make_error_code(std::errc::invalid_argument);
+      return;
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (fields[j].name_ == fields[i].name_) {
+        ec = std::make_error_code(std::errc::invalid_argument);
+        return;
+      }
+    }
+  }
+  uint32_t __hash = 2166136261u;
+  size_t __offset = sizeof(record_header_t);
+  this->fields_.clear();
+  this->fields_.reserve(fields.size());
+  for (const field_def &__f : fields) {
+    field_type __elem =
+        __f.type_ == field_type::ARRAY ? __f.elem_ : field_type::UINT8;
+    __offset = round_up(__offset, align_of(__f.type_));
+    this->fields_.push_back(
+        {std::string(__f.name_), __f.type_, __elem, uint32_t(__offset)});
+    __offset += width_of(__f.type_);
+
+    const uint8_t __types[3] = {0, uint8_t(__f.type_), uint8_t(__elem)};
+    __hash = fnv1a(__hash, __f.name_.data(), __f.name_.size());
+    __hash = fnv1a(__hash, __types, sizeof(__types));
+  }
+  this->inline_size_ = uint32_t(round_up(__offset, ALIGN));
+  this->hash_ = __hash;
+}
+
+record_schema::record_schema(const std::vector<field_def> &fields,
+                             std::error_code &ec) noexcept {
+  this->build(fields, ec);
+}
+
+record_schema::record_schema(const std::vector<field_def> &fields) {
+  std::error_code ec;
+  this->build(fields, ec);
+  throw_if(ec);
+}
+
+size_t record_schema::find(std::string_view name) const noexcept {
+  for (size_t i = 0; i < this->fields_.size(); i++) {
+    if (this->fields_[i].name_ == name) {
+      return i;
+    }
+  }
+  return npos;
+}
+
+std::string_view record_schema::field_name(size_t field) const noexcept {
+  if (field >= this->fields_.size()) {
+    return {};
+  }
+  return this->fields_[field].name_;
+}
+
+field_type record_schema::type(size_t field) const noexcept {
+  if (field >= this->fields_.size()) {
+    return field_type::NONE;
+  }
+  return this->fields_[field].type_;
+}
+
+field_type record_schema::elem(size_t field) const noexcept {
+  if (field >= this->fields_.size()) {
+    return field_type::NONE;
+  }
+  return this->fields_[field].elem_;
+}
+
+uint32_t record_schema::offset(size_t field) const noexcept {
+  if (field >= this->fields_.size()) {
+    return 0;
+  }
+  return this->fields_[field].offset_;
+}
+
+size_t record_schema::nfields() const noexcept { return this->fields_.size(); }
+
+uint32_t record_schema::inline_size() const noexcept {
+  return this->inline_size_;
+}
+
+uint32_t record_schema::hash() const noexcept { return this->hash_; }
+
+bool record_schema::valid() const noexcept { return !this->fields_.empty(); }
+
+record_schema::operator bool() const noexcept { return this->valid(); }
+
+record_builder::record_builder(const record_schema &schema, void *buf,
+                               size_t capacity) noexcept
+    : schema_(&schema), buf_(static_cast<char *>(buf)), capacity_(capacity) {
+  if (!schema.valid() || !buf ||
+      reinterpret_cast<uintptr_t>(buf) % record_schema::ALIGN) {
+    this->ec_ = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  if (capacity < schema.inline_size()) {
+    this->ec_ = IPCErrc::RecordOverflow;
+    return;
+  }
+  std::memset(this->buf_, 0, schema.inline_size());
+  this->size_ = schema.inline_size();
+}
+
+void *record_builder::scalar(size_t field, field_type type) noexcept {
+  if (this->ec_) {
+    return nullptr;
+  }
+  if (field >= this->schema_->nfields() ||
+      this->schema_->type(field) != type) {
+    this->ec_ = std::make_error_code(std::errc::invalid_argument);
+    return nullptr;
+  }
+  return this->buf_ + this->schema_->offset(field);
+}
+
+void *record_builder::append(size_t field, field_type type, field_type elem,
+                             size_t n, size_t width) noexcept {
+  if (this->ec_) {
+    return nullptr;
+  }
+  if (field >= this->schema_->nfields() ||
+      this->schema_->type(field) != type ||
+      (type == field_type::ARRAY && this->schema_->elem(field) != elem)) {
+    this->ec_ = std::make_error_code(std::errc::invalid_argument);
+    return nullptr;
+  }
+  // strings keep a terminating '\0'
+  size_t __extra = type == field_type::STRING ? 1 : 0;
+  size_t __room = this->capacity_ - this->size_;
+  if (__room < __extra || n > (__room - __extra) / width) {
+    this->ec_ = IPCErrc::RecordOverflow;
+    return nullptr;
+  }
+  size_t __end = round_up(this->size_ + n * width + __extra,
+                          record_schema::ALIGN);
+  if (__end > this->capacity_ || __end > UINT32_MAX) {
+    this->ec_ = IPCErrc::RecordOverflow;
+    return nullptr;
+  }
+  span_t __span{uint32_t(this->size_), uint32_t(n)};
+  std::memcpy(this->buf_ + this->schema_->offset(field), &__span,
+              sizeof(__span));
+  char *__p = this->buf_ + this->size_;
+  // the padding is zeroed too, no stale bytes of the buffer leak out
+  std::memset(__p + n * width, 0, __end - this->size_ - n * width);
+  this->size_ = __end;
+  return __p;
+}
+
+void record_builder::set_string(size_t field,
+                                std::string_view value) noexcept {
+  void *__p = this->append(field, field_type::STRING, field_type::UINT8,
+                           value.size(), 1);
+  if (__p) {
+    std::memcpy(__p, value.data(), value.size());
+  }
+}
+
+size_t record_builder::finish(std::error_code &ec) noexcept {
+  ec = this->ec_;
+  if (ec) {
+    return 0;
+  }
+  record_header_t __header{uint32_t(this->size_), this->schema_->hash()};
+  std::memcpy(this->buf_, &__header, sizeof(__header));
+  return this->size_;
+}
+
+size_t record_builder::finish() {
+  std::error_code ec;
+  size_t __size = this->finish(ec);
+  throw_if(ec);
+  return __size;
+}
+
+size_t record_builder::size() const noexcept { return this->size_; }
+
+record_view::record_view(const record_schema &schema, const void *data,
+                         size_t size, std::error_code &ec) noexcept {
+  ec.clear();
+  auto __base = static_cast<const char *>(data);
+  if (!schema.valid() || !data ||
+      reinterpret_cast<uintptr_t>(data) % record_schema::ALIGN ||
+      size < sizeof(record_header_t)) {
+    ec = IPCErrc::RecordMismatch;
+    return;
+  }
+  record_header_t __header;
+  std::memcpy(&__header, __base, sizeof(__header));
+  if (__header.schema_ != schema.hash() || __header.size_ > size ||
+      __header.size_ < schema.inline_size() ||
+      __header.size_ % record_schema::ALIGN) {
+    ec = IPCErrc::RecordMismatch;
+    return;
+  }
+  // every string and array has to lie within the record, the accessors do
+  // not check again
+  for (size_t i = 0; i < schema.nfields(); i++) {
+    if (is_scalar(schema.type(i))) {
+      continue;
+    }
+    span_t __span;
+    std::memcpy(&__span, __base + schema.offset(i), sizeof(__span));
+    if (__span.offset_ == 0 && __span.length_ == 0) {
+      // never set
+      continue;
+    }
+    bool __string = schema.type(i) == field_type::STRING;
+    size_t __width = __string ? 1 : width_of(schema.elem(i));
+    size_t __extra = __string ? 1 : 0;
+    if (__span.offset_ < schema.inline_size() ||
+        __span.offset_ % record_schema::ALIGN ||
+        __header.size_ - __span.offset_ < __extra ||
+        __span.length_ > (__header.size_ - __span.offset_ - __extra) / __width ||
+        (__string && __base[__span.offset_ + __span.length_] != '\0')) {
+      ec = IPCErrc::RecordMismatch;
+      return;
+    }
+  }
+  this->schema_ = &schema;
+  this->base_ = __base;
+}
+
+record_view::record_view(const record_schema &schema, const void *data,
+                         size_t size) {
+  std::error_code ec;
+  *this = record_view(schema, data, size, ec);
+  throw_if(ec);
+}
+
+const void *record_view::scalar(size_t field, field_type type) const noexcept {
+  if (!this->base_ || field >= this->schema_->nfields() ||
+      this->schema_->type(field) != type) {
+    return nullptr;
+  }
+  return this->base_ + this->schema_->offset(field);
+}
+
+const void *record_view::items(size_t field, field_type type, field_type elem,
+                               size_t &n) const noexcept {
+  n = 0;
+  if (!this->base_ || field >= this->schema_->nfields() ||
+      this->schema_->type(field) != type ||
+      (type == field_type::ARRAY && this->schema_->elem(field) != elem)) {
+    return nullptr;
+  }
+  span_t __span;
+  std::memcpy(&__span, this->base_ + this->schema_->offset(field),
+              sizeof(__span));
+  if (__span.offset_ == 0) {
+    return nullptr;
+  }
+  n = __span.length_;
+  return this->base_ + __span.offset_;
+}
+
+std::string_view record_view::string(size_t field) const noexcept {
+  size_t __n = 0;
+  auto __p = static_cast<const char *>(
+      this->items(field, field_type::STRING, field_type::UINT8, __n));
+  return __p ? std::string_view(__p, __n) : std::string_view();
+}
+
+size_t record_view::size() const noexcept {
+  if (!this->base_) {
+    return 0;
+  }
+  record_header_t __header;
+  std::memcpy(&__header, this->base_, sizeof(__header));
+  return __header.size_;
+}
+
+const void *record_view::data() const noexcept { return this->base_; }
+
+bool record_view::valid() const noexcept { return this->base_ != nullptr; }
+
+record_view::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
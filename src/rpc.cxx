@@ -0,0 +1,469 @@
+#include "rpc.hpp"
+#include "detail.hpp"
+#include "cpuinfo.hpp"
+#include "ec.hpp"
+
+#include <cstring>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace ipc {
+namespace {
+using detail::CACHE_LINE;
+using detail::deadline_t;
+using detail::READY;
+using detail::round_up;
+using detail::throw_if;
+using detail::wait_ready;
+
+/**
+ * @brief slot states, WAITER is or-ed in by a caller sleeping on the slot
+ *
+ */
+constexpr uint32_t SLOT_FREE = 0;
+constexpr uint32_t SLOT_CLAIMED = 1;
+constexpr uint32_t SLOT_REQUEST = 2;
+constexpr uint32_t SLOT_SERVING = 3;
+constexpr uint32_t SLOT_RESPONSE = 4;
+/**
+ * @brief a caller holding the slot while it checks its ticket and copies the
+ * response out
+ *
+ */
+constexpr uint32_t SLOT_COLLECTING = 5;
+constexpr uint32_t SLOT_WAITER = 0x8000'0000;
+
+/**
+ * @brief spins before a futex mode endpoint goes to sleep
+ *
+ */
+constexpr uint32_t SPIN_LIMIT = 256;
+/**
+ * @brief spins between two deadline checks (and yields, so that both ends
+ * sharing a core still make progress)
+ *
+ */
+constexpr uint32_t SPIN_CHECK = 256;
+} // namespace
+
+/**
+ * @brief placed at the begining of the shared memory buffer
+ * memory layout might look like this:
+ *  | channel meta | slot 0 | request 0 | response 0 | slot 1 | ...
+ */
+struct rpc_channel::channel_meta_t {
+  std::atomic<uint32_t> state_;
+  uint32_t nslots_;
+  uint64_t max_payload_;
+  uint64_t slot_stride_;
+  std::atomic<uint64_t> next_id_;
+  /**
+   * @brief bumped for every request, servers sleep on it
+   *
+   */
+  alignas(CACHE_LINE) std::atomic<uint32_t> doorbell_;
+  /**
+   * @brief number of servers sleeping on the doorbell
+   *
+   */
+  std::atomic<uint32_t> sleepers_;
+};
+
+struct alignas(CACHE_LINE) rpc_channel::slot_t {
+  std::atomic<uint32_t> state_;
+  uint32_t method_;
+  /**
+   * @brief correlation id of the call, read by stale tickets while the slot
+   * is reused
+   *
+   */
+  std::atomic<uint64_t> id_;
+  uint64_t req_size_;
+  uint64_t resp_size_;
+};
+
+void rpc_channel::create(std::string_view name, uint32_t nslots,
+                         size_t max_payload, std::error_code &ec) noexcept {
+  if (nslots == 0) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  size_t __stride =
+      round_up(sizeof(slot_t) + 2 * round_up(max_payload, CACHE_LINE),
+               CACHE_LINE);
+  size_t __meta_size = round_up(sizeof(channel_meta_t), CACHE_LINE);
+  this->hdl_ = shmhdl(name, __meta_size + __stride * nslots, ec);
+  if (ec) {
+    return;
+  }
+  void *__buf = this->hdl_.map(ec);
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = new (__buf) channel_meta_t;
+  this->meta_->nslots_ = nslots;
+  this->meta_->max_payload_ = max_payload;
+  this->meta_->slot_stride_ = __stride;
+  this->meta_->next_id_.store(1, std::memory_order_relaxed);
+  this->meta_->doorbell_.store(0, std::memory_order_relaxed);
+  this->meta_->sleepers_.store(0, std::memory_order_relaxed);
+  this->slots_ = static_cast<char *>(__buf) + __meta_size;
+  for (uint32_t i = 0; i < nslots; i++) {
+    auto __slot = new (this->slot_at(i)) slot_t;
+    __slot->state_.store(SLOT_FREE, std::memory_order_relaxed);
+    __slot->id_.store(0, std::memory_order_relaxed);
+  }
+  this->meta_->state_.store(READY, std::memory_order_release);
+}
+
+void rpc_channel::attach(std::string_view name, std::error_code &ec,
+                         std::chrono::milliseconds timeout) noexcept {
+  this->hdl_ = shmhdl(name, ec);
+  if (ec) {
+    return;
+  }
+  void *__buf = this->hdl_.map(ec);
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __meta_size = round_up(sizeof(channel_meta_t), CACHE_LINE);
+  if (size_t(this->hdl_.nbytes()) < __meta_size) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = static_cast<channel_meta_t *>(__buf);
+  // wait for the creator to finish initializing the slots
+  if (!wait_ready(__meta->state_, timeout)) {
+    ec = IPCErrc::ShmNotInitialized;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  if (size_t(this->hdl_.nbytes()) !=
+      __meta_size + __meta->slot_stride_ * __meta->nslots_) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = __meta;
+  this->slots_ = static_cast<char *>(__buf) + __meta_size;
+}
+
+rpc_channel::slot_t *rpc_channel::slot_at(uint32_t i) const noexcept {
+  return reinterpret_cast<slot_t *>(this->slots_ +
+                                    size_t(i) * this->meta_->slot_stride_);
+}
+
+char *rpc_channel::request_area(slot_t *slot) const noexcept {
+  return reinterpret_cast<char *>(slot) + sizeof(slot_t);
+}
+
+char *rpc_channel::response_area(slot_t *slot) const noexcept {
+  return this->request_area(slot) +
+         round_up(this->meta_->max_payload_, CACHE_LINE);
+}
+
+rpc_channel::rpc_channel(create_only_t, std::string_view name,
+                         uint32_t nslots, size_t max_payload,
+                         std::error_code &ec, rpc_wait mode) noexcept
+    : mode_(mode) {
+  this->create(name, nslots, max_payload, ec);
+}
+
+rpc_channel::rpc_channel(create_only_t, std::string_view name,
+                         uint32_t nslots, size_t max_payload, rpc_wait mode)
+    : mode_(mode) {
+  std::error_code ec;
+  this->create(name, nslots, max_payload, ec);
+  throw_if(ec);
+}
+
+rpc_channel::rpc_channel(open_only_t, std::string_view name,
+                         std::error_code &ec, rpc_wait mode,
+                         std::chrono::milliseconds timeout) noexcept
+    : mode_(mode) {
+  this->attach(name, ec, timeout);
+}
+
+rpc_channel::rpc_channel(open_only_t, std::string_view name, rpc_wait mode,
+                         std::chrono::milliseconds timeout)
+    : mode_(mode) {
+  std::error_code ec;
+  this->attach(name, ec, timeout);
+  throw_if(ec);
+}
+
+rpc_channel::rpc_channel(rpc_channel &&other) noexcept
+    : hdl_(std::move(other.hdl_)),
+      meta_(std::exchange(other.meta_, nullptr)),
+      slots_(std::exchange(other.slots_, nullptr)), mode_(other.mode_),
+      client_cursor_(other.client_cursor_),
+      server_cursor_(other.server_cursor_) {}
+
+rpc_channel &rpc_channel::operator=(rpc_channel &&other) noexcept {
+  if (this != &other) {
+    this->hdl_ = std::move(other.hdl_);
+    this->meta_ = std::exchange(other.meta_, nullptr);
+    this->slots_ = std::exchange(other.slots_, nullptr);
+    this->mode_ = other.mode_;
+    this->client_cursor_ = other.client_cursor_;
+    this->server_cursor_ = other.server_cursor_;
+  }
+  return *this;
+}
+
+rpc_ticket rpc_channel::call_async(uint32_t method, const void *data,
+                                   size_t size, std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return {};
+  }
+  if (size > this->meta_->max_payload_) {
+    ec = std::make_error_code(std::errc::message_size);
+    return {};
+  }
+  const uint32_t __nslots = this->meta_->nslots_;
+  for (uint32_t n = 0; n < __nslots; n++) {
+    uint32_t __i = (this->client_cursor_ + n) % __nslots;
+    slot_t *__slot = this->slot_at(__i);
+    uint32_t __state = SLOT_FREE;
+    if (!__slot->state_.compare_exchange_strong(__state, SLOT_CLAIMED,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+      continue;
+    }
+    this->client_cursor_ = (__i + 1) % __nslots;
+    uint64_t __id =
+        this->meta_->next_id_.fetch_add(1, std::memory_order_relaxed);
+    __slot->method_ = method;
+    __slot->id_.store(__id, std::memory_order_relaxed);
+    __slot->req_size_ = size;
+    std::memcpy(this->request_area(__slot), data, size);
+    __slot->state_.store(SLOT_REQUEST, std::memory_order_release);
+    // pairs with the sleepers_ increment in receive(): either the server sees
+    // the new doorbell value or we see it sleeping
+    this->meta_->doorbell_.fetch_add(1, std::memory_order_seq_cst);
+    if (this->meta_->sleepers_.load(std::memory_order_seq_cst) != 0) {
+      futex_wake(this->meta_->doorbell_, 1);
+    }
+    return {__i, __id};
+  }
+  ec = IPCErrc::RpcNoFreeSlot;
+  return {};
+}
+
+rpc_ticket rpc_channel::call_async(uint32_t method, const void *data,
+                                   size_t size) {
+  std::error_code ec;
+  rpc_ticket __ticket = this->call_async(method, data, size, ec);
+  throw_if(ec);
+  return __ticket;
+}
+
+bool rpc_channel::ready(const rpc_ticket &ticket) const noexcept {
+  if (!this->meta_ || ticket.slot_ >= this->meta_->nslots_) {
+    return false;
+  }
+  slot_t *__slot = this->slot_at(ticket.slot_);
+  return (__slot->state_.load(std::memory_order_acquire) & ~SLOT_WAITER) ==
+             SLOT_RESPONSE &&
+         __slot->id_.load(std::memory_order_relaxed) == ticket.id_;
+}
+
+size_t rpc_channel::wait(const rpc_ticket &ticket, void *resp, size_t cap,
+                         std::error_code &ec,
+                         std::chrono::nanoseconds timeout) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return 0;
+  }
+  if (ticket.slot_ >= this->meta_->nslots_) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return 0;
+  }
+  slot_t *__slot = this->slot_at(ticket.slot_);
+  deadline_t __deadline(timeout);
+  uint32_t __spins = 0;
+  for (;;) {
+    uint32_t __state = __slot->state_.load(std::memory_order_acquire);
+    // a ticket already collected, or whose slot went to another call
+    if ((__state & ~SLOT_WAITER) == SLOT_FREE ||
+        (__state & ~SLOT_WAITER) == SLOT_CLAIMED ||
+        __slot->id_.load(std::memory_order_relaxed) != ticket.id_) {
+      ec = std::make_error_code(std::errc::invalid_argument);
+      return 0;
+    }
+    if ((__state & ~SLOT_WAITER) == SLOT_RESPONSE) {
+      // hold the slot, then make sure it still answers this ticket: it may
+      // have been collected and reused since the id was read
+      if (!__slot->state_.compare_exchange_weak(__state, SLOT_COLLECTING,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+        continue;
+      }
+      if (__slot->id_.load(std::memory_order_relaxed) == ticket.id_) {
+        break;
+      }
+      if (__slot->state_.exchange(SLOT_RESPONSE, std::memory_order_release) &
+          SLOT_WAITER) {
+        futex_wake_all(__slot->state_);
+      }
+      ec = std::make_error_code(std::errc::invalid_argument);
+      return 0;
+    }
+    if (this->mode_ == rpc_wait::poll || __spins < SPIN_LIMIT) {
+      cpu_relax();
+      if (++__spins % SPIN_CHECK == 0) {
+        if (__deadline.expired()) {
+          ec = std::make_error_code(std::errc::timed_out);
+          return 0;
+        }
+        std::this_thread::yield();
+      }
+      continue;
+    }
+    auto __left = __deadline.remaining();
+    if (__left.count() == 0) {
+      ec = std::make_error_code(std::errc::timed_out);
+      return 0;
+    }
+    // tell the server to wake us, then sleep unless the state moved on
+    if (!(__state & SLOT_WAITER) &&
+        !__slot->state_.compare_exchange_weak(__state, __state | SLOT_WAITER,
+                                              std::memory_order_relaxed)) {
+      continue;
+    }
+    futex_wait(__slot->state_, __state | SLOT_WAITER, __left);
+  }
+  size_t __size = __slot->resp_size_;
+  std::memcpy(resp, this->response_area(__slot), __size < cap ? __size : cap);
+  if (__slot->state_.exchange(SLOT_FREE, std::memory_order_release) &
+      SLOT_WAITER) {
+    futex_wake_all(__slot->state_);
+  }
+  return __size;
+}
+
+size_t rpc_channel::wait(const rpc_ticket &ticket, void *resp, size_t cap,
+                         std::chrono::nanoseconds timeout) {
+  std::error_code ec;
+  size_t __size = this->wait(ticket, resp, cap, ec, timeout);
+  throw_if(ec);
+  return __size;
+}
+
+size_t rpc_channel::call(uint32_t method, const void *data, size_t size,
+                         void *resp, size_t cap, std::error_code &ec,
+                         std::chrono::nanoseconds timeout) noexcept {
+  ec.clear();
+  rpc_ticket __ticket = this->call_async(method, data, size, ec);
+  if (ec) {
+    return 0;
+  }
+  return this->wait(__ticket, resp, cap, ec, timeout);
+}
+
+size_t rpc_channel::call(uint32_t method, const void *data, size_t size,
+                         void *resp, size_t cap,
+                         std::chrono::nanoseconds timeout) {
+  std::error_code ec;
+  size_t __size = this->call(method, data, size, resp, cap, ec, timeout);
+  throw_if(ec);
+  return __size;
+}
+
+bool rpc_channel::poll_request(rpc_request &req) noexcept {
+  const uint32_t __nslots = this->meta_->nslots_;
+  for (uint32_t n = 0; n < __nslots; n++) {
+    uint32_t __i = (this->server_cursor_ + n) % __nslots;
+    slot_t *__slot = this->slot_at(__i);
+    uint32_t __state = __slot->state_.load(std::memory_order_relaxed);
+    if ((__state & ~SLOT_WAITER) != SLOT_REQUEST ||
+        !__slot->state_.compare_exchange_strong(
+            __state, SLOT_SERVING | (__state & SLOT_WAITER),
+            std::memory_order_acquire, std::memory_order_relaxed)) {
+      continue;
+    }
+    this->server_cursor_ = (__i + 1) % __nslots;
+    req.slot_ = __i;
+    req.id_ = __slot->id_.load(std::memory_order_relaxed);
+    req.method_ = __slot->method_;
+    req.data_ = this->request_area(__slot);
+    req.size_ = __slot->req_size_;
+    req.resp_ = this->response_area(__slot);
+    req.resp_cap_ = this->meta_->max_payload_;
+    return true;
+  }
+  return false;
+}
+
+bool rpc_channel::receive(rpc_request &req, std::error_code &ec,
+                          std::chrono::nanoseconds timeout) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return false;
+  }
+  deadline_t __deadline(timeout);
+  uint32_t __spins = 0;
+  for (;;) {
+    uint32_t __bell = this->meta_->doorbell_.load(std::memory_order_acquire);
+    if (this->poll_request(req)) {
+      return true;
+    }
+    if (this->mode_ == rpc_wait::poll || __spins < SPIN_LIMIT) {
+      cpu_relax();
+      if (++__spins % SPIN_CHECK == 0) {
+        if (__deadline.expired()) {
+          ec = std::make_error_code(std::errc::timed_out);
+          return false;
+        }
+        std::this_thread::yield();
+      }
+      continue;
+    }
+    auto __left = __deadline.remaining();
+    if (__left.count() == 0) {
+      ec = std::make_error_code(std::errc::timed_out);
+      return false;
+    }
+    this->meta_->sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    if (this->meta_->doorbell_.load(std::memory_order_seq_cst) == __bell) {
+      futex_wait(this->meta_->doorbell_, __bell, __left);
+    }
+    this->meta_->sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+void rpc_channel::reply(const rpc_request &req, size_t size) noexcept {
+  slot_t *__slot = this->slot_at(req.slot_);
+  __slot->resp_size_ = size < req.resp_cap_ ? size : req.resp_cap_;
+  uint32_t __old =
+      __slot->state_.exchange(SLOT_RESPONSE, std::memory_order_acq_rel);
+  // a stale ticket may be asleep on the slot next to its caller
+  if (__old & SLOT_WAITER) {
+    futex_wake_all(__slot->state_);
+  }
+}
+
+uint32_t rpc_channel::nslots() const noexcept {
+  return this->meta_ ? this->meta_->nslots_ : 0;
+}
+
+size_t rpc_channel::max_payload() const noexcept {
+  return this->meta_ ? this->meta_->max_payload_ : 0;
+}
+
+rpc_wait rpc_channel::mode() const noexcept { return this->mode_; }
+
+void rpc_channel::set_mode(rpc_wait mode) noexcept { this->mode_ = mode; }
+
+bool rpc_channel::valid() const noexcept { return this->meta_ != nullptr; }
+
+rpc_channel::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
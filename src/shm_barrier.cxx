@@ -0,0 +1,124 @@
+#include "shm_barrier.hpp"
+#include "detail.hpp"
+#include "cpuinfo.hpp"
+
+#include <thread>
+
+namespace ipc {
+namespace {
+/**
+ * @brief spins on the phase word before a party goes to sleep
+ *
+ */
+constexpr uint32_t SPIN_LIMIT = 256;
+/**
+ * @brief spins between two yields, so that parties sharing a core with the
+ * last one to arrive do not starve it
+ *
+ */
+constexpr uint32_t SPIN_YIELD = 64;
+
+using detail::deadline_t;
+using detail::throw_if;
+} // namespace
+
+shm_barrier::shm_barrier(create_only_t, std::string_view name,
+                         uint32_t nparties, std::error_code &ec) noexcept {
+  if (nparties == 0) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  this->obj_ = shm_object<state_t>(create_only, name, ec, nparties);
+}
+
+shm_barrier::shm_barrier(create_only_t, std::string_view name,
+                         uint32_t nparties) {
+  if (nparties == 0) {
+    throw_if(std::make_error_code(std::errc::invalid_argument));
+  }
+  this->obj_ = shm_object<state_t>(create_only, name, nparties);
+}
+
+shm_barrier::shm_barrier(open_only_t, std::string_view name,
+                         std::error_code &ec,
+                         std::chrono::milliseconds timeout) noexcept
+    : obj_(open_only, name, ec, timeout) {}
+
+shm_barrier::shm_barrier(open_only_t, std::string_view name,
+                         std::chrono::milliseconds timeout)
+    : obj_(open_only, name, timeout) {}
+
+uint32_t shm_barrier::arrive() noexcept {
+  if (!this->valid()) {
+    return 0;
+  }
+  state_t *__s = this->obj_.get();
+  // the phase cannot advance before this party arrives
+  uint32_t __phase = __s->phase_.load(std::memory_order_acquire);
+  if (__s->count_.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+      __s->nparties_) {
+    // the count is reset before the release, a party entering the next phase
+    // sees it at 0
+    __s->count_.store(0, std::memory_order_relaxed);
+    __s->phase_.store(__phase + 1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (__s->sleepers_.load(std::memory_order_relaxed) != 0) {
+      futex_wake_all(__s->phase_);
+    }
+  }
+  return __phase;
+}
+
+bool shm_barrier::wait(uint32_t token,
+                       std::chrono::nanoseconds timeout) noexcept {
+  if (!this->valid()) {
+    return false;
+  }
+  state_t *__s = this->obj_.get();
+  for (uint32_t __spins = 0; __spins < SPIN_LIMIT; __spins++) {
+    if (__s->phase_.load(std::memory_order_acquire) != token) {
+      return true;
+    }
+    cpu_relax();
+    if ((__spins + 1) % SPIN_YIELD == 0) {
+      std::this_thread::yield();
+    }
+  }
+  deadline_t __deadline(timeout);
+  __s->sleepers_.fetch_add(1, std::memory_order_relaxed);
+  // pairs with the fence in arrive(): either the last party sees us asleep or
+  // we see the new phase
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  bool __done;
+  while (!(__done = __s->phase_.load(std::memory_order_acquire) != token)) {
+    auto __left = __deadline.remaining();
+    if (__left.count() == 0) {
+      break;
+    }
+    futex_wait(__s->phase_, token, __left);
+  }
+  __s->sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  return __done;
+}
+
+uint32_t shm_barrier::arrive_and_wait() noexcept {
+  if (!this->valid()) {
+    return 0;
+  }
+  uint32_t __token = this->arrive();
+  this->wait(__token);
+  return __token + 1;
+}
+
+uint32_t shm_barrier::phase() const noexcept {
+  return this->obj_ ? this->obj_->phase_.load(std::memory_order_acquire) : 0;
+}
+
+uint32_t shm_barrier::nparties() const noexcept {
+  return this->obj_ ? this->obj_->nparties_ : 0;
+}
+
+bool shm_barrier::valid() const noexcept { return this->obj_.valid(); }
+
+shm_barrier::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
@@ -0,0 +1,279 @@
+#include "shm_rwlock.hpp"
+#include "detail.hpp"
+#include "cpuinfo.hpp"
+
+#include <functional>
+#include <thread>
+
+#ifdef __POSIX__
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace ipc {
+namespace {
+using detail::throw_if;
+
+/**
+ * @brief writer word values
+ *
+ */
+constexpr uint32_t WRITER_FREE = 0;
+constexpr uint32_t WRITER_PENDING = 1;
+constexpr uint32_t WRITER_HELD = 2;
+
+/**
+ * @brief spins before a reader or a writer goes to sleep
+ *
+ */
+constexpr uint32_t SPIN_LIMIT = 256;
+/**
+ * @brief spins between two yields, so that the lock holder still gets the
+ * core when it is shared
+ *
+ */
+constexpr uint32_t SPIN_YIELD = 64;
+
+/**
+ * @brief bumped in a forked child, whose threads must not keep the reader
+ * slot of the parent thread they were copied from
+ *
+ */
+std::atomic<uint32_t> fork_generation{0};
+#ifdef __POSIX__
+const int atfork_registered = pthread_atfork(nullptr, nullptr, [] {
+  fork_generation.fetch_add(1, std::memory_order_relaxed);
+});
+#endif
+
+struct thread_seed_t {
+  uint32_t generation_ = UINT32_MAX;
+  uint32_t value_ = 0;
+};
+thread_local thread_seed_t thread_seed;
+
+/**
+ * @brief a hash of the calling thread and process, stable between calls
+ *
+ */
+uint32_t current_seed() noexcept {
+  uint32_t __gen = fork_generation.load(std::memory_order_relaxed);
+  if (thread_seed.generation_ != __gen) {
+    uint64_t __x = std::hash<std::thread::id>()(std::this_thread::get_id());
+#ifdef __POSIX__
+    __x ^= uint64_t(getpid()) << 32;
+#endif
+    // splitmix64 finalizer
+    __x = (__x ^ (__x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    __x = (__x ^ (__x >> 27)) * 0x94d049bb133111ebull;
+    __x ^= __x >> 31;
+    thread_seed.generation_ = __gen;
+    thread_seed.value_ = uint32_t(__x);
+  }
+  return thread_seed.value_;
+}
+
+bool valid_slots(uint32_t nslots) noexcept {
+  return nslots != 0 && nslots <= shm_rwlock::MAX_SLOTS;
+}
+} // namespace
+
+shm_rwlock::shm_rwlock(create_only_t, std::string_view name,
+                       std::error_code &ec, uint32_t nslots,
+                       rw_prefer prefer) noexcept {
+  if (!valid_slots(nslots)) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  this->obj_ = shm_object<state_t>(create_only, name, ec, nslots, prefer);
+}
+
+shm_rwlock::shm_rwlock(create_only_t, std::string_view name, uint32_t nslots,
+                       rw_prefer prefer) {
+  if (!valid_slots(nslots)) {
+    throw_if(std::make_error_code(std::errc::invalid_argument));
+  }
+  this->obj_ = shm_object<state_t>(create_only, name, nslots, prefer);
+}
+
+shm_rwlock::shm_rwlock(open_only_t, std::string_view name, std::error_code &ec,
+                       std::chrono::milliseconds timeout) noexcept
+    : obj_(open_only, name, ec, timeout) {}
+
+shm_rwlock::shm_rwlock(open_only_t, std::string_view name,
+                       std::chrono::milliseconds timeout)
+    : obj_(open_only, name, timeout) {}
+
+std::atomic<uint32_t> &shm_rwlock::slot() const noexcept {
+  return this->obj_->slots_[current_seed() % this->obj_->nslots_].readers_;
+}
+
+bool shm_rwlock::readers_gone() const noexcept {
+  for (uint32_t i = 0; i < this->obj_->nslots_; i++) {
+    if (this->obj_->slots_[i].readers_.load(std::memory_order_seq_cst) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool shm_rwlock::enter_shared(std::atomic<uint32_t> &slot) noexcept {
+  state_t *__s = this->obj_.get();
+  // either the writer sees this reader in its slot, or we see the writer
+  slot.fetch_add(1, std::memory_order_seq_cst);
+  uint32_t __w = __s->writer_.load(std::memory_order_seq_cst);
+  if (__s->prefer_ == rw_prefer::writer ? __w == WRITER_FREE
+                                        : __w != WRITER_HELD) {
+    return true;
+  }
+  this->leave_shared(slot);
+  return false;
+}
+
+void shm_rwlock::leave_shared(std::atomic<uint32_t> &slot) noexcept {
+  state_t *__s = this->obj_.get();
+  slot.fetch_sub(1, std::memory_order_seq_cst);
+  // only pay for the wake up while a writer waits for the readers to drain
+  if (__s->writer_.load(std::memory_order_seq_cst) != WRITER_FREE) {
+    __s->drain_.fetch_add(1, std::memory_order_release);
+    futex_wake(__s->drain_, 1);
+  }
+}
+
+void shm_rwlock::wait_writer(bool any) noexcept {
+  state_t *__s = this->obj_.get();
+  auto __blocked = [any](uint32_t w) {
+    return any ? w != WRITER_FREE : w == WRITER_HELD;
+  };
+  for (uint32_t __spins = 0; __spins < SPIN_LIMIT; __spins++) {
+    if (!__blocked(__s->writer_.load(std::memory_order_relaxed))) {
+      return;
+    }
+    cpu_relax();
+    if ((__spins + 1) % SPIN_YIELD == 0) {
+      std::this_thread::yield();
+    }
+  }
+  __s->sleepers_.fetch_add(1, std::memory_order_relaxed);
+  // pairs with the fence in release()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint32_t __w;
+  while (__blocked(__w = __s->writer_.load(std::memory_order_relaxed))) {
+    futex_wait(__s->writer_, __w);
+  }
+  __s->sleepers_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void shm_rwlock::wait_drain() noexcept {
+  state_t *__s = this->obj_.get();
+  for (uint32_t __spins = 0; __spins < SPIN_LIMIT; __spins++) {
+    if (this->readers_gone()) {
+      return;
+    }
+    cpu_relax();
+    if ((__spins + 1) % SPIN_YIELD == 0) {
+      std::this_thread::yield();
+    }
+  }
+  for (;;) {
+    uint32_t __drain = __s->drain_.load(std::memory_order_acquire);
+    if (this->readers_gone()) {
+      return;
+    }
+    futex_wait(__s->drain_, __drain);
+  }
+}
+
+void shm_rwlock::release(uint32_t writer) noexcept {
+  state_t *__s = this->obj_.get();
+  __s->writer_.store(writer, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (__s->sleepers_.load(std::memory_order_relaxed) != 0) {
+    futex_wake_all(__s->writer_);
+  }
+}
+
+void shm_rwlock::lock() noexcept {
+  if (!this->valid()) {
+    return;
+  }
+  state_t *__s = this->obj_.get();
+  for (;;) {
+    uint32_t __w = WRITER_FREE;
+    if (__s->writer_.compare_exchange_strong(__w, WRITER_PENDING,
+                                             std::memory_order_seq_cst)) {
+      break;
+    }
+    this->wait_writer(true);
+  }
+  if (__s->prefer_ == rw_prefer::writer) {
+    // new readers already back off, wait for the ones inside
+    this->wait_drain();
+    __s->writer_.store(WRITER_HELD, std::memory_order_relaxed);
+    return;
+  }
+  for (;;) {
+    this->wait_drain();
+    __s->writer_.store(WRITER_HELD, std::memory_order_seq_cst);
+    if (this->readers_gone()) {
+      return;
+    }
+    // a reader slipped in before it could see HELD, let it finish
+    this->release(WRITER_PENDING);
+  }
+}
+
+bool shm_rwlock::try_lock() noexcept {
+  if (!this->valid()) {
+    return false;
+  }
+  uint32_t __w = WRITER_FREE;
+  if (!this->obj_->writer_.compare_exchange_strong(
+          __w, WRITER_HELD, std::memory_order_seq_cst)) {
+    return false;
+  }
+  if (this->readers_gone()) {
+    return true;
+  }
+  this->release(WRITER_FREE);
+  return false;
+}
+
+void shm_rwlock::unlock() noexcept {
+  if (this->valid()) {
+    this->release(WRITER_FREE);
+  }
+}
+
+void shm_rwlock::lock_shared() noexcept {
+  if (!this->valid()) {
+    return;
+  }
+  std::atomic<uint32_t> &__slot = this->slot();
+  while (!this->enter_shared(__slot)) {
+    this->wait_writer(this->obj_->prefer_ == rw_prefer::writer);
+  }
+}
+
+bool shm_rwlock::try_lock_shared() noexcept {
+  return this->valid() && this->enter_shared(this->slot());
+}
+
+void shm_rwlock::unlock_shared() noexcept {
+  if (this->valid()) {
+    this->leave_shared(this->slot());
+  }
+}
+
+uint32_t shm_rwlock::nslots() const noexcept {
+  return this->obj_ ? this->obj_->nslots_ : 0;
+}
+
+rw_prefer shm_rwlock::prefer() const noexcept {
+  return this->obj_ ? this->obj_->prefer_ : rw_prefer::writer;
+}
+
+bool shm_rwlock::valid() const noexcept { return this->obj_.valid(); }
+
+shm_rwlock::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
@@ -0,0 +1,156 @@
+#include "shm_semaphore.hpp"
+#include "detail.hpp"
+#include "cpuinfo.hpp"
+
+#include <thread>
+
+namespace ipc {
+namespace {
+using detail::deadline_t;
+using detail::throw_if;
+
+/**
+ * @brief failed attempts before a waiter goes to sleep
+ *
+ */
+constexpr uint32_t SPIN_LIMIT = 256;
+constexpr uint32_t SPIN_YIELD = 64;
+} // namespace
+
+shm_semaphore::shm_semaphore(create_only_t, std::string_view name,
+                             uint32_t value, std::error_code &ec) noexcept
+    : obj_(create_only, name, ec, value) {}
+
+shm_semaphore::shm_semaphore(create_only_t, std::string_view name,
+                             uint32_t value)
+    : obj_(create_only, name, value) {}
+
+shm_semaphore::shm_semaphore(open_only_t, std::string_view name,
+                             std::error_code &ec,
+                             std::chrono::milliseconds timeout) noexcept
+    : obj_(open_only, name, ec, timeout) {}
+
+shm_semaphore::shm_semaphore(open_only_t, std::string_view name,
+                             std::chrono::milliseconds timeout)
+    : obj_(open_only, name, timeout) {}
+
+bool shm_semaphore::take() noexcept {
+  state_t *__s = this->obj_.get();
+  uint32_t __count = __s->count_.load(std::memory_order_relaxed);
+  while (__count > 0) {
+    if (__s->count_.compare_exchange_weak(__count, __count - 1,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void shm_semaphore::post() noexcept {
+  if (!this->obj_) {
+    return;
+  }
+  state_t *__s = this->obj_.get();
+  __s->count_.fetch_add(1, std::memory_order_release);
+  // pairs with the fence in wait_any(): either the waiter sees the count or
+  // we see it asleep
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (__s->sleepers_.load(std::memory_order_relaxed) != 0) {
+    futex_wake(__s->count_, 1);
+  }
+}
+
+bool shm_semaphore::wait(std::chrono::nanoseconds timeout) noexcept {
+  shm_semaphore *__self = this;
+  std::error_code __ec;
+  return wait_any(&__self, 1, timeout, __ec) == 0;
+}
+
+bool shm_semaphore::try_wait() noexcept {
+  return this->obj_ && this->take();
+}
+
+uint32_t shm_semaphore::value() const noexcept {
+  return this->obj_ ? this->obj_->count_.load(std::memory_order_relaxed) : 0;
+}
+
+bool shm_semaphore::valid() const noexcept { return this->obj_.valid(); }
+
+shm_semaphore::operator bool() const noexcept { return this->valid(); }
+
+int wait_any(shm_semaphore *const *sems, size_t n,
+             std::chrono::nanoseconds timeout, std::error_code &ec) noexcept {
+  ec.clear();
+  if (n == 0 || n > FUTEX_WAIT_ANY_MAX) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return -1;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (!sems[i] || !sems[i]->valid()) {
+      ec = std::make_error_code(std::errc::invalid_argument);
+      return -1;
+    }
+  }
+  deadline_t __deadline(timeout);
+  size_t __first = 0;
+  uint32_t __spins = 0;
+  for (;;) {
+    for (size_t k = 0; k < n; k++) {
+      size_t __i = (__first + k) % n;
+      if (sems[__i]->take()) {
+        return int(__i);
+      }
+    }
+    __first = 0;
+    if (timeout.count() == 0) {
+      return -1;
+    }
+    if (__spins < SPIN_LIMIT) {
+      cpu_relax();
+      if (++__spins % SPIN_YIELD == 0) {
+        std::this_thread::yield();
+      }
+      continue;
+    }
+    auto __left = __deadline.remaining();
+    if (__left.count() == 0) {
+      return -1;
+    }
+    futex_waiter __waiters[FUTEX_WAIT_ANY_MAX];
+    for (size_t i = 0; i < n; i++) {
+      auto __s = sems[i]->obj_.get();
+      __s->sleepers_.fetch_add(1, std::memory_order_relaxed);
+      __waiters[i] = {&__s->count_, 0};
+    }
+    // pairs with the fence in post()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool __empty = true;
+    for (size_t i = 0; i < n && __empty; i++) {
+      __empty = __waiters[i].word_->load(std::memory_order_relaxed) == 0;
+    }
+    if (__empty) {
+      // a post() wakes one waiter only: the one woken tries that semaphore
+      // first, so the wake up is not lost on another one
+      int __woken = futex_wait_any(__waiters, n, __left);
+      __first = __woken >= 0 ? size_t(__woken) : 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+      sems[i]->obj_->sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+int wait_any(shm_semaphore *const *sems, size_t n,
+             std::chrono::nanoseconds timeout) {
+  std::error_code ec;
+  int __index = wait_any(sems, n, timeout, ec);
+  throw_if(ec);
+  return __index;
+}
+
+int wait_any(std::initializer_list<shm_semaphore *> sems,
+             std::chrono::nanoseconds timeout) {
+  return wait_any(sems.begin(), sems.size(), timeout);
+}
+} // namespace ipc
@@ -0,0 +1,257 @@
+#include "shm_table.hpp"
+#include "detail.hpp"
+
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace ipc {
+namespace {
+using detail::CACHE_LINE;
+using detail::READY;
+using detail::round_up;
+using detail::throw_if;
+using detail::wait_ready;
+
+constexpr size_t width_of(column_type type) noexcept {
+  return type == column_type::INT32 || type == column_type::FLOAT32 ? 4 : 8;
+}
+} // namespace
+
+/**
+ * @brief placed at the begining of the shared memory buffer
+ * memory layout might look like this:
+ *  | table meta | column descs | column 0 | column 1 | ... |
+ */
+struct shm_table::table_meta_t {
+  std::atomic<uint32_t> state_;
+  uint32_t ncolumns_;
+  uint64_t capacity_;
+  /**
+   * @brief rows published, only moved by the writer
+   *
+   */
+  alignas(CACHE_LINE) std::atomic<uint64_t> rows_;
+};
+
+struct shm_table::column_desc_t {
+  char name_[MAX_COLUMN_NAME + 1];
+  column_type type_;
+  uint32_t reserved_;
+  /**
+   * @brief from the begining of the shared memory buffer, a multiple of
+   * CACHE_LINE
+   *
+   */
+  uint64_t offset_;
+};
+
+void shm_table::create(std::string_view name,
+                       const std::vector<column_def> &columns,
+                       size_t capacity, std::error_code &ec) noexcept {
+  if (columns.empty() || columns.size() > MAX_COLUMNS || capacity == 0) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  for (size_t i = 0; i < columns.size(); i++) {
+    if (columns[i].name_.empty() ||
+        columns[i].name_.size() > MAX_COLUMN_NAME ||
+        uint32_t(columns[i].type_) > uint32_t(column_type::FLOAT64)) {
+      ec = std::make_error_code(std::errc::invalid_argument);
+      return;
+    }
+    for (size_t j = 0; j < i; j++) {
+      if (columns[j].name_ == columns[i].name_) {
+        ec = std::make_error_code(std::errc::invalid_argument);
+        return;
+      }
+    }
+  }
+  size_t __offset = round_up(sizeof(table_meta_t), CACHE_LINE) +
+                    round_up(sizeof(column_desc_t) * columns.size(), CACHE_LINE);
+  const size_t __first = __offset;
+  for (const column_def &__c : columns) {
+    __offset += round_up(width_of(__c.type_) * capacity, CACHE_LINE);
+  }
+  this->hdl_ = shmhdl(name, __offset, ec);
+  if (ec) {
+    return;
+  }
+  char *__buf = static_cast<char *>(this->hdl_.map(ec));
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = new (__buf) table_meta_t;
+  this->meta_->ncolumns_ = uint32_t(columns.size());
+  this->meta_->capacity_ = capacity;
+  this->meta_->rows_.store(0, std::memory_order_relaxed);
+  this->columns_ = reinterpret_cast<column_desc_t *>(
+      __buf + round_up(sizeof(table_meta_t), CACHE_LINE));
+  __offset = __first;
+  for (size_t i = 0; i < columns.size(); i++) {
+    auto __d = new (&this->columns_[i]) column_desc_t;
+    std::memset(__d->name_, 0, sizeof(__d->name_));
+    std::memcpy(__d->name_, columns[i].name_.data(), columns[i].name_.size());
+    __d->type_ = columns[i].type_;
+    __d->reserved_ = 0;
+    __d->offset_ = __offset;
+    __offset += round_up(width_of(columns[i].type_) * capacity, CACHE_LINE);
+  }
+  this->base_ = __buf;
+  this->meta_->state_.store(READY, std::memory_order_release);
+}
+
+void shm_table::attach(std::string_view name, std::error_code &ec,
+                       std::chrono::milliseconds timeout) noexcept {
+  this->hdl_ = shmhdl(name, ec);
+  if (ec) {
+    return;
+  }
+  char *__buf = static_cast<char *>(this->hdl_.map(ec));
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __meta_size = round_up(sizeof(table_meta_t), CACHE_LINE);
+  if (size_t(this->hdl_.nbytes()) < __meta_size) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = reinterpret_cast<table_meta_t *>(__buf);
+  // wait for the creator to finish initializing the table
+  if (!wait_ready(__meta->state_, timeout)) {
+    ec = IPCErrc::ShmNotInitialized;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __columns = reinterpret_cast<column_desc_t *>(__buf + __meta_size);
+  size_t __size =
+      __meta_size +
+      round_up(sizeof(column_desc_t) * __meta->ncolumns_, CACHE_LINE);
+  for (uint32_t i = 0; i < __meta->ncolumns_ && i < MAX_COLUMNS; i++) {
+    __size += round_up(width_of(__columns[i].type_) * __meta->capacity_,
+                       CACHE_LINE);
+  }
+  if (__meta->ncolumns_ > MAX_COLUMNS ||
+      size_t(this->hdl_.nbytes()) != __size) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = __meta;
+  this->columns_ = __columns;
+  this->base_ = __buf;
+}
+
+shm_table::shm_table(create_only_t, std::string_view name,
+                     const std::vector<column_def> &columns, size_t capacity,
+                     std::error_code &ec) noexcept {
+  this->create(name, columns, capacity, ec);
+}
+
+shm_table::shm_table(create_only_t, std::string_view name,
+                     const std::vector<column_def> &columns,
+                     size_t capacity) {
+  std::error_code ec;
+  this->create(name, columns, capacity, ec);
+  throw_if(ec);
+}
+
+shm_table::shm_table(open_only_t, std::string_view name, std::error_code &ec,
+                     std::chrono::milliseconds timeout) noexcept {
+  this->attach(name, ec, timeout);
+}
+
+shm_table::shm_table(open_only_t, std::string_view name,
+                     std::chrono::milliseconds timeout) {
+  std::error_code ec;
+  this->attach(name, ec, timeout);
+  throw_if(ec);
+}
+
+shm_table::shm_table(shm_table &&other) noexcept
+    : hdl_(std::move(other.hdl_)), meta_(std::exchange(other.meta_, nullptr)),
+      columns_(std::exchange(other.columns_, nullptr)),
+      base_(std::exchange(other.base_, nullptr)) {}
+
+shm_table &shm_table::operator=(shm_table &&other) noexcept {
+  if (this != &other) {
+    this->hdl_ = std::move(other.hdl_);
+    this->meta_ = std::exchange(other.meta_, nullptr);
+    this->columns_ = std::exchange(other.columns_, nullptr);
+    this->base_ = std::exchange(other.base_, nullptr);
+  }
+  return *this;
+}
+
+void *shm_table::data(size_t col, column_type type) const noexcept {
+  if (!this->meta_ || col >= this->meta_->ncolumns_ ||
+      this->columns_[col].type_ != type) {
+    return nullptr;
+  }
+  return this->base_ + this->columns_[col].offset_;
+}
+
+size_t shm_table::find(std::string_view name) const noexcept {
+  for (size_t i = 0; i < this->ncolumns(); i++) {
+    if (this->column_name(i) == name) {
+      return i;
+    }
+  }
+  return npos;
+}
+
+std::string_view shm_table::column_name(size_t col) const noexcept {
+  if (!this->meta_ || col >= this->meta_->ncolumns_) {
+    return {};
+  }
+  return this->columns_[col].name_;
+}
+
+column_type shm_table::type(size_t col) const noexcept {
+  if (!this->meta_ || col >= this->meta_->ncolumns_) {
+    return column_type::NONE;
+  }
+  return this->columns_[col].type_;
+}
+
+size_t shm_table::ncolumns() const noexcept {
+  return this->meta_ ? this->meta_->ncolumns_ : 0;
+}
+
+void shm_table::commit(size_t nrows, std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  uint64_t __rows = this->meta_->rows_.load(std::memory_order_relaxed);
+  if (nrows > this->meta_->capacity_ - __rows) {
+    ec = IPCErrc::TableFull;
+    return;
+  }
+  // the values written before are visible to whoever sees the new count
+  this->meta_->rows_.store(__rows + nrows, std::memory_order_release);
+}
+
+void shm_table::commit(size_t nrows) {
+  std::error_code ec;
+  this->commit(nrows, ec);
+  throw_if(ec);
+}
+
+size_t shm_table::rows() const noexcept {
+  return this->meta_ ? size_t(this->meta_->rows_.load(std::memory_order_acquire))
+                     : 0;
+}
+
+size_t shm_table::capacity() const noexcept {
+  return this->meta_ ? size_t(this->meta_->capacity_) : 0;
+}
+
+bool shm_table::valid() const noexcept { return this->meta_ != nullptr; }
+
+shm_table::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
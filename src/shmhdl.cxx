@@ -0,0 +1,106 @@
+#include "shmhdl.hpp"
+
+namespace ipc {
+namespace {
+/**
+ * @brief tells whether the process holding a slot runs, remembering the last
+ * verdicts: a process usually holds several slots
+ */
+class liveness_t {
+private:
+  proc_id self_ = proc_id::self();
+  proc_id alive_;
+  proc_id dead_;
+
+public:
+  bool operator()(const proc_id &owner) noexcept {
+    if (owner == this->self_ || owner == this->alive_) {
+      return true;
+    }
+    if (owner == this->dead_) {
+      return false;
+    }
+    if (owner.alive()) {
+      this->alive_ = owner;
+      return true;
+    }
+    this->dead_ = owner;
+    return false;
+  }
+};
+} // namespace
+
+static_assert(std::atomic<proc_id>::is_always_lock_free,
+              "proc_id must be lock free to be claimed in shared memory");
+
+bool shmhdl::join() noexcept {
+  const proc_id __self = proc_id::self();
+  // the liveness of processes can only be told within a pid namespace
+  if (this->meta_->pidns_.load(std::memory_order_relaxed) != pid_namespace()) {
+    this->meta_->pidns_.store(PIDNS_MIXED, std::memory_order_relaxed);
+  }
+  for (int __pass = 0; __pass < 2; __pass++) {
+    for (uint32_t i = 0; i < MAX_ATTACHERS; i++) {
+      proc_id __none{};
+      if (this->meta_->attachers_[i].load(std::memory_order_relaxed).empty() &&
+          this->meta_->attachers_[i].compare_exchange_strong(
+              __none, __self, std::memory_order_acq_rel)) {
+        this->meta_->nattached_.fetch_add(1, std::memory_order_acq_rel);
+        this->slot_ = i;
+        return true;
+      }
+    }
+    // the table is full, maybe of processes that are gone
+    this->reclaim();
+  }
+  return false;
+}
+
+bool shmhdl::leave() noexcept {
+  if (this->slot_ == NO_SLOT) {
+    return false;
+  }
+  // a handle inherited through fork() holds its parent's slot, it leaves the
+  // slot and the object alone
+  proc_id __self = proc_id::self();
+  bool __mine = this->meta_->attachers_[this->slot_].compare_exchange_strong(
+      __self, proc_id{}, std::memory_order_acq_rel);
+  this->slot_ = NO_SLOT;
+  if (!__mine) {
+    return false;
+  }
+  if (this->meta_->nattached_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    return true;
+  }
+  // the handles left may all be the ones of processes that crashed
+  this->reclaim();
+  return this->meta_->nattached_.load(std::memory_order_acquire) == 0;
+}
+
+size_t shmhdl::ref_count() const noexcept {
+  return this->meta_ ? this->meta_->nattached_.load(std::memory_order_acquire)
+                     : 0;
+}
+
+size_t shmhdl::reclaim() noexcept {
+  if (this->meta_ == nullptr ||
+      this->meta_->pidns_.load(std::memory_order_relaxed) != pid_namespace()) {
+    return 0;
+  }
+  liveness_t __alive;
+  size_t __freed = 0;
+  for (auto &__slot : this->meta_->attachers_) {
+    proc_id __owner = __slot.load(std::memory_order_acquire);
+    if (__owner.empty() || __alive(__owner)) {
+      continue;
+    }
+    // whoever empties the slot drops its reference
+    if (__slot.compare_exchange_strong(__owner, proc_id{},
+                                       std::memory_order_acq_rel)) {
+      this->meta_->nattached_.fetch_sub(1, std::memory_order_acq_rel);
+      __freed++;
+    }
+  }
+  return __freed;
+}
+} // namespace ipc
@@ -0,0 +1,442 @@
+#include "task_pool.hpp"
+#include "detail.hpp"
+#include "cpuinfo.hpp"
+
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace ipc {
+namespace {
+using detail::CACHE_LINE;
+using detail::deadline_t;
+using detail::READY;
+using detail::round_up;
+using detail::round_up_pow2;
+using detail::throw_if;
+using detail::wait_ready;
+
+/**
+ * @brief failed attempts to find a task before a worker parks
+ *
+ */
+constexpr uint32_t SPIN_LIMIT = 256;
+/**
+ * @brief attempts between two yields while spinning, so that workers sharing
+ * a core with the producers do not starve them
+ *
+ */
+constexpr uint32_t SPIN_YIELD = 64;
+} // namespace
+
+/**
+ * @brief placed at the begining of the shared memory buffer
+ * memory layout might look like this:
+ *  | pool meta | deque 0 | tasks 0 | deque 1 | tasks 1 | ... | injection |
+ */
+struct task_pool::pool_meta_t {
+  std::atomic<uint32_t> state_;
+  uint32_t nworkers_;
+  uint32_t capacity_;
+  uint64_t deque_stride_;
+  /**
+   * @brief workers parked on signal_, and the futex word they park on
+   *
+   */
+  alignas(CACHE_LINE) std::atomic<uint32_t> sleepers_;
+  std::atomic<uint32_t> signal_;
+  std::atomic<uint32_t> shutdown_;
+  std::atomic<uint64_t> steals_;
+  /**
+   * @brief positions of the bounded MPMC injection queue
+   *
+   */
+  alignas(CACHE_LINE) std::atomic<uint64_t> enqueue_pos_;
+  alignas(CACHE_LINE) std::atomic<uint64_t> dequeue_pos_;
+};
+
+/**
+ * @brief Chase-Lev deque: the owner pushes and takes at the bottom, thieves
+ * steal at the top. Followed by capacity task words.
+ */
+struct task_pool::deque_t {
+  alignas(CACHE_LINE) std::atomic<int64_t> top_;
+  alignas(CACHE_LINE) std::atomic<int64_t> bottom_;
+
+  std::atomic<uint64_t> *tasks() noexcept {
+    return reinterpret_cast<std::atomic<uint64_t> *>(this + 1);
+  }
+};
+
+/**
+ * @brief injection queue cell, seq_ tells whether it is free or holds a task
+ * for a given lap
+ */
+struct task_pool::cell_t {
+  std::atomic<uint64_t> seq_;
+  uint64_t task_;
+};
+
+void task_pool::create(std::string_view name, uint32_t nworkers,
+                       uint32_t capacity, std::error_code &ec) noexcept {
+  if (nworkers == 0 || capacity == 0 || capacity > (1u << 30)) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  capacity = round_up_pow2(capacity);
+  size_t __meta_size = round_up(sizeof(pool_meta_t), CACHE_LINE);
+  size_t __stride = round_up(
+      sizeof(deque_t) + capacity * sizeof(std::atomic<uint64_t>), CACHE_LINE);
+  this->hdl_ =
+      shmhdl(name, __meta_size + __stride * nworkers + capacity * sizeof(cell_t),
+             ec);
+  if (ec) {
+    return;
+  }
+  void *__buf = this->hdl_.map(ec);
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = new (__buf) pool_meta_t;
+  this->meta_->nworkers_ = nworkers;
+  this->meta_->capacity_ = capacity;
+  this->meta_->deque_stride_ = __stride;
+  this->meta_->sleepers_.store(0, std::memory_order_relaxed);
+  this->meta_->signal_.store(0, std::memory_order_relaxed);
+  this->meta_->shutdown_.store(0, std::memory_order_relaxed);
+  this->meta_->steals_.store(0, std::memory_order_relaxed);
+  this->meta_->enqueue_pos_.store(0, std::memory_order_relaxed);
+  this->meta_->dequeue_pos_.store(0, std::memory_order_relaxed);
+  this->deques_ = static_cast<char *>(__buf) + __meta_size;
+  for (uint32_t i = 0; i < nworkers; i++) {
+    auto __deque = new (this->deque_at(i)) deque_t;
+    __deque->top_.store(0, std::memory_order_relaxed);
+    __deque->bottom_.store(0, std::memory_order_relaxed);
+  }
+  this->cells_ = reinterpret_cast<cell_t *>(this->deques_ + __stride * nworkers);
+  for (uint32_t i = 0; i < capacity; i++) {
+    new (&this->cells_[i]) cell_t;
+    this->cells_[i].seq_.store(i, std::memory_order_relaxed);
+  }
+  this->meta_->state_.store(READY, std::memory_order_release);
+}
+
+void task_pool::attach(std::string_view name, std::error_code &ec,
+                       std::chrono::milliseconds timeout) noexcept {
+  this->hdl_ = shmhdl(name, ec);
+  if (ec) {
+    return;
+  }
+  void *__buf = this->hdl_.map(ec);
+  if (ec) {
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __meta_size = round_up(sizeof(pool_meta_t), CACHE_LINE);
+  if (size_t(this->hdl_.nbytes()) < __meta_size) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  auto __meta = static_cast<pool_meta_t *>(__buf);
+  // wait for the creator to finish initializing the queues
+  if (!wait_ready(__meta->state_, timeout)) {
+    ec = IPCErrc::ShmNotInitialized;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  size_t __deques_size = __meta->deque_stride_ * __meta->nworkers_;
+  if (size_t(this->hdl_.nbytes()) !=
+      __meta_size + __deques_size + __meta->capacity_ * sizeof(cell_t)) {
+    ec = IPCErrc::ShmLayoutMismatch;
+    this->hdl_ = shmhdl();
+    return;
+  }
+  this->meta_ = __meta;
+  this->deques_ = static_cast<char *>(__buf) + __meta_size;
+  this->cells_ = reinterpret_cast<cell_t *>(this->deques_ + __deques_size);
+}
+
+task_pool::deque_t *task_pool::deque_at(uint32_t worker) const noexcept {
+  return reinterpret_cast<deque_t *>(this->deques_ +
+                                     worker * this->meta_->deque_stride_);
+}
+
+task_pool::task_pool(create_only_t, std::string_view name, uint32_t nworkers,
+                     uint32_t capacity, std::error_code &ec) noexcept {
+  this->create(name, nworkers, capacity, ec);
+}
+
+task_pool::task_pool(create_only_t, std::string_view name, uint32_t nworkers,
+                     uint32_t capacity) {
+  std::error_code ec;
+  this->create(name, nworkers, capacity, ec);
+  throw_if(ec);
+}
+
+task_pool::task_pool(open_only_t, std::string_view name, std::error_code &ec,
+                     std::chrono::milliseconds timeout) noexcept {
+  this->attach(name, ec, timeout);
+}
+
+task_pool::task_pool(open_only_t, std::string_view name,
+                     std::chrono::milliseconds timeout) {
+  std::error_code ec;
+  this->attach(name, ec, timeout);
+  throw_if(ec);
+}
+
+task_pool::task_pool(task_pool &&other) noexcept
+    : hdl_(std::move(other.hdl_)), meta_(std::exchange(other.meta_, nullptr)),
+      deques_(std::exchange(other.deques_, nullptr)),
+      cells_(std::exchange(other.cells_, nullptr)), rng_(other.rng_) {}
+
+task_pool &task_pool::operator=(task_pool &&other) noexcept {
+  if (this != &other) {
+    this->hdl_ = std::move(other.hdl_);
+    this->meta_ = std::exchange(other.meta_, nullptr);
+    this->deques_ = std::exchange(other.deques_, nullptr);
+    this->cells_ = std::exchange(other.cells_, nullptr);
+    this->rng_ = other.rng_;
+  }
+  return *this;
+}
+
+void task_pool::notify() noexcept {
+  // pairs with the fence in wait(): either the parking worker sees the new
+  // task or we see it parked
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (this->meta_->sleepers_.load(std::memory_order_relaxed) != 0) {
+    this->meta_->signal_.fetch_add(1, std::memory_order_release);
+    futex_wake(this->meta_->signal_, 1);
+  }
+}
+
+void task_pool::push(uint32_t worker, uint64_t task,
+                     std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_ || worker >= this->meta_->nworkers_) {
+    ec = std::make_error_code(std::errc::invalid_argument);
+    return;
+  }
+  deque_t *__d = this->deque_at(worker);
+  int64_t __b = __d->bottom_.load(std::memory_order_relaxed);
+  int64_t __t = __d->top_.load(std::memory_order_acquire);
+  if (__b - __t >= int64_t(this->meta_->capacity_)) {
+    ec = IPCErrc::TaskQueueFull;
+    return;
+  }
+  __d->tasks()[__b & (this->meta_->capacity_ - 1)].store(
+      task, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  __d->bottom_.store(__b + 1, std::memory_order_relaxed);
+  this->notify();
+}
+
+void task_pool::push(uint32_t worker, uint64_t task) {
+  std::error_code ec;
+  this->push(worker, task, ec);
+  throw_if(ec);
+}
+
+void task_pool::submit(uint64_t task, std::error_code &ec) noexcept {
+  ec.clear();
+  if (!this->meta_) {
+    ec = IPCErrc::ShmNotMapped;
+    return;
+  }
+  const uint64_t __mask = this->meta_->capacity_ - 1;
+  uint64_t __pos = this->meta_->enqueue_pos_.load(std::memory_order_relaxed);
+  cell_t *__cell;
+  for (;;) {
+    __cell = &this->cells_[__pos & __mask];
+    uint64_t __seq = __cell->seq_.load(std::memory_order_acquire);
+    int64_t __diff = int64_t(__seq) - int64_t(__pos);
+    if (__diff == 0) {
+      if (this->meta_->enqueue_pos_.compare_exchange_weak(
+              __pos, __pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (__diff < 0) {
+      ec = IPCErrc::TaskQueueFull;
+      return;
+    } else {
+      __pos = this->meta_->enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  __cell->task_ = task;
+  __cell->seq_.store(__pos + 1, std::memory_order_release);
+  this->notify();
+}
+
+void task_pool::submit(uint64_t task) {
+  std::error_code ec;
+  this->submit(task, ec);
+  throw_if(ec);
+}
+
+bool task_pool::pop_injected(uint64_t &task) noexcept {
+  const uint64_t __mask = this->meta_->capacity_ - 1;
+  uint64_t __pos = this->meta_->dequeue_pos_.load(std::memory_order_relaxed);
+  cell_t *__cell;
+  for (;;) {
+    __cell = &this->cells_[__pos & __mask];
+    uint64_t __seq = __cell->seq_.load(std::memory_order_acquire);
+    int64_t __diff = int64_t(__seq) - int64_t(__pos + 1);
+    if (__diff == 0) {
+      if (this->meta_->dequeue_pos_.compare_exchange_weak(
+              __pos, __pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (__diff < 0) {
+      return false;
+    } else {
+      __pos = this->meta_->dequeue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  task = __cell->task_;
+  __cell->seq_.store(__pos + __mask + 1, std::memory_order_release);
+  return true;
+}
+
+bool task_pool::steal(uint32_t thief, uint64_t &task) noexcept {
+  const uint32_t __n = this->meta_->nworkers_;
+  // xorshift64, start at a random victim so thieves spread out
+  this->rng_ ^= this->rng_ << 13;
+  this->rng_ ^= this->rng_ >> 7;
+  this->rng_ ^= this->rng_ << 17;
+  uint32_t __start = uint32_t(this->rng_ % __n);
+  for (uint32_t i = 0; i < __n; i++) {
+    uint32_t __victim = (__start + i) % __n;
+    if (__victim == thief) {
+      continue;
+    }
+    deque_t *__d = this->deque_at(__victim);
+    int64_t __t = __d->top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t __b = __d->bottom_.load(std::memory_order_acquire);
+    if (__t >= __b) {
+      continue;
+    }
+    uint64_t __task = __d->tasks()[__t & (this->meta_->capacity_ - 1)].load(
+        std::memory_order_relaxed);
+    // lost the race against the owner or another thief, try the next one
+    if (!__d->top_.compare_exchange_strong(__t, __t + 1,
+                                           std::memory_order_seq_cst,
+                                           std::memory_order_relaxed)) {
+      continue;
+    }
+    task = __task;
+    this->meta_->steals_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool task_pool::take(uint32_t worker, uint64_t &task) noexcept {
+  if (!this->meta_ || worker >= this->meta_->nworkers_) {
+    return false;
+  }
+  deque_t *__d = this->deque_at(worker);
+  int64_t __b = __d->bottom_.load(std::memory_order_relaxed) - 1;
+  __d->bottom_.store(__b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t __t = __d->top_.load(std::memory_order_relaxed);
+  if (__t <= __b) {
+    task = __d->tasks()[__b & (this->meta_->capacity_ - 1)].load(
+        std::memory_order_relaxed);
+    if (__t != __b) {
+      return true;
+    }
+    // the last task, race the thieves for it
+    bool __won = __d->top_.compare_exchange_strong(
+        __t, __t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    __d->bottom_.store(__b + 1, std::memory_order_relaxed);
+    if (__won) {
+      return true;
+    }
+  } else {
+    __d->bottom_.store(__b + 1, std::memory_order_relaxed);
+  }
+  return this->pop_injected(task) || this->steal(worker, task);
+}
+
+bool task_pool::has_work() const noexcept {
+  if (this->meta_->enqueue_pos_.load(std::memory_order_relaxed) !=
+      this->meta_->dequeue_pos_.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  for (uint32_t i = 0; i < this->meta_->nworkers_; i++) {
+    deque_t *__d = this->deque_at(i);
+    if (__d->bottom_.load(std::memory_order_relaxed) >
+        __d->top_.load(std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool task_pool::wait(uint32_t worker, uint64_t &task,
+                     std::chrono::nanoseconds timeout) noexcept {
+  if (!this->meta_ || worker >= this->meta_->nworkers_) {
+    return false;
+  }
+  deadline_t __deadline(timeout);
+  uint32_t __spins = 0;
+  for (;;) {
+    if (this->take(worker, task)) {
+      return true;
+    }
+    if (this->meta_->shutdown_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    if (__spins < SPIN_LIMIT) {
+      cpu_relax();
+      if (++__spins % SPIN_YIELD == 0) {
+        std::this_thread::yield();
+      }
+      continue;
+    }
+    auto __left = __deadline.remaining();
+    if (__left.count() == 0) {
+      return false;
+    }
+    uint32_t __signal = this->meta_->signal_.load(std::memory_order_acquire);
+    this->meta_->sleepers_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!this->has_work() &&
+        !this->meta_->shutdown_.load(std::memory_order_relaxed)) {
+      futex_wait(this->meta_->signal_, __signal, __left);
+    }
+    this->meta_->sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    __spins = 0;
+  }
+}
+
+void task_pool::shutdown() noexcept {
+  if (!this->meta_) {
+    return;
+  }
+  this->meta_->shutdown_.store(1, std::memory_order_release);
+  this->meta_->signal_.fetch_add(1, std::memory_order_release);
+  futex_wake_all(this->meta_->signal_);
+}
+
+uint64_t task_pool::steals() const noexcept {
+  return this->meta_ ? this->meta_->steals_.load(std::memory_order_relaxed)
+                     : 0;
+}
+
+uint32_t task_pool::nworkers() const noexcept {
+  return this->meta_ ? this->meta_->nworkers_ : 0;
+}
+
+uint32_t task_pool::capacity() const noexcept {
+  return this->meta_ ? this->meta_->capacity_ : 0;
+}
+
+bool task_pool::valid() const noexcept { return this->meta_ != nullptr; }
+
+task_pool::operator bool() const noexcept { return this->valid(); }
+} // namespace ipc
@@ -0,0 +1,16 @@
+#include "busy_poll.hpp"
+
+#include <Windows.h>
+
+namespace ipc {
+void pin_current_thread(int cpu, std::error_code &ec) noexcept {
+  ec.clear();
+  if (cpu < 0 || cpu >= int(sizeof(DWORD_PTR) * 8)) {
+    ec.assign(ERROR_INVALID_PARAMETER, std::system_category());
+    return;
+  }
+  if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) == 0) {
+    ec.assign(GetLastError(), std::system_category());
+  }
+}
+} // namespace ipc
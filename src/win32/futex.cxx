@@ -0,0 +1,46 @@
+#include "futex.hpp"
+
+#include <Windows.h>
+
+namespace ipc {
+// WaitOnAddress() only works within a process, waiters poll instead
+bool futex_wait(std::atomic<uint32_t> &word, uint32_t expected,
+                std::chrono::nanoseconds timeout) noexcept {
+  auto __start = std::chrono::steady_clock::now();
+  while (word.load(std::memory_order_acquire) == expected) {
+    if (timeout.count() >= 0 &&
+        std::chrono::steady_clock::now() - __start >= timeout) {
+      return false;
+    }
+    if (!SwitchToThread()) {
+      Sleep(0);
+    }
+  }
+  return true;
+}
+
+void futex_wake(std::atomic<uint32_t> &, int) noexcept {}
+
+int futex_wait_any(const futex_waiter *waiters, size_t n,
+                   std::chrono::nanoseconds timeout) noexcept {
+  if (n == 0 || n > FUTEX_WAIT_ANY_MAX) {
+    return -1;
+  }
+  auto __start = std::chrono::steady_clock::now();
+  for (;;) {
+    for (size_t i = 0; i < n; i++) {
+      if (waiters[i].word_->load(std::memory_order_acquire) !=
+          waiters[i].expected_) {
+        return int(i);
+      }
+    }
+    if (timeout.count() >= 0 &&
+        std::chrono::steady_clock::now() - __start >= timeout) {
+      return -1;
+    }
+    if (!SwitchToThread()) {
+      Sleep(0);
+    }
+  }
+}
+} // namespace ipc
@@ -1,23 +1,67 @@
 ﻿#include <Windows.h>
+#include <cstdio>
+#include <stdexcept>
 #include <system_error>
 #include <atomic>
+#include <utility>
+#include <new>
 
 #include "shmhdl.hpp"
 #include "ec.hpp"
 
 namespace ipc
 {
+	namespace
+	{
+		// hints without a Win32 counterpart are ignored, the content is not affected
+		void advise_range(char* begin, char* end, SHM_ADVICE advice, std::error_code& ec) noexcept
+		{
+			ec.clear();
+			switch (advice) {
+			case SHM_ADVICE::WILLNEED: {
+				WIN32_MEMORY_RANGE_ENTRY __range;
+				__range.VirtualAddress = begin;
+				__range.NumberOfBytes = static_cast<SIZE_T>(end - begin);
+				if (PrefetchVirtualMemory(GetCurrentProcess(), 1, &__range, 0) == 0) {
+					ec.assign(GetLastError(), std::system_category());
+				}
+				break;
+			}
+			case SHM_ADVICE::REMOVE:
+				ec.assign(ERROR_NOT_SUPPORTED, std::system_category());
+				break;
+			default:
+				break;
+			}
+		}
+
+		DWORD map_access(SHM_ACCESS access) noexcept
+		{
+			switch (access) {
+			case SHM_ACCESS::READ_ONLY:
+				return FILE_MAP_READ;
+			case SHM_ACCESS::COPY_ON_WRITE:
+				return FILE_MAP_COPY;
+			default:
+				return FILE_MAP_ALL_ACCESS;
+			}
+		}
+	}
+
 	shmhdl::shmhdl(std::string_view name, const shmsz_t nbytes, std::error_code& ec) noexcept
 	{
-		this->hMapFile_ = nullptr;
 		ec.clear();
+		if (!copy_name(this->name_, name)) {
+			ec.assign(ERROR_FILENAME_EXCED_RANGE, std::system_category());
+			return;
+		}
 
 		// calculate required bytes
 		ULARGE_INTEGER __nbytes;
 		size_t __reqbytes = nbytes + sizeof(shm_meta_t);
 		CopyMemory(&__nbytes, &__reqbytes, sizeof(uint64_t));
 
-		HANDLE __hMapFile = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, __nbytes.HighPart, __nbytes.LowPart, name.data());
+		HANDLE __hMapFile = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, __nbytes.HighPart, __nbytes.LowPart, this->name_);
 		// Win32 API, even the name is used by existing shared memory object,
 		// CreateFileMapping with the exact same name will still return a valid
 		// HANDLE... This is wired.
@@ -40,32 +84,40 @@ namespace ipc
 		}
 		// success
 		this->meta_ = new(__meta) shm_meta_t;
-		this->meta_->ref_count_ = 1;
+		this->meta_->magic_ = SHM_MAGIC;
+		this->join();
 		this->meta_->status_ = SHM_STATUS::OK;
 		this->meta_->shmsz_ = nbytes;
 
 		this->hMapFile_ = __hMapFile;
-		this->name_ = { name.begin(), name.end() };
+		this->shmsz_ = nbytes;
 
 		this->addr_ = nullptr;
 	}
 	shmhdl::shmhdl(std::string_view name, const shmsz_t nbytes) {
-		this->hMapFile_ = nullptr;
 		std::error_code ec;
+		if (!copy_name(this->name_, name)) {
+			ec.assign(ERROR_FILENAME_EXCED_RANGE, std::system_category());
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
 
 		// calculate required bytes
 		ULARGE_INTEGER __nbytes;
 		size_t __reqbytes = nbytes + sizeof(shm_meta_t);
 		CopyMemory(&__nbytes, &__reqbytes, sizeof(uint64_t));
 
-		HANDLE __hMapFile = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, __nbytes.HighPart, __nbytes.LowPart, name.data());
+		HANDLE __hMapFile = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, __nbytes.HighPart, __nbytes.LowPart, this->name_);
 		// Win32 API, even the name is used by existing shared memory object,
 		// CreateFileMapping with the exact same name will still return a valid
 		// HANDLE... This is wired.
 		if (GetLastError() == ERROR_ALREADY_EXISTS) {
 			CloseHandle(__hMapFile);
 			ec.assign(ERROR_ALREADY_EXISTS, std::system_category());
-			throw std::system_error(ec);
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
 		}
 		if (__hMapFile == nullptr) {
 			ec.assign(GetLastError(), std::system_category());
@@ -77,25 +129,31 @@ namespace ipc
 		if (__meta == nullptr) {
 			ec.assign(GetLastError(), std::system_category());
 			CloseHandle(__hMapFile);
-			throw std::system_error(ec);
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
 		}
 		// success
 		this->meta_ = new(__meta) shm_meta_t;
-		this->meta_->ref_count_ = 1;
+		this->meta_->magic_ = SHM_MAGIC;
+		this->join();
 		this->meta_->status_ = SHM_STATUS::OK;
 		this->meta_->shmsz_ = nbytes;
 
 		this->hMapFile_ = __hMapFile;
-		this->name_ = { name.begin(), name.end() };
+		this->shmsz_ = nbytes;
 
 		this->addr_ = nullptr;
 	}
 
 	shmhdl::shmhdl(std::string_view name, std::error_code& ec) noexcept {
-		this->hMapFile_ = nullptr;
 		ec.clear();
+		if (!copy_name(this->name_, name)) {
+			ec.assign(ERROR_FILENAME_EXCED_RANGE, std::system_category());
+			return;
+		}
 		// try to open shmhdl
-		HANDLE __hMapFile = OpenFileMappingA(FILE_MAP_ALL_ACCESS, true, name.data());
+		HANDLE __hMapFile = OpenFileMappingA(FILE_MAP_ALL_ACCESS, true, this->name_);
 		if (__hMapFile == nullptr) {
 			ec.assign(GetLastError(), std::system_category());
 			return;
@@ -118,23 +176,36 @@ namespace ipc
 			ec = IPCErrc::ShmDeleted;
 			return;
 		}
-		this->meta_->ref_count_++;
+		if (!this->join()) {
+			UnmapViewOfFile(__meta);
+			CloseHandle(__hMapFile);
+			this->meta_ = nullptr;
+			ec = IPCErrc::ShmNoFreeSlot;
+			return;
+		}
 
 		// setup local var
 		this->hMapFile_ = __hMapFile;
-		this->name_ = { name.begin(), name.end() };
+		this->shmsz_ = this->meta_->shmsz_;
 		this->addr_ = nullptr;
 	}
 
 	shmhdl::shmhdl(std::string_view name)
 	{
-		this->hMapFile_ = nullptr;
 		std::error_code ec;
+		if (!copy_name(this->name_, name)) {
+			ec.assign(ERROR_FILENAME_EXCED_RANGE, std::system_category());
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
 		// try to open shmhdl
-		HANDLE __hMapFile = OpenFileMappingA(FILE_MAP_ALL_ACCESS, true, name.data());
+		HANDLE __hMapFile = OpenFileMappingA(FILE_MAP_ALL_ACCESS, true, this->name_);
 		if (__hMapFile == nullptr) {
 			ec.assign(GetLastError(), std::system_category());
-			throw std::system_error(ec);
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
 		}
 
 		// map shm_meta
@@ -143,7 +214,9 @@ namespace ipc
 		if (__meta == nullptr) {
 			ec.assign(GetLastError(), std::system_category());
 			CloseHandle(__hMapFile);
-			throw std::system_error(ec);
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
 		}
 		// map success -> check shmhdl STATUS
 		this->meta_ = reinterpret_cast<shm_meta_t*>(__meta);
@@ -151,40 +224,108 @@ namespace ipc
 			UnmapViewOfFile(__meta);
 			CloseHandle(__hMapFile);
 			ec = IPCErrc::ShmDeleted;
-			throw std::system_error(ec);
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
+		if (!this->join()) {
+			UnmapViewOfFile(__meta);
+			CloseHandle(__hMapFile);
+			this->meta_ = nullptr;
+			ec = IPCErrc::ShmNoFreeSlot;
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
 		}
-		this->meta_->ref_count_++;
 
 		// setup local var
 		this->hMapFile_ = __hMapFile;
-		this->name_ = { name.begin(), name.end() };
+		this->shmsz_ = this->meta_->shmsz_;
 		this->addr_ = nullptr;
 	}
 
-	shmhdl::~shmhdl()
+	shmhdl::shmhdl(std::string_view name, SHM_ACCESS access, std::error_code& ec) noexcept
+		: shmhdl(name, ec)
+	{
+		if (!ec) {
+			this->access_ = access;
+		}
+	}
+
+	shmhdl::shmhdl(std::string_view name, SHM_ACCESS access)
+		: shmhdl(name)
+	{
+		this->access_ = access;
+	}
+
+	shmhdl::shmhdl(persistent_t, std::string_view path, const shmsz_t nbytes, std::error_code& ec) noexcept
+	{
+		// file backed segments are not implemented on Win32 yet
+		ec.assign(ERROR_CALL_NOT_IMPLEMENTED, std::system_category());
+	}
+
+	shmhdl::shmhdl(persistent_t, std::string_view path, const shmsz_t nbytes)
+	{
+		std::error_code ec(ERROR_CALL_NOT_IMPLEMENTED, std::system_category());
+		char errmsg[256];
+		snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+		throw std::runtime_error(errmsg);
+	}
+
+	shmhdl::shmhdl(shmhdl&& other) noexcept
+		: hMapFile_(std::exchange(other.hMapFile_, nullptr)),
+		shmsz_(std::exchange(other.shmsz_, 0)),
+		access_(std::exchange(other.access_, SHM_ACCESS::READ_WRITE)),
+		addr_(std::exchange(other.addr_, nullptr)),
+		meta_(std::exchange(other.meta_, nullptr)),
+		slot_(std::exchange(other.slot_, NO_SLOT))
+	{
+		copy_name(this->name_, other.name_);
+		other.name_[0] = '\0';
+	}
+
+	shmhdl& shmhdl::operator=(shmhdl&& other) noexcept
+	{
+		if (this != &other) {
+			this->release();
+			this->hMapFile_ = std::exchange(other.hMapFile_, nullptr);
+			this->shmsz_ = std::exchange(other.shmsz_, 0);
+			this->access_ = std::exchange(other.access_, SHM_ACCESS::READ_WRITE);
+			this->addr_ = std::exchange(other.addr_, nullptr);
+			this->meta_ = std::exchange(other.meta_, nullptr);
+			this->slot_ = std::exchange(other.slot_, NO_SLOT);
+			copy_name(this->name_, other.name_);
+			other.name_[0] = '\0';
+		}
+		return *this;
+	}
+
+	void shmhdl::release() noexcept
 	{
 		std::error_code ec;
 		if (this->hMapFile_ != nullptr) {
-			this->meta_->ref_count_ -= 1;
-			if (this->meta_->ref_count_ == 0) {
+			if (this->leave()) {
 				this->meta_->status_ = SHM_STATUS::DEL;
-				this->unmap(ec);
-				this->unmap_meta(ec);
-				CloseHandle(hMapFile_);
-				hMapFile_ = nullptr;
-				return;
 			}
 			this->unmap(ec);
 			this->unmap_meta(ec);
 			CloseHandle(hMapFile_);
 			hMapFile_ = nullptr;
 		}
+		this->name_[0] = '\0';
+		this->shmsz_ = 0;
+		this->access_ = SHM_ACCESS::READ_WRITE;
+	}
+
+	shmhdl::~shmhdl()
+	{
+		this->release();
 	}
 
 	void* shmhdl::map(std::error_code& ec) noexcept {
 		ec.clear();
 		if (this->addr_ == nullptr) {
-			void* __ptr = MapViewOfFile(hMapFile_, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+			void* __ptr = MapViewOfFile(hMapFile_, map_access(this->access_), 0, 0, 0);
 			// fail
 			if (__ptr == nullptr) {
 				ec.assign(GetLastError(), std::system_category());
@@ -202,11 +343,175 @@ namespace ipc
 		std::error_code ec;
 		void* __ptr = this->map(ec);
 		if (ec) {
-			throw std::system_error(ec);
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
 		}
 		return __ptr;
 	}
 
+	shmview shmhdl::map_range(shmsz_t offset, shmsz_t nbytes, std::error_code& ec) noexcept
+	{
+		ec.clear();
+		if (this->hMapFile_ == nullptr) {
+			ec = IPCErrc::ShmDeleted;
+			return {};
+		}
+		if (nbytes == 0 || offset + nbytes > this->shmsz_) {
+			ec.assign(ERROR_INVALID_PARAMETER, std::system_category());
+			return {};
+		}
+		// views must start on an allocation granularity boundary
+		SYSTEM_INFO __si;
+		GetSystemInfo(&__si);
+		shmsz_t __begin = offset + sizeof(shm_meta_t);
+		shmsz_t __map_off = __begin & ~shmsz_t(__si.dwAllocationGranularity - 1);
+		size_t __map_len = static_cast<size_t>(__begin + nbytes - __map_off);
+		auto __block = new (std::nothrow) shmview::block_t;
+		if (__block == nullptr) {
+			ec.assign(ERROR_NOT_ENOUGH_MEMORY, std::system_category());
+			return {};
+		}
+		void* __base = MapViewOfFile(hMapFile_, map_access(this->access_),
+			static_cast<DWORD>(__map_off >> 32), static_cast<DWORD>(__map_off), __map_len);
+		if (__base == nullptr) {
+			ec.assign(GetLastError(), std::system_category());
+			delete __block;
+			return {};
+		}
+		__block->refs_ = 1;
+		__block->base_ = __base;
+		__block->len_ = __map_len;
+		return shmview(__block, static_cast<char*>(__base) + (__begin - __map_off), offset, nbytes);
+	}
+
+	shmview shmhdl::map_range(shmsz_t offset, shmsz_t nbytes)
+	{
+		std::error_code ec;
+		shmview __view = this->map_range(offset, nbytes, ec);
+		if (ec) {
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
+		return __view;
+	}
+
+	shmview::shmview(block_t* block, char* data, shmsz_t offset, shmsz_t nbytes) noexcept
+		: block_(block), data_(data), offset_(offset), nbytes_(nbytes)
+	{
+	}
+
+	shmview::~shmview()
+	{
+		this->reset();
+	}
+
+	shmview::shmview(const shmview& other) noexcept
+		: block_(other.block_), data_(other.data_), offset_(other.offset_), nbytes_(other.nbytes_)
+	{
+		if (this->block_) {
+			this->block_->refs_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	shmview& shmview::operator=(const shmview& other) noexcept
+	{
+		if (this != &other) {
+			if (other.block_) {
+				other.block_->refs_.fetch_add(1, std::memory_order_relaxed);
+			}
+			this->reset();
+			this->block_ = other.block_;
+			this->data_ = other.data_;
+			this->offset_ = other.offset_;
+			this->nbytes_ = other.nbytes_;
+		}
+		return *this;
+	}
+
+	shmview::shmview(shmview&& other) noexcept
+		: block_(std::exchange(other.block_, nullptr)),
+		data_(std::exchange(other.data_, nullptr)),
+		offset_(std::exchange(other.offset_, 0)),
+		nbytes_(std::exchange(other.nbytes_, 0))
+	{
+	}
+
+	shmview& shmview::operator=(shmview&& other) noexcept
+	{
+		if (this != &other) {
+			this->reset();
+			this->block_ = std::exchange(other.block_, nullptr);
+			this->data_ = std::exchange(other.data_, nullptr);
+			this->offset_ = std::exchange(other.offset_, 0);
+			this->nbytes_ = std::exchange(other.nbytes_, 0);
+		}
+		return *this;
+	}
+
+	void shmview::reset() noexcept
+	{
+		if (this->block_ && this->block_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			UnmapViewOfFile(this->block_->base_);
+			delete this->block_;
+		}
+		this->block_ = nullptr;
+		this->data_ = nullptr;
+		this->offset_ = 0;
+		this->nbytes_ = 0;
+	}
+
+	void* shmview::data() const noexcept
+	{
+		return this->data_;
+	}
+
+	shmsz_t shmview::offset() const noexcept
+	{
+		return this->offset_;
+	}
+
+	shmsz_t shmview::nbytes() const noexcept
+	{
+		return this->nbytes_;
+	}
+
+	void shmview::advise(SHM_ADVICE advice, std::error_code& ec) const noexcept
+	{
+		if (this->block_ == nullptr) {
+			ec = IPCErrc::ShmNotMapped;
+			return;
+		}
+		advise_range(this->data_, this->data_ + this->nbytes_, advice, ec);
+	}
+
+	void shmview::advise(SHM_ADVICE advice) const
+	{
+		std::error_code ec;
+		this->advise(advice, ec);
+		if (ec) {
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
+	}
+
+	size_t shmview::use_count() const noexcept
+	{
+		return this->block_ ? this->block_->refs_.load(std::memory_order_relaxed) : 0;
+	}
+
+	bool shmview::valid() const noexcept
+	{
+		return this->block_ != nullptr;
+	}
+
+	shmview::operator bool() const noexcept
+	{
+		return this->valid();
+	}
+
 	void shmhdl::unmap_meta(std::error_code& ec) noexcept
 	{
 		ec.clear();
@@ -238,7 +543,9 @@ namespace ipc
 		std::error_code ec;
 		this->unmap(ec);
 		if (ec) {
-			throw std::system_error(ec);
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
 		}
 	}
 
@@ -252,8 +559,104 @@ namespace ipc
 		this->meta_->status_ = SHM_STATUS::DEL;
 	}
 
+	void shmhdl::sync(std::error_code& ec) noexcept
+	{
+		ec.clear();
+		// segments backed by the paging file have no disk to write back to
+		if (this->addr_ == nullptr || !this->persistent_) {
+			return;
+		}
+		if (FlushViewOfFile(reinterpret_cast<char*>(this->addr_) - sizeof(shm_meta_t), 0) == 0) {
+			ec.assign(GetLastError(), std::system_category());
+		}
+	}
+
+	void shmhdl::sync()
+	{
+		std::error_code ec;
+		this->sync(ec);
+		if (ec) {
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
+	}
+
+	void shmhdl::sync(shmsz_t offset, shmsz_t nbytes, std::error_code& ec) noexcept
+	{
+		ec.clear();
+		if (this->addr_ == nullptr) {
+			ec = IPCErrc::ShmNotMapped;
+			return;
+		}
+		if (offset + nbytes > this->shmsz_) {
+			ec.assign(ERROR_INVALID_PARAMETER, std::system_category());
+			return;
+		}
+		if (!this->persistent_) {
+			return;
+		}
+		if (FlushViewOfFile(reinterpret_cast<char*>(this->addr_) + offset, nbytes) == 0) {
+			ec.assign(GetLastError(), std::system_category());
+		}
+	}
+
+	void shmhdl::sync(shmsz_t offset, shmsz_t nbytes)
+	{
+		std::error_code ec;
+		this->sync(offset, nbytes, ec);
+		if (ec) {
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
+	}
+
+	void shmhdl::advise(shmsz_t offset, shmsz_t nbytes, SHM_ADVICE advice, std::error_code& ec) noexcept
+	{
+		ec.clear();
+		if (this->addr_ == nullptr) {
+			ec = IPCErrc::ShmNotMapped;
+			return;
+		}
+		if (offset + nbytes > this->shmsz_) {
+			ec.assign(ERROR_INVALID_PARAMETER, std::system_category());
+			return;
+		}
+		char* __begin = static_cast<char*>(this->addr_) + offset;
+		advise_range(__begin, __begin + nbytes, advice, ec);
+	}
+
+	void shmhdl::advise(shmsz_t offset, shmsz_t nbytes, SHM_ADVICE advice)
+	{
+		std::error_code ec;
+		this->advise(offset, nbytes, advice, ec);
+		if (ec) {
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
+	}
+
+	void shmhdl::readahead(shmsz_t offset, shmsz_t nbytes, std::error_code& ec) noexcept
+	{
+		// there is no file to read ahead from, prefetch the mapping instead
+		this->advise(offset, nbytes, SHM_ADVICE::WILLNEED, ec);
+	}
+
+	void shmhdl::readahead(shmsz_t offset, shmsz_t nbytes)
+	{
+		std::error_code ec;
+		this->readahead(offset, nbytes, ec);
+		if (ec) {
+			char errmsg[256];
+			snprintf(errmsg, 256, "(%d) %s", ec.value(), ec.message().data());
+			throw std::runtime_error(errmsg);
+		}
+	}
+
 	shmsz_t shmhdl::nbytes() const noexcept {
-		return this->meta_->shmsz_;
+		return this->shmsz_;
 	}
 
 	std::string_view shmhdl::name() const noexcept
@@ -266,9 +669,24 @@ namespace ipc
 		return this->addr_;
 	}
 
-	size_t shmhdl::ref_count() const noexcept
+	bool shmhdl::persistent() const noexcept
+	{
+		return this->persistent_;
+	}
+
+	SHM_ACCESS shmhdl::access() const noexcept
+	{
+		return this->access_;
+	}
+
+	bool shmhdl::valid() const noexcept
+	{
+		return this->hMapFile_ != nullptr;
+	}
+
+	shmhdl::operator bool() const noexcept
 	{
-		return this->meta_->ref_count_;
+		return this->valid();
 	}
 
 	HANDLE shmhdl::native_handle() const noexcept
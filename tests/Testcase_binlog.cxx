@@ -0,0 +1,198 @@
+#include "binlog.hpp"
+#include <catch2/catch.hpp>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+std::vector<std::string> drain_all(ipc::binlog &log) {
+  std::vector<std::string> lines;
+  log.drain([&](std::string_view line) {
+    // drop the time stamp and the pid
+    auto msg = line.substr(line.find(' ') + 1);
+    lines.emplace_back(msg.substr(msg.find(' ') + 1));
+  });
+  return lines;
+}
+} // namespace
+
+TEST_CASE("records are formatted by the drain", "[format]") {
+  std::error_code ec;
+  ipc::binlog log(ipc::create_only, "test", 2, 4096, ec);
+  REQUIRE_FALSE(ec);
+  uint32_t order = log.define("order %u filled at %.2f by %s");
+  uint32_t misc = log.define("%d%% %5x|%-4s|%c %lld %p");
+  uint32_t few = log.define("a=%d b=%d");
+  REQUIRE(log.format(order) == "order %u filled at %.2f by %s");
+  REQUIRE(log.format(12345).empty());
+
+  ipc::binlog_writer w(log, ec);
+  REQUIRE_FALSE(ec);
+  std::string who = "alice";
+  REQUIRE(w.write(order, 7u, 1.5, who));
+  REQUIRE(w.write(misc, -3, 255, "ab", 'z', int64_t(1) << 40,
+                  static_cast<void *>(nullptr)));
+  REQUIRE(w.write(few, 1));
+
+  ipc::binlog drain(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  auto lines = drain_all(drain);
+  REQUIRE(lines.size() == 3);
+  REQUIRE(lines[0] == "order 7 filled at 1.50 by alice");
+  char expected[64];
+  snprintf(expected, sizeof(expected), "-3%%    ff|ab  |z 1099511627776 %p",
+           nullptr);
+  REQUIRE(lines[1] == expected);
+  REQUIRE(lines[2] == "a=1 b=<?>");
+  REQUIRE(drain_all(drain).empty());
+}
+
+TEST_CASE("lines carry the time and the pid", "[format]") {
+  std::error_code ec;
+  ipc::binlog log(ipc::create_only, "test", 1, 4096, ec);
+  REQUIRE_FALSE(ec);
+  uint32_t hello = log.define("hello");
+  ipc::binlog_writer w(log);
+  auto before = std::chrono::system_clock::now();
+  w.write(hello);
+
+  std::string line;
+  REQUIRE(log.drain([&](std::string_view l) { line = l; }) == 1);
+  double secs = std::stod(line);
+  double expected = std::chrono::duration<double>(before.time_since_epoch())
+                        .count();
+  REQUIRE(secs == Approx(expected).margin(1.0));
+  REQUIRE(line.substr(line.find(' ') + 1) ==
+          std::to_string(getpid()) + " hello");
+}
+
+TEST_CASE("full ring drops and reports", "[ring]") {
+  std::error_code ec;
+  ipc::binlog log(ipc::create_only, "test", 1, 256, ec);
+  REQUIRE_FALSE(ec);
+  uint32_t id = log.define("value %d");
+  ipc::binlog_writer w(log);
+
+  int written = 0;
+  while (w.write(id, written)) {
+    written++;
+  }
+  REQUIRE(written > 0);
+  REQUIRE(w.dropped() == 1);
+  REQUIRE_FALSE(w.write(id, 0));
+
+  auto lines = drain_all(log);
+  REQUIRE(lines.size() == size_t(written) + 1);
+  REQUIRE(lines[0] == "value 0");
+  REQUIRE(lines.back() == "2 records dropped, ring 0 was full");
+  REQUIRE(w.dropped() == 0);
+
+  // wraps around the end of the ring, padding included
+  for (int round = 0; round < 20; round++) {
+    REQUIRE(w.write(id, round));
+    REQUIRE(w.write(id, round + 1000));
+    lines = drain_all(log);
+    REQUIRE(lines.size() == 2);
+    REQUIRE(lines[0] == "value " + std::to_string(round));
+    REQUIRE(lines[1] == "value " + std::to_string(round + 1000));
+  }
+}
+
+TEST_CASE("every writer needs a ring", "[ring]") {
+  std::error_code ec;
+  ipc::binlog log(ipc::create_only, "test", 1, 256, ec);
+  REQUIRE_FALSE(ec);
+  {
+    ipc::binlog_writer a(log);
+    ipc::binlog_writer b(log, ec);
+    REQUIRE(ec == IPCErrc::LogNoFreeRing);
+    REQUIRE_FALSE(b);
+  }
+  ipc::binlog_writer c(log, ec);
+  REQUIRE_FALSE(ec);
+}
+
+TEST_CASE("records of a crashed producer are drained", "[crash]") {
+  std::error_code ec;
+  ipc::binlog log(ipc::create_only, "test", 1, 4096, ec);
+  REQUIRE_FALSE(ec);
+  uint32_t id = log.define("step %d of %s");
+
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    {
+      ipc::binlog producer(ipc::open_only, "test");
+      // never destroyed, as if the process crashed
+      auto w = new ipc::binlog_writer(producer);
+      for (int i = 0; i < 3; i++) {
+        w->write(id, i, "child");
+      }
+    }
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+
+  std::vector<std::string> lines;
+  log.drain([&](std::string_view line) { lines.emplace_back(line); });
+  REQUIRE(lines.size() == 3);
+  REQUIRE(lines[2].find(" " + std::to_string(pid) + " step 2 of child") !=
+          std::string::npos);
+
+  // the ring of the dead producer is up for grabs
+  ipc::binlog_writer w(log, ec);
+  REQUIRE_FALSE(ec);
+  w.write(id, 3, "parent");
+  auto rest = drain_all(log);
+  REQUIRE(rest.size() == 1);
+  REQUIRE(rest[0] == "step 3 of parent");
+}
+
+TEST_CASE("records keep the pid of the producer that wrote them", "[crash]") {
+  std::error_code ec;
+  ipc::binlog log(ipc::create_only, "test", 1, 4096, ec);
+  REQUIRE_FALSE(ec);
+  uint32_t id = log.define("step %d");
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    ipc::binlog producer(ipc::open_only, "test");
+    // never destroyed, as if the process crashed
+    auto w = new ipc::binlog_writer(producer);
+    char c = 0;
+    w->write(id, 0);
+    REQUIRE(write(fds[1], &c, 1) == 1);
+    REQUIRE(read(fds[0], &c, 1) == 1);
+    w->write(id, 1);
+    _exit(0);
+  }
+  std::vector<std::string> lines;
+  auto sink = [&](std::string_view line) { lines.emplace_back(line); };
+  char c = 0;
+  REQUIRE(read(fds[0], &c, 1) == 1);
+  // the claim of the child is drained with its first record
+  REQUIRE(log.drain(sink) == 1);
+  REQUIRE(write(fds[1], &c, 1) == 1);
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  close(fds[0]);
+  close(fds[1]);
+
+  // the ring changes hands before the rest of the child's records are drained
+  ipc::binlog_writer w(log, ec);
+  REQUIRE_FALSE(ec);
+  w.write(id, 2);
+  REQUIRE(log.drain(sink) == 2);
+  std::string child = " " + std::to_string(pid) + " step ";
+  std::string parent = " " + std::to_string(getpid()) + " step ";
+  REQUIRE(lines[0].find(child + "0") != std::string::npos);
+  REQUIRE(lines[1].find(child + "1") != std::string::npos);
+  REQUIRE(lines[2].find(parent + "2") != std::string::npos);
+}
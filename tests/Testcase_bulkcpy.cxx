@@ -0,0 +1,67 @@
+#include "bulkcpy.hpp"
+#include "shmhdl.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+static std::vector<unsigned char> make_payload(size_t n) {
+  std::vector<unsigned char> buf(n);
+  for (size_t i = 0; i < n; i++) {
+    buf[i] = static_cast<unsigned char>(i * 131 + (i >> 8));
+  }
+  return buf;
+}
+
+TEST_CASE("stream_copy copies every byte", "[stream]") {
+  const size_t sizes[] = {0, 1, 15, 63, 64, 255, 256, 257, 4095, 4096, 100003};
+  for (size_t n : sizes) {
+    for (size_t misalign : {0, 1, 7, 33}) {
+      auto src = make_payload(n + misalign);
+      std::vector<unsigned char> dst(n + 2 * misalign + 1, 0xee);
+      void *rv = ipc::stream_copy(dst.data() + misalign,
+                                  src.data() + misalign / 2, n);
+      REQUIRE(rv == dst.data() + misalign);
+      REQUIRE(std::memcmp(dst.data() + misalign, src.data() + misalign / 2,
+                          n) == 0);
+      // bytes around the destination are untouched
+      for (size_t i = 0; i < misalign; i++) {
+        REQUIRE(dst[i] == 0xee);
+      }
+      REQUIRE(dst[n + misalign] == 0xee);
+    }
+  }
+}
+
+TEST_CASE("parallel_copy copies every byte", "[parallel]") {
+  const size_t n = 24 * 1024 * 1024 + 123;
+  auto src = make_payload(n);
+  std::vector<unsigned char> dst(n);
+  for (unsigned nthreads : {1u, 2u, 3u, 0u}) {
+    std::fill(dst.begin(), dst.end(), 0);
+    ipc::parallel_copy(dst.data(), src.data(), n, nthreads);
+    REQUIRE(std::memcmp(dst.data(), src.data(), n) == 0);
+  }
+  // the chunks follow the pages of an unaligned destination
+  for (size_t shift : {1, 100, 4095}) {
+    std::fill(dst.begin(), dst.end(), 0);
+    ipc::parallel_copy(dst.data() + shift, src.data(), n - shift, 3);
+    REQUIRE(std::memcmp(dst.data() + shift, src.data(), n - shift) == 0);
+    REQUIRE(dst[0] == 0);
+  }
+}
+
+TEST_CASE("bulk_copy into a shmhdl buffer", "[bulk]") {
+  std::error_code ec;
+  const size_t n = 20 * 1024 * 1024;
+  ipc::shmhdl svr("test", n, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shmhdl clt("test", ec);
+  REQUIRE_FALSE(ec);
+
+  auto src = make_payload(n);
+  for (size_t len : {size_t(1000), ipc::STREAM_COPY_THRESHOLD, n}) {
+    ipc::bulk_copy(svr.map(), src.data(), len);
+    REQUIRE(std::memcmp(clt.map(), src.data(), len) == 0);
+  }
+}
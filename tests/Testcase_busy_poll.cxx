@@ -0,0 +1,87 @@
+#include "busy_poll.hpp"
+#include "cpuinfo.hpp"
+#include "semhdl.hpp"
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("unsupported hints fall back to pause", "[create]") {
+  bool waitpkg = ipc::cpu_features().waitpkg;
+  ipc::busy_poll poller(-1, ipc::spin_hint::umwait);
+  REQUIRE(poller.hint() ==
+          (waitpkg ? ipc::spin_hint::umwait : ipc::spin_hint::pause));
+  ipc::busy_poll automatic;
+  REQUIRE(automatic.hint() ==
+          (waitpkg ? ipc::spin_hint::umwait : ipc::spin_hint::pause));
+  REQUIRE(ipc::busy_poll(-1, ipc::spin_hint::pause).hint() ==
+          ipc::spin_hint::pause);
+}
+
+TEST_CASE("pin to a cpu", "[pin]") {
+  std::error_code ec;
+  ipc::busy_poll poller(0);
+  std::thread t([&] { poller.pin(ec); });
+  t.join();
+  REQUIRE_FALSE(ec);
+
+  ipc::busy_poll bad(1 << 20);
+  t = std::thread([&] { bad.pin(ec); });
+  t.join();
+  REQUIRE(ec);
+}
+
+TEST_CASE("wait until a condition holds", "[wait]") {
+  for (auto hint : {ipc::spin_hint::pause, ipc::spin_hint::tpause,
+                    ipc::spin_hint::umwait}) {
+    ipc::busy_poll poller(-1, hint);
+    std::atomic<uint32_t> word{0};
+    std::thread t([&] {
+      std::this_thread::sleep_for(20ms);
+      word.store(1);
+    });
+    REQUIRE(poller.wait_change(word, 0) == 1);
+    t.join();
+
+    t = std::thread([&] {
+      std::this_thread::sleep_for(20ms);
+      word.store(2);
+    });
+    poller.wait([&] { return word.load() == 2; });
+    t.join();
+
+    const ipc::poll_stats_t &stats = poller.stats();
+    REQUIRE(stats.waits_ == 2);
+    REQUIRE(stats.polls_ > 2);
+    REQUIRE(stats.wait_time_ >= 20ms);
+    REQUIRE(stats.efficiency() > 0.0);
+    REQUIRE(stats.efficiency() < 1.0);
+
+    poller.reset_stats();
+    REQUIRE(poller.wait_for([] { return false; }, 10ms) == false);
+    REQUIRE(poller.stats().waits_ == 0);
+    REQUIRE(poller.wait_for([] { return true; }, 10ms));
+    REQUIRE(poller.stats().efficiency() > 0.0);
+  }
+}
+
+TEST_CASE("wait on a semhdl by polling", "[wait]") {
+  std::error_code ec;
+  ipc::semhdl hdl("test", 0, ec);
+  REQUIRE_FALSE(ec);
+  ipc::busy_poll poller;
+  std::thread t([&hdl] {
+    std::this_thread::sleep_for(20ms);
+    hdl.post();
+  });
+  hdl.wait(poller, ec);
+  REQUIRE_FALSE(ec);
+  t.join();
+  REQUIRE(hdl.value() == 0);
+  REQUIRE(poller.stats().waits_ == 1);
+
+  ipc::semhdl empty;
+  empty.wait(poller, ec);
+  REQUIRE(ec);
+}
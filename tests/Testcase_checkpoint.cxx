@@ -0,0 +1,217 @@
+#include "checkpoint.hpp"
+#include "ec.hpp"
+#include <catch2/catch.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+static const char *snapshot_dir = "/tmp/ipc_Testcase_checkpoint";
+
+static void clear_snapshot_dir() {
+  std::string cmd = std::string("rm -rf ") + snapshot_dir;
+  REQUIRE(system(cmd.c_str()) == 0);
+}
+
+static size_t count_snapshots() {
+  size_t n = 0;
+  DIR *dir = opendir(snapshot_dir);
+  if (dir == nullptr) {
+    return 0;
+  }
+  while (dirent *e = readdir(dir)) {
+    n += strstr(e->d_name, ".snap") != nullptr;
+  }
+  closedir(dir);
+  return n;
+}
+
+TEST_CASE("dirty_bitmap marks pages", "[bitmap]") {
+  std::error_code ec;
+  const size_t pgsz = sysconf(_SC_PAGESIZE);
+  ipc::dirty_bitmap bm(ipc::create_only, "test", 200 * pgsz + 1, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(bm.npages() == 201);
+  REQUIRE(bm.nwords() == 4);
+
+  ipc::dirty_bitmap writer(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  writer.mark(pgsz - 1, 2);
+  writer.mark(63 * pgsz, 2 * pgsz);
+  writer.mark(200 * pgsz, 10 * pgsz);
+  REQUIRE(bm.test(0));
+  REQUIRE(bm.test(1));
+  REQUIRE_FALSE(bm.test(2));
+  REQUIRE(bm.test(63));
+  REQUIRE(bm.test(64));
+  REQUIRE_FALSE(bm.test(65));
+  REQUIRE(bm.test(200));
+
+  REQUIRE(bm.fetch_clear(0) == ((1ull << 63) | 3));
+  REQUIRE(bm.fetch_clear(0) == 0);
+  REQUIRE(bm.fetch_clear(1) == 1);
+}
+
+TEST_CASE("dirty_bitmap refuses foreign segments", "[bitmap]") {
+  std::error_code ec;
+  {
+    ipc::shmhdl raw("test", 0, ec);
+    REQUIRE_FALSE(ec);
+    ipc::dirty_bitmap bm(ipc::open_only, "test", ec, 50ms);
+    REQUIRE(ec == IPCErrc::ShmLayoutMismatch);
+    REQUIRE_FALSE(bm.valid());
+  }
+  {
+    // never initialized by a creator
+    ipc::shmhdl raw("test", 4096, ec);
+    REQUIRE_FALSE(ec);
+    ipc::dirty_bitmap bm(ipc::open_only, "test", ec, 50ms);
+    REQUIRE(ec == IPCErrc::ShmNotInitialized);
+    REQUIRE_FALSE(bm.valid());
+  }
+}
+
+TEST_CASE("checkpoint and restore a segment", "[checkpoint]") {
+  clear_snapshot_dir();
+  std::error_code ec;
+  const size_t pgsz = sysconf(_SC_PAGESIZE);
+  const size_t nbytes = 300 * pgsz + 100;
+  {
+    ipc::shmhdl seg("test", nbytes, ec);
+    REQUIRE_FALSE(ec);
+    auto ptr = static_cast<unsigned char *>(seg.map());
+    for (size_t i = 0; i < nbytes; i++) {
+      ptr[i] = static_cast<unsigned char>(i * 7);
+    }
+    ipc::checkpointer ckpt(seg, "test.dirty", snapshot_dir, ec);
+    REQUIRE_FALSE(ec);
+
+    // the first checkpoint is always full
+    ckpt.checkpoint(ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(ckpt.bytes_written() >= nbytes);
+    uint64_t full_bytes = ckpt.bytes_written();
+
+    // incremental checkpoints only write the marked pages
+    std::memset(ptr + 10 * pgsz, 0xab, 3 * pgsz);
+    ckpt.dirty().mark(10 * pgsz, 3 * pgsz);
+    ptr[nbytes - 1] = 0xcd;
+    ckpt.dirty().mark(nbytes - 1, 1);
+    ckpt.checkpoint(ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(ckpt.bytes_written() - full_bytes < 10 * pgsz);
+
+    // a write in another process
+    ipc::dirty_bitmap other(ipc::open_only, "test.dirty", ec);
+    REQUIRE_FALSE(ec);
+    ptr[200 * pgsz] = 0xef;
+    other.mark(200 * pgsz, 1);
+    ckpt.checkpoint(ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(count_snapshots() == 3);
+
+    // not marked, so not captured
+    ptr[0] = 0x11;
+  }
+
+  ipc::shmhdl seg("test", nbytes, ec);
+  REQUIRE_FALSE(ec);
+  ipc::checkpointer::restore(seg, snapshot_dir, ec);
+  REQUIRE_FALSE(ec);
+  auto ptr = static_cast<unsigned char *>(seg.map());
+  for (size_t i = 0; i < nbytes; i++) {
+    unsigned char expected = static_cast<unsigned char>(i * 7);
+    if (i >= 10 * pgsz && i < 13 * pgsz) {
+      expected = 0xab;
+    } else if (i == nbytes - 1) {
+      expected = 0xcd;
+    } else if (i == 200 * pgsz) {
+      expected = 0xef;
+    }
+    REQUIRE(ptr[i] == expected);
+  }
+}
+
+TEST_CASE("full checkpoint truncates the chain", "[checkpoint]") {
+  clear_snapshot_dir();
+  std::error_code ec;
+  ipc::shmhdl seg("test", 64 * 1024, ec);
+  REQUIRE_FALSE(ec);
+  ipc::checkpointer ckpt(seg, "test.dirty", snapshot_dir);
+  ckpt.checkpoint();
+  ckpt.checkpoint();
+  ckpt.checkpoint();
+  REQUIRE(count_snapshots() == 3);
+  ckpt.checkpoint(true);
+  REQUIRE(count_snapshots() == 1);
+  REQUIRE(ckpt.seq() == 4);
+}
+
+TEST_CASE("background checkpoints while writing", "[checkpoint]") {
+  clear_snapshot_dir();
+  std::error_code ec;
+  const size_t nbytes = 1024 * 1024;
+  ipc::shmhdl seg("test", nbytes, ec);
+  REQUIRE_FALSE(ec);
+  auto ptr = static_cast<uint64_t *>(seg.map());
+  {
+    ipc::checkpointer ckpt(seg, "test.dirty", snapshot_dir, ec);
+    REQUIRE_FALSE(ec);
+    ckpt.start(5ms);
+    for (uint64_t round = 1; round <= 50; round++) {
+      for (size_t i = 0; i < nbytes / 8; i += 512) {
+        ptr[i] = round;
+        ckpt.dirty().mark(i * 8, 8);
+      }
+      std::this_thread::sleep_for(1ms);
+    }
+    ckpt.stop();
+    REQUIRE_FALSE(ckpt.last_error());
+    // capture whatever was written after the last background checkpoint
+    ckpt.checkpoint();
+  }
+  ipc::shmhdl restored("test2", nbytes, ec);
+  REQUIRE_FALSE(ec);
+  ipc::checkpointer::restore(restored, snapshot_dir, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(std::memcmp(restored.map(), ptr, nbytes) == 0);
+}
+
+TEST_CASE("restore without snapshot", "[restore]") {
+  clear_snapshot_dir();
+  std::error_code ec;
+  ipc::shmhdl seg("test", 4096, ec);
+  REQUIRE_FALSE(ec);
+  ipc::checkpointer::restore(seg, snapshot_dir, ec);
+  REQUIRE(ec == IPCErrc::SnapshotNotFound);
+}
+
+TEST_CASE("restore rejects a corrupt snapshot", "[restore]") {
+  clear_snapshot_dir();
+  std::error_code ec;
+  ipc::shmhdl seg("test", 64 * 1024, ec);
+  REQUIRE_FALSE(ec);
+  {
+    ipc::checkpointer ckpt(seg, "test.dirty", snapshot_dir);
+    ckpt.checkpoint();
+  }
+  // point the first run of the snapshot far past the end of the segment
+  std::string path = std::string(snapshot_dir) + "/0000000000000000.snap";
+  int fd = open(path.c_str(), O_RDWR);
+  REQUIRE(fd != -1);
+  uint64_t table_offset = 0;
+  REQUIRE(pread(fd, &table_offset, sizeof(table_offset), 48) ==
+          sizeof(table_offset));
+  uint64_t first_page = uint64_t(1) << 40;
+  REQUIRE(pwrite(fd, &first_page, sizeof(first_page), table_offset) ==
+          sizeof(first_page));
+  close(fd);
+
+  ipc::checkpointer::restore(seg, snapshot_dir, ec);
+  REQUIRE(ec == IPCErrc::SnapshotCorrupted);
+}
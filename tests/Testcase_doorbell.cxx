@@ -0,0 +1,74 @@
+#include "doorbell.hpp"
+#include "shmhdl.hpp"
+#include <catch2/catch.hpp>
+#include <new>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+TEST_CASE("a ring only wakes an armed bell", "[ring]") {
+  ipc::doorbell bell;
+  std::atomic<bool> flag{false};
+  REQUIRE_FALSE(bell.ring());
+  REQUIRE_FALSE(bell.armed());
+  REQUIRE_FALSE(bell.wait([&] { return flag.load(); },
+                          std::chrono::milliseconds(10)));
+  // a consumer that timed out leaves the bell armed
+  REQUIRE(bell.armed());
+  REQUIRE(bell.ring());
+  REQUIRE_FALSE(bell.armed());
+
+  std::thread consumer([&] { REQUIRE(bell.wait([&] { return flag.load(); })); });
+  while (!bell.armed()) {
+    std::this_thread::yield();
+  }
+  flag = true;
+  // the burst is coalesced into the first wake
+  REQUIRE(bell.ring());
+  REQUIRE_FALSE(bell.ring());
+  REQUIRE_FALSE(bell.ring());
+  consumer.join();
+  REQUIRE(bell.wait([&] { return flag.load(); }, std::chrono::nanoseconds(0)));
+}
+
+TEST_CASE("bursts between processes cost one wake", "[concurrent]") {
+  constexpr uint32_t nbursts = 100;
+  constexpr uint32_t burst = 1000;
+  struct channel_t {
+    ipc::doorbell bell_;
+    std::atomic<uint32_t> count_{0};
+  };
+  std::error_code ec;
+  ipc::shmhdl hdl("test", sizeof(channel_t), ec);
+  REQUIRE_FALSE(ec);
+  auto channel = new (hdl.map()) channel_t;
+
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    uint32_t seen = 0;
+    bool ok = true;
+    while (ok && seen < nbursts * burst) {
+      uint32_t count;
+      ok = channel->bell_.wait(
+          [&] { return (count = channel->count_.load()) != seen; },
+          std::chrono::seconds(10));
+      seen = count;
+    }
+    _exit(ok ? 0 : 1);
+  }
+  uint32_t wakes = 0;
+  for (uint32_t b = 0; b < nbursts; b++) {
+    for (uint32_t i = 0; i < burst; i++) {
+      channel->count_.fetch_add(1, std::memory_order_release);
+      wakes += channel->bell_.ring();
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  REQUIRE(wakes <= nbursts * burst / 10);
+  hdl.unlink();
+}
@@ -0,0 +1,247 @@
+#include "epoch_domain.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+TEST_CASE("nodes are freed two epochs after they are retired", "[retire]") {
+  std::error_code ec;
+  ipc::epoch_domain domain(ipc::create_only, "test", 4, 8, ec);
+  REQUIRE_FALSE(ec);
+  std::vector<uint64_t> freed;
+  domain.on_reclaim([&](uint64_t node) { freed.push_back(node); });
+
+  domain.retire(1);
+  domain.retire(2);
+  REQUIRE(domain.pending() == 2);
+  REQUIRE(domain.collect() == 0);
+  REQUIRE(domain.epoch() == 1);
+  domain.retire(3);
+  REQUIRE(domain.collect() == 2);
+  REQUIRE(freed == std::vector<uint64_t>{1, 2});
+  REQUIRE(domain.collect() == 1);
+  REQUIRE(freed.back() == 3);
+  REQUIRE(domain.pending() == 0);
+}
+
+TEST_CASE("a pinned participant holds the epoch back", "[pin]") {
+  std::error_code ec;
+  ipc::epoch_domain writer(ipc::create_only, "test", 2, 4, ec);
+  REQUIRE_FALSE(ec);
+  ipc::epoch_domain reader(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(writer.id() != reader.id());
+  ipc::epoch_domain extra(ipc::open_only, "test", ec);
+  REQUIRE(ec == IPCErrc::EpochNoFreeSlot);
+  REQUIRE_FALSE(extra);
+  std::vector<uint64_t> freed;
+  writer.on_reclaim([&](uint64_t node) { freed.push_back(node); });
+
+  {
+    ipc::epoch_guard guard = reader.guard();
+    {
+      ipc::epoch_guard nested = reader.guard();
+    }
+    REQUIRE(reader.pinned());
+    writer.retire(7);
+    // the reader has seen the current epoch, it can move once
+    REQUIRE(writer.try_advance());
+    REQUIRE_FALSE(writer.try_advance());
+    for (int i = 0; i < 4; i++) {
+      writer.collect();
+    }
+    REQUIRE(freed.empty());
+
+    for (uint64_t node = 8; node < 11; node++) {
+      writer.retire(node);
+    }
+    writer.retire(11, ec);
+    REQUIRE(ec == IPCErrc::EpochLimboFull);
+  }
+  REQUIRE_FALSE(reader.pinned());
+  writer.collect();
+  writer.collect();
+  REQUIRE(freed == std::vector<uint64_t>{7, 8, 9, 10});
+}
+
+TEST_CASE("a dead participant does not stop the epoch", "[reclaim]") {
+  std::error_code ec;
+  ipc::epoch_domain domain(ipc::create_only, "test", 2, 8, ec);
+  REQUIRE_FALSE(ec);
+  std::vector<uint64_t> freed;
+  domain.on_reclaim([&](uint64_t node) { freed.push_back(node); });
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    // never destroyed, dies pinned as if the process crashed
+    auto child = new ipc::epoch_domain(ipc::open_only, "test");
+    child->pin();
+    child->retire(100);
+    child->retire(101);
+    char done = 1;
+    REQUIRE(write(fds[1], &done, 1) == 1);
+    _exit(0);
+  }
+  char done;
+  REQUIRE(read(fds[0], &done, 1) == 1);
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  close(fds[0]);
+  close(fds[1]);
+
+  // moves once, then the dead participant is found out
+  REQUIRE(domain.try_advance());
+  int attempts = 0;
+  while (!domain.try_advance()) {
+    REQUIRE(++attempts < 1000);
+  }
+  // what it retired is freed by another participant
+  for (int i = 0; i < 1000 && freed.size() < 2; i++) {
+    domain.collect();
+  }
+  REQUIRE(freed == std::vector<uint64_t>{100, 101});
+  // the slot can be joined again
+  ipc::epoch_domain again(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  // the shmhdl reference of the crashed child is never dropped
+  ipc::shmhdl("test").unlink();
+}
+
+namespace {
+constexpr uint32_t NNODES = 256;
+constexpr uint64_t LIVE = 0x4556494c;
+constexpr uint64_t POISON = 0xdeadbeef;
+
+struct node_t {
+  std::atomic<uint32_t> next_;
+  std::atomic<uint64_t> value_;
+};
+
+/**
+ * @brief two Treiber stacks of node indices + 1, the nodes in use and the
+ * free ones
+ */
+struct arena_t {
+  std::atomic<uint32_t> top_;
+  std::atomic<uint32_t> free_;
+  node_t nodes_[NNODES];
+};
+
+void push(arena_t *arena, std::atomic<uint32_t> &top, uint32_t node) {
+  uint32_t __top = top.load(std::memory_order_relaxed);
+  do {
+    arena->nodes_[node - 1].next_.store(__top, std::memory_order_relaxed);
+  } while (!top.compare_exchange_weak(__top, node, std::memory_order_release,
+                                      std::memory_order_relaxed));
+}
+
+/**
+ * @brief pops a node, the caller is pinned; counts the freed nodes it read
+ */
+uint32_t pop(arena_t *arena, std::atomic<uint32_t> &top, uint32_t &poisoned) {
+  uint32_t __top = top.load(std::memory_order_acquire);
+  while (__top) {
+    node_t &__node = arena->nodes_[__top - 1];
+    // give the others a chance to pop and retire the node meanwhile
+    if (__top % 8 == 0) {
+      std::this_thread::yield();
+    }
+    uint32_t __next = __node.next_.load(std::memory_order_relaxed);
+    poisoned += __node.value_.load(std::memory_order_relaxed) == POISON &&
+                &top != &arena->free_;
+    if (top.compare_exchange_weak(__top, __next, std::memory_order_acquire)) {
+      break;
+    }
+  }
+  return __top;
+}
+
+uint32_t count(arena_t *arena, std::atomic<uint32_t> &top) {
+  uint32_t __n = 0;
+  for (uint32_t i = top.load(); i; i = arena->nodes_[i - 1].next_.load()) {
+    __n++;
+  }
+  return __n;
+}
+
+uint32_t churn(arena_t *arena, uint32_t rounds) {
+  ipc::epoch_domain domain(ipc::open_only, "test");
+  domain.on_reclaim([arena](uint64_t node) {
+    arena->nodes_[node - 1].value_.store(POISON, std::memory_order_relaxed);
+    push(arena, arena->free_, uint32_t(node));
+  });
+  uint32_t poisoned = 0;
+  for (uint32_t i = 0; i < rounds; i++) {
+    uint32_t node;
+    {
+      ipc::epoch_guard guard = domain.guard();
+      if (i % 2 == 0) {
+        if ((node = pop(arena, arena->free_, poisoned))) {
+          arena->nodes_[node - 1].value_.store(LIVE, std::memory_order_relaxed);
+          push(arena, arena->top_, node);
+        }
+        continue;
+      }
+      node = pop(arena, arena->top_, poisoned);
+    }
+    if (!node) {
+      continue;
+    }
+    std::error_code ec;
+    domain.retire(node, ec);
+    while (ec == IPCErrc::EpochLimboFull) {
+      std::this_thread::yield();
+      domain.retire(node, ec);
+    }
+  }
+  return poisoned;
+}
+} // namespace
+
+TEST_CASE("nodes of a shared stack are never freed under a reader",
+          "[concurrent]") {
+  constexpr uint32_t rounds = 50000;
+  std::error_code ec;
+  ipc::shmhdl hdl("arena", sizeof(arena_t), ec);
+  REQUIRE_FALSE(ec);
+  auto arena = new (hdl.map()) arena_t;
+  arena->top_.store(0);
+  arena->free_.store(0);
+  for (uint32_t i = 1; i <= NNODES; i++) {
+    arena->nodes_[i - 1].value_.store(POISON);
+    push(arena, arena->free_, i);
+  }
+  ipc::epoch_domain domain(ipc::create_only, "test", 4, 32, ec);
+  REQUIRE_FALSE(ec);
+
+  pid_t pids[2];
+  for (auto &pid : pids) {
+    pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      _exit(churn(arena, rounds) == 0 ? 0 : 1);
+    }
+  }
+  REQUIRE(churn(arena, rounds) == 0);
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+  }
+
+  // every node is back, the ones the others left retired included
+  domain.on_reclaim([arena](uint64_t node) {
+    push(arena, arena->free_, uint32_t(node));
+  });
+  for (int i = 0; i < 1000; i++) {
+    domain.collect();
+  }
+  REQUIRE(count(arena, arena->top_) + count(arena, arena->free_) == NNODES);
+  hdl.unlink();
+}
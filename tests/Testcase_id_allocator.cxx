@@ -0,0 +1,139 @@
+#include "id_allocator.hpp"
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <memory>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+TEST_CASE("ids are handed out lowest first", "[allocate]") {
+  std::error_code ec;
+  ipc::id_allocator a(ipc::create_only, "test", 200, ec);
+  REQUIRE_FALSE(ec);
+  ipc::id_allocator b(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(b.capacity() == 200);
+
+  for (uint32_t i = 0; i < 200; i++) {
+    REQUIRE((i % 2 ? a : b).allocate() == i);
+  }
+  REQUIRE(a.allocate(ec) == ipc::id_allocator::npos);
+  REQUIRE(ec == IPCErrc::IdAllocatorFull);
+  REQUIRE(a.allocated(137));
+  REQUIRE(a.owner(137) == ipc::proc_id::self());
+
+  b.release(137);
+  REQUIRE_FALSE(a.allocated(137));
+  REQUIRE(a.owner(137).empty());
+  b.release(137, ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+  b.release(200, ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+  b.release(64);
+  REQUIRE(a.allocate() == 64);
+  REQUIRE(a.allocate() == 137);
+  REQUIRE(a.allocate(ec) == ipc::id_allocator::npos);
+
+  ipc::id_allocator(ipc::create_only, "big", ipc::id_allocator::MAX_CAPACITY + 1,
+                    ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+}
+
+TEST_CASE("millions of ids", "[allocate]") {
+  constexpr uint32_t capacity = 3 << 20;
+  ipc::id_allocator ids(ipc::create_only, "test", capacity);
+  for (uint32_t i = 0; i < 200000; i++) {
+    REQUIRE(ids.allocate() == i);
+  }
+  for (uint32_t id : {199999u, 4096u, 77u, 150000u}) {
+    ids.release(id);
+  }
+  REQUIRE(ids.allocate() == 77);
+  REQUIRE(ids.allocate() == 4096);
+  REQUIRE(ids.allocate() == 150000);
+  REQUIRE(ids.allocate() == 199999);
+  REQUIRE(ids.allocate() == 200000);
+  ids.release(200000);
+  for (uint32_t i = 0; i < 200000; i++) {
+    ids.release(i);
+  }
+  REQUIRE(ids.allocate() == 0);
+}
+
+TEST_CASE("ids of a dead process are released", "[reclaim]") {
+  std::error_code ec;
+  ipc::id_allocator ids(ipc::create_only, "test", 64, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(ids.allocate() == 0);
+
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    bool ok = true;
+    {
+      ipc::id_allocator child(ipc::open_only, "test");
+      for (uint32_t i = 1; i < 64; i++) {
+        ok = ok && child.allocate() == i;
+      }
+    }
+    // exits holding every id
+    _exit(ok ? 0 : 1);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  REQUIRE(ids.allocated(63));
+  REQUIRE_FALSE(ids.owner(63).alive());
+
+  // no id left: the ones of the dead process are taken back
+  REQUIRE(ids.allocate() == 1);
+  REQUIRE(ids.owner(1) == ipc::proc_id::self());
+  REQUIRE_FALSE(ids.allocated(2));
+  REQUIRE(ids.reclaim() == 0);
+  REQUIRE(ids.allocated(0));
+}
+
+TEST_CASE("concurrent allocations never share an id", "[concurrent]") {
+  constexpr uint32_t capacity = 4096 + 64;
+  constexpr int nthreads = 4;
+  ipc::id_allocator ids(ipc::create_only, "test", capacity);
+  std::unique_ptr<std::atomic<int>[]> holder(new std::atomic<int>[capacity]);
+  for (uint32_t i = 0; i < capacity; i++) {
+    holder[i].store(0);
+  }
+  std::atomic<bool> ok{true};
+
+  std::vector<std::thread> threads;
+  for (int t = 1; t <= nthreads; t++) {
+    threads.emplace_back([&, t] {
+      ipc::id_allocator mine(ipc::open_only, "test");
+      std::vector<uint32_t> held;
+      for (int round = 0; round < 50; round++) {
+        // fill up most of the allocator together, then empty it
+        for (uint32_t i = 0; i < capacity / nthreads - 8; i++) {
+          uint32_t id = mine.allocate();
+          int none = 0;
+          if (!holder[id].compare_exchange_strong(none, t)) {
+            ok = false;
+          }
+          held.push_back(id);
+        }
+        for (uint32_t id : held) {
+          holder[id].store(0);
+          mine.release(id);
+        }
+        held.clear();
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  REQUIRE(ok);
+  // every summary agrees with the bitmap again
+  for (uint32_t i = 0; i < capacity; i++) {
+    REQUIRE(ids.allocate() == i);
+  }
+}
@@ -0,0 +1,252 @@
+#include "mcast_pool.hpp"
+#include <catch2/catch.hpp>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+TEST_CASE("one buffer reaches every subscriber", "[publish]") {
+  std::error_code ec;
+  ipc::mcast_pool producer(ipc::create_only, "test", 4, 100, 4, 8, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(producer.buf_size() == 128);
+  ipc::mcast_pool a(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  ipc::mcast_pool b(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(producer.id() != a.id());
+  REQUIRE(a.id() != b.id());
+
+  {
+    ipc::mcast_buffer buf = producer.allocate();
+    REQUIRE(producer.available() == 3);
+    std::strcpy(static_cast<char *>(buf.data()), "hello");
+    buf.resize(6);
+    REQUIRE(producer.broadcast(buf) == 2);
+    REQUIRE(buf.use_count() == 3);
+  }
+  REQUIRE(producer.available() == 3);
+
+  ipc::mcast_buffer ra = a.receive();
+  ipc::mcast_buffer rb = b.receive();
+  REQUIRE(ra);
+  REQUIRE(rb);
+  REQUIRE(ra.index() == rb.index());
+  REQUIRE(ra.size() == 6);
+  REQUIRE(std::strcmp(static_cast<char *>(ra.data()), "hello") == 0);
+  REQUIRE(std::strcmp(static_cast<char *>(rb.data()), "hello") == 0);
+  REQUIRE_FALSE(a.receive());
+
+  ra.release();
+  REQUIRE(rb.use_count() == 1);
+  REQUIRE(producer.available() == 3);
+  rb.release();
+  REQUIRE(producer.available() == 4);
+}
+
+TEST_CASE("publish errors", "[publish]") {
+  std::error_code ec;
+  ipc::mcast_pool producer(ipc::create_only, "test", 3, 64, 3, 2, ec);
+  REQUIRE_FALSE(ec);
+  ipc::mcast_pool consumer(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+
+  ipc::mcast_buffer buf = producer.allocate();
+  producer.publish(buf, producer.id(), ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+  producer.publish(buf, 2, ec);
+  REQUIRE(ec == IPCErrc::McastNoSuchClient);
+  producer.publish(buf, 3, ec);
+  REQUIRE(ec == IPCErrc::McastNoSuchClient);
+  producer.publish(buf, consumer.id(), ec);
+  REQUIRE_FALSE(ec);
+  producer.publish(buf, consumer.id(), ec);
+  REQUIRE(ec == std::errc::connection_already_in_progress);
+
+  ipc::mcast_buffer other = producer.allocate();
+  producer.publish(other, consumer.id());
+  ipc::mcast_buffer third = producer.allocate();
+  producer.publish(third, consumer.id(), ec);
+  REQUIRE(ec == IPCErrc::McastQueueFull);
+  REQUIRE(third.use_count() == 1);
+  producer.allocate(ec);
+  REQUIRE(ec == IPCErrc::McastPoolExhausted);
+
+  // a receiver may forward what it got
+  ipc::mcast_buffer first = consumer.receive();
+  REQUIRE(first.index() == buf.index());
+  consumer.publish(first, producer.id(), ec);
+  REQUIRE(ec == std::errc::connection_already_in_progress);
+  buf.release();
+  consumer.publish(first, producer.id(), ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(producer.receive().index() == first.index());
+
+  ipc::mcast_pool last(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  ipc::mcast_pool extra(ipc::open_only, "test", ec);
+  REQUIRE(ec == IPCErrc::McastNoFreeClient);
+  REQUIRE_FALSE(extra);
+}
+
+TEST_CASE("leaving drops the queued references", "[reclaim]") {
+  std::error_code ec;
+  ipc::mcast_pool producer(ipc::create_only, "test", 4, 64, 2, 4, ec);
+  REQUIRE_FALSE(ec);
+  {
+    ipc::mcast_pool consumer(ipc::open_only, "test", ec);
+    REQUIRE_FALSE(ec);
+    for (int i = 0; i < 3; i++) {
+      producer.publish(producer.allocate(), consumer.id());
+    }
+    REQUIRE(producer.available() == 1);
+  }
+  REQUIRE(producer.available() == 4);
+}
+
+TEST_CASE("references of a dead process are reclaimed", "[reclaim]") {
+  std::error_code ec;
+  ipc::mcast_pool producer(ipc::create_only, "test", 4, 64, 3, 4, ec);
+  REQUIRE_FALSE(ec);
+  ipc::mcast_buffer shared = producer.allocate();
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    // never destroyed, as if the process crashed
+    auto consumer = new ipc::mcast_pool(ipc::open_only, "test");
+    uint32_t id = consumer->id();
+    REQUIRE(write(fds[1], &id, sizeof(id)) == sizeof(id));
+    new ipc::mcast_buffer(consumer->allocate());
+    new ipc::mcast_buffer(consumer->receive(ipc::FOREVER));
+    REQUIRE(write(fds[1], &id, sizeof(id)) == sizeof(id));
+    _exit(0);
+  }
+  uint32_t id;
+  REQUIRE(read(fds[0], &id, sizeof(id)) == sizeof(id));
+  producer.publish(shared, id);
+  producer.publish(producer.allocate(), id);
+  REQUIRE(read(fds[0], &id, sizeof(id)) == sizeof(id));
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  close(fds[0]);
+  close(fds[1]);
+
+  // the received buffer, the allocated one and the one still queued
+  REQUIRE(producer.available() == 1);
+  REQUIRE(shared.use_count() == 2);
+  REQUIRE(producer.reclaim() == 1);
+  REQUIRE(producer.reclaim() == 0);
+  REQUIRE(producer.available() == 3);
+  REQUIRE(shared.use_count() == 1);
+  // the slot can be joined again
+  ipc::mcast_pool again(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  // the shmhdl reference of the crashed child is never dropped
+  ipc::shmhdl("test").unlink();
+}
+
+TEST_CASE("a publisher killed mid publish does not hold up leaving",
+          "[reclaim]") {
+  std::error_code ec;
+  ipc::mcast_pool producer(ipc::create_only, "test", 4, 64, 3, 2, ec);
+  REQUIRE_FALSE(ec);
+  auto consumer = std::make_unique<ipc::mcast_pool>(ipc::open_only, "test");
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    auto publisher = new ipc::mcast_pool(ipc::open_only, "test");
+    ipc::mcast_buffer buf = publisher->allocate();
+    char c = 0;
+    REQUIRE(write(fds[1], &c, sizeof(c)) == sizeof(c));
+    // the queue fills up, every later publish stops half way
+    for (;;) {
+      publisher->publish(buf, consumer->id(), ec);
+    }
+  }
+  char c;
+  REQUIRE(read(fds[0], &c, sizeof(c)) == sizeof(c));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  kill(pid, SIGKILL);
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFSIGNALED(status));
+  close(fds[0]);
+  close(fds[1]);
+
+  consumer.reset();
+  REQUIRE(producer.reclaim() == 1);
+  REQUIRE(producer.available() == 4);
+  // both slots can be joined again
+  ipc::mcast_pool a(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  ipc::mcast_pool b(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  producer.publish(producer.allocate(), a.id());
+  ipc::shmhdl("test").unlink();
+}
+
+TEST_CASE("buffers stream to another process", "[concurrent]") {
+  constexpr uint32_t nmsgs = 20000;
+  std::error_code ec;
+  ipc::mcast_pool producer(ipc::create_only, "test", 8, 64, 3, 4, ec);
+  REQUIRE_FALSE(ec);
+
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  pid_t pids[2];
+  for (auto &pid : pids) {
+    pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      bool ok = true;
+      {
+        ipc::mcast_pool consumer(ipc::open_only, "test");
+        uint32_t id = consumer.id();
+        ok = write(fds[1], &id, sizeof(id)) == sizeof(id);
+        for (uint32_t i = 0; i < nmsgs && ok; i++) {
+          ipc::mcast_buffer buf = consumer.receive(std::chrono::seconds(10));
+          ok = buf && buf.size() == sizeof(i) &&
+               std::memcmp(buf.data(), &i, sizeof(i)) == 0;
+        }
+      }
+      _exit(ok ? 0 : 1);
+    }
+  }
+  uint32_t ids[2];
+  for (auto &id : ids) {
+    REQUIRE(read(fds[0], &id, sizeof(id)) == sizeof(id));
+  }
+  for (uint32_t i = 0; i < nmsgs; i++) {
+    ipc::mcast_buffer buf;
+    while (!(buf = producer.allocate(ec))) {
+      std::this_thread::yield();
+    }
+    std::memcpy(buf.data(), &i, sizeof(i));
+    buf.resize(sizeof(i));
+    for (uint32_t id : ids) {
+      producer.publish(buf, id, ec);
+      while (ec == IPCErrc::McastQueueFull) {
+        std::this_thread::yield();
+        producer.publish(buf, id, ec);
+      }
+      REQUIRE_FALSE(ec);
+    }
+  }
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
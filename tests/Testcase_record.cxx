@@ -0,0 +1,203 @@
+#include "mcast_pool.hpp"
+#include "record.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+const std::vector<ipc::field_def> ORDER = {
+    {"id", ipc::field_type::UINT64},
+    {"side", ipc::field_type::INT8},
+    {"symbol", ipc::field_type::STRING},
+    {"price", ipc::field_type::FLOAT64},
+    {"qty", ipc::field_type::INT32},
+    {"fills", ipc::field_type::ARRAY, ipc::field_type::INT32},
+    {"live", ipc::field_type::BOOL},
+};
+} // namespace
+
+TEST_CASE("fields are read in place", "[record]") {
+  ipc::record_schema schema(ORDER);
+  REQUIRE(schema.nfields() == 7);
+  REQUIRE(schema.find("price") == 3);
+  REQUIRE(schema.find("venue") == ipc::record_schema::npos);
+  REQUIRE(schema.field_name(5) == "fills");
+  REQUIRE(schema.elem(5) == ipc::field_type::INT32);
+  REQUIRE(schema.type(7) == ipc::field_type::NONE);
+  REQUIRE(schema.elem(7) == ipc::field_type::NONE);
+  REQUIRE(schema.offset(7) == 0);
+  REQUIRE(ipc::record_schema().type(0) == ipc::field_type::NONE);
+  REQUIRE(schema.inline_size() % 8 == 0);
+  for (size_t i = 0; i < schema.nfields(); i++) {
+    size_t align = schema.type(i) == ipc::field_type::FLOAT64 ? 8 : 4;
+    if (schema.type(i) == ipc::field_type::INT8 ||
+        schema.type(i) == ipc::field_type::BOOL) {
+      align = 1;
+    }
+    REQUIRE(schema.offset(i) % align == 0);
+  }
+
+  alignas(8) char buf[256];
+  std::memset(buf, 0xee, sizeof(buf));
+  ipc::record_builder builder(schema, buf, sizeof(buf));
+  builder.set<uint64_t>(0, 42);
+  builder.set<int8_t>(1, -1);
+  builder.set_string(2, "IPC");
+  builder.set<double>(3, 99.5);
+  int32_t *fills = builder.reserve_array<int32_t>(5, 3);
+  REQUIRE(fills);
+  fills[0] = 10;
+  fills[1] = 20;
+  fills[2] = 30;
+  size_t size = builder.finish();
+  REQUIRE(size == builder.size());
+  REQUIRE(size % 8 == 0);
+  REQUIRE(size < sizeof(buf));
+
+  ipc::record_view view(schema, buf, size);
+  REQUIRE(view.size() == size);
+  REQUIRE(view.get<uint64_t>(0) == 42);
+  REQUIRE(view.get<int8_t>(1) == -1);
+  REQUIRE(view.string(2) == "IPC");
+  REQUIRE(view.string(2).data()[3] == '\0');
+  REQUIRE(view.get<double>(3) == 99.5);
+  // fields never set read as zero
+  REQUIRE(view.get<int32_t>(4) == 0);
+  REQUIRE_FALSE(view.get<bool>(6));
+  ipc::record_array<int32_t> arr = view.array<int32_t>(5);
+  REQUIRE(arr.size() == 3);
+  REQUIRE(arr[2] == 30);
+  REQUIRE(reinterpret_cast<uintptr_t>(arr.data()) % 8 == 0);
+  // no copy, the values are the bytes of the buffer
+  REQUIRE(static_cast<const void *>(arr.data()) > static_cast<void *>(buf));
+  REQUIRE(static_cast<const void *>(arr.end()) <=
+          static_cast<void *>(buf + size));
+  // asked with the wrong type, the accessors return nothing
+  REQUIRE(view.get<int64_t>(0) == 0);
+  REQUIRE(view.string(3).empty());
+  REQUIRE(view.array<int64_t>(5).empty());
+  REQUIRE(view.get<uint64_t>(100) == 0);
+
+  // the record is relative to its begining and can be copied as is
+  alignas(8) char copy[256];
+  std::memcpy(copy, buf, size);
+  ipc::record_view moved(schema, copy, size);
+  REQUIRE(moved.string(2) == "IPC");
+  REQUIRE(moved.array<int32_t>(5)[0] == 10);
+}
+
+TEST_CASE("builder and view errors", "[record]") {
+  std::error_code ec;
+  ipc::record_schema bad({{"a", ipc::field_type::INT32},
+                          {"a", ipc::field_type::INT64}},
+                         ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+  ipc::record_schema({{"a", ipc::field_type::ARRAY, ipc::field_type::STRING}},
+                     ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+  ipc::record_schema schema(ORDER);
+
+  alignas(8) char buf[128];
+  {
+    ipc::record_builder builder(schema, buf, sizeof(buf));
+    builder.set<int64_t>(0, 1);
+    REQUIRE(builder.finish(ec) == 0);
+    REQUIRE(ec == std::errc::invalid_argument);
+  }
+  {
+    ipc::record_builder builder(schema, buf, sizeof(buf));
+    builder.set_string(2, std::string(128, 'x'));
+    builder.set<uint64_t>(0, 1);
+    builder.finish(ec);
+    REQUIRE(ec == IPCErrc::RecordOverflow);
+  }
+  {
+    ipc::record_builder builder(schema, buf, schema.inline_size() - 1);
+    builder.finish(ec);
+    REQUIRE(ec == IPCErrc::RecordOverflow);
+  }
+  {
+    ipc::record_builder builder(schema, buf + 4, 64);
+    builder.finish(ec);
+    REQUIRE(ec == std::errc::invalid_argument);
+  }
+
+  ipc::record_builder builder(schema, buf, sizeof(buf));
+  builder.set_string(2, "IPC");
+  size_t size = builder.finish(ec);
+  REQUIRE_FALSE(ec);
+  ipc::record_view unset(schema, buf, size, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(unset.array<int32_t>(5).empty());
+  ipc::record_view(schema, buf, size - 8, ec);
+  REQUIRE(ec == IPCErrc::RecordMismatch);
+
+  // same field names, different types
+  std::vector<ipc::field_def> fields = ORDER;
+  fields[4].type_ = ipc::field_type::INT64;
+  ipc::record_schema other(fields);
+  ipc::record_view view(other, buf, size, ec);
+  REQUIRE(ec == IPCErrc::RecordMismatch);
+  REQUIRE_FALSE(view);
+
+  // a string offset pointing past the record
+  uint32_t offset = size;
+  std::memcpy(buf + schema.offset(2), &offset, sizeof(offset));
+  ipc::record_view(schema, buf, size, ec);
+  REQUIRE(ec == IPCErrc::RecordMismatch);
+}
+
+TEST_CASE("records are read in place by another process", "[mcast]") {
+  std::error_code ec;
+  ipc::record_schema schema(ORDER);
+  ipc::mcast_pool producer(ipc::create_only, "test", 8, 256, 2, 8, ec);
+  REQUIRE_FALSE(ec);
+
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    bool ok = true;
+    {
+      ipc::mcast_pool consumer(ipc::open_only, "test");
+      for (uint64_t i = 0; ok && i < 100; i++) {
+        ipc::mcast_buffer buf;
+        while (!(buf = consumer.receive(std::chrono::milliseconds(100)))) {
+        }
+        ipc::record_view view(schema, buf.data(), buf.size(), ec);
+        ipc::record_array<int32_t> fills = view.array<int32_t>(5);
+        ok = !ec && view.get<uint64_t>(0) == i &&
+             view.string(2) == std::to_string(i) &&
+             fills.size() == i % 4 && view.get<bool>(6) == (i % 2 == 0);
+        for (size_t j = 0; ok && j < fills.size(); j++) {
+          ok = fills[j] == int32_t(i + j);
+        }
+      }
+    }
+    _exit(ok ? 0 : 1);
+  }
+
+  for (uint64_t i = 0; i < 100; i++) {
+    ipc::mcast_buffer buf;
+    while (!(buf = producer.allocate(ec))) {
+      producer.reclaim();
+      usleep(100);
+    }
+    ipc::record_builder builder(schema, buf.data(), buf.capacity());
+    builder.set<uint64_t>(0, i);
+    builder.set_string(2, std::to_string(i));
+    builder.set<bool>(6, i % 2 == 0);
+    int32_t *fills = builder.reserve_array<int32_t>(5, i % 4);
+    for (size_t j = 0; j < i % 4; j++) {
+      fills[j] = int32_t(i + j);
+    }
+    buf.resize(uint32_t(builder.finish()));
+    while (producer.broadcast(buf) == 0) {
+      usleep(100);
+    }
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+}
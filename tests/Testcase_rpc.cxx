@@ -0,0 +1,171 @@
+#include "rpc.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+constexpr uint32_t ECHO = 1;
+constexpr uint32_t ADD = 2;
+
+size_t handler(uint32_t method, const void *data, size_t size, void *resp,
+               size_t cap) {
+  if (method == ADD) {
+    uint64_t a, b;
+    std::memcpy(&a, data, 8);
+    std::memcpy(&b, static_cast<const char *>(data) + 8, 8);
+    uint64_t sum = a + b;
+    std::memcpy(resp, &sum, 8);
+    return 8;
+  }
+  std::memcpy(resp, data, size < cap ? size : cap);
+  return size;
+}
+
+// serve until no request arrives for 200ms
+pid_t fork_server(ipc::rpc_wait mode) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    {
+      ipc::rpc_channel server(ipc::open_only, "test", mode);
+      server.serve(handler, std::chrono::milliseconds(200));
+    }
+    _exit(0);
+  }
+  return pid;
+}
+
+void join(pid_t pid) {
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+}
+} // namespace
+
+TEST_CASE("call and receive in one process", "[rpc]") {
+  std::error_code ec;
+  ipc::rpc_channel client(ipc::create_only, "test", 4, 128, ec);
+  REQUIRE_FALSE(ec);
+  ipc::rpc_channel server(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(server.nslots() == 4);
+  REQUIRE(server.max_payload() == 128);
+
+  ipc::rpc_ticket t = client.call_async(ECHO, "hello", 6, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE_FALSE(client.ready(t));
+
+  ipc::rpc_request req;
+  REQUIRE(server.receive(req, ec, std::chrono::milliseconds(0)));
+  REQUIRE(req.method_ == ECHO);
+  REQUIRE(req.id_ == t.id_);
+  REQUIRE(req.size_ == 6);
+  REQUIRE(std::strcmp(static_cast<const char *>(req.data_), "hello") == 0);
+  std::memcpy(req.resp_, "world!", 7);
+  server.reply(req, 7);
+  REQUIRE(client.ready(t));
+
+  char resp[16];
+  REQUIRE(client.wait(t, resp, sizeof(resp), ec) == 7);
+  REQUIRE_FALSE(ec);
+  REQUIRE(std::strcmp(resp, "world!") == 0);
+
+  // nothing left to serve
+  REQUIRE_FALSE(server.receive(req, ec, std::chrono::milliseconds(10)));
+  REQUIRE(ec == std::errc::timed_out);
+}
+
+TEST_CASE("rejected calls", "[rpc]") {
+  std::error_code ec;
+  ipc::rpc_channel client(ipc::create_only, "test", 2, 16, ec);
+  REQUIRE_FALSE(ec);
+
+  char big[17] = {};
+  client.call_async(ECHO, big, sizeof(big), ec);
+  REQUIRE(ec == std::errc::message_size);
+
+  ec.clear();
+  ipc::rpc_ticket t1 = client.call_async(ECHO, "a", 2, ec);
+  client.call_async(ECHO, "b", 2, ec);
+  REQUIRE_FALSE(ec);
+  client.call_async(ECHO, "c", 2, ec);
+  REQUIRE(ec == IPCErrc::RpcNoFreeSlot);
+
+  // no server, the call stays in flight after a timeout
+  ec.clear();
+  char resp[16];
+  client.wait(t1, resp, sizeof(resp), ec, std::chrono::milliseconds(20));
+  REQUIRE(ec == std::errc::timed_out);
+  REQUIRE_THROWS(client.wait(t1, resp, sizeof(resp),
+                             std::chrono::milliseconds(1)));
+
+  // waited for again once answered, the earlier timeout is not reported
+  ipc::rpc_channel server(ipc::open_only, "test");
+  ipc::rpc_request req;
+  REQUIRE(server.receive(req, ec, std::chrono::milliseconds(0)));
+  REQUIRE_FALSE(ec);
+  server.reply(req, 0);
+  ec = std::make_error_code(std::errc::timed_out);
+  REQUIRE(client.wait(t1, resp, sizeof(resp), ec) == 0);
+  REQUIRE_FALSE(ec);
+
+  // t1 was collected, waiting for it again fails instead of spinning
+  client.wait(t1, resp, sizeof(resp), ec, std::chrono::milliseconds(100));
+  REQUIRE(ec == std::errc::invalid_argument);
+  // nor does it take the response of the call now using its slot
+  ipc::rpc_ticket t3 = client.call_async(ECHO, "c", 2, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(t3.slot_ == t1.slot_);
+  REQUIRE(server.receive(req, ec, std::chrono::milliseconds(0)));
+  server.reply(req, 0);
+  REQUIRE(server.receive(req, ec, std::chrono::milliseconds(0)));
+  std::memcpy(req.resp_, "c", 2);
+  server.reply(req, 2);
+  client.wait(t1, resp, sizeof(resp), ec, std::chrono::milliseconds(100));
+  REQUIRE(ec == std::errc::invalid_argument);
+  REQUIRE(client.wait(t3, resp, sizeof(resp), ec) == 2);
+  REQUIRE_FALSE(ec);
+  REQUIRE(std::strcmp(resp, "c") == 0);
+}
+
+TEST_CASE("calls across processes", "[rpc]") {
+  for (auto mode : {ipc::rpc_wait::futex, ipc::rpc_wait::poll}) {
+    std::error_code ec;
+    ipc::rpc_channel client(ipc::create_only, "test", 8, 256, ec, mode);
+    REQUIRE_FALSE(ec);
+    pid_t pid = fork_server(mode);
+    REQUIRE(pid != -1);
+
+    for (uint64_t i = 0; i < 1000; i++) {
+      uint64_t args[2] = {i, 2 * i};
+      uint64_t sum = 0;
+      REQUIRE(client.call(ADD, args, sizeof(args), &sum, sizeof(sum)) == 8);
+      REQUIRE(sum == 3 * i);
+    }
+    join(pid);
+  }
+}
+
+TEST_CASE("pipelined calls complete out of order", "[rpc]") {
+  std::error_code ec;
+  ipc::rpc_channel client(ipc::create_only, "test", 16, 64, ec);
+  REQUIRE_FALSE(ec);
+  pid_t pid = fork_server(ipc::rpc_wait::futex);
+  REQUIRE(pid != -1);
+
+  for (int round = 0; round < 100; round++) {
+    ipc::rpc_ticket tickets[16];
+    for (uint64_t i = 0; i < 16; i++) {
+      uint64_t args[2] = {i, uint64_t(round)};
+      tickets[i] = client.call_async(ADD, args, sizeof(args));
+    }
+    for (int i = 15; i >= 0; i--) {
+      uint64_t sum = 0;
+      REQUIRE(client.wait(tickets[i], &sum, sizeof(sum)) == 8);
+      REQUIRE(sum == uint64_t(i + round));
+    }
+  }
+  join(pid);
+}
@@ -90,4 +90,30 @@ TEST_CASE("wait/post in different process", "[wait]") {
   REQUIRE(val == 0);
   val = hdl2.value(ec);
   REQUIRE(val == 0);
-}
\ No newline at end of file
+}
+TEST_CASE("move construct/assign semhdl", "[move]") {
+  std::error_code ec;
+  ipc::semhdl hdl("test", 1, ec);
+  REQUIRE_FALSE(ec);
+
+  ipc::semhdl moved(std::move(hdl));
+  REQUIRE_FALSE(hdl.valid());
+  REQUIRE(hdl.name().empty());
+  hdl.post(ec);
+  REQUIRE(ec);
+  REQUIRE(moved.valid());
+  REQUIRE(moved.name().compare("test") == 0);
+  REQUIRE(moved.value() == 1);
+
+  std::vector<ipc::semhdl> hdls;
+  hdls.emplace_back(std::move(moved));
+  hdls.emplace_back("test2", 0, ec);
+  REQUIRE_FALSE(ec);
+  hdls[0].wait(ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(hdls[0].value() == 0);
+
+  hdl = std::move(hdls[1]);
+  REQUIRE(hdl.name().compare("test2") == 0);
+  REQUIRE(hdl.value() == 0);
+}
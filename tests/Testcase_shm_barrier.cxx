@@ -0,0 +1,104 @@
+#include "shm_barrier.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+struct progress_t {
+  std::atomic<uint32_t> arrived;
+};
+} // namespace
+
+TEST_CASE("single party never waits", "[local]") {
+  std::error_code ec;
+  ipc::shm_barrier barrier(ipc::create_only, "test", 1, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(barrier.nparties() == 1);
+  REQUIRE(barrier.phase() == 0);
+  REQUIRE(barrier.arrive_and_wait() == 1);
+  REQUIRE(barrier.arrive_and_wait() == 2);
+  REQUIRE(barrier.phase() == 2);
+}
+
+TEST_CASE("zero parties is rejected", "[local]") {
+  std::error_code ec;
+  ipc::shm_barrier barrier(ipc::create_only, "test", 0, ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+  REQUIRE_FALSE(barrier);
+  REQUIRE_THROWS_AS(ipc::shm_barrier(ipc::create_only, "test", 0),
+                    std::runtime_error);
+}
+
+TEST_CASE("unmapped barrier does nothing", "[local]") {
+  ipc::shm_barrier barrier;
+  REQUIRE(barrier.arrive() == 0);
+  REQUIRE_FALSE(barrier.wait(0));
+  REQUIRE(barrier.arrive_and_wait() == 0);
+  REQUIRE(barrier.phase() == 0);
+}
+
+TEST_CASE("split phase completes once everybody arrived", "[local]") {
+  std::error_code ec;
+  ipc::shm_barrier a(ipc::create_only, "test", 2, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shm_barrier b(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(b.nparties() == 2);
+
+  uint32_t token = a.arrive();
+  REQUIRE_FALSE(a.wait(token, std::chrono::milliseconds(10)));
+  REQUIRE(a.phase() == 0);
+  // still counted after the timeout
+  uint32_t other = b.arrive();
+  REQUIRE(other == token);
+  REQUIRE(a.wait(token, std::chrono::milliseconds(10)));
+  REQUIRE(b.wait(other));
+  REQUIRE(a.phase() == 1);
+}
+
+TEST_CASE("processes advance in lockstep", "[concurrent]") {
+  constexpr uint32_t nprocs = 4;
+  constexpr uint32_t nphases = 2000;
+  std::error_code ec;
+  ipc::shm_barrier barrier(ipc::create_only, "test", nprocs, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shm_object<progress_t> progress(ipc::create_only, "test_progress", ec);
+  REQUIRE_FALSE(ec);
+
+  // nobody may leave phase n before all parties arrived in it, nor arrive in
+  // phase n + 2 before everybody left phase n
+  auto run = [&](ipc::shm_barrier &bar, progress_t &p) {
+    int bad = 0;
+    for (uint32_t i = 0; i < nphases; i++) {
+      uint32_t before = p.arrived.fetch_add(1, std::memory_order_relaxed);
+      bad += before >= (i + 1) * nprocs;
+      bar.arrive_and_wait();
+      bad += p.arrived.load(std::memory_order_relaxed) < (i + 1) * nprocs;
+    }
+    return bad;
+  };
+
+  pid_t pids[nprocs - 1];
+  for (auto &pid : pids) {
+    pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      int bad;
+      {
+        ipc::shm_barrier bar(ipc::open_only, "test");
+        ipc::shm_object<progress_t> p(ipc::open_only, "test_progress");
+        bad = run(bar, *p);
+      }
+      _exit(bad ? 1 : 0);
+    }
+  }
+  REQUIRE(run(barrier, *progress) == 0);
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+  }
+  REQUIRE(barrier.phase() == nphases);
+  REQUIRE(progress->arrived.load() == nprocs * nphases);
+}
@@ -0,0 +1,147 @@
+#include "shm_cache.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+// large enough that a torn read would be noticed
+struct record_t {
+  uint64_t key;
+  uint64_t check[15];
+};
+
+record_t make_record(uint64_t key, uint64_t version) {
+  record_t r{key, {}};
+  for (auto &c : r.check) {
+    c = key * 31 + version;
+  }
+  return r;
+}
+
+bool consistent(uint64_t key, const record_t &r) {
+  for (auto c : r.check) {
+    if (r.key != key || c != r.check[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+TEST_CASE("put, get, update and erase", "[local]") {
+  std::error_code ec;
+  ipc::shm_cache<uint64_t, double> cache(ipc::create_only, "test", 100, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(cache.capacity() == 104);
+  ipc::shm_cache<uint64_t, double> other(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+
+  double v;
+  REQUIRE_FALSE(other.get(1, v));
+  cache.put(1, 1.5);
+  cache.put(2, 2.5);
+  REQUIRE(other.get(1, v));
+  REQUIRE(v == 1.5);
+  cache.put(1, 3.5);
+  REQUIRE(other.get(1, v));
+  REQUIRE(v == 3.5);
+  REQUIRE(other.erase(1));
+  REQUIRE_FALSE(other.erase(1));
+  REQUIRE_FALSE(cache.get(1, v));
+  REQUIRE(cache.get(2, v));
+  REQUIRE(v == 2.5);
+
+  REQUIRE(other.stats().hits_ == 2);
+  REQUIRE(other.stats().misses_ == 1);
+  REQUIRE(cache.stats().hit_rate() == Approx(0.5));
+
+  int loads = 0;
+  auto load = [&](uint64_t k) {
+    loads++;
+    return double(k) * 2;
+  };
+  REQUIRE(other.get_or_load(7, load) == 14.0);
+  REQUIRE(cache.get_or_load(7, load) == 14.0);
+  REQUIRE(loads == 1);
+}
+
+TEST_CASE("clock keeps recently read entries", "[evict]") {
+  std::error_code ec;
+  // a single set, every key competes for the same ways
+  using cache_t = ipc::shm_cache<uint64_t, uint64_t>;
+  cache_t cache(ipc::create_only, "test", cache_t::WAYS, ec);
+  REQUIRE_FALSE(ec);
+  for (uint64_t k = 0; k < cache_t::WAYS; k++) {
+    cache.put(k, k);
+  }
+  uint64_t v;
+  for (uint64_t k = 0; k < cache_t::WAYS / 2; k++) {
+    REQUIRE(cache.get(k, v));
+  }
+  for (uint64_t k = 100; k < 100 + cache_t::WAYS / 2; k++) {
+    cache.put(k, k);
+  }
+  REQUIRE(cache.stats().evictions_ == cache_t::WAYS / 2);
+  for (uint64_t k = 0; k < cache_t::WAYS / 2; k++) {
+    REQUIRE(cache.get(k, v));
+    REQUIRE(v == k);
+  }
+  for (uint64_t k = cache_t::WAYS / 2; k < cache_t::WAYS; k++) {
+    REQUIRE_FALSE(cache.get(k, v));
+  }
+}
+
+TEST_CASE("attaching with other types fails", "[layout]") {
+  std::error_code ec;
+  ipc::shm_cache<uint64_t, double> cache(ipc::create_only, "test", 64, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shm_cache<uint64_t, float> other(ipc::open_only, "test", ec);
+  REQUIRE(ec == IPCErrc::ShmLayoutMismatch);
+  REQUIRE_FALSE(other);
+}
+
+TEST_CASE("concurrent writers never tear reads", "[concurrent]") {
+  constexpr int nprocs = 3;
+  constexpr uint64_t nkeys = 64;
+  constexpr int rounds = 20000;
+  std::error_code ec;
+  // fewer entries than keys, so evictions race with lookups too
+  ipc::shm_cache<uint64_t, record_t> cache(ipc::create_only, "test", 32, ec);
+  REQUIRE_FALSE(ec);
+
+  auto run = [&](ipc::shm_cache<uint64_t, record_t> &c, uint64_t seed) {
+    int bad = 0;
+    record_t r;
+    for (int i = 0; i < rounds; i++) {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      uint64_t key = (seed >> 33) % nkeys;
+      if (c.get(key, r)) {
+        bad += !consistent(key, r);
+      } else {
+        c.put(key, make_record(key, seed >> 40));
+      }
+    }
+    return bad;
+  };
+
+  pid_t pids[nprocs];
+  for (int p = 0; p < nprocs; p++) {
+    pids[p] = fork();
+    REQUIRE(pids[p] != -1);
+    if (pids[p] == 0) {
+      int bad;
+      {
+        ipc::shm_cache<uint64_t, record_t> c(ipc::open_only, "test");
+        bad = run(c, uint64_t(p) + 1);
+      }
+      _exit(bad ? 1 : 0);
+    }
+  }
+  REQUIRE(run(cache, 42) == 0);
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+  }
+}
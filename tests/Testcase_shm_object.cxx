@@ -0,0 +1,174 @@
+#include "shm_object.hpp"
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+struct point_t {
+  double x;
+  double y;
+};
+
+struct record_t {
+  std::atomic<uint32_t> counter;
+  char name[16];
+  point_t points[4];
+};
+
+struct other_record_t {
+  std::atomic<uint32_t> counter;
+  char name[16];
+  point_t points[4];
+};
+
+// same size and fields as record_t, reordered
+struct swapped_record_t {
+  std::atomic<uint32_t> counter;
+  point_t points[4];
+  char name[16];
+};
+
+struct int_pair_t {
+  int32_t a;
+  int32_t b;
+};
+
+struct mixed_pair_t {
+  int32_t a;
+  float b;
+};
+
+struct with_ptr_t {
+  int a;
+  const char *name;
+};
+
+struct with_nested_ptr_t {
+  int a;
+  struct {
+    int b;
+    int *p;
+  } nested;
+};
+
+struct with_ptr_array_t {
+  void *ptrs[4];
+};
+
+class non_aggregate_t {
+public:
+  explicit non_aggregate_t(int v) noexcept : v_(v) {}
+  int value() const noexcept { return v_; }
+
+private:
+  int v_;
+};
+} // namespace
+
+static_assert(ipc::is_shm_safe_v<point_t>);
+static_assert(ipc::is_shm_safe_v<record_t>);
+static_assert(ipc::is_shm_safe_v<non_aggregate_t>);
+static_assert(ipc::is_shm_safe_v<std::atomic<uint64_t>>);
+static_assert(!ipc::is_shm_safe_v<with_ptr_t>);
+static_assert(!ipc::is_shm_safe_v<with_nested_ptr_t>);
+static_assert(!ipc::is_shm_safe_v<with_ptr_array_t>);
+static_assert(!ipc::is_shm_safe_v<std::atomic<int *>>);
+static_assert(ipc::shm_object<record_t>::layout_hash !=
+              ipc::shm_object<other_record_t>::layout_hash);
+// the type names differ, compare what is hashed besides them
+template <typename T> constexpr uint64_t fields_hash() {
+  constexpr size_t n = ipc::detail::aggregate_field_count<T>();
+  return ipc::detail::fields_hash<T, n>(0, std::make_index_sequence<n>{});
+}
+static_assert(fields_hash<record_t>() == fields_hash<other_record_t>());
+static_assert(fields_hash<record_t>() != fields_hash<swapped_record_t>());
+static_assert(sizeof(int_pair_t) == sizeof(mixed_pair_t));
+static_assert(fields_hash<int_pair_t>() != fields_hash<mixed_pair_t>());
+
+TEST_CASE("create shm_object and attach to it", "[create]") {
+  std::error_code ec;
+  ipc::shm_object<record_t> svr(ipc::create_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(svr.valid());
+  REQUIRE(size_t(svr.handle().nbytes()) >= sizeof(record_t));
+  REQUIRE(reinterpret_cast<uintptr_t>(svr.get()) % alignof(record_t) == 0);
+  svr->counter = 42;
+  std::strcpy(svr->name, "svr");
+  svr->points[3] = {1.0, 2.0};
+
+  ipc::shm_object<record_t> clt(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(clt->counter == 42);
+  REQUIRE(std::strcmp(clt->name, "svr") == 0);
+  REQUIRE(clt->points[3].y == 2.0);
+  clt->counter++;
+  REQUIRE(svr->counter == 43);
+}
+
+TEST_CASE("create shm_object with constructor arguments", "[create]") {
+  std::error_code ec;
+  ipc::shm_object<non_aggregate_t> svr(ipc::create_only, "test", ec, 7);
+  REQUIRE_FALSE(ec);
+  ipc::shm_object<non_aggregate_t> clt(ipc::open_only, "test");
+  REQUIRE(clt->value() == 7);
+  REQUIRE_THROWS(ipc::shm_object<non_aggregate_t>(ipc::create_only, "test", 8));
+}
+
+TEST_CASE("attach shm_object with a different layout", "[attach]") {
+  std::error_code ec;
+  ipc::shm_object<record_t> svr(ipc::create_only, "test", ec);
+  REQUIRE_FALSE(ec);
+
+  // same size, different type
+  ipc::shm_object<other_record_t> clt1(ipc::open_only, "test", ec);
+  REQUIRE(ec == IPCErrc::ShmLayoutMismatch);
+  REQUIRE_FALSE(clt1.valid());
+
+  ipc::shm_object<point_t> clt2(ipc::open_only, "test", ec);
+  REQUIRE(ec == IPCErrc::ShmLayoutMismatch);
+  REQUIRE(svr.handle().ref_count() == 1);
+}
+
+TEST_CASE("attach shm_object before it is initialized", "[attach]") {
+  std::error_code ec;
+  shmsz_t nbytes =
+      ipc::shm_object<record_t>(ipc::create_only, "probe").handle().nbytes();
+  ipc::shmhdl raw("test", nbytes, ec);
+  REQUIRE_FALSE(ec);
+
+  ipc::shm_object<record_t> clt(ipc::open_only, "test", ec, 50ms);
+  REQUIRE(ec == IPCErrc::ShmNotInitialized);
+  REQUIRE_FALSE(clt.valid());
+}
+
+TEST_CASE("attach shm_object to a foreign segment", "[attach]") {
+  std::error_code ec;
+  for (shmsz_t nbytes : {0, 1, 4096}) {
+    ipc::shmhdl raw("test", nbytes, ec);
+    REQUIRE_FALSE(ec);
+    // rejected right away, without waiting for the timeout
+    auto start = std::chrono::steady_clock::now();
+    ipc::shm_object<record_t> clt(ipc::open_only, "test", ec, 1000ms);
+    REQUIRE(ec == IPCErrc::ShmLayoutMismatch);
+    REQUIRE(std::chrono::steady_clock::now() - start < 500ms);
+    REQUIRE_FALSE(clt.valid());
+  }
+}
+
+TEST_CASE("attacher waits for the creator", "[attach]") {
+  std::error_code ec;
+  std::thread t([]() {
+    std::this_thread::sleep_for(100ms);
+    ipc::shm_object<point_t> svr(ipc::create_only, "test", point_t{1.0, 2.0});
+    std::this_thread::sleep_for(300ms);
+  });
+  ipc::shm_object<point_t> clt;
+  while (!clt.valid()) {
+    clt = ipc::shm_object<point_t>(ipc::open_only, "test", ec, 1000ms);
+  }
+  REQUIRE(clt->x == 1.0);
+  REQUIRE(clt->y == 2.0);
+  t.join();
+}
@@ -0,0 +1,133 @@
+#include "shm_pool.hpp"
+#include <algorithm>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <thread>
+
+namespace {
+size_t count_segments(std::string_view prefix) {
+  size_t n = 0;
+  DIR *dir = opendir("/dev/shm");
+  while (auto ent = readdir(dir)) {
+    n += std::string_view(ent->d_name).substr(0, prefix.size()) == prefix;
+  }
+  closedir(dir);
+  return n;
+}
+} // namespace
+
+TEST_CASE("spares are handed out under the requested name", "[acquire]") {
+  std::error_code ec;
+  ipc::shm_pool pool("pool", {4096, 65536}, 2, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(pool.spares(4096) == 0);
+  pool.fill();
+  REQUIRE(pool.spares(4096) == 2);
+  REQUIRE(pool.spares(65536) == 2);
+  REQUIRE(count_segments("pool.") == 4);
+
+  ipc::shmhdl hdl = pool.acquire("test", 1000, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(hdl.name() == "test");
+  REQUIRE(hdl.nbytes() == 4096);
+  REQUIRE(hdl.addr() != nullptr);
+  REQUIRE(pool.spares(4096) == 1);
+  REQUIRE(count_segments("pool.") == 3);
+
+  std::memcpy(hdl.addr(), "hello", 6);
+  ipc::shmhdl other("test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(other.nbytes() == 4096);
+  REQUIRE(std::strcmp(static_cast<char *>(other.map()), "hello") == 0);
+  REQUIRE(hdl.ref_count() == 2);
+
+  // the name is taken, the spare stays in the pool
+  pool.acquire("test", 1000, ec);
+  REQUIRE(ec == std::errc::file_exists);
+  REQUIRE(pool.spares(4096) == 1);
+
+  ipc::shmhdl anon = pool.acquire(5000, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(anon.nbytes() == 65536);
+  REQUIRE(anon.name().substr(0, 5) == "pool.");
+
+  REQUIRE(pool.stats().hits_ == 2);
+  REQUIRE(pool.stats().misses_ == 0);
+}
+
+TEST_CASE("without a spare the segment is created", "[acquire]") {
+  std::error_code ec;
+  ipc::shm_pool pool("pool", {4096}, 1, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shmhdl small = pool.acquire("test", 100, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(small.nbytes() == 100);
+  ipc::shmhdl large = pool.acquire("test2", 8192, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(large.nbytes() == 8192);
+  REQUIRE(pool.stats().misses_ == 2);
+}
+
+TEST_CASE("recycled segments come back zeroed", "[recycle]") {
+  std::error_code ec;
+  ipc::shm_pool pool("pool", {4096}, 1, ec);
+  REQUIRE_FALSE(ec);
+  pool.fill();
+  ipc::shmhdl hdl = pool.acquire("test", 4096);
+  std::memset(hdl.addr(), 0xab, 4096);
+
+  {
+    ipc::shmhdl other("test");
+    REQUIRE_FALSE(pool.recycle(other));
+  }
+  ipc::shmhdl unpooled("test2", 100);
+  REQUIRE_FALSE(pool.recycle(unpooled));
+  REQUIRE(unpooled);
+
+  REQUIRE(pool.recycle(hdl));
+  REQUIRE_FALSE(hdl);
+  REQUIRE(pool.stats().recycled_ == 1);
+  // the name is free again
+  ipc::shmhdl gone("test", ec);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+
+  pool.fill();
+  // the spare created by the first fill(), then the recycled one
+  ipc::shmhdl a = pool.acquire("test", 4096);
+  REQUIRE(pool.spares(4096) == 0);
+  pool.fill();
+  REQUIRE(pool.spares(4096) == 1);
+  ipc::shmhdl b = pool.acquire("test3", 4096);
+  for (auto p : {a.addr(), b.addr()}) {
+    auto bytes = static_cast<unsigned char *>(p);
+    REQUIRE(std::all_of(bytes, bytes + 4096, [](auto c) { return c == 0; }));
+  }
+}
+
+TEST_CASE("the background thread keeps the pool filled", "[background]") {
+  std::error_code ec;
+  size_t before = count_segments("pool.");
+  {
+    ipc::shm_pool pool("pool", {4096, 1 << 20}, 4, ec);
+    REQUIRE_FALSE(ec);
+    pool.start();
+    std::vector<ipc::shmhdl> hdls;
+    for (int i = 0; i < 16; i++) {
+      hdls.push_back(pool.acquire("test" + std::to_string(i), 1 << 20));
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pool.spares(1 << 20) < 4 &&
+           std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(pool.spares(1 << 20) == 4);
+    REQUIRE(pool.spares(4096) == 4);
+    REQUIRE(pool.stats().hits_ + pool.stats().misses_ == 16);
+    REQUIRE_FALSE(pool.last_error());
+    pool.stop();
+  }
+  // the spares are unlinked with the pool
+  REQUIRE(count_segments("pool.") == before);
+}
@@ -0,0 +1,143 @@
+#include "shm_rwlock.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+struct pair_t {
+  // written under the write lock, always equal under the read lock
+  std::atomic<uint64_t> a;
+  std::atomic<uint64_t> b;
+};
+} // namespace
+
+TEST_CASE("readers share, writers exclude", "[local]") {
+  std::error_code ec;
+  ipc::shm_rwlock lock(ipc::create_only, "test", ec, 4);
+  REQUIRE_FALSE(ec);
+  ipc::shm_rwlock other(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(other.nslots() == 4);
+  REQUIRE(other.prefer() == ipc::rw_prefer::writer);
+
+  lock.lock_shared();
+  REQUIRE(other.try_lock_shared());
+  REQUIRE_FALSE(other.try_lock());
+  other.unlock_shared();
+  lock.unlock_shared();
+
+  REQUIRE(other.try_lock());
+  REQUIRE_FALSE(lock.try_lock_shared());
+  REQUIRE_FALSE(lock.try_lock());
+  other.unlock();
+  lock.lock();
+  lock.unlock();
+  REQUIRE(lock.try_lock_shared());
+  lock.unlock_shared();
+}
+
+TEST_CASE("reader slots are bounded", "[local]") {
+  std::error_code ec;
+  ipc::shm_rwlock none(ipc::create_only, "test", ec, 0);
+  REQUIRE(ec == std::errc::invalid_argument);
+  ec.clear();
+  ipc::shm_rwlock many(ipc::create_only, "test", ec,
+                       ipc::shm_rwlock::MAX_SLOTS + 1);
+  REQUIRE(ec == std::errc::invalid_argument);
+  REQUIRE_THROWS_AS(ipc::shm_rwlock(ipc::create_only, "test", 0),
+                    std::runtime_error);
+}
+
+TEST_CASE("unmapped rwlock does nothing", "[local]") {
+  ipc::shm_rwlock lock;
+  lock.lock();
+  lock.unlock();
+  REQUIRE_FALSE(lock.try_lock());
+  lock.lock_shared();
+  lock.unlock_shared();
+  REQUIRE_FALSE(lock.try_lock_shared());
+  REQUIRE(lock.nslots() == 0);
+}
+
+TEST_CASE("waiting writer keeps new readers out", "[prefer]") {
+  std::error_code ec;
+  ipc::shm_rwlock lock(ipc::create_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  lock.lock_shared();
+  std::atomic<bool> locked{false};
+  std::thread writer([&] {
+    lock.lock();
+    locked = true;
+    lock.unlock();
+  });
+
+  // once the writer waits, readers are turned away
+  bool turned_away = false;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  std::thread reader([&] {
+    while (!turned_away && std::chrono::steady_clock::now() < deadline) {
+      if (lock.try_lock_shared()) {
+        lock.unlock_shared();
+        std::this_thread::yield();
+      } else {
+        turned_away = true;
+      }
+    }
+  });
+  reader.join();
+  REQUIRE(turned_away);
+  REQUIRE_FALSE(locked);
+  lock.unlock_shared();
+  writer.join();
+  REQUIRE(locked);
+}
+
+TEST_CASE("readers never see a half written value", "[concurrent]") {
+  for (auto prefer : {ipc::rw_prefer::writer, ipc::rw_prefer::reader}) {
+    constexpr int nreaders = 3;
+    constexpr uint64_t nwrites = 2000;
+    constexpr uint64_t nreads = 2000;
+    std::error_code ec;
+    ipc::shm_rwlock lock(ipc::create_only, "test", ec, 8, prefer);
+    REQUIRE_FALSE(ec);
+    ipc::shm_object<pair_t> pair(ipc::create_only, "test_pair", ec);
+    REQUIRE_FALSE(ec);
+
+    pid_t pids[nreaders];
+    for (auto &pid : pids) {
+      pid = fork();
+      REQUIRE(pid != -1);
+      if (pid == 0) {
+        int bad = 0;
+        {
+          ipc::shm_rwlock l(ipc::open_only, "test");
+          ipc::shm_object<pair_t> p(ipc::open_only, "test_pair");
+          // a fixed number of reads, readers may starve the writer
+          for (uint64_t i = 0; i < nreads; i++) {
+            l.lock_shared();
+            uint64_t a = p->a.load(std::memory_order_relaxed);
+            std::this_thread::yield();
+            uint64_t b = p->b.load(std::memory_order_relaxed);
+            l.unlock_shared();
+            bad += a != b;
+          }
+        }
+        _exit(bad ? 1 : 0);
+      }
+    }
+
+    for (uint64_t i = 1; i <= nwrites; i++) {
+      lock.lock();
+      pair->a.store(i, std::memory_order_relaxed);
+      pair->b.store(i, std::memory_order_relaxed);
+      lock.unlock();
+    }
+    for (pid_t pid : pids) {
+      int status;
+      waitpid(pid, &status, 0);
+      REQUIRE(WIFEXITED(status));
+      REQUIRE(WEXITSTATUS(status) == 0);
+    }
+  }
+}
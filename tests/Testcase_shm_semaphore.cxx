@@ -0,0 +1,120 @@
+#include "shm_semaphore.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+TEST_CASE("post and wait", "[semaphore]") {
+  std::error_code ec;
+  ipc::shm_semaphore sem(ipc::create_only, "test", 1, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shm_semaphore other(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(other.value() == 1);
+  REQUIRE(other.try_wait());
+  REQUIRE_FALSE(sem.try_wait());
+  REQUIRE_FALSE(sem.wait(std::chrono::milliseconds(10)));
+  other.post();
+  other.post();
+  REQUIRE(sem.wait());
+  REQUIRE(sem.wait(std::chrono::milliseconds(10)));
+  REQUIRE(sem.value() == 0);
+}
+
+TEST_CASE("futex_wait_any reports the word that changed", "[futex]") {
+  std::atomic<uint32_t> words[3] = {0, 0, 0};
+  ipc::futex_waiter waiters[3] = {
+      {&words[0], 0}, {&words[1], 0}, {&words[2], 0}};
+  REQUIRE(ipc::futex_wait_any(waiters, 3, std::chrono::milliseconds(10)) ==
+          -1);
+  words[2] = 1;
+  REQUIRE(ipc::futex_wait_any(waiters, 3, std::chrono::milliseconds(10)) == 2);
+  words[2] = 0;
+
+  std::thread waker([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    words[1] = 1;
+    ipc::futex_wake(words[1]);
+  });
+  int woken;
+  while ((woken = ipc::futex_wait_any(waiters, 3)) < 0 ||
+         words[woken] == 0) {
+  }
+  REQUIRE(woken == 1);
+  waker.join();
+  REQUIRE(ipc::futex_wait_any(waiters, 0) == -1);
+}
+
+TEST_CASE("wait on several semaphores", "[wait_any]") {
+  std::error_code ec;
+  ipc::shm_semaphore a(ipc::create_only, "test.a", 0, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shm_semaphore b(ipc::create_only, "test.b", 0, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shm_semaphore c(ipc::create_only, "test.c", 0, ec);
+  REQUIRE_FALSE(ec);
+
+  REQUIRE(ipc::wait_any({&a, &b, &c}, std::chrono::milliseconds(10)) == -1);
+  c.post();
+  b.post();
+  // the first ready one is taken
+  REQUIRE(ipc::wait_any({&a, &b, &c}) == 1);
+  REQUIRE(ipc::wait_any({&a, &b, &c}) == 2);
+  REQUIRE(ipc::wait_any({&a, &b, &c}, std::chrono::nanoseconds(0)) == -1);
+
+  ipc::shm_semaphore empty;
+  ipc::shm_semaphore *sems[] = {&a, &empty};
+  REQUIRE(ipc::wait_any(sems, 2, ipc::FOREVER, ec) == -1);
+  REQUIRE(ec == std::errc::invalid_argument);
+  REQUIRE_THROWS(ipc::wait_any({&a, &empty}));
+  // an invalid semaphore ignores the calls
+  empty.post();
+  REQUIRE_FALSE(empty.try_wait());
+  REQUIRE(empty.value() == 0);
+  ipc::shm_semaphore moved(std::move(a));
+  a.post();
+  REQUIRE_FALSE(a.try_wait());
+}
+
+TEST_CASE("a process sleeps on semaphores posted by others", "[concurrent]") {
+  constexpr uint32_t nposts = 5000;
+  std::error_code ec;
+  ipc::shm_semaphore sems[3];
+  const char *names[] = {"test.a", "test.b", "test.c"};
+  for (int i = 0; i < 3; i++) {
+    sems[i] = ipc::shm_semaphore(ipc::create_only, names[i], 0, ec);
+    REQUIRE_FALSE(ec);
+  }
+
+  pid_t pids[3];
+  for (int i = 0; i < 3; i++) {
+    pids[i] = fork();
+    REQUIRE(pid_t(pids[i]) != -1);
+    if (pids[i] == 0) {
+      {
+        ipc::shm_semaphore sem(ipc::open_only, names[i]);
+        for (uint32_t k = 0; k < nposts; k++) {
+          sem.post();
+          if (k % 100 == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+          }
+        }
+      }
+      _exit(0);
+    }
+  }
+  uint32_t taken[3] = {};
+  ipc::shm_semaphore *ptrs[] = {&sems[0], &sems[1], &sems[2]};
+  for (uint32_t k = 0; k < 3 * nposts; k++) {
+    int i = ipc::wait_any(ptrs, 3, std::chrono::seconds(10));
+    REQUIRE(i >= 0);
+    taken[i]++;
+  }
+  for (int i = 0; i < 3; i++) {
+    REQUIRE(taken[i] == nposts);
+    REQUIRE(sems[i].value() == 0);
+    int status;
+    waitpid(pids[i], &status, 0);
+    REQUIRE(WIFEXITED(status));
+  }
+}
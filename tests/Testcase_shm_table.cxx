@@ -0,0 +1,188 @@
+#include "column_scan.hpp"
+#include "shm_table.hpp"
+#include <algorithm>
+#include <catch2/catch.hpp>
+#include <limits>
+#include <random>
+#include <sys/wait.h>
+#include <unistd.h>
+
+TEST_CASE("columns are typed arrays in the segment", "[table]") {
+  std::error_code ec;
+  ipc::shm_table writer(ipc::create_only, "test",
+                        {{"id", ipc::column_type::INT64},
+                         {"price", ipc::column_type::FLOAT64},
+                         {"qty", ipc::column_type::INT32}},
+                        100, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shm_table reader(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(reader.ncolumns() == 3);
+  REQUIRE(reader.capacity() == 100);
+  REQUIRE(reader.find("price") == 1);
+  REQUIRE(reader.find("volume") == ipc::shm_table::npos);
+  REQUIRE(reader.column_name(2) == "qty");
+  REQUIRE(reader.type(2) == ipc::column_type::INT32);
+  REQUIRE(reader.type(3) == ipc::column_type::NONE);
+  REQUIRE(ipc::shm_table().type(0) == ipc::column_type::NONE);
+  REQUIRE(reader.column<double>(0) == nullptr);
+  REQUIRE(reader.column<int64_t>(3) == nullptr);
+  REQUIRE(reinterpret_cast<uintptr_t>(reader.column<double>(1)) % 32 == 0);
+
+  int64_t *id = writer.column<int64_t>(0);
+  double *price = writer.column<double>(1);
+  for (int64_t i = 0; i < 10; i++) {
+    id[i] = i;
+    price[i] = 1.5 * double(i);
+  }
+  REQUIRE(reader.rows() == 0);
+  writer.commit(10);
+  REQUIRE(reader.rows() == 10);
+  REQUIRE(reader.column<int64_t>(0)[9] == 9);
+  REQUIRE(reader.column<double>(1)[4] == 6.0);
+  writer.commit(90);
+  writer.commit(1, ec);
+  REQUIRE(ec == IPCErrc::TableFull);
+  REQUIRE(reader.rows() == 100);
+
+  ipc::shm_table dup(ipc::create_only, "dup",
+                     {{"a", ipc::column_type::INT32},
+                      {"a", ipc::column_type::INT32}},
+                     10, ec);
+  REQUIRE(ec == std::errc::invalid_argument);
+}
+
+namespace {
+template <typename T> bool compare(T value, ipc::cmp_op op, T operand) {
+  switch (op) {
+  case ipc::cmp_op::EQ:
+    return value == operand;
+  case ipc::cmp_op::NE:
+    return value != operand;
+  case ipc::cmp_op::LT:
+    return value < operand;
+  case ipc::cmp_op::LE:
+    return value <= operand;
+  case ipc::cmp_op::GT:
+    return value > operand;
+  case ipc::cmp_op::GE:
+    return value >= operand;
+  }
+  return false;
+}
+
+// integral values, so that float sums are exact in any order
+template <typename T> void check_kernels(size_t n) {
+  std::mt19937 rng(n);
+  std::uniform_int_distribution<int> dist(-50, 50);
+  std::vector<T> col(n);
+  for (T &v : col) {
+    v = T(dist(rng));
+  }
+  std::vector<uint64_t> sel(ipc::selection_words(n), ~uint64_t(0));
+  std::vector<uint64_t> other(ipc::selection_words(n));
+  for (ipc::cmp_op op : {ipc::cmp_op::EQ, ipc::cmp_op::NE, ipc::cmp_op::LT,
+                         ipc::cmp_op::LE, ipc::cmp_op::GT, ipc::cmp_op::GE}) {
+    size_t selected = ipc::column_filter(col.data(), n, op, T(7), sel.data());
+    size_t expected = 0;
+    for (size_t i = 0; i < n; i++) {
+      bool bit = (sel[i / 64] >> (i % 64)) & 1;
+      REQUIRE(bit == compare(col[i], op, T(7)));
+      expected += bit;
+    }
+    REQUIRE(selected == expected);
+    REQUIRE(ipc::selection_count(sel.data(), n) == expected);
+    if (n % 64) {
+      REQUIRE(sel.back() >> (n % 64) == 0);
+    }
+  }
+
+  ipc::column_filter(col.data(), n, ipc::cmp_op::GT, T(-20), sel.data());
+  ipc::column_filter(col.data(), n, ipc::cmp_op::LT, T(20), other.data());
+  ipc::selection_and(sel.data(), other.data(), n);
+  // every other block fully selected, to take both paths of the kernels
+  for (size_t w = 0; w < sel.size(); w += 2) {
+    sel[w] = ~uint64_t(0);
+  }
+  if (n % 64) {
+    sel.back() &= (uint64_t(1) << (n % 64)) - 1;
+  }
+  ipc::column_sum_t<T> all = 0, some = 0;
+  T lo = std::numeric_limits<T>::max(), hi = std::numeric_limits<T>::lowest();
+  for (size_t i = 0; i < n; i++) {
+    all += col[i];
+    if ((sel[i / 64] >> (i % 64)) & 1) {
+      some += col[i];
+      lo = std::min(lo, col[i]);
+      hi = std::max(hi, col[i]);
+    }
+  }
+  REQUIRE(ipc::column_sum(col.data(), n) == all);
+  REQUIRE(ipc::column_sum(col.data(), n, sel.data()) == some);
+  REQUIRE(ipc::column_min(col.data(), n, sel.data()) == lo);
+  REQUIRE(ipc::column_max(col.data(), n, sel.data()) == hi);
+  REQUIRE(ipc::column_min(col.data(), n) ==
+          *std::min_element(col.begin(), col.end()));
+  REQUIRE(ipc::column_max(col.data(), n) ==
+          *std::max_element(col.begin(), col.end()));
+
+  std::fill(sel.begin(), sel.end(), 0);
+  REQUIRE(ipc::column_min(col.data(), n, sel.data()) ==
+          std::numeric_limits<T>::max());
+  REQUIRE(ipc::column_sum(col.data(), n, sel.data()) == 0);
+}
+} // namespace
+
+TEST_CASE("scan kernels match plain loops", "[scan]") {
+  for (size_t n : {1, 63, 64, 1000, 4096 + 37}) {
+    check_kernels<int32_t>(n);
+    check_kernels<int64_t>(n);
+    check_kernels<float>(n);
+    check_kernels<double>(n);
+  }
+}
+
+TEST_CASE("readers scan while the writer appends", "[concurrent]") {
+  constexpr size_t capacity = 1 << 16;
+  constexpr size_t batch = 1000;
+  std::error_code ec;
+  ipc::shm_table writer(ipc::create_only, "test",
+                        {{"id", ipc::column_type::INT64},
+                         {"half", ipc::column_type::FLOAT32}},
+                        capacity, ec);
+  REQUIRE_FALSE(ec);
+
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    bool ok = true;
+    {
+      ipc::shm_table reader(ipc::open_only, "test");
+      const int64_t *id = reader.column<int64_t>(0);
+      const float *half = reader.column<float>(1);
+      size_t rows = 0;
+      while (ok && rows < capacity) {
+        // whatever count is seen, the rows below it are complete
+        rows = reader.rows();
+        int64_t n = int64_t(rows);
+        ok = ipc::column_sum(id, rows) == n * (n - 1) / 2 &&
+             ipc::column_sum(half, rows) * 2 == double(n * (n - 1) / 2);
+      }
+    }
+    _exit(ok ? 0 : 1);
+  }
+  int64_t *id = writer.column<int64_t>(0);
+  float *half = writer.column<float>(1);
+  for (size_t row = 0; row < capacity; row += batch) {
+    size_t n = std::min(batch, capacity - row);
+    for (size_t i = row; i < row + n; i++) {
+      id[i] = int64_t(i);
+      half[i] = float(i) / 2;
+    }
+    writer.commit(n);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+}
@@ -1,8 +1,15 @@
 #include "shmhdl.hpp"
+#include "ec.hpp"
 #include <array>
+#include <cstring>
+#include <cstdio>
 #include <catch2/catch.hpp>
 #include <memory>
 #include <random>
+#include <csignal>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 TEST_CASE("create shmhdl with given name and nbytes", "[create]") {
   std::error_code ec;
@@ -255,4 +262,404 @@ TEST_CASE("unlink will privent other shmhdl to attach to it", "[unlink]") {
   REQUIRE(ec);
   REQUIRE(clt1.ref_count() == 2);
   REQUIRE(svr.ref_count() == 2);
-}
\ No newline at end of file
+}
+TEST_CASE("create shmhdl with too long name", "[create]") {
+  std::error_code ec;
+  std::string name(ipc::MAX_NAME_LEN + 1, 'x');
+  ipc::shmhdl hdl(name, 4096, ec);
+  REQUIRE(ec);
+  REQUIRE_FALSE(hdl.valid());
+  REQUIRE(hdl.name().empty());
+}
+
+TEST_CASE("move construct/assign shmhdl", "[move]") {
+  std::error_code ec;
+  ipc::shmhdl svr("test", 4096, ec);
+  REQUIRE_FALSE(ec);
+  void *__addr = svr.map(ec);
+  REQUIRE_FALSE(ec);
+
+  ipc::shmhdl moved(std::move(svr));
+  REQUIRE_FALSE(svr.valid());
+  REQUIRE(svr.addr() == nullptr);
+  REQUIRE(svr.name().empty());
+  REQUIRE(svr.nbytes() == 0);
+  REQUIRE(svr.ref_count() == 0);
+  REQUIRE(moved.valid());
+  REQUIRE(moved.addr() == __addr);
+  REQUIRE(moved.name().compare("test") == 0);
+  REQUIRE(moved.nbytes() == 4096);
+  REQUIRE(moved.ref_count() == 1);
+
+  ipc::shmhdl clt("test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(moved.ref_count() == 2);
+
+  // assigning releases the handle's own attachment first
+  clt = std::move(moved);
+  REQUIRE_FALSE(moved.valid());
+  REQUIRE(clt.ref_count() == 1);
+  REQUIRE(clt.addr() == __addr);
+
+  // a moved-from handle can be reused
+  svr = ipc::shmhdl("test2", 1024, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(svr.valid());
+  REQUIRE(svr.nbytes() == 1024);
+}
+
+TEST_CASE("store shmhdl by value in a vector", "[move]") {
+  std::error_code ec;
+  ipc::shmhdl svr("test", 4096, ec);
+  REQUIRE_FALSE(ec);
+
+  std::vector<ipc::shmhdl> clts;
+  for (int i = 0; i < 20; i++) {
+    // no reserve, so the vector relocates the handles while growing
+    clts.emplace_back("test", ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(svr.ref_count() == size_t(i + 2));
+  }
+  for (auto &e : clts) {
+    REQUIRE(e.name().compare("test") == 0);
+    REQUIRE(e.ref_count() == 21);
+  }
+  clts.erase(clts.begin());
+  REQUIRE(svr.ref_count() == 20);
+  clts.clear();
+  REQUIRE(svr.ref_count() == 1);
+}
+
+TEST_CASE("persistent shmhdl keeps its content", "[persistent]") {
+  std::error_code ec;
+  const char *path = "/tmp/ipc_Testcase_shmhdl.seg";
+  ::remove(path);
+  {
+    ipc::shmhdl hdl(ipc::persistent, path, 4096, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(hdl.persistent());
+    REQUIRE(hdl.nbytes() == 4096);
+    REQUIRE(hdl.ref_count() == 1);
+
+    ipc::shmhdl other(ipc::persistent, path, 4096, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(hdl.ref_count() == 2);
+
+    auto __ptr = static_cast<uint64_t *>(hdl.map(ec));
+    REQUIRE_FALSE(ec);
+    for (uint64_t i = 0; i < 512; i++) {
+      __ptr[i] = i * i;
+    }
+    hdl.sync(ec);
+    REQUIRE_FALSE(ec);
+    hdl.sync(8, 16, ec);
+    REQUIRE_FALSE(ec);
+    hdl.sync(4090, 16, ec);
+    REQUIRE(ec);
+  }
+  // the segment survives its last handle and can grow when reopened
+  ipc::shmhdl hdl(ipc::persistent, path, 8192, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(hdl.ref_count() == 1);
+  REQUIRE(hdl.nbytes() == 8192);
+  auto __ptr = static_cast<uint64_t *>(hdl.map(ec));
+  REQUIRE_FALSE(ec);
+  for (uint64_t i = 0; i < 512; i++) {
+    REQUIRE(__ptr[i] == i * i);
+  }
+  REQUIRE(__ptr[1000] == 0);
+
+  hdl.unlink(ec);
+  REQUIRE_FALSE(ec);
+  ipc::shmhdl again(ipc::persistent, path, 4096, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(static_cast<uint64_t *>(again.map())[1] == 0);
+  again.unlink();
+}
+
+TEST_CASE("persistent shmhdl drops references of crashed processes",
+          "[persistent]") {
+  std::error_code ec;
+  const char *path = "/tmp/ipc_Testcase_shmhdl.seg";
+  ::remove(path);
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    // leave without releasing the handle
+    new ipc::shmhdl(ipc::persistent, path, 4096);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+
+  ipc::shmhdl hdl(ipc::persistent, path, 4096, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(hdl.ref_count() == 1);
+  hdl.unlink();
+}
+
+TEST_CASE("persistent shmhdl refuses foreign files", "[persistent]") {
+  std::error_code ec;
+  const char *path = "/tmp/ipc_Testcase_shmhdl.txt";
+  FILE *f = fopen(path, "w");
+  REQUIRE(f);
+  fputs("this is not a segment, it must not be overwritten\n", f);
+  fclose(f);
+
+  ipc::shmhdl hdl(ipc::persistent, path, 4096, ec);
+  REQUIRE(ec == IPCErrc::ShmLayoutMismatch);
+  REQUIRE_FALSE(hdl.valid());
+  ::remove(path);
+}
+
+TEST_CASE("map ranges of a shmhdl", "[map_range]") {
+  std::error_code ec;
+  const shmsz_t nbytes = 64 * 1024 * 1024;
+  ipc::shmhdl hdl("test", nbytes, ec);
+  REQUIRE_FALSE(ec);
+  auto buf = static_cast<char *>(hdl.map());
+  for (shmsz_t i = 0; i < nbytes; i += 4096) {
+    buf[i] = char(i / 4096);
+  }
+
+  // unaligned window in the middle of the segment
+  ipc::shmview view = hdl.map_range(5 * 4096 + 7, 3 * 4096, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(view.offset() == 5 * 4096 + 7);
+  REQUIRE(view.nbytes() == 3 * 4096);
+  REQUIRE(view.use_count() == 1);
+  auto data = static_cast<char *>(view.data());
+  REQUIRE(data[4096 - 7] == 6);
+  data[0] = 'x';
+  REQUIRE(buf[5 * 4096 + 7] == 'x');
+
+  // the last page of the segment
+  ipc::shmview tail = hdl.map_range(nbytes - 4096, 4096);
+  REQUIRE(static_cast<char *>(tail.data())[0] == char((nbytes - 4096) / 4096));
+
+  // copies share the mapping, which outlives the handle
+  ipc::shmview copy = view;
+  REQUIRE(view.use_count() == 2);
+  view.reset();
+  REQUIRE_FALSE(view.valid());
+  REQUIRE(copy.use_count() == 1);
+  hdl = ipc::shmhdl();
+  REQUIRE(static_cast<char *>(copy.data())[0] == 'x');
+}
+
+TEST_CASE("map invalid ranges of a shmhdl", "[map_range]") {
+  std::error_code ec;
+  ipc::shmhdl hdl("test", 8192, ec);
+  REQUIRE_FALSE(ec);
+  hdl.map_range(4096, 8192, ec);
+  REQUIRE(ec);
+  hdl.map_range(0, 0, ec);
+  REQUIRE(ec);
+  REQUIRE_THROWS(hdl.map_range(-1, 10));
+  ipc::shmhdl empty;
+  REQUIRE_FALSE(empty.map_range(0, 10, ec).valid());
+  REQUIRE(ec);
+}
+
+TEST_CASE("advise access patterns of shmhdl ranges", "[advise]") {
+  std::error_code ec;
+  const shmsz_t nbytes = 16 * 4096;
+  ipc::shmhdl hdl("test", nbytes, ec);
+  REQUIRE_FALSE(ec);
+  hdl.advise(0, nbytes, ipc::SHM_ADVICE::WILLNEED, ec);
+  REQUIRE(ec == IPCErrc::ShmNotMapped);
+
+  auto buf = static_cast<char *>(hdl.map());
+  std::memset(buf, 'x', nbytes);
+  for (auto advice : {ipc::SHM_ADVICE::WILLNEED, ipc::SHM_ADVICE::SEQUENTIAL,
+                      ipc::SHM_ADVICE::RANDOM, ipc::SHM_ADVICE::NORMAL,
+                      ipc::SHM_ADVICE::DONTNEED}) {
+    hdl.advise(100, 3 * 4096, advice, ec);
+    REQUIRE_FALSE(ec);
+  }
+  // dropping this process' pages keeps the content
+  REQUIRE(buf[100] == 'x');
+  REQUIRE(buf[5000] == 'x');
+
+  struct stat st;
+  REQUIRE(fstat(hdl.fd(), &st) == 0);
+  auto blocks = st.st_blocks;
+  // only the pages entirely inside the range are freed, the buffer starts on
+  // a page boundary
+  hdl.advise(4096 + 100, 8 * 4096, ipc::SHM_ADVICE::REMOVE, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(fstat(hdl.fd(), &st) == 0);
+  REQUIRE(st.st_blocks < blocks);
+  REQUIRE(buf[4096 + 100] == 'x');
+  REQUIRE(buf[2 * 4096] == 0);
+  REQUIRE(buf[8 * 4096] == 0);
+  REQUIRE(buf[9 * 4096 - 1] == 0);
+  REQUIRE(buf[9 * 4096] == 'x');
+
+  hdl.advise(0, nbytes + 1, ipc::SHM_ADVICE::NORMAL, ec);
+  REQUIRE(ec);
+
+  ipc::shmview view = hdl.map_range(10 * 4096, 4096);
+  view.advise(ipc::SHM_ADVICE::WILLNEED, ec);
+  REQUIRE_FALSE(ec);
+}
+
+TEST_CASE("read ahead a persistent shmhdl", "[advise]") {
+  std::error_code ec;
+  const char *path = "/tmp/ipc_Testcase_shmhdl.seg";
+  ::remove(path);
+  ipc::shmhdl hdl(ipc::persistent, path, 1024 * 1024, ec);
+  REQUIRE_FALSE(ec);
+  hdl.readahead(0, 1024 * 1024, ec);
+  REQUIRE_FALSE(ec);
+  hdl.readahead(1024 * 1024, 1, ec);
+  REQUIRE(ec);
+  hdl.unlink();
+}
+
+TEST_CASE("read only shmhdl faults on write", "[access]") {
+  std::error_code ec;
+  ipc::shmhdl writer("test", 4096, ec);
+  REQUIRE_FALSE(ec);
+  static_cast<char *>(writer.map())[0] = 'w';
+
+  ipc::shmhdl reader("test", ipc::SHM_ACCESS::READ_ONLY, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(reader.access() == ipc::SHM_ACCESS::READ_ONLY);
+  REQUIRE(writer.ref_count() == 2);
+  auto ro = static_cast<volatile char *>(reader.map());
+  REQUIRE(ro[0] == 'w');
+  static_cast<char *>(writer.addr())[1] = 'x';
+  REQUIRE(ro[1] == 'x');
+
+  ipc::shmview view = reader.map_range(0, 16);
+  REQUIRE(static_cast<char *>(view.data())[1] == 'x');
+
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    ro[2] = 'r';
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFSIGNALED(status));
+  REQUIRE(WTERMSIG(status) == SIGSEGV);
+}
+
+TEST_CASE("copy on write shmhdl keeps its writes private", "[access]") {
+  std::error_code ec;
+  ipc::shmhdl owner("test", 2 * 4096, ec);
+  REQUIRE_FALSE(ec);
+  auto shared = static_cast<char *>(owner.map());
+  std::memset(shared, 's', 2 * 4096);
+
+  ipc::shmhdl scratch("test", ipc::SHM_ACCESS::COPY_ON_WRITE, ec);
+  REQUIRE_FALSE(ec);
+  auto priv = static_cast<char *>(scratch.map());
+  REQUIRE(priv[4096] == 's');
+  priv[0] = 'p';
+  REQUIRE(priv[0] == 'p');
+  REQUIRE(shared[0] == 's');
+
+  ipc::shmhdl other("test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(static_cast<char *>(other.map())[0] == 's');
+
+  // moving keeps the access mode
+  ipc::shmhdl moved(std::move(scratch));
+  REQUIRE(moved.access() == ipc::SHM_ACCESS::COPY_ON_WRITE);
+  REQUIRE(static_cast<char *>(moved.addr())[0] == 'p');
+}
+
+TEST_CASE("handles of crashed processes do not keep the object alive",
+          "[crash]") {
+  std::error_code ec;
+  {
+    ipc::shmhdl svr("test", 4096, ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(reinterpret_cast<uintptr_t>(svr.map()) % 4096 == 0);
+    pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      // leave without releasing the handles
+      for (int i = 0; i < 3; i++) {
+        new ipc::shmhdl("test");
+      }
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    // counted until somebody checks the processes
+    REQUIRE(svr.ref_count() == 4);
+    REQUIRE(svr.reclaim() == 3);
+    REQUIRE(svr.reclaim() == 0);
+    REQUIRE(svr.ref_count() == 1);
+
+    // a handle inherited through fork() does not release the parent's slot
+    pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      svr.~shmhdl();
+      _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(svr.ref_count() == 1);
+    ipc::shmhdl clt("test", ec);
+    REQUIRE_FALSE(ec);
+    REQUIRE(svr.ref_count() == 2);
+  }
+  // the last live handle removed the object
+  ipc::shmhdl gone("test", ec);
+  REQUIRE(ec);
+}
+
+TEST_CASE("the last live handle reclaims the others", "[crash]") {
+  std::error_code ec;
+  {
+    ipc::shmhdl svr("test", 4096, ec);
+    REQUIRE_FALSE(ec);
+    pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      new ipc::shmhdl("test");
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(svr.ref_count() == 2);
+  }
+  ipc::shmhdl gone("test", ec);
+  REQUIRE(ec == std::errc::no_such_file_or_directory);
+}
+
+TEST_CASE("slots of crashed processes are taken over", "[crash]") {
+  std::error_code ec;
+  ipc::shmhdl svr("test", 4096, ec);
+  REQUIRE_FALSE(ec);
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    for (size_t i = 1; i < ipc::shmhdl::MAX_ATTACHERS; i++) {
+      new ipc::shmhdl("test");
+    }
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+
+  std::vector<ipc::shmhdl> clts;
+  for (size_t i = 1; i < ipc::shmhdl::MAX_ATTACHERS; i++) {
+    clts.emplace_back("test", ec);
+    REQUIRE_FALSE(ec);
+  }
+  REQUIRE(svr.ref_count() == ipc::shmhdl::MAX_ATTACHERS);
+  ipc::shmhdl extra("test", ec);
+  REQUIRE(ec == IPCErrc::ShmNoFreeSlot);
+  REQUIRE_FALSE(extra.valid());
+}
@@ -0,0 +1,160 @@
+#include "shm_object.hpp"
+#include "task_pool.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+constexpr uint32_t ntasks = 3000;
+// every tenth task spawns one more
+constexpr uint32_t nspawned = ntasks / 10;
+
+struct ran_t {
+  std::atomic<uint32_t> total;
+  std::atomic<uint32_t> count[ntasks + nspawned];
+};
+} // namespace
+
+TEST_CASE("owner takes its own tasks last in first out", "[local]") {
+  std::error_code ec;
+  ipc::task_pool pool(ipc::create_only, "test", 2, 5, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(pool.nworkers() == 2);
+  REQUIRE(pool.capacity() == 8);
+
+  uint64_t task;
+  REQUIRE_FALSE(pool.take(0, task));
+  for (uint64_t i = 0; i < 8; i++) {
+    pool.push(0, i, ec);
+    REQUIRE_FALSE(ec);
+  }
+  pool.push(0, 8, ec);
+  REQUIRE(ec == IPCErrc::TaskQueueFull);
+  ec.clear();
+
+  REQUIRE(pool.take(0, task));
+  REQUIRE(task == 7);
+  REQUIRE(pool.take(0, task));
+  REQUIRE(task == 6);
+  REQUIRE(pool.steals() == 0);
+}
+
+TEST_CASE("idle worker steals the oldest task", "[local]") {
+  std::error_code ec;
+  ipc::task_pool owner(ipc::create_only, "test", 2, 16, ec);
+  REQUIRE_FALSE(ec);
+  ipc::task_pool thief(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(thief.capacity() == 16);
+
+  owner.push(0, 1);
+  owner.push(0, 2);
+  owner.push(0, 3);
+  uint64_t task;
+  REQUIRE(thief.take(1, task));
+  REQUIRE(task == 1);
+  REQUIRE(owner.take(0, task));
+  REQUIRE(task == 3);
+  REQUIRE(thief.take(1, task));
+  REQUIRE(task == 2);
+  REQUIRE_FALSE(owner.take(0, task));
+  REQUIRE_FALSE(thief.take(1, task));
+  REQUIRE(owner.steals() == 2);
+}
+
+TEST_CASE("submitted tasks reach any worker in order", "[local]") {
+  std::error_code ec;
+  ipc::task_pool pool(ipc::create_only, "test", 2, 4, ec);
+  REQUIRE_FALSE(ec);
+  for (uint64_t i = 0; i < 4; i++) {
+    pool.submit(i);
+  }
+  pool.submit(4, ec);
+  REQUIRE(ec == IPCErrc::TaskQueueFull);
+
+  uint64_t task;
+  REQUIRE(pool.take(1, task));
+  REQUIRE(task == 0);
+  REQUIRE(pool.take(0, task));
+  REQUIRE(task == 1);
+  // a freed cell is reused on the next lap
+  pool.submit(5, ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(pool.take(1, task));
+  REQUIRE(task == 2);
+  REQUIRE(pool.take(1, task));
+  REQUIRE(task == 3);
+  REQUIRE(pool.take(1, task));
+  REQUIRE(task == 5);
+  REQUIRE(pool.steals() == 0);
+}
+
+TEST_CASE("wait times out and returns on shutdown", "[wait]") {
+  std::error_code ec;
+  ipc::task_pool pool(ipc::create_only, "test", 1, 4, ec);
+  REQUIRE_FALSE(ec);
+  uint64_t task;
+  REQUIRE_FALSE(pool.wait(0, task, std::chrono::milliseconds(20)));
+
+  pool.submit(9);
+  pool.shutdown();
+  // the queued task is still handed out
+  REQUIRE(pool.wait(0, task));
+  REQUIRE(task == 9);
+  REQUIRE_FALSE(pool.wait(0, task));
+}
+
+TEST_CASE("worker processes run every task exactly once", "[concurrent]") {
+  std::error_code ec;
+  ipc::task_pool pool(ipc::create_only, "test", 3, ntasks, ec);
+  REQUIRE_FALSE(ec);
+  ipc::shm_object<ran_t> ran(ipc::create_only, "test_ran", ec);
+  REQUIRE_FALSE(ec);
+
+  // everything starts on the parent's deque, the workers have to steal it
+  for (uint64_t i = 0; i < ntasks; i++) {
+    pool.push(0, i);
+  }
+
+  pid_t pids[2];
+  for (uint32_t w = 1; w <= 2; w++) {
+    pid_t pid = fork();
+    REQUIRE(pid != -1);
+    if (pid == 0) {
+      {
+        ipc::task_pool worker(ipc::open_only, "test");
+        ipc::shm_object<ran_t> results(ipc::open_only, "test_ran");
+        uint64_t task;
+        while (worker.wait(w, task)) {
+          results->count[task].fetch_add(1, std::memory_order_relaxed);
+          if (task < ntasks && task % 10 == 0) {
+            worker.push(w, ntasks + task / 10);
+          }
+          results->total.fetch_add(1, std::memory_order_release);
+        }
+      }
+      _exit(0);
+    }
+    pids[w - 1] = pid;
+  }
+
+  const uint32_t expected = ntasks + nspawned;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (ran->total.load(std::memory_order_acquire) < expected &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  pool.shutdown();
+  for (pid_t pid : pids) {
+    int status;
+    waitpid(pid, &status, 0);
+    REQUIRE(WIFEXITED(status));
+  }
+
+  REQUIRE(ran->total.load() == expected);
+  for (uint32_t i = 0; i < expected; i++) {
+    REQUIRE(ran->count[i].load() == 1);
+  }
+  REQUIRE(pool.steals() >= ntasks);
+}
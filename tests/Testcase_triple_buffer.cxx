@@ -0,0 +1,109 @@
+#include "triple_buffer.hpp"
+#include <catch2/catch.hpp>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+struct sample_t {
+  uint64_t seq;
+  double value;
+};
+
+// large enough that a torn read would be noticed
+struct frame_t {
+  uint64_t seq;
+  uint64_t pixels[8191];
+};
+} // namespace
+
+TEST_CASE("triple_buffer keeps the newest value", "[read]") {
+  std::error_code ec;
+  ipc::triple_buffer<sample_t> writer(ipc::create_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  ipc::triple_buffer<sample_t> reader(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+
+  sample_t s{};
+  REQUIRE_FALSE(reader.fresh());
+  REQUIRE_FALSE(reader.read(s));
+  REQUIRE(s.seq == 0);
+
+  writer.write({1, 1.5});
+  writer.write({2, 2.5});
+  writer.back() = {3, 3.5};
+  writer.publish();
+  REQUIRE(reader.fresh());
+  REQUIRE(reader.read(s));
+  REQUIRE(s.seq == 3);
+  REQUIRE(s.value == 3.5);
+
+  // nothing new, front stays valid
+  REQUIRE_FALSE(reader.update());
+  REQUIRE(reader.front().seq == 3);
+
+  writer.write({4, 4.5});
+  REQUIRE(reader.front().seq == 3);
+  REQUIRE(reader.update());
+  REQUIRE(reader.front().seq == 4);
+}
+
+TEST_CASE("restarted reader resumes its slot", "[read]") {
+  std::error_code ec;
+  ipc::triple_buffer<sample_t> writer(ipc::create_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  {
+    ipc::triple_buffer<sample_t> reader(ipc::open_only, "test", ec);
+    REQUIRE_FALSE(ec);
+    writer.write({1, 0.0});
+    REQUIRE(reader.update());
+  }
+  ipc::triple_buffer<sample_t> reader(ipc::open_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  REQUIRE(reader.front().seq == 1);
+  writer.write({2, 0.0});
+  writer.write({3, 0.0});
+  REQUIRE(reader.update());
+  REQUIRE(reader.front().seq == 3);
+}
+
+TEST_CASE("concurrent writer and reader never tear", "[concurrent]") {
+  std::error_code ec;
+  ipc::triple_buffer<frame_t> writer(ipc::create_only, "test", ec);
+  REQUIRE_FALSE(ec);
+  constexpr uint64_t nframes = 20000;
+
+  pid_t pid = fork();
+  REQUIRE(pid != -1);
+  if (pid == 0) {
+    int bad = 0;
+    {
+      ipc::triple_buffer<frame_t> reader(ipc::open_only, "test");
+      uint64_t last = 0;
+      while (last != nframes) {
+        if (!reader.update()) {
+          continue;
+        }
+        const frame_t &f = reader.front();
+        bad += f.seq < last;
+        for (uint64_t p : f.pixels) {
+          bad += p != f.seq;
+        }
+        last = f.seq;
+      }
+    }
+    _exit(bad ? 1 : 0);
+  }
+  for (uint64_t seq = 1; seq <= nframes; seq++) {
+    frame_t &f = writer.back();
+    f.seq = seq;
+    for (uint64_t &p : f.pixels) {
+      p = seq;
+    }
+    writer.publish();
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+}